@@ -3,17 +3,20 @@ import "dart:io";
 
 import "package:cryptography_plus/cryptography_plus.dart";
 import "package:desktop_updater/src/app_archive.dart";
+import "package:desktop_updater/src/binary_manifest.dart";
+import "package:desktop_updater/src/merkle.dart";
 
 import "helper/copy.dart";
 
 Future<String> getFileHash(File file) async {
   try {
-    // Dosya içeriğini okuyun
-    final List<int> fileBytes = await file.readAsBytes();
-
-    // blake2s algoritmasıyla hash hesaplayın
-
-    final hash = await Blake2b().hash(fileBytes);
+    // Dosyayı parça parça okuyarak hash hesaplayın
+    final sink = Blake2b().newHashSink();
+    await for (final chunk in file.openRead()) {
+      sink.add(chunk);
+    }
+    sink.close();
+    final hash = await sink.hash();
 
     // Hash'i utf-8 base64'e dönüştürün ve geri döndürün
     return base64.encode(hash.bytes);
@@ -23,7 +26,215 @@ Future<String> getFileHash(File file) async {
   }
 }
 
-Future<String?> genFileHashes({required String? path}) async {
+/// Hashes [files] with BLAKE3 using the `b3sum` tool, in the same order.
+/// Dart has no BLAKE3 implementation, so releases that opt in need `b3sum`
+/// (https://github.com/BLAKE3-team/BLAKE3) on the PATH.
+Future<List<String>> getBlake3Hashes(List<File> files) async {
+  final hashes = <String>[];
+  const batchSize = 256;
+  for (var i = 0; i < files.length; i += batchSize) {
+    final batch = files.skip(i).take(batchSize).map((f) => f.path).toList();
+    final result = await Process.run("b3sum", ["--no-names", ...batch]);
+    if (result.exitCode != 0) {
+      throw Exception("b3sum failed: ${result.stderr}");
+    }
+    final lines = (result.stdout as String)
+        .split("\n")
+        .where((line) => line.isNotEmpty)
+        .toList();
+    for (final hex in lines) {
+      final bytes = <int>[
+        for (var j = 0; j < hex.length; j += 2)
+          int.parse(hex.substring(j, j + 2), radix: 16),
+      ];
+      hashes.add(base64.encode(bytes));
+    }
+  }
+  return hashes;
+}
+
+/// Hashes every file below [dir] that [include] accepts, keyed by path
+/// relative to [dir]. Files in [known], hashed earlier with [algorithm] and
+/// not written since, are taken from it instead of being read again.
+Future<List<FileHashModel>> hashFiles(
+  Directory dir, {
+  required String algorithm,
+  required bool Function(String relativePath) include,
+  Map<String, FileHashModel> known = const {},
+}) async {
+  if (algorithm == treeHashAlgorithm) {
+    // Only the native hasher computes tree digests, see runManifestTool
+    throw ArgumentError.value(algorithm, "algorithm", "needs --manifest-tool");
+  }
+  // ignore: prefer_final_locals
+  var hashList = <FileHashModel>[];
+
+  // Dizin içindeki tüm dosyaları döngüyle okuyoruz
+  final files = <File>[];
+  await for (final entity in dir.list(recursive: true, followLinks: false)) {
+    if (entity is File &&
+        include(entity.path.substring(dir.path.length + 1))) {
+      files.add(entity);
+    }
+  }
+
+  String relative(File file) => file.path.substring(dir.path.length + 1);
+  final unknown = files.where((f) => !known.containsKey(relative(f))).toList();
+  final blake3Hashes = algorithm == blake3HashAlgorithm
+      ? Map.fromIterables(unknown, await getBlake3Hashes(unknown))
+      : null;
+
+  for (var i = 0; i < files.length; i++) {
+    final entity = files[i];
+    final foundPath = relative(entity);
+    final reused = known[foundPath];
+    if (reused != null) {
+      hashList.add(reused);
+      continue;
+    }
+
+    // Dosyanın hash'ini al
+    final hash = blake3Hashes?[entity] ?? await getFileHash(entity);
+
+    // Dosya yolunu ve hash değerini yaz
+    if (hash.isNotEmpty) {
+      final hashObj = FileHashModel(
+        filePath: foundPath,
+        calculatedHash: hash,
+        length: entity.lengthSync(),
+        algorithm: algorithm,
+      );
+      hashList.add(hashObj);
+    }
+  }
+  return hashList;
+}
+
+/// Whether [relativePath] is a delta index or a delta the
+/// desktop_updater_delta tool added to the release, see linux/delta_main.cc.
+bool isDelta(String relativePath) =>
+    relativePath == deltaIndexFileName ||
+    relativePath.startsWith("$deltaDirectoryName/");
+
+/// Runs the native manifest generator, the desktop_updater_manifest target
+/// of linux/CMakeLists.txt, on [bundle]. It walks and hashes the bundle in
+/// parallel and writes the same files as the Dart code below. [index] keeps
+/// digests between runs, so a second run only reads files changed since.
+Future<void> runManifestTool(
+  String tool,
+  Directory bundle, {
+  required String algorithm,
+  required String index,
+  List<String> args = const [],
+}) async {
+  final result = await Process.run(
+    tool,
+    [bundle.path, "--algorithm", algorithm, "--index", index, ...args],
+  );
+  if (result.exitCode != 0) {
+    throw Exception("$tool failed: ${result.stderr}");
+  }
+  stdout.write(result.stdout);
+}
+
+/// Files up to this size get a compressed copy. Larger ones compress about
+/// as well without a dictionary, and are fetched as parallel byte ranges,
+/// which compressed copies are not.
+const maxCompressedFileSize = 1 << 20;
+
+/// Trains a zstd dictionary on the bundle's small files, writes it as
+/// [zstdDictionaryFileName] and compresses each of those files with it into
+/// a copy next to it ending in [zstdFileSuffix], kept where it saves at
+/// least a tenth. Returns the size of each kept copy by path relative to
+/// [bundle]. Needs the `zstd` tool (https://github.com/facebook/zstd) on
+/// the PATH.
+Future<Map<String, int>> compressWithDictionary(Directory bundle) async {
+  final files = <File>[];
+  await for (final entity in bundle.list(recursive: true, followLinks: false)) {
+    if (entity is! File) continue;
+    final relativePath = entity.path.substring(bundle.path.length + 1);
+    if (relativePath.endsWith("hashes.json") ||
+        relativePath == merkleTreeFileName ||
+        isDelta(relativePath) ||
+        relativePath == zstdDictionaryFileName ||
+        relativePath.endsWith(zstdFileSuffix) ||
+        relativePath.endsWith(".DS_Store") ||
+        entity.lengthSync() > maxCompressedFileSize) {
+      continue;
+    }
+    files.add(entity);
+  }
+  if (files.isEmpty) return {};
+
+  final tempDir = await Directory.systemTemp.createTemp("desktop_updater");
+  final fileList = File("${tempDir.path}/files.txt");
+  await fileList.writeAsString(files.map((f) => f.path).join("\n"));
+  final dictionary = File("${bundle.path}/$zstdDictionaryFileName");
+  try {
+    final train = await Process.run("zstd", [
+      "--train",
+      "-q",
+      "-f",
+      "--maxdict=112640",
+      "-o",
+      dictionary.path,
+      "--filelist",
+      fileList.path,
+    ]);
+    if (train.exitCode != 0) {
+      // Too few or too uniform files to train on.
+      print("zstd dictionary training failed: ${train.stderr}");
+      return {};
+    }
+    final compress = await Process.run("zstd", [
+      "-19",
+      "-q",
+      "-f",
+      "-D",
+      dictionary.path,
+      "--filelist",
+      fileList.path,
+    ]);
+    if (compress.exitCode != 0) {
+      throw Exception("zstd failed: ${compress.stderr}");
+    }
+  } finally {
+    await tempDir.delete(recursive: true);
+  }
+
+  final compressedLengths = <String, int>{};
+  var before = 0;
+  var after = 0;
+  for (final file in files) {
+    final copy = File("${file.path}$zstdFileSuffix");
+    final length = file.lengthSync();
+    final compressedLength = copy.lengthSync();
+    before += length;
+    if (compressedLength * 10 > length * 9) {
+      await copy.delete();
+      after += length;
+      continue;
+    }
+    after += compressedLength;
+    compressedLengths[file.path.substring(bundle.path.length + 1)] =
+        compressedLength;
+  }
+  if (compressedLengths.isEmpty) {
+    await dictionary.delete();
+  }
+  print("Compressed ${compressedLengths.length} of ${files.length} files "
+      "with a shared dictionary: $before -> $after bytes");
+  return compressedLengths;
+}
+
+Future<String?> genFileHashes({
+  required String? path,
+  String algorithm = legacyHashAlgorithm,
+  Map<String, int> compressedLengths = const {},
+  String? manifestTool,
+  String? manifestIndex,
+  Map<String, FileHashModel> known = const {},
+}) async {
   print("Generating file hashes for $path");
 
   if (path == null) {
@@ -40,32 +251,53 @@ Future<String?> genFileHashes({required String? path}) async {
     // dir + output.txt dosyası oluşturulur
     final outputFile = File("${dir.path}${Platform.pathSeparator}hashes.json");
 
+    if (manifestTool != null && manifestIndex != null) {
+      // Copies not kept were deleted, so every copy left is a kept one
+      await runManifestTool(
+        manifestTool,
+        dir,
+        algorithm: algorithm,
+        index: manifestIndex,
+        args: [if (compressedLengths.isNotEmpty) "--zstd-copies"],
+      );
+      return outputFile.path;
+    }
+
     // Çıktı dosyasını açıyoruz
     final sink = outputFile.openWrite();
 
-    // ignore: prefer_final_locals
-    var hashList = <FileHashModel>[];
-
-    // Dizin içindeki tüm dosyaları döngüyle okuyoruz
-    await for (final entity in dir.list(recursive: true, followLinks: false)) {
-      if (entity is File &&
-          !entity.path.endsWith("hashes.json") &&
-          !entity.path.endsWith(".DS_Store")) {
-        // Dosyanın hash'ini al
-        final hash = await getFileHash(entity);
-        final foundPath = entity.path.substring(dir.path.length + 1);
-
-        // Dosya yolunu ve hash değerini yaz
-        if (hash.isNotEmpty) {
-          final hashObj = FileHashModel(
-            filePath: foundPath,
-            calculatedHash: hash,
-            length: entity.lengthSync(),
-          );
-          hashList.add(hashObj);
-        }
-      }
-    }
+    bool isCompressedCopy(String relativePath) =>
+        relativePath.endsWith(zstdFileSuffix) &&
+        compressedLengths.containsKey(relativePath.substring(
+            0, relativePath.length - zstdFileSuffix.length));
+
+    final hashList = [
+      for (final entry in await hashFiles(
+        dir,
+        algorithm: algorithm,
+        known: known,
+        include: (relativePath) =>
+            !relativePath.endsWith("hashes.json") &&
+            relativePath != merkleTreeFileName &&
+            !isDelta(relativePath) &&
+            !relativePath.endsWith(".DS_Store") &&
+            !isCompressedCopy(relativePath) &&
+            !(compressedLengths.isNotEmpty &&
+                relativePath == zstdDictionaryFileName),
+      ))
+        FileHashModel(
+          filePath: entry.filePath,
+          calculatedHash: entry.calculatedHash,
+          length: entry.length,
+          algorithm: entry.algorithm,
+          compressedLength: compressedLengths[entry.filePath],
+        ),
+    ];
+
+    // Dizin Merkle ağacı, istemciler değişmeyen alt ağaçları atlar
+    final tree = await MerkleTree.build(hashList, algorithm);
+    await File("${dir.path}${Platform.pathSeparator}$merkleTreeFileName")
+        .writeAsString(jsonEncode(tree));
 
     // Dosya hash'lerini json formatına çevir
     final jsonStr = jsonEncode(hashList);
@@ -81,6 +313,103 @@ Future<String?> genFileHashes({required String? path}) async {
   }
 }
 
+/// Returns the ELF executables at the top of a Linux bundle (the runner).
+Future<List<File>> findElfExecutables(Directory bundle) async {
+  final executables = <File>[];
+  await for (final entity in bundle.list(followLinks: false)) {
+    if (entity is! File) continue;
+    final handle = await entity.open();
+    final magic = await handle.read(4);
+    await handle.close();
+    if (magic.length == 4 &&
+        magic[0] == 0x7f &&
+        magic[1] == 0x45 &&
+        magic[2] == 0x4c &&
+        magic[3] == 0x46) {
+      executables.add(entity);
+    }
+  }
+  return executables;
+}
+
+/// Records the bundle's manifest at build time so installed clients know
+/// their file digests without hashing them. The manifest goes into an ELF
+/// section of the runner, or into a sidecar file when objcopy is not
+/// available. The file that carries it is left out of it, since embedding
+/// changes that file's digest. Returns the digests hashed here by relative
+/// path, for genFileHashes to reuse; empty when [manifestTool] hashed them.
+Future<Map<String, FileHashModel>> embedBuildManifest(
+  Directory bundle,
+  String algorithm, {
+  String? manifestTool,
+  String? manifestIndex,
+}) async {
+  final runners = await findElfExecutables(bundle);
+  final runner = runners.length == 1 ? runners.first : null;
+  final runnerName = runner?.path.substring(bundle.path.length + 1);
+
+  final List<int> encoded;
+  var hashed = <String, FileHashModel>{};
+  if (manifestTool != null && manifestIndex != null) {
+    final tempDir = await Directory.systemTemp.createTemp("desktop_updater");
+    final output = File("${tempDir.path}/manifest.bin");
+    await runManifestTool(
+      manifestTool,
+      bundle,
+      algorithm: algorithm,
+      index: manifestIndex,
+      args: [
+        "--binary",
+        output.path,
+        if (runnerName != null) ...["--exclude", runnerName],
+        "--exclude",
+        buildManifestSidecar,
+      ],
+    );
+    encoded = await output.readAsBytes();
+    await tempDir.delete(recursive: true);
+  } else {
+    final entries = await hashFiles(
+      bundle,
+      algorithm: algorithm,
+      include: (relativePath) =>
+          relativePath != runnerName &&
+          relativePath != buildManifestSidecar &&
+          relativePath != merkleTreeFileName &&
+          !isDelta(relativePath) &&
+          !relativePath.endsWith("hashes.json") &&
+          !relativePath.endsWith(".DS_Store"),
+    );
+    encoded = encodeBinaryManifest(entries, algorithm);
+    hashed = {for (final entry in entries) entry.filePath: entry};
+  }
+
+  if (runner != null) {
+    final tempDir = await Directory.systemTemp.createTemp("desktop_updater");
+    final payload = File("${tempDir.path}/manifest.bin");
+    await payload.writeAsBytes(encoded);
+    final result = await Process.run("objcopy", [
+      "--remove-section",
+      buildManifestSection,
+      "--add-section",
+      "$buildManifestSection=${payload.path}",
+      runner.path,
+    ]).catchError((Object e) => ProcessResult(0, 1, "", e.toString()));
+    await tempDir.delete(recursive: true);
+    if (result.exitCode == 0) {
+      print("Build manifest embedded in $runnerName");
+      return hashed;
+    }
+    print("objcopy failed, writing a sidecar instead: ${result.stderr}");
+  }
+
+  final sidecar = File("${bundle.path}/$buildManifestSidecar");
+  await sidecar.parent.create(recursive: true);
+  await sidecar.writeAsBytes(encoded);
+  print("Build manifest written to $buildManifestSidecar");
+  return hashed;
+}
+
 Future<void> main(List<String> args) async {
   if (args.isEmpty) {
     print("PLATFORM must be specified: macos, windows, linux");
@@ -94,6 +423,40 @@ Future<void> main(List<String> args) async {
     exit(1);
   }
 
+  // Opt-in manifest algorithm, e.g. --hash-algorithm=blake3, or
+  // --hash-algorithm=blake2b-tree together with --manifest-tool
+  var hashAlgorithm = legacyHashAlgorithm;
+  // Linux bundles carry their manifest with --build-manifest
+  var embedManifest = false;
+  // Linux releases publish zstd copies of small files with --zstd-dictionary
+  var compress = false;
+  // Linux releases can be hashed natively with --manifest-tool=PATH
+  String? manifestTool;
+  for (final arg in args.skip(1)) {
+    if (arg.startsWith("--hash-algorithm=")) {
+      hashAlgorithm = arg.substring("--hash-algorithm=".length);
+    } else if (arg == "--build-manifest") {
+      embedManifest = true;
+    } else if (arg == "--zstd-dictionary") {
+      compress = true;
+    } else if (arg.startsWith("--manifest-tool=")) {
+      manifestTool = arg.substring("--manifest-tool=".length);
+    }
+  }
+
+  if (hashAlgorithm != legacyHashAlgorithm &&
+      hashAlgorithm != treeHashAlgorithm &&
+      hashAlgorithm != blake3HashAlgorithm) {
+    print("Unsupported hash algorithm: $hashAlgorithm");
+    exit(1);
+  }
+  if (hashAlgorithm == treeHashAlgorithm &&
+      (platform != "linux" || manifestTool == null)) {
+    print("$treeHashAlgorithm is only computed by the native manifest tool: "
+        "archive linux --manifest-tool=PATH");
+    exit(1);
+  }
+
   // Go to dist directory and get all folder names
   final distDir = Directory("dist");
 
@@ -180,10 +543,39 @@ Future<void> main(List<String> args) async {
     );
   }
 
+  final bundlePath =
+      "${lastBuildNumberFolder.path}${Platform.pathSeparator}$foundVersion+$foundBuildNumber-$platform";
+
+  // Shared by both runs of the tool, so the second only rehashes the runner
+  final manifestDir = platform == "linux" && manifestTool != null
+      ? await Directory.systemTemp.createTemp("desktop_updater")
+      : null;
+  final manifestIndex =
+      manifestDir == null ? null : "${manifestDir.path}/hash_index.bin";
+
+  final known = platform == "linux" && embedManifest
+      ? await embedBuildManifest(
+          Directory(bundlePath),
+          hashAlgorithm,
+          manifestTool: manifestTool,
+          manifestIndex: manifestIndex,
+        )
+      : const <String, FileHashModel>{};
+
+  // Only the Linux client decompresses; others fetch the files as they are
+  final compressedLengths = platform == "linux" && compress
+      ? await compressWithDictionary(Directory(bundlePath))
+      : const <String, int>{};
+
   await genFileHashes(
-    path:
-        "${lastBuildNumberFolder.path}${Platform.pathSeparator}$foundVersion+$foundBuildNumber-$platform",
+    path: bundlePath,
+    algorithm: hashAlgorithm,
+    compressedLengths: compressedLengths,
+    manifestTool: manifestTool,
+    manifestIndex: manifestIndex,
+    known: known,
   );
+  await manifestDir?.delete(recursive: true);
 
   return;
 }
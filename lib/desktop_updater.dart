@@ -6,7 +6,10 @@ import "package:desktop_updater/src/update.dart";
 import "package:desktop_updater/src/version_check.dart";
 
 export "package:desktop_updater/src/app_archive.dart";
+export "package:desktop_updater/src/binary_manifest.dart" show BinaryManifest;
 export "package:desktop_updater/src/localization.dart";
+export "package:desktop_updater/src/memory_stats.dart";
+export "package:desktop_updater/src/restart_metrics.dart";
 export "package:desktop_updater/src/update.dart" show DownloadCompleteResult, UpdateStreamResult;
 export "package:desktop_updater/src/update_progress.dart";
 export "package:desktop_updater/widget/update_dialog.dart";
@@ -45,6 +48,54 @@ class DesktopUpdater {
     return genFileHashes(path: path);
   }
 
+  /// Caps the memory the native update pipeline may use for buffers
+  Future<void> setMemoryBudget(int bytes) {
+    return DesktopUpdaterPlatform.instance.setMemoryBudget(bytes);
+  }
+
+  /// Caps disk and network bandwidth of native update work (Linux only).
+  /// Null leaves a limit unchanged, 0 removes it
+  Future<void> setRateLimits({
+    int? diskBytesPerSecond,
+    int? diskOpsPerSecond,
+    int? networkBytesPerSecond,
+  }) {
+    return DesktopUpdaterPlatform.instance.setRateLimits(
+      diskBytesPerSecond: diskBytesPerSecond,
+      diskOpsPerSecond: diskOpsPerSecond,
+      networkBytesPerSecond: networkBytesPerSecond,
+    );
+  }
+
+  /// Watches the install directory for changes (Linux only), so later
+  /// update checks only re-check the files that changed
+  Future<void> setDirtyTracking({required bool enabled}) {
+    return DesktopUpdaterPlatform.instance.setDirtyTracking(enabled: enabled);
+  }
+
+  /// Runs native update work at idle CPU and I/O priority (Linux only), so
+  /// background update checks do not make the app stutter
+  Future<void> setBackgroundPriority({required bool enabled}) {
+    return DesktopUpdaterPlatform.instance
+        .setBackgroundPriority(enabled: enabled);
+  }
+
+  /// Temporarily runs native update work at normal priority (Linux only),
+  /// for updates the user is waiting on
+  Future<void> setForegroundBoost({required bool enabled}) {
+    return DesktopUpdaterPlatform.instance.setForegroundBoost(enabled: enabled);
+  }
+
+  /// Returns the timings of recent restarts (Linux only), oldest first
+  Future<List<RestartMetrics>?> getRestartMetrics() {
+    return DesktopUpdaterPlatform.instance.getRestartMetrics();
+  }
+
+  /// Returns current and peak memory use of the native update pipeline
+  Future<MemoryStats?> getMemoryStats() {
+    return DesktopUpdaterPlatform.instance.getMemoryStats();
+  }
+
   Future<UpdateStreamResult> updateApp({
     required String remoteUpdateFolder,
     required List<FileHashModel?> changedFiles,
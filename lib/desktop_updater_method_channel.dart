@@ -1,4 +1,6 @@
 import "package:desktop_updater/desktop_updater_platform_interface.dart";
+import "package:desktop_updater/src/memory_stats.dart";
+import "package:desktop_updater/src/restart_metrics.dart";
 import "package:flutter/foundation.dart";
 import "package:flutter/services.dart";
 
@@ -20,6 +22,11 @@ class MethodChannelDesktopUpdater extends DesktopUpdaterPlatform {
     await methodChannel.invokeMethod<void>("restartApp");
   }
 
+  @override
+  Future<bool?> applyUpdate() async {
+    return methodChannel.invokeMethod<bool>("applyUpdate");
+  }
+
   @override
   Future<String?> sayHello() async {
     return methodChannel.invokeMethod<String>("sayHello");
@@ -30,6 +37,145 @@ class MethodChannelDesktopUpdater extends DesktopUpdaterPlatform {
     return methodChannel.invokeMethod<String>("getExecutablePath");
   }
 
+  @override
+  Future<String?> hashDirectory({
+    required String directory,
+    required String outputPath,
+    required String algorithm,
+    String? treeOutputPath,
+  }) {
+    return methodChannel.invokeMethod<String>("generateFileHashes", {
+      "directory": directory,
+      "output": outputPath,
+      "algorithm": algorithm,
+      if (treeOutputPath != null) "treeOutput": treeOutputPath,
+    });
+  }
+
+  @override
+  Future<Uint8List?> diffManifest({
+    required String oldHashFilePath,
+    required String newHashFilePath,
+    Set<String>? onlyDirectories,
+    bool returnAllOnAnyChange = false,
+  }) {
+    return methodChannel.invokeMethod<Uint8List>("diffManifest", {
+      "old": oldHashFilePath,
+      "new": newHashFilePath,
+      if (onlyDirectories != null) "onlyDirectories": onlyDirectories.toList(),
+      "returnAllOnAnyChange": returnAllOnAnyChange,
+    });
+  }
+
+  @override
+  Future<void> setMemoryBudget(int bytes) {
+    return methodChannel.invokeMethod<void>("setMemoryBudget", {
+      "bytes": bytes,
+    });
+  }
+
+  @override
+  Future<void> setRateLimits({
+    int? diskBytesPerSecond,
+    int? diskOpsPerSecond,
+    int? networkBytesPerSecond,
+  }) {
+    return methodChannel.invokeMethod<void>("setRateLimits", {
+      if (diskBytesPerSecond != null) "diskBytesPerSecond": diskBytesPerSecond,
+      if (diskOpsPerSecond != null) "diskOpsPerSecond": diskOpsPerSecond,
+      if (networkBytesPerSecond != null)
+        "networkBytesPerSecond": networkBytesPerSecond,
+    });
+  }
+
+  @override
+  Future<void> setDirtyTracking({required bool enabled}) {
+    return methodChannel.invokeMethod<void>("setDirtyTracking", {
+      "enabled": enabled,
+    });
+  }
+
+  @override
+  Future<void> setBackgroundPriority({required bool enabled}) {
+    return methodChannel.invokeMethod<void>("setBackgroundPriority", {
+      "enabled": enabled,
+    });
+  }
+
+  @override
+  Future<void> setForegroundBoost({required bool enabled}) {
+    return methodChannel.invokeMethod<void>("setForegroundBoost", {
+      "enabled": enabled,
+    });
+  }
+
+  @override
+  Future<List<RestartMetrics>?> getRestartMetrics() async {
+    final restarts = await methodChannel
+        .invokeMethod<List<Object?>>("getRestartMetrics");
+    return restarts
+        ?.map((e) => RestartMetrics.fromMap(e! as Map<Object?, Object?>))
+        .toList();
+  }
+
+  @override
+  Future<MemoryStats?> getMemoryStats() async {
+    final stats = await methodChannel
+        .invokeMethod<Map<Object?, Object?>>("getMemoryStats");
+    return stats == null ? null : MemoryStats.fromMap(stats);
+  }
+
+  @override
+  Future<void> downloadFile({
+    required String url,
+    required String path,
+    required int length,
+    required String id,
+    String? dictionaryUrl,
+    String? hash,
+    String? algorithm,
+  }) async {
+    await methodChannel.invokeMethod<Map<Object?, Object?>>("downloadFile", {
+      "url": url,
+      "path": path,
+      "length": length,
+      "id": id,
+      if (dictionaryUrl != null) "dictionaryUrl": dictionaryUrl,
+      if (hash != null) "hash": hash,
+      if (algorithm != null) "algorithm": algorithm,
+    });
+  }
+
+  @override
+  Future<Map<String, int>?> getDownloadProgress() async {
+    return methodChannel.invokeMapMethod<String, int>("getDownloadProgress");
+  }
+
+  @override
+  Future<bool?> cancelDownload(String id) async {
+    return methodChannel.invokeMethod<bool>("cancelDownload", {"id": id});
+  }
+
+  @override
+  Future<Map<String, dynamic>?> cancelUpdate() async {
+    return methodChannel.invokeMapMethod<String, dynamic>("cancelUpdate");
+  }
+
+  @override
+  Future<List<int>?> planWork({
+    required List<int> sizes,
+    required int workers,
+    String kind = "download",
+  }) async {
+    final plan =
+        await methodChannel.invokeMapMethod<String, dynamic>("planWork", {
+      "sizes": Int64List.fromList(sizes),
+      "workers": workers,
+      "kind": kind,
+    });
+    return (plan?["order"] as List<Object?>?)?.cast<int>();
+  }
+
   @override
   Future<void> updateApp({required String remoteUpdateFolder}) async {
     return methodChannel.invokeMethod<void>("updateApp", [remoteUpdateFolder]);
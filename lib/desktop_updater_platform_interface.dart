@@ -1,5 +1,9 @@
+import "dart:typed_data";
+
 import "package:desktop_updater/desktop_updater_method_channel.dart";
 import "package:desktop_updater/src/app_archive.dart";
+import "package:desktop_updater/src/memory_stats.dart";
+import "package:desktop_updater/src/restart_metrics.dart";
 import "package:plugin_platform_interface/plugin_platform_interface.dart";
 
 abstract class DesktopUpdaterPlatform extends PlatformInterface {
@@ -31,6 +35,15 @@ abstract class DesktopUpdaterPlatform extends PlatformInterface {
     throw UnimplementedError("restartApp() has not been implemented.");
   }
 
+  /// Moves the staged update into place and checks it against its staged
+  /// manifest, off the UI thread, so that [restartApp] only has to
+  /// relaunch. Returns false if files are left for [restartApp] to copy once
+  /// the app has exited. Fails with code CANCELLED if [cancelUpdate] stops it,
+  /// after the replaced files are restored.
+  Future<bool?> applyUpdate() {
+    throw UnimplementedError("applyUpdate() has not been implemented.");
+  }
+
   Future<String?> sayHello() {
     throw UnimplementedError("sayHello() has not been implemented.");
   }
@@ -43,6 +56,132 @@ abstract class DesktopUpdaterPlatform extends PlatformInterface {
     throw UnimplementedError("generateFileHashes() has not been implemented.");
   }
 
+  /// Hashes [directory] with the native hasher and writes the manifest to
+  /// [outputPath], and its directory Merkle tree to [treeOutputPath] if
+  /// given. Returns the path of the written manifest.
+  Future<String?> hashDirectory({
+    required String directory,
+    required String outputPath,
+    required String algorithm,
+    String? treeOutputPath,
+  }) {
+    throw UnimplementedError("hashDirectory() has not been implemented.");
+  }
+
+  /// Compares two hashes.json files like verifyFileHashes and returns the
+  /// changed entries of [newHashFilePath] as one binary manifest buffer, to
+  /// be read with BinaryManifest.parse. Returns null where the native
+  /// comparison is not available.
+  Future<Uint8List?> diffManifest({
+    required String oldHashFilePath,
+    required String newHashFilePath,
+    Set<String>? onlyDirectories,
+    bool returnAllOnAnyChange = false,
+  }) {
+    throw UnimplementedError("diffManifest() has not been implemented.");
+  }
+
+  /// Caps the memory the native update pipeline may hold in in-flight
+  /// buffers. Stages wait for memory instead of exceeding it; 0 removes the
+  /// cap.
+  Future<void> setMemoryBudget(int bytes) {
+    throw UnimplementedError("setMemoryBudget() has not been implemented.");
+  }
+
+  /// Caps the disk and network bandwidth of the native update stages. Null
+  /// leaves a limit unchanged and 0 removes it. Applies to work already in
+  /// progress.
+  Future<void> setRateLimits({
+    int? diskBytesPerSecond,
+    int? diskOpsPerSecond,
+    int? networkBytesPerSecond,
+  }) {
+    throw UnimplementedError("setRateLimits() has not been implemented.");
+  }
+
+  /// Starts or stops watching the install directory for changes while the
+  /// app runs, so update checks only look at files that changed.
+  Future<void> setDirtyTracking({required bool enabled}) {
+    throw UnimplementedError("setDirtyTracking() has not been implemented.");
+  }
+
+  /// Runs native update work at idle CPU and I/O priority, off the CPUs
+  /// Flutter renders on, so checking and staging updates does not cause jank.
+  Future<void> setBackgroundPriority({required bool enabled}) {
+    throw UnimplementedError(
+      "setBackgroundPriority() has not been implemented.",
+    );
+  }
+
+  /// Lifts background priority while the user waits on an update they
+  /// started.
+  Future<void> setForegroundBoost({required bool enabled}) {
+    throw UnimplementedError("setForegroundBoost() has not been implemented.");
+  }
+
+  /// Timings of the most recent restarts, oldest first.
+  Future<List<RestartMetrics>?> getRestartMetrics() {
+    throw UnimplementedError("getRestartMetrics() has not been implemented.");
+  }
+
+  /// Current and peak memory use of the native update pipeline.
+  Future<MemoryStats?> getMemoryStats() {
+    throw UnimplementedError("getMemoryStats() has not been implemented.");
+  }
+
+  /// Downloads [url] to [path] natively, fetching large files as parallel
+  /// byte ranges. [length] is the size hashes.json lists. [id] names the
+  /// download for [getDownloadProgress] and [cancelDownload]. With
+  /// [dictionaryUrl], [url] is a zstd file compressed with that dictionary
+  /// and [path] receives it decompressed. With [hash] and [algorithm], the
+  /// entry hashes.json lists for the file, the download fails with code
+  /// HASH_MISMATCH if it does not match them.
+  Future<void> downloadFile({
+    required String url,
+    required String path,
+    required int length,
+    required String id,
+    String? dictionaryUrl,
+    String? hash,
+    String? algorithm,
+  }) {
+    throw UnimplementedError("downloadFile() has not been implemented.");
+  }
+
+  /// Bytes received so far by every download still running, by the id it
+  /// was started with. Finished downloads are not listed.
+  Future<Map<String, int>?> getDownloadProgress() {
+    throw UnimplementedError("getDownloadProgress() has not been implemented.");
+  }
+
+  /// Stops the download named [id]; it then fails with code CANCELLED.
+  Future<bool?> cancelDownload(String id) {
+    throw UnimplementedError("cancelDownload() has not been implemented.");
+  }
+
+  /// Cancels every native stage of the update in flight (hashing,
+  /// downloads and applying staged files) and, once they have stopped,
+  /// removes the staged files. The native calls fail with code CANCELLED.
+  /// Completes with "idle" and "elapsedMs": whether the stages stopped and
+  /// how long that took.
+  Future<Map<String, dynamic>?> cancelUpdate() {
+    throw UnimplementedError("cancelUpdate() has not been implemented.");
+  }
+
+  /// Orders the work items of an update stage, given by their byte
+  /// [sizes], for [workers] that each start the next item as they finish
+  /// one. [kind] ("download", "hash" or "apply") picks the cost model.
+  /// Huge items start early and share the link with many small ones, so the
+  /// stage does not end with one large item running alone. Completes with
+  /// the indexes into [sizes] in the order to start them.
+  Future<List<int>?> planWork({
+    required List<int> sizes,
+    required int workers,
+    String kind = "download",
+  }) {
+    throw UnimplementedError("planWork() has not been implemented.");
+  }
+
   Future<List<FileHashModel?>> verifyFileHash(
     String oldHashFilePath,
     String newHashFilePath,
@@ -115,11 +115,30 @@ class ChangeModel {
   }
 }
 
+/// Digest algorithm of manifests written before entries carried an
+/// "algorithm" field: sequential BLAKE2b-512.
+const legacyHashAlgorithm = "blake2b";
+
+/// BLAKE2b tree hash over fixed 1 MiB leaves. Leaves are hashed in parallel
+/// by the native hasher, which is only available on Linux.
+const treeHashAlgorithm = "blake2b-tree";
+
+/// BLAKE3-256, hashed natively with SIMD and across threads on Linux.
+const blake3HashAlgorithm = "blake3";
+
+/// Zstd dictionary a release's compressed files share, next to hashes.json.
+const zstdDictionaryFileName = "update.dict";
+
+/// Suffix of the compressed copy of a file that lists a compressedLength.
+const zstdFileSuffix = ".zst";
+
 class FileHashModel {
   FileHashModel({
     required this.filePath,
     required this.calculatedHash,
     required this.length,
+    this.algorithm = legacyHashAlgorithm,
+    this.compressedLength,
   });
 
   factory FileHashModel.fromJson(Map<String, dynamic> json) {
@@ -127,17 +146,77 @@ class FileHashModel {
       filePath: json["path"],
       calculatedHash: json["calculatedHash"],
       length: json["length"],
+      algorithm: json["algorithm"] ?? legacyHashAlgorithm,
+      compressedLength: json["compressedLength"],
     );
   }
   final String filePath;
   final String calculatedHash;
   final int length;
+  final String algorithm;
+
+  /// Size of the copy published as [filePath] + [zstdFileSuffix], compressed
+  /// with the release's [zstdDictionaryFileName]; null if there is none.
+  final int? compressedLength;
 
   Map<String, dynamic> toJson() {
     return {
       "path": filePath,
       "calculatedHash": calculatedHash,
       "length": length,
+      // Omitted for legacy entries so older clients see the same manifest.
+      if (algorithm != legacyHashAlgorithm) "algorithm": algorithm,
+      if (compressedLength != null) "compressedLength": compressedLength,
+    };
+  }
+}
+
+/// Manifest of the files an update downloaded, written next to its update
+/// folder. The Linux plugin checks the files it applies against it.
+const stagedManifestFileName = "update.hashes.json";
+
+/// Index of a release's deltas from earlier releases, next to hashes.json.
+/// Written by the desktop_updater_delta tool, see linux/delta_main.cc.
+const deltaIndexFileName = "deltas.json";
+
+/// Folder of a release the files listed in [deltaIndexFileName] are in.
+const deltaDirectoryName = "deltas";
+
+/// One entry of [deltaIndexFileName]: a delta that rebuilds the release's
+/// file at [filePath] from the file whose digest is [fromHash].
+class DeltaFileModel {
+  DeltaFileModel({
+    required this.filePath,
+    required this.fromHash,
+    required this.toHash,
+    required this.deltaPath,
+    required this.length,
+  });
+
+  factory DeltaFileModel.fromJson(Map<String, dynamic> json) {
+    return DeltaFileModel(
+      filePath: json["path"],
+      fromHash: json["fromHash"],
+      toHash: json["toHash"],
+      deltaPath: json["delta"],
+      length: json["length"],
+    );
+  }
+  final String filePath;
+  final String fromHash;
+  final String toHash;
+
+  /// Path of the delta file relative to the release.
+  final String deltaPath;
+  final int length;
+
+  Map<String, dynamic> toJson() {
+    return {
+      "path": filePath,
+      "fromHash": fromHash,
+      "toHash": toHash,
+      "delta": deltaPath,
+      "length": length,
     };
   }
 }
@@ -0,0 +1,214 @@
+import "dart:convert";
+import "dart:typed_data";
+
+import "package:desktop_updater/src/app_archive.dart";
+
+/// ELF section of the Linux runner that carries the build manifest.
+const buildManifestSection = ".desktop_updater_manifest";
+
+/// Sidecar used when the manifest cannot be embedded, relative to the bundle.
+const buildManifestSidecar = "data/desktop_updater_manifest.bin";
+
+const _magic = [0x44, 0x55, 0x4d, 0x46]; // "DUMF"
+const _version = 2;
+const _headerSize = 16;
+const _recordSize = 24;
+
+int _algorithmId(String algorithm) {
+  switch (algorithm) {
+    case legacyHashAlgorithm:
+      return 0;
+    case treeHashAlgorithm:
+      return 1;
+    case blake3HashAlgorithm:
+      return 2;
+  }
+  throw ArgumentError("Unknown hash algorithm: $algorithm");
+}
+
+int _digestSize(String algorithm) =>
+    algorithm == blake3HashAlgorithm ? 32 : 64;
+
+int _compareBytes(List<int> a, List<int> b) {
+  final length = a.length < b.length ? a.length : b.length;
+  for (var i = 0; i < length; i++) {
+    if (a[i] != b[i]) {
+      return a[i] - b[i];
+    }
+  }
+  return a.length - b.length;
+}
+
+/// Encodes [entries] in the compact binary manifest format read by the
+/// native plugin (linux/binary_manifest.h). All entries must use
+/// [algorithm].
+Uint8List encodeBinaryManifest(
+  List<FileHashModel> entries,
+  String algorithm,
+) {
+  final digestSize = _digestSize(algorithm);
+  final paths = [for (final entry in entries) utf8.encode(entry.filePath)];
+  final order = List<int>.generate(entries.length, (i) => i)
+    ..sort((a, b) => _compareBytes(paths[a], paths[b]));
+  final stringsSize = paths.fold<int>(0, (sum, p) => sum + p.length);
+
+  final size = _headerSize +
+      entries.length * (_recordSize + digestSize) +
+      stringsSize;
+  final bytes = Uint8List(size);
+  final data = ByteData.sublistView(bytes);
+
+  bytes.setAll(0, _magic);
+  data
+    ..setUint16(4, _version, Endian.little)
+    ..setUint8(6, _algorithmId(algorithm))
+    ..setUint8(7, digestSize)
+    ..setUint32(8, entries.length, Endian.little)
+    ..setUint32(12, stringsSize, Endian.little);
+
+  final digestsStart = _headerSize + entries.length * _recordSize;
+  final stringsStart = digestsStart + entries.length * digestSize;
+  var stringOffset = 0;
+  for (var i = 0; i < order.length; i++) {
+    final entry = entries[order[i]];
+    final path = paths[order[i]];
+    final digest = base64.decode(entry.calculatedHash);
+    if (entry.algorithm != algorithm || digest.length != digestSize) {
+      throw ArgumentError("Unexpected digest for ${entry.filePath}");
+    }
+
+    final record = _headerSize + i * _recordSize;
+    data
+      ..setUint32(record, stringOffset, Endian.little)
+      ..setUint32(record + 4, path.length, Endian.little)
+      ..setUint64(record + 8, entry.length, Endian.little)
+      ..setUint64(record + 16, entry.compressedLength ?? 0, Endian.little);
+    bytes
+      ..setAll(digestsStart + i * digestSize, digest)
+      ..setAll(stringsStart + stringOffset, path);
+    stringOffset += path.length;
+  }
+  return bytes;
+}
+
+String _algorithmName(int id) {
+  switch (id) {
+    case 0:
+      return legacyHashAlgorithm;
+    case 1:
+      return treeHashAlgorithm;
+    case 2:
+      return blake3HashAlgorithm;
+  }
+  throw FormatException("Unknown hash algorithm id: $id");
+}
+
+/// Reads a binary manifest in place, as returned by the native plugin.
+///
+/// Nothing is copied up front: records are read from [bytes] on access,
+/// digests are views into it and paths are decoded only when asked for, so
+/// decoding cost does not grow with the size of the manifest.
+class BinaryManifest {
+  BinaryManifest._(
+    this._bytes,
+    this._data,
+    this.algorithm,
+    this.digestSize,
+    this.length,
+  );
+
+  /// Checks the header and that every record lies inside [bytes].
+  factory BinaryManifest.parse(Uint8List bytes) {
+    if (bytes.length < _headerSize) {
+      throw const FormatException("Binary manifest is truncated");
+    }
+    for (var i = 0; i < _magic.length; i++) {
+      if (bytes[i] != _magic[i]) {
+        throw const FormatException("Not a binary manifest");
+      }
+    }
+    final data = ByteData.sublistView(bytes);
+    if (data.getUint16(4, Endian.little) != _version) {
+      throw const FormatException("Unsupported binary manifest version");
+    }
+    final algorithm = _algorithmName(data.getUint8(6));
+    final digestSize = data.getUint8(7);
+    final count = data.getUint32(8, Endian.little);
+    final stringsSize = data.getUint32(12, Endian.little);
+    if (digestSize != _digestSize(algorithm) ||
+        bytes.length !=
+            _headerSize + count * (_recordSize + digestSize) + stringsSize) {
+      throw const FormatException("Binary manifest is truncated");
+    }
+    final manifest =
+        BinaryManifest._(bytes, data, algorithm, digestSize, count);
+    for (var i = 0; i < count; i++) {
+      final record = _headerSize + i * _recordSize;
+      final end = data.getUint32(record, Endian.little) +
+          data.getUint32(record + 4, Endian.little);
+      if (end > stringsSize) {
+        throw const FormatException("Binary manifest path out of range");
+      }
+    }
+    return manifest;
+  }
+
+  final Uint8List _bytes;
+  final ByteData _data;
+
+  /// Digest algorithm shared by every entry.
+  final String algorithm;
+
+  /// Raw digest size in bytes.
+  final int digestSize;
+
+  /// Number of entries.
+  final int length;
+
+  int get _digestsStart => _headerSize + length * _recordSize;
+  int get _stringsStart => _digestsStart + length * digestSize;
+
+  /// UTF-8 bytes of the path of entry [index], without copying.
+  Uint8List pathBytes(int index) {
+    final record = _headerSize + index * _recordSize;
+    final start = _stringsStart + _data.getUint32(record, Endian.little);
+    return Uint8List.sublistView(
+      _bytes,
+      start,
+      start + _data.getUint32(record + 4, Endian.little),
+    );
+  }
+
+  /// Path of entry [index], relative to the install directory.
+  String path(int index) => utf8.decode(pathBytes(index));
+
+  /// File size of entry [index] in bytes.
+  int fileLength(int index) =>
+      _data.getUint64(_headerSize + index * _recordSize + 8, Endian.little);
+
+  /// Size of the compressed copy of entry [index], or null if it has none.
+  int? compressedLength(int index) {
+    final length =
+        _data.getUint64(_headerSize + index * _recordSize + 16, Endian.little);
+    return length == 0 ? null : length;
+  }
+
+  /// Raw digest of entry [index], without copying.
+  Uint8List digest(int index) {
+    final start = _digestsStart + index * digestSize;
+    return Uint8List.sublistView(_bytes, start, start + digestSize);
+  }
+
+  /// Entry [index] as a [FileHashModel].
+  FileHashModel entry(int index) => FileHashModel(
+        filePath: path(index),
+        calculatedHash: base64.encode(digest(index)),
+        length: fileLength(index),
+        algorithm: algorithm,
+        compressedLength: compressedLength(index),
+      );
+
+  /// Every entry as a [FileHashModel], in path order.
+  List<FileHashModel> toModels() =>
+      [for (var i = 0; i < length; i++) entry(i)];
+}
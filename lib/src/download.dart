@@ -1,14 +1,32 @@
 import "dart:async";
 import "dart:io";
 
+import "package:desktop_updater/desktop_updater_platform_interface.dart";
+import "package:desktop_updater/src/app_archive.dart";
 import "package:dio/dio.dart";
 import "package:flutter/foundation.dart";
+import "package:flutter/services.dart";
 import "package:path/path.dart" as path;
 
 /// Manages file downloads with progress reporting.
 /// Uses a shared Dio instance for connection pooling and DNS caching.
 class FileDownloader {
   static FileDownloader? _instance;
+  static int _nextDownloadId = 0;
+
+  /// Cleared once the plugin turns out to be built without native downloads
+  /// (no libcurl), so later files go straight to Dio.
+  static bool _nativeDownloads = true;
+
+  /// Cleared once the plugin turns out to be built without libzstd, so later
+  /// files skip their compressed copies.
+  static bool _nativeDictionaries = true;
+
+  /// Progress callbacks of the native downloads in flight, by id. One timer
+  /// polls the plugin for all of them at once, however many are running.
+  static final Map<String, void Function(int received)> _nativeProgress = {};
+  static Timer? _nativeProgressTimer;
+  static bool _nativeProgressPending = false;
   Dio? _dio;
 
   FileDownloader._();
@@ -69,6 +87,79 @@ class FileDownloader {
     );
   }
 
+  static void _watchNativeProgress(
+      String id, void Function(int received) onReceived) {
+    _nativeProgress[id] = onReceived;
+    _nativeProgressTimer ??= Timer.periodic(
+        const Duration(milliseconds: 250), (_) => _pollNativeProgress());
+  }
+
+  static void _unwatchNativeProgress(String id) {
+    _nativeProgress.remove(id);
+    if (_nativeProgress.isEmpty) {
+      _nativeProgressTimer?.cancel();
+      _nativeProgressTimer = null;
+    }
+  }
+
+  static Future<void> _pollNativeProgress() async {
+    // Skipped while the last poll is still waiting for its answer.
+    if (_nativeProgressPending) return;
+    _nativeProgressPending = true;
+    try {
+      final received =
+          await DesktopUpdaterPlatform.instance.getDownloadProgress();
+      received?.forEach((id, bytes) => _nativeProgress[id]?.call(bytes));
+    } finally {
+      _nativeProgressPending = false;
+    }
+  }
+
+  /// Downloads through the plugin, polling it for progress. Throws a cancel
+  /// [DioException] when [cancelToken] stops it, so callers handle both paths
+  /// alike.
+  Future<void> _nativeDownloadFile(
+      {required String url,
+      required String fullSavePath,
+      required int length,
+      String? dictionaryUrl,
+      String? hash,
+      String? algorithm,
+      void Function(double receivedKB, double totalKB)? progressCallback,
+      CancelToken? cancelToken}) async {
+    final platform = DesktopUpdaterPlatform.instance;
+    final id = "${pid}_${_nextDownloadId++}";
+    cancelToken?.whenCancel.then((_) => platform.cancelDownload(id)).ignore();
+    if (progressCallback != null) {
+      _watchNativeProgress(
+          id, (received) => progressCallback(received / 1024, length / 1024));
+    }
+    try {
+      if (cancelToken?.isCancelled ?? false) {
+        throw PlatformException(code: "CANCELLED");
+      }
+      await platform.downloadFile(
+        url: url,
+        path: fullSavePath,
+        length: length,
+        id: id,
+        dictionaryUrl: dictionaryUrl,
+        hash: hash,
+        algorithm: algorithm,
+      );
+      progressCallback?.call(length / 1024, length / 1024);
+    } on PlatformException catch (e) {
+      if (e.code != "CANCELLED") rethrow;
+      throw DioException(
+        requestOptions: RequestOptions(path: url),
+        type: DioExceptionType.cancel,
+        error: e,
+      );
+    } finally {
+      _unwatchNativeProgress(id);
+    }
+  }
+
   bool checkIsNetworkError(DioException e) {
     if (e.type == DioExceptionType.cancel) return false;
     final msg = (e.message ?? e.error?.toString() ?? '').toLowerCase();
@@ -112,12 +203,23 @@ class FileDownloader {
   /// Downloads a file with progress reporting.
   /// [progressCallback] receives two doubles: receivedKB and totalKB.
   /// [cancelToken] optional; when cancelled, aborts the download.
+  /// [length] is the size hashes.json lists. On Linux, files of known length
+  /// are fetched natively: concurrent downloads share HTTP/2 connections and
+  /// large files are split into parallel ranges. Files with a
+  /// [compressedLength] are fetched as their zstd copy there, decompressed
+  /// with the release's shared dictionary as they arrive, and as they are if
+  /// that fails. Native downloads are checked against [hash] and [algorithm]
+  /// when given, and fetched again through Dio if they do not match.
   Future<void> downloadFile(
     String? host,
     String filePath,
     String savePath,
     void Function(double receivedKB, double totalKB)? progressCallback, {
     CancelToken? cancelToken,
+    int? length,
+    int? compressedLength,
+    String? hash,
+    String? algorithm,
   }) async {
     if (host == null) return;
 
@@ -147,6 +249,58 @@ class FileDownloader {
     final url = "$host/$encodedPath";
     final dio = _getDio();
 
+    if (Platform.isLinux &&
+        _nativeDownloads &&
+        _nativeDictionaries &&
+        length != null &&
+        compressedLength != null) {
+      try {
+        // Progress is reported in uncompressed bytes, like the other paths.
+        await _nativeDownloadFile(
+          url: "$url$zstdFileSuffix",
+          fullSavePath: fullSavePath,
+          length: compressedLength,
+          dictionaryUrl: "$host/$zstdDictionaryFileName",
+          hash: hash,
+          algorithm: algorithm,
+          progressCallback: progressCallback == null || compressedLength == 0
+              ? null
+              : (receivedKB, _) => progressCallback(
+                    receivedKB * length / compressedLength, length / 1024),
+          cancelToken: cancelToken,
+        );
+        return;
+      } on PlatformException catch (e) {
+        if (e.code == "DICTIONARY_UNSUPPORTED") _nativeDictionaries = false;
+        debugPrint(
+            "Desktop Updater: compressed download failed: ${e.message}");
+      } on MissingPluginException {
+        // Older plugin builds, or ones built without libcurl.
+        _nativeDownloads = false;
+      }
+    }
+
+    if (Platform.isLinux && _nativeDownloads && length != null) {
+      try {
+        await _nativeDownloadFile(
+          url: url,
+          fullSavePath: fullSavePath,
+          length: length,
+          hash: hash,
+          algorithm: algorithm,
+          progressCallback: progressCallback,
+          cancelToken: cancelToken,
+        );
+        return;
+      } on PlatformException catch (e) {
+        // Dio retries with its own TLS and proxy handling.
+        debugPrint("Desktop Updater: native download failed: ${e.message}");
+      } on MissingPluginException {
+        // Older plugin builds, or ones built without libcurl.
+        _nativeDownloads = false;
+      }
+    }
+
     try {
       await _tryDownloadFile(
         dio: dio,
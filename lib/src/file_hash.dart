@@ -4,16 +4,23 @@ import "dart:io";
 
 import "package:cryptography_plus/cryptography_plus.dart";
 import "package:desktop_updater/desktop_updater.dart";
+import "package:desktop_updater/desktop_updater_platform_interface.dart";
 import "package:desktop_updater/src/app_archive.dart";
+import "package:desktop_updater/src/binary_manifest.dart";
+import "package:desktop_updater/src/merkle.dart";
+import "package:http/http.dart" as http;
 import "package:flutter/material.dart";
+import "package:flutter/services.dart";
 
 Future<String> getFileHash(File file) async {
   try {
-    // Read file content
-    final List<int> fileBytes = await file.readAsBytes();
-
-    // Compute hash with Blake2b algorithm
-    final hash = await Blake2b().hash(fileBytes);
+    // Stream the file through the hash so memory stays flat for large files
+    final sink = Blake2b().newHashSink();
+    await for (final chunk in file.openRead()) {
+      sink.add(chunk);
+    }
+    sink.close();
+    final hash = await sink.hash();
 
     // Encode hash to base64 and return
     return base64.encode(hash.bytes);
@@ -23,6 +30,16 @@ Future<String> getFileHash(File file) async {
   }
 }
 
+/// Returns the digest algorithm a hashes.json file was written with.
+Future<String> manifestHashAlgorithm(String hashFilePath) async {
+  final decoded = jsonDecode(await File(hashFilePath).readAsString());
+  if (decoded is List && decoded.isNotEmpty && decoded.first is Map) {
+    return (decoded.first as Map)["algorithm"] as String? ??
+        legacyHashAlgorithm;
+  }
+  return legacyHashAlgorithm;
+}
+
 bool _pathEquals(String a, String b) {
   final na = a.replaceAll(r'\', '/');
   final nb = b.replaceAll(r'\', '/');
@@ -32,10 +49,19 @@ bool _pathEquals(String a, String b) {
   return na == nb;
 }
 
+String _parentDirectory(String filePath) {
+  final normalized = filePath.replaceAll(r'\', '/');
+  final slash = normalized.lastIndexOf('/');
+  return slash < 0 ? "" : normalized.substring(0, slash);
+}
+
+/// Compares two manifests. With [onlyDirectories], files outside those
+/// directories are known to be unchanged and are not compared.
 Future<List<FileHashModel?>> verifyFileHashes(
   String oldHashFilePath,
   String newHashFilePath, {
   bool returnAllOnAnyChange = false,
+  Set<String>? onlyDirectories,
 }) async {
   if (oldHashFilePath == newHashFilePath) {
     return [];
@@ -67,6 +93,10 @@ Future<List<FileHashModel?>> verifyFileHashes(
 
   for (final newHash in newHashes) {
     final newPath = newHash?.filePath ?? "";
+    if (onlyDirectories != null &&
+        !onlyDirectories.contains(_parentDirectory(newPath))) {
+      continue;
+    }
     final oldHash = oldHashes.firstWhere(
       (element) =>
           element?.filePath != null && _pathEquals(element!.filePath, newPath),
@@ -79,6 +109,8 @@ Future<List<FileHashModel?>> verifyFileHashes(
           filePath: newHash?.filePath ?? "",
           calculatedHash: newHash?.calculatedHash ?? "",
           length: newHash?.length ?? 0,
+          algorithm: newHash?.algorithm ?? legacyHashAlgorithm,
+          compressedLength: newHash?.compressedLength,
         ),
       );
     }
@@ -92,7 +124,10 @@ Future<List<FileHashModel?>> verifyFileHashes(
 }
 
 // Computes hashes of all files in a directory and writes them to a file
-Future<String> genFileHashes({String? path}) async {
+Future<String> genFileHashes({
+  String? path,
+  String algorithm = legacyHashAlgorithm,
+}) async {
   path ??= Platform.resolvedExecutable;
 
   final directoryPath =
@@ -113,6 +148,30 @@ Future<String> genFileHashes({String? path}) async {
     final outputFile =
         File("${tempDir.path}${Platform.pathSeparator}hashes.json");
 
+    // On Linux the native hasher serves every algorithm and reuses the
+    // build manifest and its hash index, so unchanged files are not read.
+    if (Platform.isLinux) {
+      final nativePath = await DesktopUpdaterPlatform.instance.hashDirectory(
+        directory: dir.path,
+        outputPath: outputFile.path,
+        algorithm: algorithm,
+        treeOutputPath:
+            "${tempDir.path}${Platform.pathSeparator}$merkleTreeFileName",
+      );
+      if (nativePath != null) {
+        return nativePath;
+      }
+    }
+
+    // Only the native hasher can compute the newer algorithms
+    if (algorithm != legacyHashAlgorithm) {
+      // Legacy digests never match, so every file is treated as changed
+      debugPrint(
+        "Desktop Updater: $algorithm is not supported on this platform, "
+        "falling back to $legacyHashAlgorithm",
+      );
+    }
+
     // Open output file for writing
     final sink = outputFile.openWrite();
 
@@ -152,3 +211,87 @@ Future<String> genFileHashes({String? path}) async {
     throw Exception("Desktop Updater: Directory does not exist");
   }
 }
+
+/// Merkle tree of the manifest at [hashFilePath]: the one the native hasher
+/// wrote next to it, or computed from the manifest.
+Future<MerkleTree> localMerkleTree(String hashFilePath, String algorithm) async {
+  final treeFile = File(
+    "${File(hashFilePath).parent.path}${Platform.pathSeparator}$merkleTreeFileName",
+  );
+  if (await treeFile.exists()) {
+    return MerkleTree.fromJson(jsonDecode(await treeFile.readAsString()));
+  }
+  final entries = (jsonDecode(await File(hashFilePath).readAsString()) as List)
+      .map((e) => FileHashModel.fromJson(e as Map<String, dynamic>))
+      .toList();
+  return MerkleTree.build(entries, algorithm);
+}
+
+/// Files of the release in [remoteUpdateFolder] that differ from the local
+/// install. When the release publishes a Merkle tree, the roots are
+/// compared first: an up-to-date install needs no hashes.json download,
+/// and otherwise only files in subtrees whose digests differ are compared.
+Future<List<FileHashModel?>> findChangedFiles(
+  String remoteUpdateFolder, {
+  bool returnAllOnAnyChange = false,
+}) async {
+  final remoteTree = await downloadMerkleTree(remoteUpdateFolder);
+
+  String? oldHashFilePath;
+  Set<String>? onlyDirectories;
+  if (remoteTree != null) {
+    oldHashFilePath = await genFileHashes(algorithm: remoteTree.algorithm);
+    final localTree =
+        await localMerkleTree(oldHashFilePath, remoteTree.algorithm);
+    onlyDirectories = changedDirectories(localTree, remoteTree);
+    if (onlyDirectories != null && onlyDirectories.isEmpty) {
+      debugPrint("Desktop Updater: Merkle roots match, nothing to update");
+      return [];
+    }
+  }
+
+  final tempDir = await Directory.systemTemp.createTemp("desktop_updater");
+  final newHashFile =
+      File("${tempDir.path}${Platform.pathSeparator}hashes.json");
+  final client = http.Client();
+  try {
+    final response = await client.send(
+      http.Request("GET", Uri.parse("$remoteUpdateFolder/hashes.json")),
+    );
+    if (response.statusCode != 200) {
+      throw const HttpException("Failed to download hashes.json");
+    }
+    await response.stream.pipe(newHashFile.openWrite());
+  } finally {
+    client.close();
+  }
+
+  oldHashFilePath ??= await genFileHashes(
+    algorithm: await manifestHashAlgorithm(newHashFile.path),
+  );
+
+  // The native diff hands back one packed buffer, so neither manifest is
+  // decoded into Dart objects and only the changes are materialized.
+  if (Platform.isLinux) {
+    try {
+      final changes = await DesktopUpdaterPlatform.instance.diffManifest(
+        oldHashFilePath: oldHashFilePath,
+        newHashFilePath: newHashFile.path,
+        onlyDirectories: onlyDirectories,
+        returnAllOnAnyChange: returnAllOnAnyChange,
+      );
+      if (changes != null) {
+        return BinaryManifest.parse(changes).toModels();
+      }
+    } on PlatformException catch (e) {
+      debugPrint("Desktop Updater: native diff failed: ${e.message}");
+    }
+  }
+
+  return verifyFileHashes(
+    oldHashFilePath,
+    newHashFile.path,
+    returnAllOnAnyChange: returnAllOnAnyChange,
+    onlyDirectories: onlyDirectories,
+  );
+}
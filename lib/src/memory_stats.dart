@@ -0,0 +1,30 @@
+/// Memory used by the native update pipeline, in bytes.
+class MemoryStats {
+  MemoryStats({
+    required this.limit,
+    required this.inUse,
+    required this.peak,
+    required this.peakRss,
+  });
+
+  factory MemoryStats.fromMap(Map<Object?, Object?> map) {
+    return MemoryStats(
+      limit: map["limit"] as int? ?? 0,
+      inUse: map["inUse"] as int? ?? 0,
+      peak: map["peak"] as int? ?? 0,
+      peakRss: map["peakRss"] as int? ?? 0,
+    );
+  }
+
+  /// Budget for in-flight buffers; 0 means uncapped.
+  final int limit;
+
+  /// Buffer bytes currently held by the hashing, download and apply stages.
+  final int inUse;
+
+  /// Highest [inUse] since the budget was last set.
+  final int peak;
+
+  /// Peak resident set size of the whole process.
+  final int peakRss;
+}
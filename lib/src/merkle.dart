@@ -0,0 +1,194 @@
+import "dart:convert";
+import "dart:typed_data";
+
+import "package:cryptography_plus/cryptography_plus.dart";
+import "package:desktop_updater/src/app_archive.dart";
+import "package:http/http.dart" as http;
+
+/// File published next to hashes.json with the release's directory hashes.
+const merkleTreeFileName = "tree.json";
+
+/// BLAKE2b-512 digests of every directory of a release, computed over the
+/// file digests below it. Must match build_merkle_tree in linux/merkle.cc.
+class MerkleTree {
+  MerkleTree({
+    required this.algorithm,
+    required this.root,
+    required this.directories,
+  });
+
+  factory MerkleTree.fromJson(Map<String, dynamic> json) {
+    return MerkleTree(
+      algorithm: json["algorithm"] ?? legacyHashAlgorithm,
+      root: json["root"],
+      directories: Map<String, String>.from(json["directories"]),
+    );
+  }
+
+  /// Digest algorithm of the files the tree was built over.
+  final String algorithm;
+  final String root;
+
+  /// Base64 digests keyed by relative directory path; the root is "".
+  final Map<String, String> directories;
+
+  /// Directories are written in path byte order, as linux/merkle.cc and
+  /// the native manifest tool write them, so the file is reproducible.
+  Map<String, dynamic> toJson() {
+    final paths = directories.keys.toList()
+      ..sort((a, b) => _compareBytes(utf8.encode(a), utf8.encode(b)));
+    return {
+      "algorithm": algorithm,
+      "root": root,
+      "directories": {for (final path in paths) path: directories[path]},
+    };
+  }
+
+  /// Builds the tree of a manifest. Each directory is hashed over its
+  /// children sorted by name bytes, see linux/merkle.h for the layout.
+  static Future<MerkleTree> build(
+    List<FileHashModel> entries,
+    String algorithm,
+  ) async {
+    final children = <String, List<_Child>>{"": []};
+    for (final entry in entries) {
+      final path = entry.filePath.replaceAll(r"\", "/");
+      children.putIfAbsent(_parentOf(path), () => []).add(
+            _Child(
+              name: utf8.encode(_nameOf(path)),
+              directory: false,
+              length: entry.length,
+              digest: base64.decode(entry.calculatedHash),
+            ),
+          );
+      for (var dir = _parentOf(path); dir.isNotEmpty; dir = _parentOf(dir)) {
+        children.putIfAbsent(dir, () => []);
+      }
+    }
+
+    // Deepest directories first, so children are done before their parent
+    final order = children.keys.toList()
+      ..sort((a, b) => _depthOf(b).compareTo(_depthOf(a)));
+
+    final directories = <String, String>{};
+    final hasher = Blake2b();
+    for (final dir in order) {
+      final nodes = children[dir]!..sort((a, b) => _compareBytes(a.name, b.name));
+      final serialized = BytesBuilder(copy: false);
+      for (final child in nodes) {
+        serialized
+          ..addByte(child.directory ? 1 : 0)
+          ..add(_le(child.name.length, 4))
+          ..add(child.name);
+        if (!child.directory) {
+          serialized
+            ..add(_le(child.length, 8))
+            ..addByte(child.digest.length);
+        }
+        serialized.add(child.digest);
+      }
+      final node = (await hasher.hash(serialized.takeBytes())).bytes;
+      directories[dir] = base64.encode(node);
+      if (dir.isNotEmpty) {
+        children[_parentOf(dir)]!.add(
+          _Child(
+            name: utf8.encode(_nameOf(dir)),
+            directory: true,
+            length: 0,
+            digest: node,
+          ),
+        );
+      }
+    }
+
+    return MerkleTree(
+      algorithm: algorithm,
+      root: directories[""]!,
+      directories: directories,
+    );
+  }
+}
+
+class _Child {
+  _Child({
+    required this.name,
+    required this.directory,
+    required this.length,
+    required this.digest,
+  });
+  final List<int> name;
+  final bool directory;
+  final int length;
+  final List<int> digest;
+}
+
+String _parentOf(String path) {
+  final slash = path.lastIndexOf("/");
+  return slash < 0 ? "" : path.substring(0, slash);
+}
+
+String _nameOf(String path) => path.substring(path.lastIndexOf("/") + 1);
+
+int _depthOf(String path) =>
+    path.isEmpty ? 0 : "/".allMatches(path).length + 1;
+
+int _compareBytes(List<int> a, List<int> b) {
+  final length = a.length < b.length ? a.length : b.length;
+  for (var i = 0; i < length; i++) {
+    if (a[i] != b[i]) {
+      return a[i] - b[i];
+    }
+  }
+  return a.length - b.length;
+}
+
+Uint8List _le(int value, int bytes) {
+  final out = Uint8List(bytes);
+  for (var i = 0; i < bytes; i++) {
+    out[i] = (value >> (8 * i)) & 0xff;
+  }
+  return out;
+}
+
+/// Directories whose own files may differ between [local] and [remote],
+/// found by descending from the root only into subtrees whose digests
+/// differ. Empty when the roots match; null when the trees were built over
+/// different digest algorithms and cannot be compared.
+Set<String>? changedDirectories(MerkleTree local, MerkleTree remote) {
+  if (local.algorithm != remote.algorithm) {
+    return null;
+  }
+  final childrenOf = <String, List<String>>{};
+  for (final dir in remote.directories.keys) {
+    if (dir.isNotEmpty) {
+      childrenOf.putIfAbsent(_parentOf(dir), () => []).add(dir);
+    }
+  }
+
+  final changed = <String>{};
+  final pending = <String>[""];
+  while (pending.isNotEmpty) {
+    final dir = pending.removeLast();
+    if (local.directories[dir] == remote.directories[dir]) {
+      continue;
+    }
+    changed.add(dir);
+    pending.addAll(childrenOf[dir] ?? const []);
+  }
+  return changed;
+}
+
+/// Downloads the tree published in [remoteFolder]. Returns null for
+/// releases made before trees were published.
+Future<MerkleTree?> downloadMerkleTree(String remoteFolder) async {
+  try {
+    final response =
+        await http.get(Uri.parse("$remoteFolder/$merkleTreeFileName"));
+    if (response.statusCode != 200) {
+      return null;
+    }
+    return MerkleTree.fromJson(jsonDecode(response.body));
+  } catch (_) {
+    return null;
+  }
+}
@@ -0,0 +1,65 @@
+/// Timings of one restartApp, recorded by the Linux plugin.
+///
+/// Timestamps are CLOCK_BOOTTIME nanoseconds shared by the old and the new
+/// process; 0 means the phase was not reached.
+class RestartMetrics {
+  RestartMetrics({
+    required this.requested,
+    required this.applied,
+    required this.warmed,
+    required this.exited,
+    required this.started,
+    required this.registered,
+    required this.firstFrame,
+  });
+
+  factory RestartMetrics.fromMap(Map<Object?, Object?> map) {
+    return RestartMetrics(
+      requested: map["requested"] as int? ?? 0,
+      applied: map["applied"] as int? ?? 0,
+      warmed: map["warmed"] as int? ?? 0,
+      exited: map["exited"] as int? ?? 0,
+      started: map["started"] as int? ?? 0,
+      registered: map["registered"] as int? ?? 0,
+      firstFrame: map["firstFrame"] as int? ?? 0,
+    );
+  }
+
+  /// restartApp was called in the old process.
+  final int requested;
+
+  /// applyUpdate moved the staged update into place, which happens before
+  /// restartApp is called.
+  final int applied;
+
+  /// The pages the last startup needed were handed to a process reading
+  /// them ahead of the new process.
+  final int warmed;
+
+  /// The old process was about to exit.
+  final int exited;
+
+  /// The new process was started.
+  final int started;
+
+  /// The plugin was registered in the new process.
+  final int registered;
+
+  /// The new process drew its first frame.
+  final int firstFrame;
+
+  /// Whether the new process got as far as its first frame.
+  bool get isComplete => requested != 0 && firstFrame != 0;
+
+  static Duration? _between(int from, int to) =>
+      from == 0 || to == 0 ? null : Duration(microseconds: (to - from) ~/ 1000);
+
+  /// From the old process exiting to the new one starting.
+  Duration? get relaunchTime => _between(exited, started);
+
+  /// From the new process starting to its first frame.
+  Duration? get startupTime => _between(started, firstFrame);
+
+  /// Time the app was unusable: from restartApp to the first frame.
+  Duration? get downtime => _between(requested, firstFrame);
+}
@@ -1,6 +1,8 @@
 import "dart:async";
+import "dart:convert";
 import "dart:io";
 
+import "package:desktop_updater/desktop_updater_platform_interface.dart";
 import "package:desktop_updater/src/app_archive.dart";
 import "package:desktop_updater/src/download.dart";
 import "package:desktop_updater/src/update_progress.dart";
@@ -74,6 +76,36 @@ Future<String> _getDownloadPath(Directory targetDir) async {
   return targetDir.path;
 }
 
+/// Puts [queue] in the order its downloads should start in. On Linux the
+/// native scheduler plans it from the bytes each file transfers, so large
+/// files start early and share the link with small ones instead of queueing
+/// all at once or finishing alone at the end. Elsewhere, or if that fails,
+/// the largest go first.
+@visibleForTesting
+Future<void> scheduleDownloads(
+  List<FileHashModel> queue,
+  int workers,
+) async {
+  if (Platform.isLinux && queue.length > 1) {
+    try {
+      final order = await DesktopUpdaterPlatform.instance.planWork(
+        sizes: queue.map((f) => f.compressedLength ?? f.length).toList(),
+        workers: workers,
+      );
+      if (order != null && order.length == queue.length) {
+        final planned = [for (final index in order) queue[index]];
+        queue
+          ..clear()
+          ..addAll(planned);
+        return;
+      }
+    } catch (e) {
+      debugPrint("Warning: Could not plan the download order: $e");
+    }
+  }
+  queue.sort((a, b) => b.length.compareTo(a.length));
+}
+
 /// Modified updateAppFunction to return a stream of UpdateProgress and a cancel callback.
 Future<UpdateStreamResult> updateAppFunction({
   required String remoteUpdateFolder,
@@ -109,6 +141,15 @@ Future<UpdateStreamResult> updateAppFunction({
     for (final token in List<CancelToken>.from(activeCancelTokens)) {
       token.cancel("Download cancelled");
     }
+    // Dio tokens only reach Dart downloads; this also stops native hashing
+    // and downloads and removes what was staged.
+    if (Platform.isLinux) {
+      unawaited(DesktopUpdaterPlatform.instance.cancelUpdate().then(
+        (result) => debugPrint("[Update] Native stages cancelled: $result"),
+        onError: (Object e) =>
+            debugPrint("Warning: Could not cancel native stages: $e"),
+      ));
+    }
     if (!completeCompleter.isCompleted) {
       completeCompleter.complete(DownloadCompleteResult(
         successCount: 0,
@@ -204,7 +245,8 @@ Future<UpdateStreamResult> updateAppFunction({
           downloadQueue.add(file);
         }
       }
-      downloadQueue.sort((a, b) => b.length.compareTo(a.length));
+      await scheduleDownloads(downloadQueue, maxConcurrentDownloads);
+      var nextDownload = 0;
 
       final dirsToCreate = <String>{};
       for (final file in downloadQueue) {
@@ -326,13 +368,14 @@ Future<UpdateStreamResult> updateAppFunction({
               unawaited(savePeriodicLog());
             });
 
-            while (downloadQueue.isNotEmpty || activeDownloads.isNotEmpty) {
+            while (nextDownload < downloadQueue.length ||
+                activeDownloads.isNotEmpty) {
               if (cancelled) break;
 
               while (activeDownloads.length < maxConcurrentDownloads &&
-                  downloadQueue.isNotEmpty &&
+                  nextDownload < downloadQueue.length &&
                   !cancelled) {
-                final file = downloadQueue.removeAt(0);
+                final file = downloadQueue[nextDownload++];
                 final startTime = DateTime.now();
                 final cancelToken = CancelToken();
                 activeCancelTokens.add(cancelToken);
@@ -375,6 +418,10 @@ Future<UpdateStreamResult> updateAppFunction({
                     } catch (_) {}
                   },
                   cancelToken: cancelToken,
+                  length: file.length,
+                  compressedLength: file.compressedLength,
+                  hash: file.calculatedHash,
+                  algorithm: file.algorithm,
                 ).then((_) async {
                   if (cancelled) {
                     activeCancelTokens.remove(cancelToken);
@@ -534,7 +581,7 @@ Future<UpdateStreamResult> updateAppFunction({
                   await Future.any(futures);
                 }
                 await Future.delayed(Duration.zero);
-              } else if (downloadQueue.isNotEmpty) {
+              } else if (nextDownload < downloadQueue.length) {
                 await Future.delayed(Duration(milliseconds: 50));
               } else {
                 break;
@@ -560,6 +607,42 @@ Future<UpdateStreamResult> updateAppFunction({
                 .map<String>((r) => r["file"] as String)
                 .toList();
 
+            // What applyUpdate checks the applied files against on Linux,
+            // only for a complete update so it never describes a stale one.
+            // The update is then moved into place before whenComplete
+            // resolves, so a restart that follows right away only relaunches.
+            if (Platform.isLinux) {
+              final stagedManifest =
+                  File(path.join(downloadPath, stagedManifestFileName));
+              var complete = false;
+              try {
+                if (!cancelled && failed == 0) {
+                  await stagedManifest.writeAsString(
+                    jsonEncode(changes.whereType<FileHashModel>().toList()),
+                    flush: true,
+                  );
+                  complete = true;
+                } else if (await stagedManifest.exists()) {
+                  await stagedManifest.delete();
+                }
+              } catch (e) {
+                debugPrint("Warning: Could not write the staged manifest: $e");
+              }
+              if (complete && !cancelled) {
+                try {
+                  final applied =
+                      await DesktopUpdaterPlatform.instance.applyUpdate();
+                  if (applied == false) {
+                    debugPrint("[Update] Staged files left for the restart "
+                        "to copy");
+                  }
+                } catch (e) {
+                  // restartApp's update script copies what is still staged.
+                  debugPrint("Warning: Could not apply the update: $e");
+                }
+              }
+            }
+
             if (!completeCompleter.isCompleted) {
               completeCompleter.complete(DownloadCompleteResult(
                 successCount: ok,
@@ -96,42 +96,8 @@ Future<ItemModel?> versionCheckFunction({
     }
 
     if (latestVersion.shortVersion > int.parse(currentVersion!)) {
-      final tempDir = await Directory.systemTemp.createTemp("desktop_updater");
-      final client = http.Client();
-
-      final newHashFileUrl = "${latestVersion.url}/hashes.json";
-      final newHashFileRequest = http.Request("GET", Uri.parse(newHashFileUrl));
-      final newHashFileResponse = await client.send(newHashFileRequest);
-
-      if (newHashFileResponse.statusCode != 200) {
-        client.close();
-        throw const HttpException("Failed to download hashes.json");
-      }
-
-      final outputFile =
-          File("${tempDir.path}${Platform.pathSeparator}hashes.json");
-      final sink = outputFile.openWrite();
-
-      await newHashFileResponse.stream.listen(
-        sink.add,
-        onDone: () async {
-          await sink.close();
-          client.close();
-        },
-        onError: (e) async {
-          await sink.close();
-          client.close();
-          throw e;
-        },
-        cancelOnError: true,
-      ).asFuture();
-
-      final oldHashFilePath = await genFileHashes();
-      final newHashFilePath = outputFile.path;
-
-      final changedFiles = await verifyFileHashes(
-        oldHashFilePath,
-        newHashFilePath,
+      final changedFiles = await findChangedFiles(
+        latestVersion.url,
         returnAllOnAnyChange: Platform.isMacOS,
       );
 
@@ -1,3 +1,5 @@
+import "dart:io";
+
 import "package:desktop_updater/desktop_updater.dart";
 import "package:flutter/material.dart";
 
@@ -112,7 +114,22 @@ class DesktopUpdaterController extends ChangeNotifier {
     }
   }
 
-  Future<void> downloadUpdate() async {
+  bool _boosted = false;
+
+  // Native work runs at normal priority while a download the user started
+  // is in progress; only the Linux plugin has a background priority.
+  Future<void> _setForegroundBoost(bool enabled) async {
+    if (!Platform.isLinux || _boosted == enabled) {
+      return;
+    }
+    _boosted = enabled;
+    await _plugin.setForegroundBoost(enabled: enabled);
+  }
+
+  /// Downloads the changed files. With [boost], native update work is
+  /// lifted out of background priority until the download ends, for when
+  /// the user is waiting on it.
+  Future<void> downloadUpdate({bool boost = false}) async {
     if (_folderUrl == null) {
       throw Exception("Folder URL is not set");
     }
@@ -121,6 +138,10 @@ class DesktopUpdaterController extends ChangeNotifier {
       throw Exception("Changed files are not set");
     }
 
+    if (boost) {
+      await _setForegroundBoost(true);
+    }
+
     final updateResult = await _plugin.updateApp(
       remoteUpdateFolder: _folderUrl!,
       changedFiles: _changedFiles ?? [],
@@ -149,11 +170,13 @@ class DesktopUpdaterController extends ChangeNotifier {
         _downloadedSize = _downloadSize;
         _isDownloaded = true;
         _updateStreamResult = null;
+        _setForegroundBoost(false);
         notifyListeners();
       },
       onError: (_) {
         _isDownloading = false;
         _updateStreamResult = null;
+        _setForegroundBoost(false);
         notifyListeners();
       },
       cancelOnError: false,
@@ -165,6 +188,7 @@ class DesktopUpdaterController extends ChangeNotifier {
       _updateStreamResult!.cancel();
       _updateStreamResult = null;
       _isDownloading = false;
+      _setForegroundBoost(false);
       notifyListeners();
     }
   }
@@ -330,7 +330,8 @@ class UpdateDialogWidget extends StatelessWidget {
                             color: buttonTextColor,
                           ),
                         ),
-                        onPressed: notifier.downloadUpdate,
+                        onPressed: () =>
+                            notifier.downloadUpdate(boost: true),
                       ),
                     ],
                   ),
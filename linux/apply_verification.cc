@@ -0,0 +1,167 @@
+#include "apply_verification.h"
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstring>
+#include <unordered_set>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    struct VerifyJob
+    {
+      const FileHashEntry *expected;
+      FileStat stat;
+      std::string digest;
+    };
+  } // namespace
+
+  void StagedDigests::record(const std::string &path,
+                             const HashIndexEntry &entry)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[path] = entry;
+  }
+
+  bool StagedDigests::find(const std::string &path,
+                           HashIndexEntry *entry) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it == entries_.end())
+    {
+      return false;
+    }
+    *entry = it->second;
+    return true;
+  }
+
+  void StagedDigests::clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+  }
+
+  bool same_staged_file(const FileStat &staged, const FileStat &installed)
+  {
+    return staged.inode == installed.inode && staged.size == installed.size &&
+           staged.mtime_ns == installed.mtime_ns;
+  }
+
+  bool verify_applied_files(FileHasher *hasher, const std::string &install_dir,
+                            const std::string &staging_dir,
+                            const std::vector<std::string> &written,
+                            const std::vector<FileHashEntry> &expected,
+                            const StagedDigests *staged, HashIndex *index,
+                            VerifyStats *stats, std::string *error)
+  {
+    *stats = VerifyStats();
+    std::unordered_map<std::string, const FileHashEntry *> by_path;
+    for (const FileHashEntry &entry : expected)
+    {
+      by_path[entry.path] = &entry;
+    }
+
+    std::vector<VerifyJob> jobs;
+    std::unordered_set<std::string> seen;
+    for (const std::string &path : written)
+    {
+      auto it = by_path.find(path);
+      if (it == by_path.end())
+      {
+        continue;
+      }
+      VerifyJob job;
+      job.expected = it->second;
+      if (!stat_file(install_dir + "/" + path, &job.stat))
+      {
+        *error = "Cannot stat " + path + ": " + strerror(errno);
+        return false;
+      }
+      if (job.stat.size != static_cast<uint64_t>(job.expected->length))
+      {
+        *error = path + " has " + std::to_string(job.stat.size) +
+                 " bytes, expected " + std::to_string(job.expected->length);
+        return false;
+      }
+      HashIndexEntry known;
+      if (staged != nullptr && staged->find(staging_dir + "/" + path, &known) &&
+          known.algorithm == job.expected->algorithm &&
+          same_staged_file(known.stat, job.stat))
+      {
+        job.digest = known.digest;
+        stats->reused++;
+      }
+      seen.insert(path);
+      jobs.push_back(job);
+    }
+    for (const FileHashEntry &entry : expected)
+    {
+      if (seen.count(entry.path) == 0)
+      {
+        *error = entry.path + " was not applied";
+        return false;
+      }
+    }
+
+    // One batch per algorithm, though a manifest normally uses only one.
+    for (HashAlgorithm algorithm :
+         {HashAlgorithm::kBlake2b, HashAlgorithm::kBlake2bTree,
+          HashAlgorithm::kBlake3})
+    {
+      std::vector<VerifyJob *> pending;
+      std::vector<std::string> paths;
+      for (VerifyJob &job : jobs)
+      {
+        if (job.digest.empty() && job.expected->algorithm == algorithm)
+        {
+          pending.push_back(&job);
+          paths.push_back(install_dir + "/" + job.expected->path);
+        }
+      }
+      if (pending.empty())
+      {
+        continue;
+      }
+      std::vector<std::string> digests;
+      hasher->hash_files(paths, algorithm, &digests);
+      for (size_t i = 0; i < pending.size(); i++)
+      {
+        if (digests[i].empty())
+        {
+          *error = "Cannot read " + pending[i]->expected->path;
+          return false;
+        }
+        pending[i]->digest = digests[i];
+        stats->hashed++;
+      }
+    }
+
+    for (const VerifyJob &job : jobs)
+    {
+      const std::string actual = base64_encode(
+          reinterpret_cast<const uint8_t *>(job.digest.data()),
+          job.digest.size());
+      if (actual != job.expected->calculated_hash)
+      {
+        *error = job.expected->path + " does not match the manifest";
+        return false;
+      }
+    }
+    if (index != nullptr)
+    {
+      for (const VerifyJob &job : jobs)
+      {
+        HashIndexEntry entry;
+        entry.stat = job.stat;
+        entry.algorithm = job.expected->algorithm;
+        entry.digest = job.digest;
+        index->update(job.expected->path, entry);
+      }
+    }
+    return true;
+  }
+
+} // namespace desktop_updater
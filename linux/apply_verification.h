@@ -0,0 +1,62 @@
+#ifndef DESKTOP_UPDATER_APPLY_VERIFICATION_H_
+#define DESKTOP_UPDATER_APPLY_VERIFICATION_H_
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file_hasher.h"
+#include "hash_index.h"
+#include "manifest.h"
+
+namespace desktop_updater
+{
+
+  // Digests of staged files taken as they were downloaded, keyed by the
+  // staged file's path, with the stat data they were taken at. Shared by
+  // the download threads that record them and the apply that reuses them.
+  class StagedDigests
+  {
+  public:
+    void record(const std::string &path, const HashIndexEntry &entry);
+    bool find(const std::string &path, HashIndexEntry *entry) const;
+    void clear();
+
+  private:
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, HashIndexEntry> entries_;
+  };
+
+  // Whether installed is still the file staged was taken of. A rename into
+  // place keeps the inode, size and modification time; only the change time
+  // moves, so it is not compared.
+  bool same_staged_file(const FileStat &staged, const FileStat &installed);
+
+  struct VerifyStats
+  {
+    size_t reused = 0;
+    size_t hashed = 0;
+  };
+
+  // Checks the files an apply moved into install_dir, listed relative to it
+  // in written, against the expected manifest of the update. Only those
+  // files are looked at. A digest in staged for the file's staging_dir path
+  // is reused when same_staged_file() holds; the rest are hashed in
+  // parallel. Every expected entry must have been written and match in
+  // length and digest; written files the manifest does not list are not
+  // checked. On success the verified files are recorded in index, which may
+  // be null, with their stat data as installed, so the next update check
+  // does not read them again. Returns false, naming the first bad file in
+  // error, otherwise.
+  bool verify_applied_files(FileHasher *hasher, const std::string &install_dir,
+                            const std::string &staging_dir,
+                            const std::vector<std::string> &written,
+                            const std::vector<FileHashEntry> &expected,
+                            const StagedDigests *staged, HashIndex *index,
+                            VerifyStats *stats, std::string *error);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_APPLY_VERIFICATION_H_
@@ -0,0 +1,551 @@
+#include "binary_delta.h"
+
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const char kMagic[4] = {'D', 'U', 'D', 'L'};
+    const size_t kControlTripleSize = 24;
+
+    uint32_t load_u32(const uint8_t *p)
+    {
+      return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+             (static_cast<uint32_t>(p[2]) << 16) |
+             (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    uint64_t load_u64(const uint8_t *p)
+    {
+      return static_cast<uint64_t>(load_u32(p)) |
+             (static_cast<uint64_t>(load_u32(p + 4)) << 32);
+    }
+
+    void append_le(std::string *out, uint64_t value, size_t bytes)
+    {
+      for (size_t i = 0; i < bytes; i++)
+      {
+        out->push_back(static_cast<char>(value >> (8 * i)));
+      }
+    }
+
+    // Larsson and Sadakane's suffix sorting, as bsdiff uses it. group[i] is
+    // the rank group of suffix i; a negative order[i] is the length of a run
+    // of suffixes that are already sorted.
+    class SuffixSorter
+    {
+    public:
+      SuffixSorter(int32_t *order, int32_t *group)
+          : order_(order), group_(group) {}
+
+      void sort(const uint8_t *data, int32_t size)
+      {
+        int32_t buckets[256] = {0};
+        for (int32_t i = 0; i < size; i++)
+        {
+          buckets[data[i]]++;
+        }
+        for (int i = 1; i < 256; i++)
+        {
+          buckets[i] += buckets[i - 1];
+        }
+        for (int i = 255; i > 0; i--)
+        {
+          buckets[i] = buckets[i - 1];
+        }
+        buckets[0] = 0;
+        for (int32_t i = 0; i < size; i++)
+        {
+          order_[++buckets[data[i]]] = i;
+        }
+        order_[0] = size;
+        for (int32_t i = 0; i < size; i++)
+        {
+          group_[i] = buckets[data[i]];
+        }
+        group_[size] = 0;
+        for (int i = 1; i < 256; i++)
+        {
+          if (buckets[i] == buckets[i - 1] + 1)
+          {
+            order_[buckets[i]] = -1;
+          }
+        }
+        order_[0] = -1;
+
+        for (int32_t h = 1; order_[0] != -(size + 1); h += h)
+        {
+          int32_t sorted = 0;
+          int32_t i = 0;
+          while (i < size + 1)
+          {
+            if (order_[i] < 0)
+            {
+              sorted -= order_[i];
+              i -= order_[i];
+              continue;
+            }
+            if (sorted != 0)
+            {
+              order_[i - sorted] = -sorted;
+            }
+            const int32_t length = group_[order_[i]] + 1 - i;
+            split(i, length, h);
+            i += length;
+            sorted = 0;
+          }
+          if (sorted != 0)
+          {
+            order_[i - sorted] = -sorted;
+          }
+        }
+        for (int32_t i = 0; i < size + 1; i++)
+        {
+          order_[group_[i]] = i;
+        }
+      }
+
+    private:
+      int32_t key(int32_t i, int32_t h) const { return group_[order_[i] + h]; }
+
+      void swap(int32_t a, int32_t b) { std::swap(order_[a], order_[b]); }
+
+      // Sorts order_[start, start + length) by the rank h positions ahead.
+      void split(int32_t start, int32_t length, int32_t h)
+      {
+        if (length < 16)
+        {
+          for (int32_t k = start; k < start + length;)
+          {
+            int32_t equal = 1;
+            int32_t x = key(k, h);
+            for (int32_t i = 1; k + i < start + length; i++)
+            {
+              if (key(k + i, h) < x)
+              {
+                x = key(k + i, h);
+                equal = 0;
+              }
+              if (key(k + i, h) == x)
+              {
+                swap(k + equal, k + i);
+                equal++;
+              }
+            }
+            for (int32_t i = 0; i < equal; i++)
+            {
+              group_[order_[k + i]] = k + equal - 1;
+            }
+            if (equal == 1)
+            {
+              order_[k] = -1;
+            }
+            k += equal;
+          }
+          return;
+        }
+
+        const int32_t x = key(start + length / 2, h);
+        int32_t less = 0;
+        int32_t equal = 0;
+        for (int32_t i = start; i < start + length; i++)
+        {
+          if (key(i, h) < x)
+          {
+            less++;
+          }
+          else if (key(i, h) == x)
+          {
+            equal++;
+          }
+        }
+        const int32_t equal_start = start + less;
+        const int32_t greater_start = equal_start + equal;
+        int32_t i = start;
+        int32_t j = 0;
+        int32_t k = 0;
+        while (i < equal_start)
+        {
+          if (key(i, h) < x)
+          {
+            i++;
+          }
+          else if (key(i, h) == x)
+          {
+            swap(i, equal_start + j);
+            j++;
+          }
+          else
+          {
+            swap(i, greater_start + k);
+            k++;
+          }
+        }
+        while (equal_start + j < greater_start)
+        {
+          if (key(equal_start + j, h) == x)
+          {
+            j++;
+          }
+          else
+          {
+            swap(equal_start + j, greater_start + k);
+            k++;
+          }
+        }
+
+        if (equal_start > start)
+        {
+          split(start, equal_start - start, h);
+        }
+        for (int32_t m = 0; m < equal; m++)
+        {
+          group_[order_[equal_start + m]] = greater_start - 1;
+        }
+        if (equal == 1)
+        {
+          order_[equal_start] = -1;
+        }
+        if (start + length > greater_start)
+        {
+          split(greater_start, start + length - greater_start, h);
+        }
+      }
+
+      int32_t *order_;
+      int32_t *group_;
+    };
+
+    int64_t match_length(const uint8_t *a, int64_t a_size, const uint8_t *b,
+                         int64_t b_size)
+    {
+      int64_t i = 0;
+      while (i < a_size && i < b_size && a[i] == b[i])
+      {
+        i++;
+      }
+      return i;
+    }
+
+    // Longest prefix of target found in old, by binary search over its
+    // sorted suffixes.
+    int64_t search(const int32_t *order, const uint8_t *old_data,
+                   int64_t old_size, const uint8_t *target,
+                   int64_t target_size, int64_t start, int64_t end,
+                   int64_t *position)
+    {
+      while (end - start >= 2)
+      {
+        const int64_t middle = start + (end - start) / 2;
+        const int64_t suffix = order[middle];
+        if (memcmp(old_data + suffix, target,
+                   static_cast<size_t>(std::min(old_size - suffix,
+                                                target_size))) < 0)
+        {
+          start = middle;
+        }
+        else
+        {
+          end = middle;
+        }
+      }
+      const int64_t x = match_length(old_data + order[start],
+                                     old_size - order[start], target,
+                                     target_size);
+      const int64_t y = match_length(old_data + order[end],
+                                     old_size - order[end], target,
+                                     target_size);
+      if (x > y)
+      {
+        *position = order[start];
+        return x;
+      }
+      *position = order[end];
+      return y;
+    }
+
+    bool compress(const std::string &data, int level, std::string *out)
+    {
+      out->resize(ZSTD_compressBound(data.size()));
+      const size_t size = ZSTD_compress(&(*out)[0], out->size(), data.data(),
+                                        data.size(), level);
+      if (ZSTD_isError(size))
+      {
+        return false;
+      }
+      out->resize(size);
+      return true;
+    }
+
+    // Decompresses a frame that must fill exactly frame_size bytes and
+    // expand to at most limit bytes.
+    bool decompress(const uint8_t *frame, size_t frame_size, uint64_t limit,
+                    std::string *out)
+    {
+      if (ZSTD_findFrameCompressedSize(frame, frame_size) != frame_size)
+      {
+        return false;
+      }
+      const unsigned long long size =
+          ZSTD_getFrameContentSize(frame, frame_size);
+      if (size == ZSTD_CONTENTSIZE_UNKNOWN ||
+          size == ZSTD_CONTENTSIZE_ERROR || size > limit)
+      {
+        return false;
+      }
+      out->resize(static_cast<size_t>(size));
+      const size_t written = ZSTD_decompress(out->empty() ? nullptr : &(*out)[0],
+                                             out->size(), frame, frame_size);
+      return !ZSTD_isError(written) && written == out->size();
+    }
+  } // namespace
+
+  size_t binary_delta_scratch_size(size_t old_size)
+  {
+    return 2 * (old_size + 1) * sizeof(int32_t);
+  }
+
+  bool make_binary_delta(const uint8_t *old_data, size_t old_size,
+                         const uint8_t *new_data, size_t new_size, int level,
+                         uint8_t *scratch, std::string *delta)
+  {
+    if (old_size > kMaxDeltaSourceSize)
+    {
+      return false;
+    }
+    int32_t *order = reinterpret_cast<int32_t *>(scratch);
+    int32_t *group = order + old_size + 1;
+    SuffixSorter(order, group).sort(old_data, static_cast<int32_t>(old_size));
+
+    const int64_t old_length = static_cast<int64_t>(old_size);
+    const int64_t new_length = static_cast<int64_t>(new_size);
+    std::string control;
+    std::string diff;
+    std::string extra;
+    int64_t scan = 0;
+    int64_t length = 0;
+    int64_t position = 0;
+    int64_t last_scan = 0;
+    int64_t last_position = 0;
+    int64_t last_offset = 0;
+    while (scan < new_length)
+    {
+      // Extend the scan until a match beats continuing the last one by more
+      // than 8 bytes, or the last one simply carries on.
+      int64_t old_score = 0;
+      int64_t scored = scan += length;
+      for (; scan < new_length; scan++)
+      {
+        length = search(order, old_data, old_length, new_data + scan,
+                        new_length - scan, 0, old_length, &position);
+        for (; scored < scan + length; scored++)
+        {
+          if (scored + last_offset < old_length &&
+              old_data[scored + last_offset] == new_data[scored])
+          {
+            old_score++;
+          }
+        }
+        if ((length == old_score && length != 0) || length > old_score + 8)
+        {
+          break;
+        }
+        if (scan + last_offset < old_length &&
+            old_data[scan + last_offset] == new_data[scan])
+        {
+          old_score--;
+        }
+      }
+      if (length == old_score && scan != new_length)
+      {
+        continue;
+      }
+
+      // How far the last match extends forwards, approximately.
+      int64_t forward = 0;
+      {
+        int64_t score = 0;
+        int64_t best = 0;
+        for (int64_t i = 0;
+             last_scan + i < scan && last_position + i < old_length;)
+        {
+          if (old_data[last_position + i] == new_data[last_scan + i])
+          {
+            score++;
+          }
+          i++;
+          if (score * 2 - i > best * 2 - forward)
+          {
+            best = score;
+            forward = i;
+          }
+        }
+      }
+      // How far the new match extends backwards.
+      int64_t backward = 0;
+      if (scan < new_length)
+      {
+        int64_t score = 0;
+        int64_t best = 0;
+        for (int64_t i = 1; scan >= last_scan + i && position >= i; i++)
+        {
+          if (old_data[position - i] == new_data[scan - i])
+          {
+            score++;
+          }
+          if (score * 2 - i > best * 2 - backward)
+          {
+            best = score;
+            backward = i;
+          }
+        }
+      }
+      // Split any overlap where it matches best.
+      if (last_scan + forward > scan - backward)
+      {
+        const int64_t overlap = (last_scan + forward) - (scan - backward);
+        int64_t score = 0;
+        int64_t best = 0;
+        int64_t split = 0;
+        for (int64_t i = 0; i < overlap; i++)
+        {
+          if (new_data[last_scan + forward - overlap + i] ==
+              old_data[last_position + forward - overlap + i])
+          {
+            score++;
+          }
+          if (new_data[scan - backward + i] ==
+              old_data[position - backward + i])
+          {
+            score--;
+          }
+          if (score > best)
+          {
+            best = score;
+            split = i + 1;
+          }
+        }
+        forward += split - overlap;
+        backward -= split;
+      }
+
+      for (int64_t i = 0; i < forward; i++)
+      {
+        diff.push_back(static_cast<char>(new_data[last_scan + i] -
+                                         old_data[last_position + i]));
+      }
+      const int64_t copy = (scan - backward) - (last_scan + forward);
+      extra.append(reinterpret_cast<const char *>(new_data) + last_scan +
+                       forward,
+                   static_cast<size_t>(copy));
+      append_le(&control, static_cast<uint64_t>(forward), 8);
+      append_le(&control, static_cast<uint64_t>(copy), 8);
+      append_le(&control,
+                static_cast<uint64_t>((position - backward) -
+                                      (last_position + forward)),
+                8);
+
+      last_scan = scan - backward;
+      last_position = position - backward;
+      last_offset = position - scan;
+    }
+
+    std::string control_frame;
+    std::string diff_frame;
+    std::string extra_frame;
+    if (!compress(control, level, &control_frame) ||
+        !compress(diff, level, &diff_frame) ||
+        !compress(extra, level, &extra_frame))
+    {
+      return false;
+    }
+    delta->clear();
+    delta->append(kMagic, sizeof(kMagic));
+    append_le(delta, kBinaryDeltaVersion, 4);
+    append_le(delta, old_size, 8);
+    append_le(delta, new_size, 8);
+    append_le(delta, control_frame.size(), 8);
+    append_le(delta, diff_frame.size(), 8);
+    delta->append(control_frame);
+    delta->append(diff_frame);
+    delta->append(extra_frame);
+    return true;
+  }
+
+  bool apply_binary_delta(const uint8_t *old_data, size_t old_size,
+                          const uint8_t *delta, size_t delta_size,
+                          std::string *out)
+  {
+    if (delta_size < kBinaryDeltaHeaderSize ||
+        memcmp(delta, kMagic, sizeof(kMagic)) != 0 ||
+        load_u32(delta + 4) != kBinaryDeltaVersion ||
+        load_u64(delta + 8) != old_size)
+    {
+      return false;
+    }
+    const uint64_t new_size = load_u64(delta + 16);
+    const uint64_t control_size = load_u64(delta + 24);
+    const uint64_t diff_size = load_u64(delta + 32);
+    const uint64_t frames_size = delta_size - kBinaryDeltaHeaderSize;
+    if (control_size > frames_size || diff_size > frames_size - control_size)
+    {
+      return false;
+    }
+    const uint8_t *control_frame = delta + kBinaryDeltaHeaderSize;
+    const uint8_t *diff_frame = control_frame + control_size;
+    const uint8_t *extra_frame = diff_frame + diff_size;
+    std::string control;
+    std::string diff;
+    std::string extra;
+    if (!decompress(control_frame, control_size,
+                    kControlTripleSize * (new_size + 1), &control) ||
+        !decompress(diff_frame, diff_size, new_size, &diff) ||
+        !decompress(extra_frame, frames_size - control_size - diff_size,
+                    new_size, &extra) ||
+        control.size() % kControlTripleSize != 0)
+    {
+      return false;
+    }
+
+    out->clear();
+    out->reserve(static_cast<size_t>(new_size));
+    uint64_t old_position = 0;
+    size_t diff_position = 0;
+    size_t extra_position = 0;
+    for (size_t i = 0; i < control.size(); i += kControlTripleSize)
+    {
+      const uint8_t *triple =
+          reinterpret_cast<const uint8_t *>(control.data()) + i;
+      const uint64_t add = load_u64(triple);
+      const uint64_t copy = load_u64(triple + 8);
+      const uint64_t seek = load_u64(triple + 16);
+      if (add > diff.size() - diff_position || add > old_size - old_position ||
+          copy > extra.size() - extra_position)
+      {
+        return false;
+      }
+      for (uint64_t j = 0; j < add; j++)
+      {
+        out->push_back(static_cast<char>(diff[diff_position + j] +
+                                         old_data[old_position + j]));
+      }
+      diff_position += add;
+      old_position += add;
+      out->append(extra, extra_position, copy);
+      extra_position += copy;
+      // Unsigned wraparound moves backwards for negative seeks.
+      old_position += seek;
+      if (old_position > old_size)
+      {
+        return false;
+      }
+    }
+    return out->size() == new_size && diff_position == diff.size() &&
+           extra_position == extra.size();
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,49 @@
+#ifndef DESKTOP_UPDATER_BINARY_DELTA_H_
+#define DESKTOP_UPDATER_BINARY_DELTA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace desktop_updater
+{
+
+  // bsdiff-style delta that rebuilds a new file from an old one:
+  //
+  //   header   "DUDL" | u32 version | u64 old size | u64 new size |
+  //            u64 control size | u64 diff size
+  //   control  zstd frame of (u64 add | u64 copy | i64 seek) triples
+  //   diff     zstd frame of bytewise differences to the old file
+  //   extra    zstd frame of bytes taken as they are
+  //
+  // Each triple adds the next add bytes of diff to as many bytes of the old
+  // file, appends the next copy bytes of extra and then moves the old file
+  // position by seek. Integers are little-endian.
+  const uint32_t kBinaryDeltaVersion = 1;
+  const size_t kBinaryDeltaHeaderSize = 40;
+
+  // Largest old file a delta can be made from; suffixes are indexed with
+  // 32-bit integers.
+  const size_t kMaxDeltaSourceSize = 0x7ffffffe;
+
+  // Bytes of scratch make_binary_delta() needs for an old file of
+  // old_size bytes: two 32-bit arrays over its suffixes.
+  size_t binary_delta_scratch_size(size_t old_size);
+
+  // Encodes the delta from old_data to new_data with its streams compressed
+  // at zstd level. scratch must hold binary_delta_scratch_size(old_size)
+  // bytes and be suitably aligned for int32_t. Returns false if old_size is
+  // above kMaxDeltaSourceSize or compression fails.
+  bool make_binary_delta(const uint8_t *old_data, size_t old_size,
+                         const uint8_t *new_data, size_t new_size, int level,
+                         uint8_t *scratch, std::string *delta);
+
+  // Rebuilds the new file. Returns false if the delta is malformed or was
+  // made from an old file of another size.
+  bool apply_binary_delta(const uint8_t *old_data, size_t old_size,
+                          const uint8_t *delta, size_t delta_size,
+                          std::string *out);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_BINARY_DELTA_H_
@@ -0,0 +1,224 @@
+#include "binary_manifest.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const char kMagic[4] = {'D', 'U', 'M', 'F'};
+
+    uint16_t load_u16(const uint8_t *p)
+    {
+      return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    uint32_t load_u32(const uint8_t *p)
+    {
+      return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+             (static_cast<uint32_t>(p[2]) << 16) |
+             (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    uint64_t load_u64(const uint8_t *p)
+    {
+      return static_cast<uint64_t>(load_u32(p)) |
+             (static_cast<uint64_t>(load_u32(p + 4)) << 32);
+    }
+
+    void append_le(std::string *out, uint64_t value, size_t bytes)
+    {
+      for (size_t i = 0; i < bytes; i++)
+      {
+        out->push_back(static_cast<char>(value >> (8 * i)));
+      }
+    }
+
+    uint8_t algorithm_id(HashAlgorithm algorithm)
+    {
+      switch (algorithm)
+      {
+      case HashAlgorithm::kBlake2bTree:
+        return 1;
+      case HashAlgorithm::kBlake3:
+        return 2;
+      case HashAlgorithm::kBlake2b:
+        break;
+      }
+      return 0;
+    }
+
+    bool algorithm_from_id(uint8_t id, HashAlgorithm *algorithm)
+    {
+      switch (id)
+      {
+      case 0:
+        *algorithm = HashAlgorithm::kBlake2b;
+        return true;
+      case 1:
+        *algorithm = HashAlgorithm::kBlake2bTree;
+        return true;
+      case 2:
+        *algorithm = HashAlgorithm::kBlake3;
+        return true;
+      }
+      return false;
+    }
+
+    int compare_path(const char *a, size_t a_length, const char *b,
+                     size_t b_length)
+    {
+      const int result = memcmp(a, b, std::min(a_length, b_length));
+      if (result != 0)
+      {
+        return result;
+      }
+      return a_length < b_length ? -1 : (a_length > b_length ? 1 : 0);
+    }
+  } // namespace
+
+  size_t hash_algorithm_digest_size(HashAlgorithm algorithm)
+  {
+    return algorithm == HashAlgorithm::kBlake3 ? 32 : 64;
+  }
+
+  bool encode_binary_manifest(HashAlgorithm algorithm,
+                              const std::vector<FileHashEntry> &entries,
+                              std::string *out)
+  {
+    const size_t digest_size = hash_algorithm_digest_size(algorithm);
+    std::vector<const FileHashEntry *> sorted;
+    sorted.reserve(entries.size());
+    for (const FileHashEntry &entry : entries)
+    {
+      sorted.push_back(&entry);
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](const FileHashEntry *a, const FileHashEntry *b)
+              { return compare_path(a->path.data(), a->path.size(),
+                                    b->path.data(), b->path.size()) < 0; });
+
+    std::string records;
+    std::string digests;
+    std::string strings;
+    std::string digest;
+    for (const FileHashEntry *entry : sorted)
+    {
+      if (entry->algorithm != algorithm ||
+          !base64_decode(entry->calculated_hash, &digest) ||
+          digest.size() != digest_size)
+      {
+        return false;
+      }
+      append_le(&records, strings.size(), 4);
+      append_le(&records, entry->path.size(), 4);
+      append_le(&records, static_cast<uint64_t>(entry->length), 8);
+      append_le(&records, static_cast<uint64_t>(entry->compressed_length), 8);
+      digests.append(digest);
+      strings.append(entry->path);
+    }
+
+    out->assign(kMagic, sizeof(kMagic));
+    append_le(out, kBinaryManifestVersion, 2);
+    out->push_back(static_cast<char>(algorithm_id(algorithm)));
+    out->push_back(static_cast<char>(digest_size));
+    append_le(out, sorted.size(), 4);
+    append_le(out, strings.size(), 4);
+    out->append(records);
+    out->append(digests);
+    out->append(strings);
+    return true;
+  }
+
+  bool ManifestView::parse(const uint8_t *data, size_t size)
+  {
+    if (size < kBinaryManifestHeaderSize || memcmp(data, kMagic, 4) != 0 ||
+        !algorithm_from_id(data[6], &algorithm_))
+    {
+      return false;
+    }
+    switch (load_u16(data + 4))
+    {
+    case 1:
+      record_size_ = kBinaryManifestV1RecordSize;
+      break;
+    case kBinaryManifestVersion:
+      record_size_ = kBinaryManifestRecordSize;
+      break;
+    default:
+      return false;
+    }
+    digest_size_ = data[7];
+    if (digest_size_ != hash_algorithm_digest_size(algorithm_))
+    {
+      return false;
+    }
+    const uint64_t count = load_u32(data + 8);
+    const uint64_t strings_size = load_u32(data + 12);
+    const uint64_t expected = kBinaryManifestHeaderSize +
+                              count * (record_size_ + digest_size_) +
+                              strings_size;
+    if (expected != size)
+    {
+      return false;
+    }
+    const uint8_t *records = data + kBinaryManifestHeaderSize;
+    for (uint64_t i = 0; i < count; i++)
+    {
+      const uint8_t *record = records + i * record_size_;
+      if (static_cast<uint64_t>(load_u32(record)) + load_u32(record + 4) >
+          strings_size)
+      {
+        return false;
+      }
+    }
+    data_ = data;
+    count_ = static_cast<size_t>(count);
+    digests_ = records + count * record_size_;
+    strings_ = reinterpret_cast<const char *>(digests_ + count * digest_size_);
+    return true;
+  }
+
+  ManifestRecord ManifestView::record(size_t index) const
+  {
+    const uint8_t *record =
+        data_ + kBinaryManifestHeaderSize + index * record_size_;
+    ManifestRecord out;
+    out.path = strings_ + load_u32(record);
+    out.path_length = load_u32(record + 4);
+    out.length = load_u64(record + 8);
+    out.compressed_length =
+        record_size_ >= kBinaryManifestRecordSize ? load_u64(record + 16) : 0;
+    out.digest = digests_ + index * digest_size_;
+    return out;
+  }
+
+  bool ManifestView::find(const std::string &path, ManifestRecord *record) const
+  {
+    size_t low = 0;
+    size_t high = count_;
+    while (low < high)
+    {
+      const size_t middle = low + (high - low) / 2;
+      const ManifestRecord candidate = this->record(middle);
+      const int result = compare_path(candidate.path, candidate.path_length,
+                                      path.data(), path.size());
+      if (result == 0)
+      {
+        *record = candidate;
+        return true;
+      }
+      if (result < 0)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+    return false;
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,77 @@
+#ifndef DESKTOP_UPDATER_BINARY_MANIFEST_H_
+#define DESKTOP_UPDATER_BINARY_MANIFEST_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "manifest.h"
+
+namespace desktop_updater
+{
+
+  // Compact binary form of a manifest, read in place without parsing:
+  //
+  //   header   "DUMF" | u16 version | u8 algorithm | u8 digest size |
+  //            u32 entry count | u32 string table size
+  //   records  entry count x (u32 path offset | u32 path length |
+  //            u64 length | u64 compressed length)
+  //   digests  entry count x digest size raw bytes
+  //   strings  UTF-8 paths, not terminated
+  //
+  // Integers are little-endian and records are sorted by path bytes, so a
+  // path is found by binary search. Every entry uses the same algorithm. A
+  // compressed length of 0 means the file has no compressed copy. Version 1
+  // records lack it; they are still read, as runners embed their manifest.
+  const uint16_t kBinaryManifestVersion = 2;
+  const size_t kBinaryManifestHeaderSize = 16;
+  const size_t kBinaryManifestRecordSize = 24;
+  const size_t kBinaryManifestV1RecordSize = 16;
+
+  struct ManifestRecord
+  {
+    const char *path;
+    uint32_t path_length;
+    uint64_t length;
+    uint64_t compressed_length;
+    const uint8_t *digest;
+  };
+
+  // Encodes entries, which must all use algorithm. Returns false if a
+  // digest is not valid base64 of the algorithm's digest size.
+  bool encode_binary_manifest(HashAlgorithm algorithm,
+                              const std::vector<FileHashEntry> &entries,
+                              std::string *out);
+
+  // Zero-copy reader over an encoded manifest. The bytes must outlive the
+  // view; records point straight into them.
+  class ManifestView
+  {
+  public:
+    // Checks the header and that every record lies inside the buffer.
+    bool parse(const uint8_t *data, size_t size);
+
+    HashAlgorithm algorithm() const { return algorithm_; }
+    size_t digest_size() const { return digest_size_; }
+    size_t size() const { return count_; }
+
+    ManifestRecord record(size_t index) const;
+    bool find(const std::string &path, ManifestRecord *record) const;
+
+  private:
+    const uint8_t *data_ = nullptr;
+    HashAlgorithm algorithm_ = HashAlgorithm::kBlake2b;
+    size_t digest_size_ = 0;
+    size_t record_size_ = kBinaryManifestRecordSize;
+    size_t count_ = 0;
+    const uint8_t *digests_ = nullptr;
+    const char *strings_ = nullptr;
+  };
+
+  // Raw digest size of algorithm in bytes.
+  size_t hash_algorithm_digest_size(HashAlgorithm algorithm);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_BINARY_MANIFEST_H_
@@ -0,0 +1,182 @@
+#include "blake2b.h"
+
+#include <cstring>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const uint64_t kIv[8] = {
+        0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+        0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+        0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL};
+
+    const uint8_t kSigma[12][16] = {
+        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+        {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+        {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+        {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+        {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+        {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+        {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+        {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+        {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+        {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+        {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+    inline uint64_t rotr64(uint64_t x, int n)
+    {
+      return (x >> n) | (x << (64 - n));
+    }
+
+    inline uint64_t load64(const uint8_t *p)
+    {
+      uint64_t v = 0;
+      for (int i = 7; i >= 0; i--)
+      {
+        v = (v << 8) | p[i];
+      }
+      return v;
+    }
+
+    inline void store64(uint8_t *p, uint64_t v)
+    {
+      for (int i = 0; i < 8; i++)
+      {
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+      }
+    }
+
+#define BLAKE2B_G(a, b, c, d, x, y) \
+  do                                \
+  {                                 \
+    a = a + b + x;                  \
+    d = rotr64(d ^ a, 32);          \
+    c = c + d;                      \
+    b = rotr64(b ^ c, 24);          \
+    a = a + b + y;                  \
+    d = rotr64(d ^ a, 16);          \
+    c = c + d;                      \
+    b = rotr64(b ^ c, 63);          \
+  } while (0)
+  } // namespace
+
+  Blake2b::Blake2b(const Blake2bParams &params)
+      : buffer_length_(0),
+        digest_length_(params.digest_length),
+        last_node_(params.last_node)
+  {
+    uint8_t block[64] = {};
+    block[0] = params.digest_length;
+    block[1] = 0; // key length
+    block[2] = params.fanout;
+    block[3] = params.depth;
+    for (int i = 0; i < 4; i++)
+    {
+      block[4 + i] = static_cast<uint8_t>(params.leaf_length >> (8 * i));
+    }
+    store64(block + 8, params.node_offset);
+    block[16] = params.node_depth;
+    block[17] = params.inner_length;
+
+    for (int i = 0; i < 8; i++)
+    {
+      h_[i] = kIv[i] ^ load64(block + 8 * i);
+    }
+    t_[0] = 0;
+    t_[1] = 0;
+  }
+
+  void Blake2b::compress(const uint8_t *block, bool last_block)
+  {
+    uint64_t m[16];
+    uint64_t v[16];
+    for (int i = 0; i < 16; i++)
+    {
+      m[i] = load64(block + 8 * i);
+    }
+    for (int i = 0; i < 8; i++)
+    {
+      v[i] = h_[i];
+      v[i + 8] = kIv[i];
+    }
+    v[12] ^= t_[0];
+    v[13] ^= t_[1];
+    if (last_block)
+    {
+      v[14] = ~v[14];
+      if (last_node_)
+      {
+        v[15] = ~v[15];
+      }
+    }
+
+    for (int r = 0; r < 12; r++)
+    {
+      const uint8_t *s = kSigma[r];
+      BLAKE2B_G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+      BLAKE2B_G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+      BLAKE2B_G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+      BLAKE2B_G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+      BLAKE2B_G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+      BLAKE2B_G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+      BLAKE2B_G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+      BLAKE2B_G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+      h_[i] ^= v[i] ^ v[i + 8];
+    }
+  }
+
+  void Blake2b::update(const void *data, size_t length)
+  {
+    const uint8_t *in = static_cast<const uint8_t *>(data);
+    while (length > 0)
+    {
+      // Keep the last block buffered: it must be compressed with the
+      // finalization flag set, which is only known in finish().
+      if (buffer_length_ == kBlockSize)
+      {
+        t_[0] += kBlockSize;
+        if (t_[0] < kBlockSize)
+        {
+          t_[1]++;
+        }
+        compress(buffer_, false);
+        buffer_length_ = 0;
+      }
+      size_t take = kBlockSize - buffer_length_;
+      if (take > length)
+      {
+        take = length;
+      }
+      memcpy(buffer_ + buffer_length_, in, take);
+      buffer_length_ += take;
+      in += take;
+      length -= take;
+    }
+  }
+
+  void Blake2b::finish(uint8_t *out)
+  {
+    t_[0] += buffer_length_;
+    if (t_[0] < buffer_length_)
+    {
+      t_[1]++;
+    }
+    memset(buffer_ + buffer_length_, 0, kBlockSize - buffer_length_);
+    compress(buffer_, true);
+
+    uint8_t digest[kMaxDigestSize];
+    for (int i = 0; i < 8; i++)
+    {
+      store64(digest + 8 * i, h_[i]);
+    }
+    memcpy(out, digest, digest_length_);
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,52 @@
+#ifndef DESKTOP_UPDATER_BLAKE2B_H_
+#define DESKTOP_UPDATER_BLAKE2B_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace desktop_updater
+{
+
+  // BLAKE2b parameter block. The defaults describe plain sequential
+  // BLAKE2b-512, which is what the Dart side computes for legacy manifests.
+  struct Blake2bParams
+  {
+    uint8_t digest_length = 64;
+    uint8_t fanout = 1;
+    uint8_t depth = 1;
+    uint32_t leaf_length = 0;
+    uint64_t node_offset = 0;
+    uint8_t node_depth = 0;
+    uint8_t inner_length = 0;
+    bool last_node = false;
+  };
+
+  // Unkeyed BLAKE2b (RFC 7693) with support for the tree parameters used by
+  // the "blake2b-tree" manifest algorithm.
+  class Blake2b
+  {
+  public:
+    static const size_t kBlockSize = 128;
+    static const size_t kMaxDigestSize = 64;
+
+    explicit Blake2b(const Blake2bParams &params = Blake2bParams());
+
+    void update(const void *data, size_t length);
+
+    // Writes the digest (params.digest_length bytes) to out.
+    void finish(uint8_t *out);
+
+  private:
+    void compress(const uint8_t *block, bool last_block);
+
+    uint64_t h_[8];
+    uint64_t t_[2];
+    uint8_t buffer_[kBlockSize];
+    size_t buffer_length_;
+    size_t digest_length_;
+    bool last_node_;
+  };
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_BLAKE2B_H_
@@ -0,0 +1,345 @@
+#include "blake3.h"
+
+#include <cstring>
+#include <vector>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const uint32_t kIv[8] = {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+        0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+
+    const uint8_t kSchedule[7][16] = {
+        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+        {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+        {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+        {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+        {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+        {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+        {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13}};
+
+    const uint32_t kChunkStart = 1 << 0;
+    const uint32_t kChunkEnd = 1 << 1;
+    const uint32_t kParent = 1 << 2;
+    const uint32_t kRoot = 1 << 3;
+
+    const size_t kBlockSize = 64;
+    const size_t kBlocksPerChunk = kBlake3ChunkSize / kBlockSize;
+
+    inline uint32_t load32(const uint8_t *p)
+    {
+      return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+             (static_cast<uint32_t>(p[2]) << 16) |
+             (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    inline void store32(uint8_t *p, uint32_t v)
+    {
+      p[0] = static_cast<uint8_t>(v);
+      p[1] = static_cast<uint8_t>(v >> 8);
+      p[2] = static_cast<uint8_t>(v >> 16);
+      p[3] = static_cast<uint8_t>(v >> 24);
+    }
+
+    // The quarter-round works unchanged on scalars and on GCC/Clang vector
+    // types, so the portable and SIMD paths share one definition.
+#define BLAKE3_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define BLAKE3_G(a, b, c, d, x, y) \
+  do                               \
+  {                                \
+    a = a + b + (x);               \
+    d = BLAKE3_ROTR(d ^ a, 16);    \
+    c = c + d;                     \
+    b = BLAKE3_ROTR(b ^ c, 12);    \
+    a = a + b + (y);               \
+    d = BLAKE3_ROTR(d ^ a, 8);     \
+    c = c + d;                     \
+    b = BLAKE3_ROTR(b ^ c, 7);     \
+  } while (0)
+#define BLAKE3_ROUNDS(v, m)                                              \
+  for (int r = 0; r < 7; r++)                                            \
+  {                                                                      \
+    const uint8_t *s = kSchedule[r];                                     \
+    BLAKE3_G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);                 \
+    BLAKE3_G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);                 \
+    BLAKE3_G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);                \
+    BLAKE3_G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);                \
+    BLAKE3_G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);                \
+    BLAKE3_G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);              \
+    BLAKE3_G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);               \
+    BLAKE3_G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);               \
+  }
+
+    void compress(const uint32_t cv[8], const uint32_t m[16],
+                  uint32_t block_length, uint64_t counter, uint32_t flags,
+                  uint32_t out[8])
+    {
+      uint32_t v[16] = {
+          cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+          kIv[0], kIv[1], kIv[2], kIv[3],
+          static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32),
+          block_length, flags};
+      BLAKE3_ROUNDS(v, m);
+      for (int i = 0; i < 8; i++)
+      {
+        out[i] = v[i] ^ v[i + 8];
+      }
+    }
+
+    // Compresses one chunk of up to kBlake3ChunkSize bytes.
+    void hash_chunk_scalar(const uint8_t *input, size_t length,
+                           uint64_t counter, uint32_t extra_end_flags,
+                           uint32_t cv[8])
+    {
+      memcpy(cv, kIv, sizeof(kIv));
+      const size_t blocks = length == 0 ? 1 : (length + kBlockSize - 1) / kBlockSize;
+      for (size_t b = 0; b < blocks; b++)
+      {
+        uint8_t block[kBlockSize] = {};
+        const size_t offset = b * kBlockSize;
+        const size_t block_length =
+            length - offset < kBlockSize ? length - offset : kBlockSize;
+        memcpy(block, input + offset, block_length);
+        uint32_t m[16];
+        for (int i = 0; i < 16; i++)
+        {
+          m[i] = load32(block + 4 * i);
+        }
+        uint32_t flags = 0;
+        if (b == 0)
+        {
+          flags |= kChunkStart;
+        }
+        if (b + 1 == blocks)
+        {
+          flags |= kChunkEnd | extra_end_flags;
+        }
+        compress(cv, m, static_cast<uint32_t>(block_length), counter, flags, cv);
+      }
+    }
+
+    // Hashes Lanes full, consecutive chunks at once, one chunk per vector
+    // lane. Instantiated once per SIMD width inside functions compiled for
+    // the matching instruction set.
+    template <typename V, int Lanes>
+    inline __attribute__((always_inline)) void hash_chunks_lanes(
+        const uint8_t *input, uint64_t counter, Blake3Cv *out)
+    {
+      V h[8];
+      for (int i = 0; i < 8; i++)
+      {
+        h[i] = V{} + kIv[i];
+      }
+      V counter_low = {};
+      V counter_high = {};
+      for (int lane = 0; lane < Lanes; lane++)
+      {
+        const uint64_t c = counter + static_cast<uint64_t>(lane);
+        counter_low[lane] = static_cast<uint32_t>(c);
+        counter_high[lane] = static_cast<uint32_t>(c >> 32);
+      }
+
+      for (size_t b = 0; b < kBlocksPerChunk; b++)
+      {
+        V m[16] = {};
+        for (int w = 0; w < 16; w++)
+        {
+          for (int lane = 0; lane < Lanes; lane++)
+          {
+            m[w][lane] = load32(input + lane * kBlake3ChunkSize + b * kBlockSize + 4 * w);
+          }
+        }
+        uint32_t flags = 0;
+        if (b == 0)
+        {
+          flags |= kChunkStart;
+        }
+        if (b + 1 == kBlocksPerChunk)
+        {
+          flags |= kChunkEnd;
+        }
+        V v[16] = {
+            h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+            V{} + kIv[0], V{} + kIv[1], V{} + kIv[2], V{} + kIv[3],
+            counter_low, counter_high,
+            V{} + static_cast<uint32_t>(kBlockSize), V{} + flags};
+        BLAKE3_ROUNDS(v, m);
+        for (int i = 0; i < 8; i++)
+        {
+          h[i] = v[i] ^ v[i + 8];
+        }
+      }
+
+      for (int lane = 0; lane < Lanes; lane++)
+      {
+        for (int i = 0; i < 8; i++)
+        {
+          out[lane].words[i] = h[i][lane];
+        }
+      }
+    }
+
+    typedef uint32_t U32x4 __attribute__((vector_size(16)));
+
+    void hash_chunks_x4(const uint8_t *input, uint64_t counter, Blake3Cv *out)
+    {
+      hash_chunks_lanes<U32x4, 4>(input, counter, out);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DESKTOP_UPDATER_BLAKE3_X86 1
+    typedef uint32_t U32x8 __attribute__((vector_size(32)));
+    typedef uint32_t U32x16 __attribute__((vector_size(64)));
+
+    __attribute__((target("avx2"))) void hash_chunks_avx2(
+        const uint8_t *input, uint64_t counter, Blake3Cv *out)
+    {
+      hash_chunks_lanes<U32x8, 8>(input, counter, out);
+    }
+
+    __attribute__((target("avx512f"))) void hash_chunks_avx512(
+        const uint8_t *input, uint64_t counter, Blake3Cv *out)
+    {
+      hash_chunks_lanes<U32x16, 16>(input, counter, out);
+    }
+#endif
+
+    struct Backend
+    {
+      const char *name;
+      size_t lanes;
+      void (*hash_chunks)(const uint8_t *, uint64_t, Blake3Cv *);
+    };
+
+    Backend select_backend()
+    {
+#ifdef DESKTOP_UPDATER_BLAKE3_X86
+      if (__builtin_cpu_supports("avx512f"))
+      {
+        return Backend{"avx512", 16, hash_chunks_avx512};
+      }
+      if (__builtin_cpu_supports("avx2"))
+      {
+        return Backend{"avx2", 8, hash_chunks_avx2};
+      }
+#endif
+      return Backend{"portable", 4, hash_chunks_x4};
+    }
+
+    const Backend &backend()
+    {
+      static const Backend selected = select_backend();
+      return selected;
+    }
+
+    void parent_cv(const Blake3Cv &left, const Blake3Cv &right, uint32_t flags,
+                   uint32_t out[8])
+    {
+      uint32_t m[16];
+      memcpy(m, left.words, sizeof(left.words));
+      memcpy(m + 8, right.words, sizeof(right.words));
+      compress(kIv, m, kBlockSize, 0, kParent | flags, out);
+    }
+
+    Blake3Cv merge_range(const Blake3Cv *cvs, size_t count)
+    {
+      if (count == 1)
+      {
+        return cvs[0];
+      }
+      size_t left = 1;
+      while (left * 2 < count)
+      {
+        left *= 2;
+      }
+      const Blake3Cv left_cv = merge_range(cvs, left);
+      const Blake3Cv right_cv = merge_range(cvs + left, count - left);
+      Blake3Cv cv;
+      parent_cv(left_cv, right_cv, 0, cv.words);
+      return cv;
+    }
+  } // namespace
+
+  void blake3_chunk_cvs(const uint8_t *input, size_t length,
+                        uint64_t chunk_counter, Blake3Cv *out)
+  {
+    const Backend &simd = backend();
+    size_t full_chunks = length / kBlake3ChunkSize;
+    size_t index = 0;
+    while (index + simd.lanes <= full_chunks)
+    {
+      simd.hash_chunks(input + index * kBlake3ChunkSize, chunk_counter + index,
+                       out + index);
+      index += simd.lanes;
+    }
+    while (index < full_chunks)
+    {
+      hash_chunk_scalar(input + index * kBlake3ChunkSize, kBlake3ChunkSize,
+                        chunk_counter + index, 0, out[index].words);
+      index++;
+    }
+    const size_t tail = length - full_chunks * kBlake3ChunkSize;
+    if (tail > 0 || length == 0)
+    {
+      hash_chunk_scalar(input + full_chunks * kBlake3ChunkSize, tail,
+                        chunk_counter + index, 0, out[index].words);
+    }
+  }
+
+  void blake3_merge(const Blake3Cv *cvs, size_t count, bool root,
+                    Blake3Cv *cv, uint8_t *digest)
+  {
+    if (!root)
+    {
+      *cv = merge_range(cvs, count);
+      return;
+    }
+    size_t left = 1;
+    while (left * 2 < count)
+    {
+      left *= 2;
+    }
+    uint32_t out[8];
+    parent_cv(merge_range(cvs, left), merge_range(cvs + left, count - left),
+              kRoot, out);
+    for (int i = 0; i < 8; i++)
+    {
+      store32(digest + 4 * i, out[i]);
+    }
+  }
+
+  void blake3_single_chunk(const uint8_t *input, size_t length,
+                           uint8_t *digest)
+  {
+    uint32_t cv[8];
+    hash_chunk_scalar(input, length, 0, kRoot, cv);
+    for (int i = 0; i < 8; i++)
+    {
+      store32(digest + 4 * i, cv[i]);
+    }
+  }
+
+  std::string blake3_hash(const void *data, size_t length)
+  {
+    const uint8_t *input = static_cast<const uint8_t *>(data);
+    std::string digest(kBlake3OutSize, '\0');
+    uint8_t *out = reinterpret_cast<uint8_t *>(&digest[0]);
+    if (length <= kBlake3ChunkSize)
+    {
+      blake3_single_chunk(input, length, out);
+      return digest;
+    }
+    std::vector<Blake3Cv> cvs((length + kBlake3ChunkSize - 1) / kBlake3ChunkSize);
+    blake3_chunk_cvs(input, length, 0, cvs.data());
+    blake3_merge(cvs.data(), cvs.size(), true, nullptr, out);
+    return digest;
+  }
+
+  const char *blake3_backend_name()
+  {
+    return backend().name;
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,47 @@
+#ifndef DESKTOP_UPDATER_BLAKE3_H_
+#define DESKTOP_UPDATER_BLAKE3_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace desktop_updater
+{
+
+  const size_t kBlake3ChunkSize = 1024;
+  const size_t kBlake3OutSize = 32;
+
+  // BLAKE3 chaining value: the 32-byte output of a non-root tree node.
+  struct Blake3Cv
+  {
+    uint32_t words[8];
+  };
+
+  // Chaining values of the consecutive chunks in input, which must start at
+  // chunk index chunk_counter. Only the last chunk may be shorter than
+  // kBlake3ChunkSize. Full chunks are compressed several at a time with the
+  // widest SIMD backend the CPU supports.
+  void blake3_chunk_cvs(const uint8_t *input, size_t length,
+                        uint64_t chunk_counter, Blake3Cv *out);
+
+  // Folds the chaining values of consecutive subtrees into their parent
+  // following BLAKE3's left-full tree layout. Every subtree but the last must
+  // span the same power-of-two number of chunks. With root set, count must be
+  // at least 2 and the 32-byte digest is written to digest; otherwise the
+  // parent's chaining value is returned through cv.
+  void blake3_merge(const Blake3Cv *cvs, size_t count, bool root,
+                    Blake3Cv *cv, uint8_t *digest);
+
+  // Digest of an input that fits in one chunk.
+  void blake3_single_chunk(const uint8_t *input, size_t length,
+                           uint8_t *digest);
+
+  // One-shot BLAKE3-256 of an in-memory buffer.
+  std::string blake3_hash(const void *data, size_t length);
+
+  // Name of the SIMD backend selected for this CPU, for diagnostics.
+  const char *blake3_backend_name();
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_BLAKE3_H_
@@ -0,0 +1,142 @@
+#include "build_manifest.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace desktop_updater
+{
+
+  const char kBuildManifestSection[] = ".desktop_updater_manifest";
+  const char kBuildManifestSidecar[] = "data/desktop_updater_manifest.bin";
+
+  MappedFile::~MappedFile() { close(); }
+
+  bool MappedFile::open(const std::string &path)
+  {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+      ::close(fd);
+      return false;
+    }
+    void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                      MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+      return false;
+    }
+    data_ = static_cast<uint8_t *>(data);
+    size_ = static_cast<size_t>(st.st_size);
+    ctime_ns_ = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 +
+                st.st_ctim.tv_nsec;
+    return true;
+  }
+
+  void MappedFile::close()
+  {
+    if (data_ != nullptr)
+    {
+      munmap(data_, size_);
+      data_ = nullptr;
+      size_ = 0;
+    }
+    ctime_ns_ = 0;
+  }
+
+  bool find_elf_section(const uint8_t *image, size_t size, const char *name,
+                        uint64_t *offset, uint64_t *length)
+  {
+    Elf64_Ehdr header;
+    if (size < sizeof(header))
+    {
+      return false;
+    }
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 ||
+        header.e_ident[EI_CLASS] != ELFCLASS64 ||
+        header.e_ident[EI_DATA] != ELFDATA2LSB ||
+        header.e_shentsize != sizeof(Elf64_Shdr) ||
+        header.e_shstrndx == SHN_UNDEF || header.e_shstrndx >= header.e_shnum)
+    {
+      return false;
+    }
+    if (header.e_shoff > size ||
+        static_cast<uint64_t>(header.e_shnum) * sizeof(Elf64_Shdr) >
+            size - header.e_shoff)
+    {
+      return false;
+    }
+
+    auto section = [&](size_t index)
+    {
+      Elf64_Shdr out;
+      memcpy(&out, image + header.e_shoff + index * sizeof(Elf64_Shdr),
+             sizeof(out));
+      return out;
+    };
+
+    const Elf64_Shdr names = section(header.e_shstrndx);
+    if (names.sh_offset > size || names.sh_size > size - names.sh_offset)
+    {
+      return false;
+    }
+    const char *table = reinterpret_cast<const char *>(image + names.sh_offset);
+    const size_t name_length = strlen(name);
+
+    for (size_t i = 0; i < header.e_shnum; i++)
+    {
+      const Elf64_Shdr candidate = section(i);
+      if (candidate.sh_name + name_length >= names.sh_size ||
+          memcmp(table + candidate.sh_name, name, name_length + 1) != 0)
+      {
+        continue;
+      }
+      if (candidate.sh_type == SHT_NOBITS || candidate.sh_offset > size ||
+          candidate.sh_size > size - candidate.sh_offset)
+      {
+        return false;
+      }
+      *offset = candidate.sh_offset;
+      *length = candidate.sh_size;
+      return true;
+    }
+    return false;
+  }
+
+  bool BuildManifest::load(const std::string &executable,
+                           const std::string &bundle_dir)
+  {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    if (file_.open(executable) &&
+        find_elf_section(file_.data(), file_.size(), kBuildManifestSection,
+                         &offset, &length) &&
+        view_.parse(file_.data() + offset, static_cast<size_t>(length)))
+    {
+      source_ = "section";
+      return true;
+    }
+    if (file_.open(bundle_dir + "/" + kBuildManifestSidecar) &&
+        view_.parse(file_.data(), file_.size()))
+    {
+      source_ = "sidecar";
+      return true;
+    }
+    file_.close();
+    view_ = ManifestView();
+    return false;
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,73 @@
+#ifndef DESKTOP_UPDATER_BUILD_MANIFEST_H_
+#define DESKTOP_UPDATER_BUILD_MANIFEST_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "binary_manifest.h"
+
+namespace desktop_updater
+{
+
+  // ELF section the release tooling stores the binary manifest in.
+  extern const char kBuildManifestSection[];
+  // Sidecar used when the manifest cannot be embedded, relative to the
+  // bundle directory.
+  extern const char kBuildManifestSidecar[];
+
+  // Read-only private mapping of a whole file.
+  class MappedFile
+  {
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+    // Status change time of the file when it was opened, in nanoseconds.
+    int64_t ctime_ns() const { return ctime_ns_; }
+
+  private:
+    uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    int64_t ctime_ns_ = 0;
+  };
+
+  // Locates a section by name in a 64-bit little-endian ELF image and
+  // returns its file range. Only the headers are touched, so with a mapped
+  // image the rest of the binary is never paged in.
+  bool find_elf_section(const uint8_t *image, size_t size, const char *name,
+                        uint64_t *offset, uint64_t *length);
+
+  // The manifest the release pipeline recorded for this bundle, so the
+  // client knows what each file should contain without hashing it. Looked
+  // up in the executable's kBuildManifestSection first and in the sidecar
+  // otherwise. The file carrying the manifest is never listed in it.
+  class BuildManifest
+  {
+  public:
+    bool load(const std::string &executable, const std::string &bundle_dir);
+
+    const ManifestView &view() const { return view_; }
+    // Where the manifest was found: "section" or "sidecar".
+    const char *source() const { return source_; }
+    // When the file carrying the manifest was installed (its ctime). Files
+    // changed after the install do not match the manifest any more.
+    int64_t installed_ns() const { return file_.ctime_ns(); }
+
+  private:
+    MappedFile file_;
+    ManifestView view_;
+    const char *source_ = "";
+  };
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_BUILD_MANIFEST_H_
@@ -0,0 +1,101 @@
+#include "cancellation.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+
+namespace desktop_updater
+{
+
+  CancellationToken::CancellationToken()
+      : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+
+  CancellationToken::~CancellationToken()
+  {
+    if (fd_ >= 0)
+    {
+      close(fd_);
+    }
+  }
+
+  void CancellationToken::cancel()
+  {
+    if (cancelled_.exchange(true, std::memory_order_acq_rel))
+    {
+      return;
+    }
+    const uint64_t one = 1;
+    while (write(fd_, &one, sizeof(one)) < 0 && errno == EINTR)
+    {
+    }
+  }
+
+  void CancellationToken::reset()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      reset_pending_ = false;
+    }
+    clear();
+  }
+
+  bool CancellationToken::reset_when_idle()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (active_ > 0)
+    {
+      reset_pending_ = true;
+      return false;
+    }
+    reset_pending_ = false;
+    clear();
+    return true;
+  }
+
+  void CancellationToken::clear()
+  {
+    uint64_t count;
+    while (read(fd_, &count, sizeof(count)) < 0 && errno == EINTR)
+    {
+    }
+    cancelled_.store(false, std::memory_order_release);
+  }
+
+  bool CancellationToken::wait_idle(int timeout_ms)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return idle_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                             [this]()
+                             { return active_ == 0; });
+  }
+
+  size_t CancellationToken::active() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return active_;
+  }
+
+  CancellationToken::Work::Work(CancellationToken *token) : token_(token)
+  {
+    std::lock_guard<std::mutex> lock(token_->mutex_);
+    token_->active_++;
+  }
+
+  CancellationToken::Work::~Work()
+  {
+    std::lock_guard<std::mutex> lock(token_->mutex_);
+    if (--token_->active_ == 0)
+    {
+      if (token_->reset_pending_)
+      {
+        token_->reset_pending_ = false;
+        token_->clear();
+      }
+      token_->idle_cv_.notify_all();
+    }
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,86 @@
+#ifndef DESKTOP_UPDATER_CANCELLATION_H_
+#define DESKTOP_UPDATER_CANCELLATION_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+namespace desktop_updater
+{
+
+  // Cooperative cancellation shared by every native update stage: the
+  // directory walk, hashing, downloads and the apply step. Stages check
+  // cancelled() between units of work small enough to keep the latency of
+  // a cancel in the tens of milliseconds, and code that blocks in poll()
+  // adds fd() to its poll set, which becomes readable on cancel().
+  //
+  // Each running stage holds a Work scope, so whoever cancels can wait for
+  // the stages to wind down before removing what they were writing.
+  class CancellationToken
+  {
+  public:
+    CancellationToken();
+    ~CancellationToken();
+
+    CancellationToken(const CancellationToken &) = delete;
+    CancellationToken &operator=(const CancellationToken &) = delete;
+
+    // Marks the token cancelled and makes fd() readable. Idempotent.
+    void cancel();
+    bool cancelled() const
+    {
+      return cancelled_.load(std::memory_order_acquire);
+    }
+    // Makes the token usable for the next update. Stages still holding a
+    // Work scope should have been waited for first.
+    void reset();
+    // Resets now if no Work scope is held and returns true. Otherwise the
+    // token stays cancelled, so stages still winding down keep stopping,
+    // and is reset when the last scope ends.
+    bool reset_when_idle();
+
+    // eventfd that is readable while the token is cancelled. Never read it;
+    // reset() clears it.
+    int fd() const { return fd_; }
+
+    // Blocks until no Work scope is held, or timeout_ms passes. Returns
+    // whether the stages went idle.
+    bool wait_idle(int timeout_ms);
+    size_t active() const;
+
+    // Counts a running stage for wait_idle().
+    class Work
+    {
+    public:
+      explicit Work(CancellationToken *token);
+      ~Work();
+
+      Work(const Work &) = delete;
+      Work &operator=(const Work &) = delete;
+
+    private:
+      CancellationToken *token_;
+    };
+
+  private:
+    // Drains fd() and clears the flag.
+    void clear();
+
+    std::atomic<bool> cancelled_{false};
+    int fd_ = -1;
+    mutable std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    size_t active_ = 0;
+    bool reset_pending_ = false;
+  };
+
+  // Whether token is cancelled; a null token never is.
+  inline bool is_cancelled(const CancellationToken *token)
+  {
+    return token != nullptr && token->cancelled();
+  }
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_CANCELLATION_H_
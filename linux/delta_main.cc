@@ -0,0 +1,144 @@
+// Makes deltas from earlier releases to the newest one in a dist folder as
+// bin/archive.dart leaves it, so clients on those releases can download
+// changed files as deltas:
+//
+//   desktop_updater_delta DIST [--platform NAME] [--versions N]
+//       [--level N] [--memory MIB]
+//
+// Run it after the archive step. The newest dist/<build> release gets a
+// delta from each of the N releases before it (3 by default) for every
+// file that changed, stored below its deltas/ folder and listed in its
+// deltas.json. Files are diffed in parallel; --memory caps the suffix
+// arrays and buffers of the files in progress (1024 MiB by default), at
+// about ten bytes per byte of file.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "memory_budget.h"
+#include "release_delta.h"
+#include "thread_pool.h"
+
+namespace
+{
+
+  void usage()
+  {
+    fprintf(stderr,
+            "usage: desktop_updater_delta DIST [--platform NAME] "
+            "[--versions N]\n"
+            "    [--level N] [--memory MIB]\n");
+  }
+
+  bool parse_count(const std::string &text, long *value)
+  {
+    char *end = nullptr;
+    *value = strtol(text.c_str(), &end, 10);
+    return !text.empty() && *end == '\0' && *value > 0;
+  }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  std::string dist;
+  std::string platform = "linux";
+  long versions = 3;
+  long level = 19;
+  long memory_mib = 1024;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string flag = argv[i];
+    if (flag.compare(0, 2, "--") != 0 && dist.empty())
+    {
+      dist = flag;
+      continue;
+    }
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 2;
+    }
+    const std::string value = argv[++i];
+    bool ok = true;
+    if (flag == "--platform")
+    {
+      platform = value;
+    }
+    else if (flag == "--versions")
+    {
+      ok = parse_count(value, &versions);
+    }
+    else if (flag == "--level")
+    {
+      ok = parse_count(value, &level);
+    }
+    else if (flag == "--memory")
+    {
+      ok = parse_count(value, &memory_mib);
+    }
+    else
+    {
+      ok = false;
+    }
+    if (!ok)
+    {
+      usage();
+      return 2;
+    }
+  }
+  if (dist.empty())
+  {
+    usage();
+    return 2;
+  }
+
+  const std::vector<std::string> bundles =
+      desktop_updater::find_release_bundles(dist, platform);
+  if (bundles.empty())
+  {
+    fprintf(stderr, "desktop_updater_delta: no %s release in %s\n",
+            platform.c_str(), dist.c_str());
+    return 1;
+  }
+  const std::string &release = bundles.back();
+  // Newest first, so a file that is the same in two bases gets its delta
+  // from the newer one.
+  std::vector<std::string> bases;
+  for (size_t i = bundles.size() - 1;
+       i > 0 && bases.size() < static_cast<size_t>(versions); i--)
+  {
+    bases.push_back(bundles[i - 1]);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  desktop_updater::MemoryBudget budget(static_cast<size_t>(memory_mib) << 20);
+  desktop_updater::ReleaseDeltaOptions options;
+  options.level = static_cast<int>(level);
+  options.budget = &budget;
+  desktop_updater::ThreadPool pool;
+  std::vector<desktop_updater::DeltaIndexEntry> entries;
+  desktop_updater::ReleaseDeltaStats stats;
+  if (!desktop_updater::make_release_deltas(&pool, release, bases, options,
+                                            &entries, &stats))
+  {
+    fprintf(stderr, "desktop_updater_delta: cannot make deltas for %s\n",
+            release.c_str());
+    return 1;
+  }
+
+  printf("%s: %zu deltas from %zu releases for %zu changed files, "
+         "%llu bytes instead of %llu, %.0f ms on %zu threads, "
+         "%zu MiB peak buffers\n",
+         release.c_str(), stats.deltas, bases.size(), stats.changed_files,
+         static_cast<unsigned long long>(stats.delta_bytes),
+         static_cast<unsigned long long>(stats.full_bytes),
+         std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count(),
+         pool.size(), budget.peak() >> 20);
+  return 0;
+}
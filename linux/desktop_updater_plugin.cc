@@ -2,16 +2,47 @@
 
 #include <flutter_linux/flutter_linux.h>
 #include <gtk/gtk.h>
+#include <glib-unix.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <libgen.h>
+#include <atomic>
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 #include <linux/limits.h>
 
+#include "apply_verification.h"
+#include "binary_manifest.h"
+#include "build_manifest.h"
+#include "cancellation.h"
+#include "directory_watcher.h"
+#ifdef DESKTOP_UPDATER_CURL
+#include "downloader.h"
+#endif
+#include "event_ring.h"
+#include "file_hasher.h"
+#include "hash_index.h"
+#include "manifest.h"
+#include "memory_budget.h"
+#include "merkle.h"
+#include "rate_limiter.h"
+#include "restart_metrics.h"
+#include "rollback.h"
+#include "shared_hash_index.h"
+#include "staged_update.h"
+#include "startup_profile.h"
+#include "thread_pool.h"
+#include "work_scheduler.h"
+#include "worker_priority.h"
+
 // Forward declarations
 FlMethodResponse *get_platform_version();
 
@@ -89,6 +120,55 @@ void runUpdateScript()
   }
 }
 
+// Files an applied update replaced are kept here, below the install, until
+// the relaunched app shows its first frame.
+static const char kRollbackDirectory[] = "rollback";
+
+// How long the relaunched app has to show its first frame before the update
+// is rolled back.
+static const int kHealthTimeoutMs = 60 * 1000;
+
+// The desktop_updater_supervisor target of linux/CMakeLists.txt, relative to
+// the install.
+static const char kSupervisorExecutable[] = "lib/desktop_updater_supervisor";
+
+// Starts the executable as a new process of its own, without waiting for
+// this one to exit. When the update left a snapshot, the child execs the
+// supervisor instead, which stays behind until the new app reports its
+// first frame over a pipe. If it crashes or hangs before that, the
+// supervisor rolls the update back and starts the old version. Everything
+// is prepared before fork(), since the child of this multithreaded process
+// may only make async-signal-safe calls until it execs.
+static bool relaunch(const char *executable_path,
+                     const std::string &install_dir)
+{
+  const std::string snapshot = install_dir + "/" + kRollbackDirectory;
+  const std::string supervisor = install_dir + "/" + kSupervisorExecutable;
+  const std::string timeout = std::to_string(kHealthTimeoutMs);
+  std::vector<const char *> argv;
+  struct stat st;
+  if (stat(snapshot.c_str(), &st) == 0 &&
+      access(supervisor.c_str(), X_OK) == 0)
+  {
+    argv = {supervisor.c_str(), install_dir.c_str(), snapshot.c_str(),
+            timeout.c_str(), executable_path, nullptr};
+  }
+  else
+  {
+    // Without a snapshot or a supervisor there is nothing to roll back to.
+    desktop_updater::discard_update_snapshot(snapshot);
+    argv = {executable_path, nullptr};
+  }
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    setsid();
+    execv(argv[0], const_cast<char *const *>(argv.data()));
+    _exit(1);
+  }
+  return pid > 0;
+}
+
 // Implementation of get_platform_version
 FlMethodResponse *get_platform_version()
 {
@@ -106,10 +186,1152 @@ FlMethodResponse *get_platform_version()
 struct _DesktopUpdaterPlugin
 {
   GObject parent_instance;
+
+  // Native worker pool shared by the update stages.
+  desktop_updater::ThreadPool *pool;
+  // Caps in-flight buffer memory across all stages running on the pool.
+  desktop_updater::MemoryBudget *memory_budget;
+  // Disk and network rate limits shared by the stages, see setRateLimits.
+  desktop_updater::IoLimits *io_limits;
+  desktop_updater::FileHasher *hasher;
+#ifdef DESKTOP_UPDATER_CURL
+  // Native downloads, see downloadFile, and the ones in flight. Concurrent
+  // downloads share its connections.
+  desktop_updater::Downloader *downloader;
+  desktop_updater::DownloadRegistry *downloads;
+#endif
+  // Digests of the files downloadFile staged, reused by the check after
+  // applyUpdate moves them into place.
+  desktop_updater::StagedDigests *staged_digests;
+  // Cancels the hashing, downloads and apply in flight, see cancelUpdate.
+  desktop_updater::CancellationToken *cancel;
+  // Optional inotify tracking of the install directory, see setDirtyTracking.
+  desktop_updater::DirectoryWatcher *watcher;
+  // Workers run at idle CPU and I/O priority while background_priority is
+  // set, unless foreground_boost is; see apply_worker_priority.
+  bool background_priority;
+  bool foreground_boost;
+  bool workers_in_background;
+  // Work native threads hand to the main loop, drained by events_source.
+  desktop_updater::EventRing *events;
+  guint events_source;
+  // When applyUpdate last moved an update into place, as boottime_ns(), for
+  // the restart record; 0 if it has not since the last restartApp.
+  std::atomic<int64_t> applied_ns;
 };
 
 G_DEFINE_TYPE(DesktopUpdaterPlugin, desktop_updater_plugin, g_object_get_type())
 
+// A response computed on a worker thread, waiting to be sent from the GTK
+// main loop.
+struct PendingResponse
+{
+  DesktopUpdaterPlugin *plugin;
+  FlMethodCall *method_call;
+  FlMethodResponse *response;
+};
+
+static void respond_on_main_thread(void *user_data)
+{
+  PendingResponse *pending = static_cast<PendingResponse *>(user_data);
+  fl_method_call_respond(pending->method_call, pending->response, nullptr);
+  g_object_unref(pending->response);
+  g_object_unref(pending->method_call);
+  g_object_unref(pending->plugin);
+  delete pending;
+}
+
+// Most events run per main loop wakeup. A backlog is worked off over
+// several iterations so input and frames are handled in between.
+static const size_t kEventsPerDispatch = 1024;
+// Events that can wait for the main loop before producers are held up.
+static const size_t kEventRingCapacity = 16384;
+
+static gboolean drain_events_cb(gint fd, GIOCondition condition,
+                                gpointer user_data)
+{
+  DesktopUpdaterPlugin *self = static_cast<DesktopUpdaterPlugin *>(user_data);
+  self->events->drain(kEventsPerDispatch);
+  return G_SOURCE_CONTINUE;
+}
+
+// Runs run(data) on the main loop. Safe to call from any thread but the
+// main one; everything posted before the next wakeup is handled in one
+// batch there, instead of a main loop source per event.
+static void post_to_main_loop(DesktopUpdaterPlugin *self, void (*run)(void *),
+                              void *data)
+{
+  desktop_updater::MainLoopEvent event;
+  event.run = run;
+  event.data = data;
+  self->events->push(event);
+}
+
+// Runs work off the main thread so long native jobs do not block the UI, then
+// responds to method_call once it completes. The plugin is kept alive until
+// the response has been sent.
+static void respond_async(DesktopUpdaterPlugin *self, FlMethodCall *method_call,
+                          std::function<FlMethodResponse *()> work)
+{
+  g_object_ref(self);
+  g_object_ref(method_call);
+  std::thread([self, method_call, work]()
+              {
+                PendingResponse *pending =
+                    new PendingResponse{self, method_call, work()};
+                post_to_main_loop(self, respond_on_main_thread, pending); })
+      .detach();
+}
+
+static std::string executable_path()
+{
+  char path[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  if (len == -1)
+  {
+    return std::string();
+  }
+  path[len] = '\0';
+  return std::string(path);
+}
+
+static std::string executable_directory()
+{
+  std::string path = executable_path();
+  if (path.empty())
+  {
+    return path;
+  }
+  return std::string(dirname(&path[0]));
+}
+
+static bool same_directory(const std::string &a, const std::string &b)
+{
+  struct stat a_stat;
+  struct stat b_stat;
+  return stat(a.c_str(), &a_stat) == 0 && stat(b.c_str(), &b_stat) == 0 &&
+         a_stat.st_dev == b_stat.st_dev && a_stat.st_ino == b_stat.st_ino;
+}
+
+// Seconds after registration at which the startup profile is taken, by when
+// the first frames are up and the pages they needed are cached.
+static const guint kStartupProfileDelaySeconds = 15;
+
+// Directory downloads are staged in before applyUpdate moves them into place.
+static const char kStagingDirectory[] = "update";
+
+// Manifest of the staged files, written next to the staging directory by
+// updateAppFunction once every download succeeded.
+static const char kStagedManifest[] = "update.hashes.json";
+
+static std::string startup_profile_path(const std::string &install_dir)
+{
+  return desktop_updater::default_cache_path(install_dir, "profile");
+}
+
+// An update replaces the runner, so a profile written after the runner's
+// last change still describes this install and is not taken again.
+static bool startup_profile_is_current(const std::string &path)
+{
+  struct stat profile;
+  struct stat runner;
+  if (stat(path.c_str(), &profile) != 0 ||
+      stat("/proc/self/exe", &runner) != 0)
+  {
+    return false;
+  }
+  return profile.st_mtim.tv_sec > runner.st_ctim.tv_sec ||
+         (profile.st_mtim.tv_sec == runner.st_ctim.tv_sec &&
+          profile.st_mtim.tv_nsec >= runner.st_ctim.tv_nsec);
+}
+
+static gboolean record_startup_profile_cb(gpointer user_data)
+{
+  if (startup_profile_is_current(startup_profile_path(executable_directory())))
+  {
+    return G_SOURCE_REMOVE;
+  }
+  std::thread([]()
+              {
+                desktop_updater::enter_background(std::vector<int>());
+                const std::string directory = executable_directory();
+                std::vector<desktop_updater::ProfileExtent> extents;
+                desktop_updater::record_startup_profile(
+                    directory, {kStagingDirectory}, &extents);
+                desktop_updater::write_startup_profile(
+                    startup_profile_path(directory), extents); })
+      .detach();
+  return G_SOURCE_REMOVE;
+}
+
+// Reads the pages the last startup needed from a child process, from the
+// staged update where a file is replaced, so the relaunched app starts from
+// the page cache. This process exits right after the relaunch, so the child
+// is never waited for. Returns whether the child was started.
+static bool warm_next_start()
+{
+  const std::string directory = executable_directory();
+  std::vector<desktop_updater::ProfileExtent> extents;
+  if (!desktop_updater::read_startup_profile(startup_profile_path(directory),
+                                             &extents))
+  {
+    return false;
+  }
+  uint64_t bytes = 0;
+  const pid_t warmer = desktop_updater::warm_startup_profile(
+      directory, directory + "/" + kStagingDirectory, extents, &bytes);
+  g_print("desktop_updater: warming %" G_GUINT64_FORMAT " bytes for restart\n",
+          static_cast<guint64>(bytes));
+  return warmer > 0;
+}
+
+// A restart is only credited to this process if it started this soon after
+// the old one exited; anything older was a restart that never came back.
+static const int64_t kRestartClaimWindowNs = 10ll * 60 * 1000000000;
+
+static std::string restart_log_path()
+{
+  return desktop_updater::default_cache_path(executable_directory(), "restarts");
+}
+
+static void record_first_frame()
+{
+  const int64_t now = desktop_updater::boottime_ns();
+  desktop_updater::RestartLog log;
+  log.load(restart_log_path());
+  desktop_updater::RestartRecord *record = log.newest();
+  if (record != nullptr && record->first_frame_ns == 0 &&
+      record->started_ns == desktop_updater::process_start_ns())
+  {
+    record->first_frame_ns = now;
+    log.save(restart_log_path());
+  }
+}
+
+// Write end of the pipe relaunch()'s supervisor waits on, if this process
+// is an update's first start; -1 once reported.
+static int health_fd = -1;
+
+static void take_health_fd()
+{
+  const char *value = getenv(desktop_updater::kHealthFdVariable);
+  if (value == nullptr)
+  {
+    return;
+  }
+  health_fd = atoi(value);
+  unsetenv(desktop_updater::kHealthFdVariable);
+  // Not for processes the app starts.
+  fcntl(health_fd, F_SETFD, FD_CLOEXEC);
+}
+
+static void report_first_frame()
+{
+  record_first_frame();
+  if (health_fd >= 0)
+  {
+    desktop_updater::report_healthy(health_fd);
+    health_fd = -1;
+  }
+}
+
+static void first_frame_cb(gpointer user_data, FlView *view)
+{
+  report_first_frame();
+}
+
+static gboolean first_idle_cb(gpointer user_data)
+{
+  report_first_frame();
+  return G_SOURCE_REMOVE;
+}
+
+static void watch_first_frame(FlPluginRegistrar *registrar)
+{
+  FlView *view = fl_plugin_registrar_get_view(registrar);
+  if (view != nullptr && g_signal_lookup("first-frame", G_OBJECT_TYPE(view)) != 0)
+  {
+    g_signal_connect_swapped(view, "first-frame", G_CALLBACK(first_frame_cb),
+                             nullptr);
+  }
+  else
+  {
+    // Older engines have no first-frame signal; the first idle of the main
+    // loop comes shortly after it.
+    g_idle_add(first_idle_cb, nullptr);
+  }
+}
+
+// If this process is the relaunch of a restartApp, completes the record the
+// old process left. Returns true if its first frame should be timestamped.
+static bool record_restart_start()
+{
+  const int64_t registered = desktop_updater::boottime_ns();
+  const int64_t started = desktop_updater::process_start_ns();
+  desktop_updater::RestartLog log;
+  log.load(restart_log_path());
+  desktop_updater::RestartRecord *pending = log.pending();
+  // Start times have clock tick precision, so allow one tick of overlap.
+  if (pending == nullptr || started == 0 ||
+      started + 10000000 < pending->exited_ns ||
+      started - pending->exited_ns > kRestartClaimWindowNs)
+  {
+    return false;
+  }
+  pending->started_ns = started;
+  pending->registered_ns = registered;
+  return log.save(restart_log_path());
+}
+
+// Checks the files an apply wrote against the staged manifest, and records
+// them in the hash index so the next update check does not read them
+// again.
+static bool verify_applied_files(
+    DesktopUpdaterPlugin *self, const std::string &directory,
+    const std::string &staging, const std::vector<std::string> &written,
+    const std::vector<desktop_updater::FileHashEntry> &expected,
+    std::string *error)
+{
+  const std::string index_path = desktop_updater::default_hash_index_path(directory);
+  desktop_updater::HashIndex index;
+  index.load(index_path);
+  desktop_updater::VerifyStats stats;
+  if (!desktop_updater::verify_applied_files(self->hasher, directory, staging,
+                                             written, expected,
+                                             self->staged_digests, &index,
+                                             &stats, error))
+  {
+    return false;
+  }
+  g_print("desktop_updater: verified %zu applied files, %zu from download "
+          "digests, %zu hashed\n",
+          stats.reused + stats.hashed, stats.reused, stats.hashed);
+  index.save(index_path);
+  return true;
+}
+
+// Moves the downloaded files from the staging directory into the install
+// while the app is still running, after snapshotting the files it replaces
+// for relaunch() to roll back to, then verifies them. Runs on a worker
+// thread, see applyUpdate. Returns true if nothing is left to copy; sets
+// *cancelled if cancelUpdate stopped it, once the install is rolled back.
+static bool apply_staged_files(DesktopUpdaterPlugin *self, bool *cancelled)
+{
+  *cancelled = false;
+  // Held throughout, so cancelUpdate only removes the staged files once
+  // none of them is being snapshotted or moved.
+  desktop_updater::CancellationToken::Work work(self->cancel);
+  const std::string directory = executable_directory();
+  const std::string staging = directory + "/" + kStagingDirectory;
+  const std::string snapshot = directory + "/" + kRollbackDirectory;
+  const std::string manifest = directory + "/" + kStagedManifest;
+  // One left behind by an earlier update whose supervisor never finished.
+  desktop_updater::discard_update_snapshot(snapshot);
+  struct stat st;
+  if (stat(staging.c_str(), &st) != 0)
+  {
+    unlink(manifest.c_str());
+    return true;
+  }
+  // The manifest is written only once every file of an update has been
+  // downloaded, so staged files without one are an incomplete or cancelled
+  // update that could not be verified; neither this nor the update script
+  // may apply them. The next update check downloads them again.
+  std::vector<desktop_updater::FileHashEntry> expected;
+  if (!desktop_updater::read_manifest_json(manifest, &expected))
+  {
+    g_print("desktop_updater: staged files have no readable manifest, "
+            "discarded instead of applied\n");
+    desktop_updater::discard_staged_update(staging);
+    self->staged_digests->clear();
+    return true;
+  }
+  desktop_updater::SnapshotStats snapshot_stats;
+  std::string error;
+  if (!desktop_updater::take_update_snapshot(directory, staging, snapshot,
+                                             &snapshot_stats, &error))
+  {
+    g_print("desktop_updater: staged update not applied: %s\n", error.c_str());
+    desktop_updater::discard_update_snapshot(snapshot);
+    return false;
+  }
+  desktop_updater::ApplyStats stats;
+  if (!desktop_updater::apply_staged_update(directory, staging, self->io_limits,
+                                            &stats, &error, self->cancel,
+                                            self->memory_budget))
+  {
+    if (self->cancel->cancelled())
+    {
+      // cancelUpdate removes what is still staged once this returns.
+      g_print("desktop_updater: staged update cancelled, rolling back\n");
+      if (!desktop_updater::restore_update_snapshot(directory, snapshot, &error))
+      {
+        g_print("desktop_updater: rollback incomplete: %s\n", error.c_str());
+      }
+      *cancelled = true;
+      return true;
+    }
+    // The update script finishes what is left, unsupervised as before.
+    g_print("desktop_updater: staged update not applied: %s\n", error.c_str());
+    desktop_updater::discard_update_snapshot(snapshot);
+    return false;
+  }
+  const bool verified =
+      verify_applied_files(self, directory, staging, stats.files, expected,
+                           &error);
+  unlink(manifest.c_str());
+  self->staged_digests->clear();
+  if (!verified)
+  {
+    // Without the snapshot, relaunch() starts the old version unsupervised;
+    // the next update check finds the update again.
+    g_print("desktop_updater: applied update failed verification, rolling "
+            "back: %s\n",
+            error.c_str());
+    if (!desktop_updater::restore_update_snapshot(directory, snapshot, &error))
+    {
+      g_print("desktop_updater: rollback incomplete: %s\n", error.c_str());
+    }
+    return true;
+  }
+  g_print("desktop_updater: applied update, %zu renamed, %zu copied; "
+          "%zu cloned and %zu linked for rollback\n",
+          stats.renamed, stats.copied, snapshot_stats.cloned,
+          snapshot_stats.linked);
+  self->applied_ns = desktop_updater::boottime_ns();
+  return true;
+}
+
+// Applies the staged update off the main thread once updateAppFunction has
+// downloaded every file, so that restartApp only has to relaunch. Responds
+// with whether nothing is left for the update script to copy, or fails with
+// CANCELLED if cancelUpdate stopped it.
+static void handle_apply_update(DesktopUpdaterPlugin *self,
+                                FlMethodCall *method_call)
+{
+  respond_async(self, method_call, [self]()
+                {
+                  bool cancelled = false;
+                  const bool applied = apply_staged_files(self, &cancelled);
+                  if (cancelled)
+                  {
+                    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+                        "CANCELLED", "Applying the update was cancelled", nullptr));
+                  }
+                  g_autoptr(FlValue) result = fl_value_new_bool(applied);
+                  return FL_METHOD_RESPONSE(fl_method_success_response_new(result)); });
+}
+
+// Returns the recorded restarts, oldest first, as maps of CLOCK_BOOTTIME
+// nanoseconds per phase.
+static FlMethodResponse *get_restart_metrics()
+{
+  desktop_updater::RestartLog log;
+  log.load(restart_log_path());
+  g_autoptr(FlValue) result = fl_value_new_list();
+  for (const desktop_updater::RestartRecord &record : log.records())
+  {
+    FlValue *map = fl_value_new_map();
+    fl_value_set_string_take(map, "requested", fl_value_new_int(record.requested_ns));
+    fl_value_set_string_take(map, "applied", fl_value_new_int(record.applied_ns));
+    fl_value_set_string_take(map, "warmed", fl_value_new_int(record.warmed_ns));
+    fl_value_set_string_take(map, "exited", fl_value_new_int(record.exited_ns));
+    fl_value_set_string_take(map, "started", fl_value_new_int(record.started_ns));
+    fl_value_set_string_take(map, "registered", fl_value_new_int(record.registered_ns));
+    fl_value_set_string_take(map, "firstFrame", fl_value_new_int(record.first_frame_ns));
+    fl_value_append_take(result, map);
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+static const gchar *lookup_string_arg(FlValue *args, const gchar *key)
+{
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP)
+  {
+    return nullptr;
+  }
+  FlValue *value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_STRING)
+  {
+    return nullptr;
+  }
+  return fl_value_get_string(value);
+}
+
+// How long a check waits for another user's instance to finish hashing a
+// shared install before hashing it on its own.
+static const int kSharedIndexTimeoutMs = 60 * 1000;
+
+// Hashes an install directory natively and writes hashes.json to "output",
+// plus the directory Merkle tree to "treeOutput" when given.
+// For the running app's own install, digests come from the persisted hash
+// index and the build manifest, and only files whose stat data changed since
+// install are read. Installs the user cannot write to are usually shared by
+// several users, so where an administrator provisioned a shared cache their
+// index is the shared one and only one instance at a time hashes the tree.
+static void handle_generate_file_hashes(DesktopUpdaterPlugin *self,
+                                        FlMethodCall *method_call)
+{
+  FlValue *args = fl_method_call_get_args(method_call);
+  const gchar *directory_arg = lookup_string_arg(args, "directory");
+  const gchar *output_arg = lookup_string_arg(args, "output");
+  const gchar *algorithm_arg = lookup_string_arg(args, "algorithm");
+  const gchar *tree_output_arg = lookup_string_arg(args, "treeOutput");
+
+  desktop_updater::HashDirectoryOptions options;
+  if (!desktop_updater::parse_hash_algorithm(
+          algorithm_arg != nullptr ? algorithm_arg : "", &options.algorithm))
+  {
+    g_autoptr(FlMethodResponse) response = FL_METHOD_RESPONSE(
+        fl_method_error_response_new("UNSUPPORTED_ALGORITHM", algorithm_arg, nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
+  if (output_arg == nullptr)
+  {
+    g_autoptr(FlMethodResponse) response = FL_METHOD_RESPONSE(
+        fl_method_error_response_new("INVALID_ARGUMENTS", "output is required", nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
+
+  const std::string directory =
+      directory_arg != nullptr ? directory_arg : executable_directory();
+  const std::string output = output_arg;
+  const std::string tree_output =
+      tree_output_arg != nullptr ? tree_output_arg : "";
+  const bool own_install = same_directory(directory, executable_directory());
+  // Neither the release's metadata nor the updater's own files are part of
+  // the bundle, so an install carrying them still gets the release's root.
+  desktop_updater::exclude_release_files(&options);
+  for (const char *path : {kStagingDirectory, kRollbackDirectory,
+                           kStagedManifest, "update_script.sh"})
+  {
+    options.excluded_paths.push_back(path);
+  }
+  desktop_updater::FileHasher *hasher = self->hasher;
+  desktop_updater::DirectoryWatcher *watcher = self->watcher;
+  desktop_updater::CancellationToken *cancel = self->cancel;
+  options.cancel = cancel;
+
+  respond_async(self, method_call, [hasher, watcher, cancel, directory, output, tree_output, options, own_install]() mutable
+                {
+                  desktop_updater::CancellationToken::Work work(cancel);
+                  desktop_updater::HashIndex index;
+                  desktop_updater::BuildManifest build_manifest;
+                  const std::string index_path =
+                      desktop_updater::default_hash_index_path(directory);
+                  const std::string shared_path =
+                      own_install && access(directory.c_str(), W_OK) != 0
+                          ? desktop_updater::shared_hash_index_path(directory)
+                          : std::string();
+                  desktop_updater::SharedHashIndex shared(shared_path);
+                  const bool use_shared =
+                      !shared_path.empty() &&
+                      shared.acquire(&index, kSharedIndexTimeoutMs);
+                  if (own_install)
+                  {
+                    if (!use_shared)
+                    {
+                      index.load(index_path);
+                    }
+                    options.index = &index;
+                    if (build_manifest.load(executable_path(), directory))
+                    {
+                      options.baseline = &build_manifest.view();
+                      options.baseline_installed_ns =
+                          build_manifest.installed_ns();
+                    }
+                  }
+                  // Taken before hashing so changes made meanwhile are seen
+                  // by the next check.
+                  desktop_updater::DirtyPaths dirty;
+                  const bool tracked = own_install && watcher->running();
+                  if (tracked)
+                  {
+                    dirty = watcher->take();
+                    options.dirty = &dirty;
+                  }
+
+                  std::vector<desktop_updater::FileHashEntry> entries;
+                  desktop_updater::HashDirectoryStats stats;
+                  if (!hasher->hash_directory(directory, options, &entries, &stats))
+                  {
+                    if (tracked)
+                    {
+                      watcher->invalidate();
+                    }
+                    if (cancel->cancelled())
+                    {
+                      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+                          "CANCELLED", "Hashing was cancelled", nullptr));
+                    }
+                    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+                        "HASH_FAILED", "Directory does not exist", nullptr));
+                  }
+                  if (!desktop_updater::write_manifest_json(output, entries))
+                  {
+                    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+                        "HASH_FAILED", "Could not write the hash file", nullptr));
+                  }
+                  desktop_updater::MerkleDirectories tree;
+                  if (!tree_output.empty() &&
+                      (!desktop_updater::build_merkle_tree(entries, &tree) ||
+                       !desktop_updater::write_merkle_tree_json(
+                           tree_output, options.algorithm, tree)))
+                  {
+                    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+                        "HASH_FAILED", "Could not write the tree file", nullptr));
+                  }
+                  if (own_install)
+                  {
+                    g_print("desktop_updater: %zu files from %s index, %zu from %s "
+                            "build manifest, %zu hashed, %s\n",
+                            stats.from_index, use_shared ? "shared" : "user",
+                            stats.from_baseline,
+                            build_manifest.source(), stats.hashed,
+                            options.dirty != nullptr && !dirty.full_scan
+                                ? "dirty paths only"
+                                : "full scan");
+                    const bool saved = use_shared ? shared.commit(index)
+                                                  : index.save(index_path);
+                    if (!saved && tracked)
+                    {
+                      watcher->invalidate();
+                    }
+                  }
+                  g_autoptr(FlValue) result = fl_value_new_string(output.c_str());
+                  return FL_METHOD_RESPONSE(fl_method_success_response_new(result)); });
+}
+
+// Compares the manifest at "old" with the one at "new" like verifyFileHashes
+// and responds with the changed entries of "new" as one binary manifest
+// buffer (see binary_manifest.h), so the list crosses the channel without a
+// value per entry. "onlyDirectories" limits the comparison to files in those
+// directories; with "returnAllOnAnyChange" every entry of "new" is returned
+// as soon as one differs.
+static void handle_diff_manifest(DesktopUpdaterPlugin *self,
+                                 FlMethodCall *method_call)
+{
+  FlValue *args = fl_method_call_get_args(method_call);
+  const gchar *old_arg = lookup_string_arg(args, "old");
+  const gchar *new_arg = lookup_string_arg(args, "new");
+  if (old_arg == nullptr || new_arg == nullptr)
+  {
+    g_autoptr(FlMethodResponse) response = FL_METHOD_RESPONSE(
+        fl_method_error_response_new("INVALID_ARGUMENTS", "old and new are required", nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
+
+  bool has_only_directories = false;
+  std::set<std::string> only_directories;
+  bool return_all = false;
+  if (fl_value_get_type(args) == FL_VALUE_TYPE_MAP)
+  {
+    FlValue *directories = fl_value_lookup_string(args, "onlyDirectories");
+    if (directories != nullptr &&
+        fl_value_get_type(directories) == FL_VALUE_TYPE_LIST)
+    {
+      has_only_directories = true;
+      for (size_t i = 0; i < fl_value_get_length(directories); i++)
+      {
+        FlValue *directory = fl_value_get_list_value(directories, i);
+        if (fl_value_get_type(directory) == FL_VALUE_TYPE_STRING)
+        {
+          only_directories.insert(fl_value_get_string(directory));
+        }
+      }
+    }
+    FlValue *all = fl_value_lookup_string(args, "returnAllOnAnyChange");
+    return_all = all != nullptr && fl_value_get_type(all) == FL_VALUE_TYPE_BOOL &&
+                 fl_value_get_bool(all);
+  }
+
+  const std::string old_path = old_arg;
+  const std::string new_path = new_arg;
+  respond_async(self, method_call, [old_path, new_path, has_only_directories, only_directories, return_all]()
+                {
+                  std::vector<desktop_updater::FileHashEntry> old_entries;
+                  std::vector<desktop_updater::FileHashEntry> new_entries;
+                  if (!desktop_updater::read_manifest_json(old_path, &old_entries) ||
+                      !desktop_updater::read_manifest_json(new_path, &new_entries))
+                  {
+                    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+                        "DIFF_FAILED", "Could not read the hash files", nullptr));
+                  }
+                  std::vector<desktop_updater::FileHashEntry> changes =
+                      desktop_updater::diff_manifests(
+                          old_entries, new_entries,
+                          has_only_directories ? &only_directories : nullptr);
+                  if (return_all && !changes.empty())
+                  {
+                    changes = new_entries;
+                  }
+
+                  // A binary manifest has a single algorithm; an empty list
+                  // is tagged with the legacy one.
+                  const desktop_updater::HashAlgorithm algorithm =
+                      changes.empty() ? desktop_updater::HashAlgorithm::kBlake2b
+                                      : changes.front().algorithm;
+                  std::string encoded;
+                  if (!desktop_updater::encode_binary_manifest(algorithm, changes,
+                                                               &encoded))
+                  {
+                    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+                        "DIFF_FAILED", "Hash file mixes algorithms or digest sizes",
+                        nullptr));
+                  }
+                  g_autoptr(FlValue) result = fl_value_new_uint8_list(
+                      reinterpret_cast<const uint8_t *>(encoded.data()),
+                      encoded.size());
+                  return FL_METHOD_RESPONSE(fl_method_success_response_new(result)); });
+}
+
+// Sets the shared memory budget to "bytes" (0 removes the cap) and starts a
+// new peak measurement.
+static FlMethodResponse *set_memory_budget(DesktopUpdaterPlugin *self,
+                                           FlValue *args)
+{
+  FlValue *bytes = nullptr;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP)
+  {
+    bytes = fl_value_lookup_string(args, "bytes");
+  }
+  if (bytes == nullptr || fl_value_get_type(bytes) != FL_VALUE_TYPE_INT ||
+      fl_value_get_int(bytes) < 0)
+  {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "bytes must be a non-negative integer", nullptr));
+  }
+  self->memory_budget->set_limit(static_cast<size_t>(fl_value_get_int(bytes)));
+  self->memory_budget->reset_peak();
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Updates the limits given in args; omitted ones are left as they are and
+// 0 removes a limit. Stages that are waiting pick up the new rate at once.
+static FlMethodResponse *set_rate_limits(DesktopUpdaterPlugin *self,
+                                         FlValue *args)
+{
+  struct Limit
+  {
+    const char *key;
+    desktop_updater::TokenBucket *bucket;
+  };
+  const Limit limits[] = {
+      {"diskBytesPerSecond", &self->io_limits->disk_bytes},
+      {"diskOpsPerSecond", &self->io_limits->disk_ops},
+      {"networkBytesPerSecond", &self->io_limits->network_bytes},
+  };
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP)
+  {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "Expected a map of limits", nullptr));
+  }
+  for (const Limit &limit : limits)
+  {
+    FlValue *value = fl_value_lookup_string(args, limit.key);
+    if (value != nullptr && (fl_value_get_type(value) != FL_VALUE_TYPE_INT ||
+                             fl_value_get_int(value) < 0))
+    {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "INVALID_ARGUMENTS", "Limits must be non-negative integers", nullptr));
+    }
+  }
+  for (const Limit &limit : limits)
+  {
+    FlValue *value = fl_value_lookup_string(args, limit.key);
+    if (value != nullptr)
+    {
+      limit.bucket->set_rate(static_cast<uint64_t>(fl_value_get_int(value)));
+    }
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+#ifdef DESKTOP_UPDATER_CURL
+// Downloads "url" to "path", over HTTP/2 streams shared with the other
+// downloads in flight where the host supports it, and split into parallel
+// byte ranges when "length" is large enough (see downloader.h). With
+// "dictionaryUrl", "url" is a zstd file compressed with that dictionary and
+// "path" receives it decompressed; plugins built without libzstd fail such
+// calls with DICTIONARY_UNSUPPORTED. "id" names the download for
+// getDownloadProgress and cancelDownload while it runs. With "hash" and
+// "algorithm", the entry hashes.json lists for the file, the download is
+// hashed once complete and fails with HASH_MISMATCH if it differs; the
+// digest is kept for the check after applyUpdate applies the file. Responds
+// with a map of transfer statistics.
+static void handle_download_file(DesktopUpdaterPlugin *self,
+                                 FlMethodCall *method_call)
+{
+  FlValue *args = fl_method_call_get_args(method_call);
+  const gchar *url_arg = lookup_string_arg(args, "url");
+  const gchar *path_arg = lookup_string_arg(args, "path");
+  const gchar *id_arg = lookup_string_arg(args, "id");
+  const gchar *dictionary_arg = lookup_string_arg(args, "dictionaryUrl");
+  const gchar *hash_arg = lookup_string_arg(args, "hash");
+  const gchar *algorithm_arg = lookup_string_arg(args, "algorithm");
+  FlValue *length_value = args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                              ? fl_value_lookup_string(args, "length")
+                              : nullptr;
+  if (url_arg == nullptr || path_arg == nullptr || id_arg == nullptr ||
+      (length_value != nullptr &&
+       (fl_value_get_type(length_value) != FL_VALUE_TYPE_INT ||
+        fl_value_get_int(length_value) < 0)))
+  {
+    g_autoptr(FlMethodResponse) response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "url, path and id are required", nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
+
+#ifndef DESKTOP_UPDATER_ZSTD
+  // Built without libzstd: the caller fetches the plain file instead.
+  if (dictionary_arg != nullptr)
+  {
+    g_autoptr(FlMethodResponse) response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "DICTIONARY_UNSUPPORTED", "built without libzstd", nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
+#endif
+
+  const std::string url = url_arg;
+  const std::string path = path_arg;
+  const std::string id = id_arg;
+  const uint64_t length =
+      length_value != nullptr ? static_cast<uint64_t>(fl_value_get_int(length_value)) : 0;
+  desktop_updater::DownloadOptions options;
+  if (dictionary_arg != nullptr)
+  {
+    options.dictionary_url = dictionary_arg;
+  }
+  const std::string expected_hash = hash_arg != nullptr ? hash_arg : "";
+  desktop_updater::HashAlgorithm algorithm = desktop_updater::HashAlgorithm::kBlake2b;
+  if (algorithm_arg != nullptr &&
+      !desktop_updater::parse_hash_algorithm(algorithm_arg, &algorithm))
+  {
+    g_autoptr(FlMethodResponse) response = FL_METHOD_RESPONSE(
+        fl_method_error_response_new("UNSUPPORTED_ALGORITHM", algorithm_arg, nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
+  desktop_updater::Downloader *downloader = self->downloader;
+  desktop_updater::DownloadRegistry *downloads = self->downloads;
+  desktop_updater::FileHasher *hasher = self->hasher;
+  desktop_updater::StagedDigests *staged_digests = self->staged_digests;
+  desktop_updater::CancellationToken *cancel = self->cancel;
+  options.cancel = cancel;
+  std::shared_ptr<desktop_updater::DownloadProgress> progress = downloads->add(id);
+
+  respond_async(self, method_call, [downloader, downloads, hasher, staged_digests, cancel, url, path, id, length, options, progress, expected_hash, algorithm]()
+                {
+                  desktop_updater::CancellationToken::Work work(cancel);
+                  desktop_updater::DownloadStats stats;
+                  std::string error;
+                  const bool ok = downloader->download(
+                      url, path, length, options, progress.get(), &stats, &error);
+                  downloads->remove(id);
+                  if (!ok)
+                  {
+                    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+                        progress->cancelled || cancel->cancelled() ? "CANCELLED"
+                                                                   : "DOWNLOAD_FAILED",
+                        error.c_str(), nullptr));
+                  }
+                  if (!expected_hash.empty())
+                  {
+                    desktop_updater::HashIndexEntry staged;
+                    staged.algorithm = algorithm;
+                    if (!desktop_updater::stat_file(path, &staged.stat) ||
+                        !hasher->hash_file(path, algorithm, &staged.digest, cancel) ||
+                        desktop_updater::base64_encode(
+                            reinterpret_cast<const uint8_t *>(staged.digest.data()),
+                            staged.digest.size()) != expected_hash)
+                    {
+                      unlink(path.c_str());
+                      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+                          cancel->cancelled() ? "CANCELLED" : "HASH_MISMATCH",
+                          path.c_str(), nullptr));
+                    }
+                    staged_digests->record(path, staged);
+                  }
+                  g_autoptr(FlValue) result = fl_value_new_map();
+                  fl_value_set_string_take(
+                      result, "bytes", fl_value_new_int(static_cast<int64_t>(stats.bytes)));
+                  fl_value_set_string_take(
+                      result, "requests", fl_value_new_int(static_cast<int64_t>(stats.requests)));
+                  fl_value_set_string_take(
+                      result, "connections", fl_value_new_int(stats.peak_connections));
+                  fl_value_set_string_take(result, "retries", fl_value_new_int(stats.retries));
+                  fl_value_set_string_take(result, "split", fl_value_new_bool(stats.split));
+                  fl_value_set_string_take(result, "http2", fl_value_new_bool(stats.http2));
+                  return FL_METHOD_RESPONSE(fl_method_success_response_new(result)); });
+}
+
+// Bytes received so far by every download still running, as a map from id.
+// Polled once for all of them, however many are in flight.
+static FlMethodResponse *get_download_progress(DesktopUpdaterPlugin *self)
+{
+  g_autoptr(FlValue) result = fl_value_new_map();
+  for (const auto &download : self->downloads->received())
+  {
+    fl_value_set_string_take(result, download.first.c_str(),
+                             fl_value_new_int(static_cast<int64_t>(download.second)));
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Aborts the download named "id"; its downloadFile call fails with
+// CANCELLED. Responds with whether it was still running.
+static FlMethodResponse *cancel_download(DesktopUpdaterPlugin *self,
+                                         FlValue *args)
+{
+  const gchar *id = lookup_string_arg(args, "id");
+  std::shared_ptr<desktop_updater::DownloadProgress> progress =
+      id != nullptr ? self->downloads->find(id) : nullptr;
+  if (progress != nullptr)
+  {
+    progress->cancelled = true;
+  }
+  g_autoptr(FlValue) result = fl_value_new_bool(progress != nullptr);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+#endif
+
+// How long cancelUpdate waits for the native stages to stop before it gives
+// up on removing the staged update.
+static const int kCancelIdleTimeoutMs = 5000;
+
+// Cancels every native stage of the update in flight: hashing, downloads,
+// verification of downloads and the apply step. Each stops within one read
+// buffer or poll wakeup, and the calls running them fail with CANCELLED.
+// Once they are idle, the staging directory and the staged manifest are
+// removed. Responds with whether the stages went idle and how many
+// milliseconds that took.
+static void handle_cancel_update(DesktopUpdaterPlugin *self,
+                                 FlMethodCall *method_call)
+{
+  desktop_updater::CancellationToken *cancel = self->cancel;
+  desktop_updater::StagedDigests *staged_digests = self->staged_digests;
+
+  respond_async(self, method_call, [cancel, staged_digests]()
+                {
+                  const int64_t start = desktop_updater::boottime_ns();
+                  cancel->cancel();
+                  const bool idle = cancel->wait_idle(kCancelIdleTimeoutMs);
+                  const int64_t elapsed_ms =
+                      (desktop_updater::boottime_ns() - start) / 1000000;
+                  if (idle)
+                  {
+                    const std::string directory = executable_directory();
+                    desktop_updater::discard_staged_update(
+                        directory + "/" + kStagingDirectory);
+                    unlink((directory + "/" + kStagedManifest).c_str());
+                    staged_digests->clear();
+                  }
+                  else
+                  {
+                    g_print("desktop_updater: %zu update stages still running "
+                            "after cancel, staged files kept\n",
+                            cancel->active());
+                  }
+                  g_print("desktop_updater: update cancelled in %" G_GUINT64_FORMAT " ms\n",
+                          static_cast<guint64>(elapsed_ms));
+                  // Stages still running keep seeing the cancel until the
+                  // last of them ends.
+                  cancel->reset_when_idle();
+                  g_autoptr(FlValue) result = fl_value_new_map();
+                  fl_value_set_string_take(result, "idle", fl_value_new_bool(idle));
+                  fl_value_set_string_take(result, "elapsedMs", fl_value_new_int(elapsed_ms));
+                  return FL_METHOD_RESPONSE(fl_method_success_response_new(result)); });
+}
+
+// Orders the work items of one update stage, given as their byte sizes in
+// "sizes", for "workers" that each take the next item as they finish one;
+// see plan_work in work_scheduler.h. "kind" is "download" (the default),
+// "hash" or "apply" and picks the cost model. Responds with "order", the
+// indexes into sizes in the order to start them, and "estimatedSeconds".
+static void handle_plan_work(DesktopUpdaterPlugin *self,
+                             FlMethodCall *method_call)
+{
+  FlValue *args = fl_method_call_get_args(method_call);
+  const gchar *kind_arg = lookup_string_arg(args, "kind");
+  FlValue *sizes_value = nullptr;
+  FlValue *workers_value = nullptr;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP)
+  {
+    sizes_value = fl_value_lookup_string(args, "sizes");
+    workers_value = fl_value_lookup_string(args, "workers");
+  }
+  desktop_updater::WorkKind kind = desktop_updater::WorkKind::kDownload;
+  std::vector<uint64_t> sizes;
+  bool valid = sizes_value != nullptr && workers_value != nullptr &&
+               fl_value_get_type(workers_value) == FL_VALUE_TYPE_INT &&
+               fl_value_get_int(workers_value) > 0 &&
+               (kind_arg == nullptr ||
+                desktop_updater::parse_work_kind(kind_arg, &kind));
+  if (valid && fl_value_get_type(sizes_value) == FL_VALUE_TYPE_INT64_LIST)
+  {
+    const int64_t *values = fl_value_get_int64_list(sizes_value);
+    for (size_t i = 0; i < fl_value_get_length(sizes_value); i++)
+    {
+      sizes.push_back(values[i] > 0 ? static_cast<uint64_t>(values[i]) : 0);
+    }
+  }
+  else if (valid && fl_value_get_type(sizes_value) == FL_VALUE_TYPE_LIST)
+  {
+    for (size_t i = 0; valid && i < fl_value_get_length(sizes_value); i++)
+    {
+      FlValue *size = fl_value_get_list_value(sizes_value, i);
+      valid = fl_value_get_type(size) == FL_VALUE_TYPE_INT;
+      if (valid)
+      {
+        const int64_t value = fl_value_get_int(size);
+        sizes.push_back(value > 0 ? static_cast<uint64_t>(value) : 0);
+      }
+    }
+  }
+  else
+  {
+    valid = false;
+  }
+  if (!valid)
+  {
+    g_autoptr(FlMethodResponse) response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "sizes and a positive workers are required", nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
+  const size_t workers = static_cast<size_t>(fl_value_get_int(workers_value));
+
+  // A large update is tens of thousands of items; simulating them is kept
+  // off the main thread.
+  respond_async(self, method_call, [sizes, workers, kind]()
+                {
+                  const desktop_updater::WorkPlan plan = desktop_updater::plan_work(
+                      sizes, desktop_updater::default_work_cost(kind), workers);
+                  std::vector<int64_t> order(plan.order.begin(), plan.order.end());
+                  g_autoptr(FlValue) result = fl_value_new_map();
+                  fl_value_set_string_take(
+                      result, "order", fl_value_new_int64_list(order.data(), order.size()));
+                  fl_value_set_string_take(
+                      result, "estimatedSeconds", fl_value_new_float(plan.makespan_seconds));
+                  return FL_METHOD_RESPONSE(fl_method_success_response_new(result)); });
+}
+
+// Starts or stops inotify tracking of the install directory. While it runs,
+// hashing the install only looks at paths that changed since the last check.
+static FlMethodResponse *set_dirty_tracking(DesktopUpdaterPlugin *self,
+                                            FlValue *args)
+{
+  FlValue *enabled = nullptr;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP)
+  {
+    enabled = fl_value_lookup_string(args, "enabled");
+  }
+  if (enabled == nullptr || fl_value_get_type(enabled) != FL_VALUE_TYPE_BOOL)
+  {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "enabled must be a bool", nullptr));
+  }
+  if (!fl_value_get_bool(enabled))
+  {
+    self->watcher->stop();
+  }
+  else if (!self->watcher->running() &&
+           !self->watcher->start(executable_directory()))
+  {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "WATCH_FAILED", "Could not start inotify", nullptr));
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Respawns the pool's workers when the effective priority changes. Fresh
+// workers are spawned from the GTK main thread and so start at normal
+// priority; background ones then lower themselves.
+static void apply_worker_priority(DesktopUpdaterPlugin *self)
+{
+  const bool background = self->background_priority && !self->foreground_boost;
+  if (background == self->workers_in_background)
+  {
+    return;
+  }
+  self->workers_in_background = background;
+  if (!background)
+  {
+    self->pool->respawn(nullptr);
+    return;
+  }
+  const std::vector<int> cpus = desktop_updater::background_cpus();
+  self->pool->respawn([cpus]()
+                      { desktop_updater::enter_background(cpus); });
+}
+
+static FlValue *lookup_bool_arg(FlValue *args, const gchar *key)
+{
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP)
+  {
+    return nullptr;
+  }
+  FlValue *value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_BOOL)
+  {
+    return nullptr;
+  }
+  return value;
+}
+
+// Runs hashing and staging at idle CPU and I/O priority, away from the CPUs
+// Flutter renders on, so background update work does not cause jank.
+static FlMethodResponse *set_background_priority(DesktopUpdaterPlugin *self,
+                                                 FlValue *args)
+{
+  FlValue *enabled = lookup_bool_arg(args, "enabled");
+  if (enabled == nullptr)
+  {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "enabled must be a bool", nullptr));
+  }
+  self->background_priority = fl_value_get_bool(enabled);
+  apply_worker_priority(self);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Temporarily lifts background priority while the user is waiting on an
+// update they asked for.
+static FlMethodResponse *set_foreground_boost(DesktopUpdaterPlugin *self,
+                                              FlValue *args)
+{
+  FlValue *enabled = lookup_bool_arg(args, "enabled");
+  if (enabled == nullptr)
+  {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "enabled must be a bool", nullptr));
+  }
+  self->foreground_boost = fl_value_get_bool(enabled);
+  apply_worker_priority(self);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+static FlMethodResponse *get_memory_stats(DesktopUpdaterPlugin *self)
+{
+  desktop_updater::MemoryBudget *budget = self->memory_budget;
+  g_autoptr(FlValue) result = fl_value_new_map();
+  fl_value_set_string_take(result, "limit",
+                           fl_value_new_int(static_cast<int64_t>(budget->limit())));
+  fl_value_set_string_take(result, "inUse",
+                           fl_value_new_int(static_cast<int64_t>(budget->in_use())));
+  fl_value_set_string_take(result, "peak",
+                           fl_value_new_int(static_cast<int64_t>(budget->peak())));
+  fl_value_set_string_take(
+      result, "peakRss",
+      fl_value_new_int(static_cast<int64_t>(desktop_updater::peak_rss_bytes())));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
 // Called when a method call is received from Flutter.
 static void desktop_updater_plugin_handle_method_call(
     DesktopUpdaterPlugin *self,
@@ -123,9 +1345,79 @@ static void desktop_updater_plugin_handle_method_call(
   {
     response = get_platform_version();
   }
+  else if (strcmp(method, "generateFileHashes") == 0)
+  {
+    handle_generate_file_hashes(self, method_call);
+    return;
+  }
+  else if (strcmp(method, "diffManifest") == 0)
+  {
+    handle_diff_manifest(self, method_call);
+    return;
+  }
+#ifdef DESKTOP_UPDATER_CURL
+  else if (strcmp(method, "downloadFile") == 0)
+  {
+    handle_download_file(self, method_call);
+    return;
+  }
+  else if (strcmp(method, "getDownloadProgress") == 0)
+  {
+    response = get_download_progress(self);
+  }
+  else if (strcmp(method, "cancelDownload") == 0)
+  {
+    response = cancel_download(self, fl_method_call_get_args(method_call));
+  }
+#endif
+  else if (strcmp(method, "cancelUpdate") == 0)
+  {
+    handle_cancel_update(self, method_call);
+    return;
+  }
+  else if (strcmp(method, "planWork") == 0)
+  {
+    handle_plan_work(self, method_call);
+    return;
+  }
+  else if (strcmp(method, "setMemoryBudget") == 0)
+  {
+    response = set_memory_budget(self, fl_method_call_get_args(method_call));
+  }
+  else if (strcmp(method, "getRestartMetrics") == 0)
+  {
+    response = get_restart_metrics();
+  }
+  else if (strcmp(method, "setRateLimits") == 0)
+  {
+    response = set_rate_limits(self, fl_method_call_get_args(method_call));
+  }
+  else if (strcmp(method, "getMemoryStats") == 0)
+  {
+    response = get_memory_stats(self);
+  }
+  else if (strcmp(method, "setDirtyTracking") == 0)
+  {
+    response = set_dirty_tracking(self, fl_method_call_get_args(method_call));
+  }
+  else if (strcmp(method, "setBackgroundPriority") == 0)
+  {
+    response = set_background_priority(self, fl_method_call_get_args(method_call));
+  }
+  else if (strcmp(method, "setForegroundBoost") == 0)
+  {
+    response = set_foreground_boost(self, fl_method_call_get_args(method_call));
+  }
+  else if (strcmp(method, "applyUpdate") == 0)
+  {
+    handle_apply_update(self, method_call);
+    return;
+  }
   else if (strcmp(method, "restartApp") == 0)
   {
     printf("Restarting the application...\n");
+    desktop_updater::RestartRecord restart;
+    restart.requested_ns = desktop_updater::boottime_ns();
 
     char executable_path[PATH_MAX];
     ssize_t len = readlink("/proc/self/exe", executable_path, sizeof(executable_path) - 1);
@@ -134,8 +1426,40 @@ static void desktop_updater_plugin_handle_method_call(
       executable_path[len] = '\0';
       printf("Executable path: %s\n", executable_path);
 
-      createUpdateScript(executable_path);
-      runUpdateScript();
+      // applyUpdate moved the update into place already. Whatever it could
+      // not is copied by the update script once this process is gone, but
+      // only for a complete update: staged files without their manifest
+      // were never verified.
+      const std::string directory = executable_directory();
+      const std::string staging = directory + "/" + kStagingDirectory;
+      struct stat st;
+      bool left_staged = stat(staging.c_str(), &st) == 0;
+      if (left_staged &&
+          access((directory + "/" + kStagedManifest).c_str(), F_OK) != 0)
+      {
+        desktop_updater::discard_staged_update(staging);
+        left_staged = false;
+      }
+      restart.applied_ns = self->applied_ns.exchange(0);
+      if (warm_next_start())
+      {
+        restart.warmed_ns = desktop_updater::boottime_ns();
+      }
+
+      // Saved before the new process can start and look for it.
+      desktop_updater::RestartLog log;
+      log.load(restart_log_path());
+      restart.exited_ns = desktop_updater::boottime_ns();
+      log.add(restart);
+      log.save(restart_log_path());
+
+      // Files are only ever renamed into place, so the new process can
+      // start while this one is still running.
+      if (left_staged || !relaunch(executable_path, directory))
+      {
+        createUpdateScript(executable_path);
+        runUpdateScript();
+      }
 
       // Exit current process
       exit(0);
@@ -151,6 +1475,36 @@ static void desktop_updater_plugin_handle_method_call(
 
 static void desktop_updater_plugin_dispose(GObject *object)
 {
+  DesktopUpdaterPlugin *self = DESKTOP_UPDATER_PLUGIN(object);
+  delete self->watcher;
+  self->watcher = nullptr;
+  delete self->hasher;
+  self->hasher = nullptr;
+#ifdef DESKTOP_UPDATER_CURL
+  delete self->downloader;
+  self->downloader = nullptr;
+  delete self->downloads;
+  self->downloads = nullptr;
+#endif
+  delete self->staged_digests;
+  self->staged_digests = nullptr;
+  delete self->cancel;
+  self->cancel = nullptr;
+  delete self->pool;
+  self->pool = nullptr;
+  delete self->memory_budget;
+  self->memory_budget = nullptr;
+  delete self->io_limits;
+  self->io_limits = nullptr;
+  // Every pending response holds a reference, so none is left in the ring.
+  if (self->events_source != 0)
+  {
+    g_source_remove(self->events_source);
+    self->events_source = 0;
+  }
+  delete self->events;
+  self->events = nullptr;
+
   G_OBJECT_CLASS(desktop_updater_plugin_parent_class)->dispose(object);
 }
 
@@ -159,7 +1513,28 @@ static void desktop_updater_plugin_class_init(DesktopUpdaterPluginClass *klass)
   G_OBJECT_CLASS(klass)->dispose = desktop_updater_plugin_dispose;
 }
 
-static void desktop_updater_plugin_init(DesktopUpdaterPlugin *self) {}
+static void desktop_updater_plugin_init(DesktopUpdaterPlugin *self)
+{
+  self->pool = new desktop_updater::ThreadPool();
+  self->memory_budget = new desktop_updater::MemoryBudget();
+  self->io_limits = new desktop_updater::IoLimits();
+  self->hasher = new desktop_updater::FileHasher(
+      self->pool, self->memory_budget, self->io_limits);
+#ifdef DESKTOP_UPDATER_CURL
+  self->downloader = new desktop_updater::Downloader(self->io_limits,
+                                                     self->memory_budget);
+  self->downloads = new desktop_updater::DownloadRegistry();
+#endif
+  self->staged_digests = new desktop_updater::StagedDigests();
+  self->cancel = new desktop_updater::CancellationToken();
+  self->events = new desktop_updater::EventRing(kEventRingCapacity);
+  self->events_source = g_unix_fd_add(self->events->wake_fd(), G_IO_IN,
+                                      drain_events_cb, self);
+  self->watcher = new desktop_updater::DirectoryWatcher();
+  self->background_priority = false;
+  self->foreground_boost = false;
+  self->workers_in_background = false;
+}
 
 static void method_call_cb(FlMethodChannel *channel, FlMethodCall *method_call,
                            gpointer user_data)
@@ -182,5 +1557,14 @@ void desktop_updater_plugin_register_with_registrar(FlPluginRegistrar *registrar
                                             g_object_ref(plugin),
                                             g_object_unref);
 
+  const bool restarted = record_restart_start();
+  take_health_fd();
+  if (restarted || health_fd >= 0)
+  {
+    watch_first_frame(registrar);
+  }
+  g_timeout_add_seconds(kStartupProfileDelaySeconds, record_startup_profile_cb,
+                        nullptr);
+
   g_object_unref(plugin);
 }
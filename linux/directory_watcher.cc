@@ -0,0 +1,228 @@
+#include "directory_watcher.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const uint32_t kWatchMask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB |
+                                IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                IN_ONLYDIR;
+
+    // Past this many dirty paths a full scan is cheaper than the bookkeeping.
+    const size_t kMaxDirtyPaths = 10000;
+
+    std::string join(const std::string &a, const std::string &b)
+    {
+      return a.empty() ? b : a + "/" + b;
+    }
+  } // namespace
+
+  DirectoryWatcher::DirectoryWatcher() = default;
+
+  DirectoryWatcher::~DirectoryWatcher() { stop(); }
+
+  bool DirectoryWatcher::start(const std::string &root)
+  {
+    stop();
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0)
+    {
+      return false;
+    }
+    wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd_ < 0)
+    {
+      close(inotify_fd_);
+      inotify_fd_ = -1;
+      return false;
+    }
+    root_ = root;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      dirty_ = DirtyPaths();
+    }
+    add_watches("");
+    running_ = true;
+    thread_ = std::thread(&DirectoryWatcher::run, this);
+    return true;
+  }
+
+  void DirectoryWatcher::stop()
+  {
+    running_ = false;
+    if (thread_.joinable())
+    {
+      const uint64_t one = 1;
+      ssize_t written = write(wake_fd_, &one, sizeof(one));
+      (void)written;
+      thread_.join();
+    }
+    if (inotify_fd_ >= 0)
+    {
+      close(inotify_fd_);
+      inotify_fd_ = -1;
+    }
+    if (wake_fd_ >= 0)
+    {
+      close(wake_fd_);
+      wake_fd_ = -1;
+    }
+    watches_.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    dirty_ = DirtyPaths();
+  }
+
+  bool DirectoryWatcher::running() const { return running_; }
+
+  DirtyPaths DirectoryWatcher::take()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DirtyPaths out;
+    out.full_scan = dirty_.full_scan || !running();
+    out.paths.swap(dirty_.paths);
+    dirty_.full_scan = false;
+    return out;
+  }
+
+  void DirectoryWatcher::invalidate()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dirty_.full_scan = true;
+    dirty_.paths.clear();
+  }
+
+  void DirectoryWatcher::mark(const std::string &relative)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (dirty_.full_scan)
+    {
+      return;
+    }
+    dirty_.paths.insert(relative);
+    if (dirty_.paths.size() > kMaxDirtyPaths)
+    {
+      dirty_.full_scan = true;
+      dirty_.paths.clear();
+    }
+  }
+
+  void DirectoryWatcher::add_watches(const std::string &relative)
+  {
+    const std::string path = relative.empty() ? root_ : root_ + "/" + relative;
+    const int wd = inotify_add_watch(inotify_fd_, path.c_str(), kWatchMask);
+    if (wd < 0)
+    {
+      // Out of watches (ENOSPC) or the directory vanished: changes below it
+      // would go unnoticed, so nothing recorded can be trusted.
+      invalidate();
+      return;
+    }
+    watches_[wd] = relative;
+
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr)
+    {
+      return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      {
+        continue;
+      }
+      struct stat st;
+      if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+          S_ISDIR(st.st_mode))
+      {
+        add_watches(join(relative, entry->d_name));
+      }
+    }
+    closedir(dir);
+  }
+
+  void DirectoryWatcher::handle_events(const char *buffer, size_t length)
+  {
+    for (size_t offset = 0; offset < length;)
+    {
+      const struct inotify_event *event =
+          reinterpret_cast<const struct inotify_event *>(buffer + offset);
+      offset += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW)
+      {
+        invalidate();
+        continue;
+      }
+      auto watch = watches_.find(event->wd);
+      if (watch == watches_.end())
+      {
+        continue;
+      }
+      const std::string directory = watch->second;
+      if (event->mask & IN_IGNORED)
+      {
+        watches_.erase(watch);
+        continue;
+      }
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+      {
+        if (directory.empty())
+        {
+          invalidate();
+        }
+        continue;
+      }
+
+      const std::string relative =
+          event->len > 0 ? join(directory, event->name) : directory;
+      if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+      {
+        // Files created before the watch lands are found by relisting it.
+        add_watches(relative);
+      }
+      mark(relative);
+    }
+  }
+
+  void DirectoryWatcher::run()
+  {
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    struct pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+    for (;;)
+    {
+      if (poll(fds, 2, -1) < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        invalidate();
+        running_ = false;
+        return;
+      }
+      if (fds[1].revents != 0)
+      {
+        return;
+      }
+      ssize_t n;
+      while ((n = read(inotify_fd_, buffer, sizeof(buffer))) > 0)
+      {
+        handle_events(buffer, static_cast<size_t>(n));
+      }
+    }
+  }
+
+} // namespace desktop_updater
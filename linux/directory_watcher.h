@@ -0,0 +1,70 @@
+#ifndef DESKTOP_UPDATER_DIRECTORY_WATCHER_H_
+#define DESKTOP_UPDATER_DIRECTORY_WATCHER_H_
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace desktop_updater
+{
+
+  // Paths below a watched root that changed since the last snapshot.
+  struct DirtyPaths
+  {
+    // Set when the changes are not known precisely: before the first
+    // snapshot, after the kernel queue overflowed, or when a watch could not
+    // be added. The whole tree must then be scanned.
+    bool full_scan = true;
+    // Relative paths of changed files and of directories whose contents
+    // must be listed again.
+    std::set<std::string> paths;
+  };
+
+  // Keeps an inotify watch on every directory below root while it runs and
+  // records which paths change, so an update check only has to look at those
+  // instead of stat'ing the whole install.
+  class DirectoryWatcher
+  {
+  public:
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher &) = delete;
+    DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+    bool start(const std::string &root);
+    void stop();
+    bool running() const;
+    const std::string &root() const { return root_; }
+
+    // Returns the changes recorded so far and starts recording afresh.
+    DirtyPaths take();
+    // Forces the next snapshot to be a full scan, e.g. when the caller could
+    // not finish processing the one it took.
+    void invalidate();
+
+  private:
+    void add_watches(const std::string &relative);
+    void mark(const std::string &relative);
+    void run();
+    void handle_events(const char *buffer, size_t length);
+
+    std::string root_;
+    int inotify_fd_ = -1;
+    int wake_fd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+
+    // Only touched by the watcher thread once it has started.
+    std::unordered_map<int, std::string> watches_;
+
+    mutable std::mutex mutex_;
+    DirtyPaths dirty_;
+  };
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_DIRECTORY_WATCHER_H_
@@ -0,0 +1,911 @@
+#include "downloader.h"
+
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#ifdef DESKTOP_UPDATER_ZSTD
+#include <zstd.h>
+#else
+// Built without libzstd, no download is ever decompressed and these stay
+// null.
+typedef struct ZSTD_DCtx_s ZSTD_DCtx;
+typedef struct ZSTD_DDict_s ZSTD_DDict;
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    typedef std::chrono::steady_clock Clock;
+
+    const uint64_t kUnknownEnd = UINT64_MAX;
+    const long kConnectTimeoutSeconds = 30;
+    // A transfer slower than this for kStallSeconds is retried.
+    const long kStallBytesPerSecond = 1;
+    const long kStallSeconds = 60;
+    const int kPollMs = 50;
+    const int kIdlePollMs = 1000;
+    // Connections opened to one host by all downloads together. Over HTTP/2
+    // requests are multiplexed onto the first and more are only opened
+    // once it carries as many streams as the server allows.
+    const long kMaxHostConnections = 16;
+    const int kDefaultStreamWeight = 16;
+    const int kSmallFileStreamWeight = 256;
+    const int kMaxStreamWeight = 256;
+    // Each release publishes its own dictionary; only the latest few are
+    // kept.
+    const size_t kMaxDictionaries = 4;
+    // bin/archive.dart trains dictionaries of at most 110 KB.
+    const size_t kMaxDictionarySize = 1 << 20;
+    // libcurl's receive buffer, set explicitly so it can be charged to the
+    // memory budget.
+    const long kReceiveBufferSize = CURL_MAX_WRITE_SIZE;
+
+    struct Range
+    {
+      uint64_t begin;
+      uint64_t end;
+      int attempts;
+    };
+
+    // One request in flight.
+    struct Transfer
+    {
+      DownloadJob *job = nullptr;
+      CURL *easy = nullptr;
+      Range range = {0, 0, 0};
+      uint64_t written = 0;
+      // Sent with a Range header.
+      bool ranged = false;
+      // A 200 with the whole file is acceptable in place of the range.
+      bool may_be_whole = false;
+      // The response turned out to carry the whole file.
+      bool whole = false;
+      bool checked = false;
+      long status = 0;
+      // Unexpected status, Content-Range or amount of data.
+      bool rejected = false;
+      uint64_t content_range_begin = kUnknownEnd;
+    };
+  } // namespace
+
+  // One call to Downloader::download(), owned by the calling thread and
+  // driven by the download thread until done is set.
+  struct DownloadJob
+  {
+    std::string url;
+    std::string path;
+    uint64_t length = 0;
+    DownloadOptions options;
+    DownloadProgress *progress = nullptr;
+    DownloadStats *stats = nullptr;
+    std::string *error = nullptr;
+    IoLimits *limits = nullptr;
+    int fd = -1;
+    long weight = 0;
+
+    std::deque<Range> pending;
+    bool split = false;
+    int active = 0;
+    // Only the first range is requested until the server shows it honors
+    // ranges.
+    int target = 1;
+    bool growing = false;
+    double best_rate = 0;
+    Clock::time_point sample_start;
+    uint64_t sample_received = 0;
+    uint64_t received = 0;
+    uint64_t completed = 0;
+    bool write_failed = false;
+    int write_errno = 0;
+    bool failed = false;
+    bool done = false;
+
+    // Set for compressed files, whose bytes are decompressed into fd at
+    // output_offset as they arrive.
+    ZSTD_DCtx *dctx = nullptr;
+    BudgetedBuffer *output = nullptr;
+    uint64_t output_offset = 0;
+    // Whether the bytes received so far end on a complete zstd frame.
+    bool frame_done = false;
+    // Set instead of fd to keep the body in memory, up to its size.
+    BudgetedBuffer *body = nullptr;
+    size_t body_size = 0;
+  };
+
+  // A zstd dictionary shared by the downloads compressed with it.
+  struct DownloadDictionary
+  {
+    ~DownloadDictionary()
+    {
+#ifdef DESKTOP_UPDATER_ZSTD
+      ZSTD_freeDDict(ddict);
+#endif
+    }
+
+    // Held while the dictionary is fetched, so the downloads needing it
+    // meanwhile wait for that fetch instead of starting their own.
+    std::mutex mutex;
+    ZSTD_DDict *ddict = nullptr;
+    // Why it could not be fetched. Not retried: the files compressed with
+    // it are also published as they are.
+    std::string error;
+  };
+
+  namespace
+  {
+    void fail(DownloadJob *job, const std::string &error)
+    {
+      if (!job->failed)
+      {
+        *job->error = error;
+        job->failed = true;
+      }
+    }
+
+    bool job_cancelled(const DownloadJob *job)
+    {
+      return job->progress->cancelled || is_cancelled(job->options.cancel);
+    }
+
+    size_t on_header(char *data, size_t size, size_t count, void *user)
+    {
+      Transfer *transfer = static_cast<Transfer *>(user);
+      const size_t length = size * count;
+      const std::string line(data, length);
+      if (line.compare(0, 5, "HTTP/") == 0)
+      {
+        // A new response, after a redirect or an interim one.
+        transfer->content_range_begin = kUnknownEnd;
+      }
+      else if (line.size() > 14 && strncasecmp(line.c_str(), "content-range:", 14) == 0)
+      {
+        unsigned long long begin = 0;
+        if (sscanf(line.c_str() + 14, " bytes %llu-", &begin) == 1)
+        {
+          transfer->content_range_begin = begin;
+        }
+      }
+      return length;
+    }
+
+    // Checks the response before its first body byte is written.
+    bool accept_response(Transfer *transfer)
+    {
+      curl_easy_getinfo(transfer->easy, CURLINFO_RESPONSE_CODE,
+                        &transfer->status);
+      if (transfer->ranged && transfer->status == 206)
+      {
+        return transfer->content_range_begin == transfer->range.begin;
+      }
+      if (transfer->status == 200 && (!transfer->ranged || transfer->may_be_whole))
+      {
+        transfer->whole = transfer->ranged;
+        return true;
+      }
+      return false;
+    }
+
+    bool write_at(DownloadJob *job, const char *data, size_t length,
+                  uint64_t offset)
+    {
+      size_t done = 0;
+      while (done < length)
+      {
+        const ssize_t n = pwrite(job->fd, data + done, length - done,
+                                 static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (n <= 0)
+        {
+          job->write_failed = true;
+          job->write_errno = errno;
+          return false;
+        }
+        done += static_cast<size_t>(n);
+      }
+      return true;
+    }
+
+    // Appends what length bytes of the compressed body decompress to. The
+    // loop also runs while the output buffer comes back full, since the
+    // decompressor may be holding more.
+    bool decompress(DownloadJob *job, const char *data, size_t length)
+    {
+#ifndef DESKTOP_UPDATER_ZSTD
+      fail(job, job->url + ": built without libzstd");
+      return false;
+#else
+      ZSTD_inBuffer input = {data, length, 0};
+      bool flushed = false;
+      while (input.pos < input.size || !flushed)
+      {
+        ZSTD_outBuffer output = {job->output->data(), job->output->size(), 0};
+        const size_t result = ZSTD_decompressStream(job->dctx, &output, &input);
+        if (ZSTD_isError(result))
+        {
+          fail(job, job->url + ": " + ZSTD_getErrorName(result));
+          return false;
+        }
+        if (!write_at(job, reinterpret_cast<const char *>(job->output->data()),
+                      output.pos, job->output_offset))
+        {
+          return false;
+        }
+        job->output_offset += output.pos;
+        job->frame_done = result == 0;
+        flushed = output.pos < output.size;
+      }
+      return true;
+#endif
+    }
+
+    size_t on_data(char *data, size_t size, size_t count, void *user)
+    {
+      Transfer *transfer = static_cast<Transfer *>(user);
+      DownloadJob *job = transfer->job;
+      const size_t length = size * count;
+      if (job->failed || job_cancelled(job))
+      {
+        return 0;
+      }
+      if (!transfer->checked)
+      {
+        transfer->checked = true;
+        if (!accept_response(transfer))
+        {
+          transfer->rejected = true;
+          return 0;
+        }
+      }
+      const uint64_t offset = transfer->range.begin + transfer->written;
+      const uint64_t end = transfer->whole ? kUnknownEnd : transfer->range.end;
+      if (end != kUnknownEnd && length > end - offset)
+      {
+        transfer->rejected = true;
+        return 0;
+      }
+      if (job->limits != nullptr &&
+          !job->limits->network_bytes.acquire(length, job->options.cancel))
+      {
+        return 0;
+      }
+      if (job->body != nullptr)
+      {
+        if (length > job->body->size() - job->body_size)
+        {
+          fail(job, job->url + ": larger than " +
+                        std::to_string(job->body->size()) + " bytes");
+          return 0;
+        }
+        memcpy(job->body->data() + job->body_size, data, length);
+        job->body_size += length;
+      }
+      else if (job->dctx != nullptr ? !decompress(job, data, length)
+                                    : !write_at(job, data, length, offset))
+      {
+        return 0;
+      }
+      transfer->written += length;
+      job->received += length;
+      job->progress->received += length;
+      return length;
+    }
+
+    std::unique_ptr<Transfer> launch(CURLM *multi, DownloadJob *job,
+                                     const Range &range)
+    {
+      std::unique_ptr<Transfer> transfer(new Transfer());
+      transfer->job = job;
+      transfer->range = range;
+      transfer->ranged = job->split;
+      transfer->may_be_whole =
+          job->split && range.begin == 0 && !job->stats->split;
+      CURL *easy = curl_easy_init();
+      transfer->easy = easy;
+      curl_easy_setopt(easy, CURLOPT_URL, job->url.c_str());
+      curl_easy_setopt(easy, CURLOPT_PRIVATE, transfer.get());
+      curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, on_data);
+      curl_easy_setopt(easy, CURLOPT_WRITEDATA, transfer.get());
+      curl_easy_setopt(easy, CURLOPT_BUFFERSIZE, kReceiveBufferSize);
+      curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, on_header);
+      curl_easy_setopt(easy, CURLOPT_HEADERDATA, transfer.get());
+      curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+      curl_easy_setopt(easy, CURLOPT_MAXREDIRS, 5L);
+      curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+      curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, kConnectTimeoutSeconds);
+      curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, kStallBytesPerSecond);
+      curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, kStallSeconds);
+      // HTTP/2 is negotiated with ALPN over TLS and with an Upgrade: h2c
+      // header otherwise; servers without it answer over HTTP/1.1.
+      curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
+      // Waits for a connection being set up to the same host rather than
+      // opening another, in case it turns out to multiplex.
+      curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+      curl_easy_setopt(easy, CURLOPT_STREAM_WEIGHT, job->weight);
+      char header[64];
+      if (job->split)
+      {
+        snprintf(header, sizeof(header), "%llu-%llu",
+                 static_cast<unsigned long long>(range.begin),
+                 static_cast<unsigned long long>(range.end - 1));
+        curl_easy_setopt(easy, CURLOPT_RANGE, header);
+      }
+      curl_multi_add_handle(multi, easy);
+      job->active++;
+      job->stats->peak_connections =
+          std::max(job->stats->peak_connections, job->active);
+      return transfer;
+    }
+
+    // Once the server answers a range with 206, requests are added.
+    void note_ranges(DownloadJob *job, const Transfer &transfer)
+    {
+      if (transfer.status == 206 && !job->stats->split)
+      {
+        job->stats->split = true;
+        job->target = std::max(job->target, 2);
+        job->sample_start = Clock::now();
+        job->sample_received = job->received;
+      }
+    }
+
+    void finish_transfer(DownloadJob *job, Transfer *transfer,
+                         CURLcode result)
+    {
+      if (!transfer->checked && result == CURLE_OK)
+      {
+        // An empty body never reached on_data().
+        transfer->checked = true;
+        transfer->rejected = !accept_response(transfer);
+      }
+      long version = 0;
+      if (curl_easy_getinfo(transfer->easy, CURLINFO_HTTP_VERSION, &version) ==
+              CURLE_OK &&
+          version == CURL_HTTP_VERSION_2_0)
+      {
+        job->stats->http2 = true;
+      }
+      const uint64_t expected =
+          transfer->whole ? job->length : transfer->range.end - transfer->range.begin;
+      const bool complete =
+          result == CURLE_OK && !transfer->rejected &&
+          (expected == kUnknownEnd || expected == 0 ||
+           transfer->written == expected);
+
+      if (job->failed)
+      {
+        return;
+      }
+      if (complete)
+      {
+        job->stats->requests++;
+        job->completed += transfer->written;
+        if (transfer->whole)
+        {
+          // The server ignored Range and sent everything at once.
+          job->pending.clear();
+        }
+      }
+      else if (job_cancelled(job))
+      {
+        fail(job, "cancelled");
+      }
+      else if (job->write_failed)
+      {
+        fail(job, "cannot write " + job->path + ": " +
+                      strerror(job->write_errno));
+      }
+      else
+      {
+        Range rest = transfer->range;
+        if (transfer->ranged && !transfer->whole)
+        {
+          rest.begin += transfer->written;
+          job->completed += transfer->written;
+        }
+        else
+        {
+          // Without ranges there is no resuming; start over.
+          job->progress->received -= transfer->written;
+          rest.begin = 0;
+          rest.end = transfer->whole ? job->length : rest.end;
+          if (job->dctx != nullptr)
+          {
+#ifdef DESKTOP_UPDATER_ZSTD
+            ZSTD_DCtx_reset(job->dctx, ZSTD_reset_session_only);
+#endif
+            job->output_offset = 0;
+            job->frame_done = false;
+          }
+          job->body_size = 0;
+        }
+        if (++rest.attempts >= job->options.max_attempts)
+        {
+          char reason[128];
+          if (result != CURLE_OK && !transfer->rejected)
+          {
+            snprintf(reason, sizeof(reason), "%s",
+                     curl_easy_strerror(result));
+          }
+          else
+          {
+            snprintf(reason, sizeof(reason), "unexpected response (HTTP %ld)",
+                     transfer->status);
+          }
+          fail(job, job->url + ": " + reason);
+        }
+        else
+        {
+          job->stats->retries++;
+          job->pending.push_front(rest);
+        }
+      }
+      note_ranges(job, *transfer);
+    }
+
+    // Adds a request while the last one raised the job's throughput.
+    void adjust_target(DownloadJob *job, Clock::time_point now)
+    {
+      const double elapsed =
+          std::chrono::duration<double>(now - job->sample_start).count();
+      if (!job->stats->split || !job->growing ||
+          elapsed * 1000 < job->options.sample_interval_ms)
+      {
+        return;
+      }
+      const double rate = (job->received - job->sample_received) / elapsed;
+      if (rate >= job->best_rate * 1.1 &&
+          job->target < job->options.max_connections)
+      {
+        job->best_rate = rate;
+        job->target++;
+      }
+      else
+      {
+        // The last request added did not pay off; retire it.
+        if (rate < job->best_rate * 1.1)
+        {
+          job->target = std::max(2, job->target - 1);
+        }
+        job->growing = false;
+      }
+      job->sample_start = now;
+      job->sample_received = job->received;
+    }
+
+    // Closes the file of a job with no requests left in flight.
+    void finish_job(DownloadJob *job)
+    {
+      job->stats->bytes = job->received;
+      if (!job->failed && job->length > 0 && job->completed != job->length)
+      {
+        fail(job, job->url + ": received " + std::to_string(job->completed) +
+                      " of " + std::to_string(job->length) + " bytes");
+      }
+      if (!job->failed && job->dctx != nullptr && !job->frame_done)
+      {
+        fail(job, job->url + ": compressed data ends mid-frame");
+      }
+      if (job->fd >= 0 && close(job->fd) != 0)
+      {
+        fail(job, "cannot write " + job->path + ": " + strerror(errno));
+      }
+      if (job->failed && !job->path.empty())
+      {
+        unlink(job->path.c_str());
+      }
+    }
+
+    // Picks the job's stream weight and cuts it into the ranges to fetch.
+    void plan(DownloadJob *job)
+    {
+      const DownloadOptions &options = job->options;
+      job->weight = options.stream_weight > 0
+                        ? std::min(options.stream_weight, kMaxStreamWeight)
+                    : job->length > 0 && job->length < options.small_file_size
+                        ? kSmallFileStreamWeight
+                        : kDefaultStreamWeight;
+      job->split = job->length > 0 && job->length >= options.split_threshold &&
+                   options.max_connections > 1 && options.range_size > 0 &&
+                   job->dctx == nullptr && job->body == nullptr;
+      job->growing = job->split;
+      if (job->split)
+      {
+        for (uint64_t begin = 0; begin < job->length;
+             begin += options.range_size)
+        {
+          job->pending.push_back(
+              {begin, std::min(begin + options.range_size, job->length), 0});
+        }
+      }
+      else
+      {
+        job->pending.push_back(
+            {0, job->length > 0 ? job->length : kUnknownEnd, 0});
+      }
+    }
+
+    void wake(int fd)
+    {
+      const uint64_t one = 1;
+      if (write(fd, &one, sizeof(one)) < 0)
+      {
+        // Already pending; the download thread drains the counter.
+      }
+    }
+
+    std::once_flag curl_initialized;
+  } // namespace
+
+  std::shared_ptr<DownloadProgress> DownloadRegistry::add(const std::string &id)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<DownloadProgress> progress(new DownloadProgress());
+    downloads_[id] = progress;
+    return progress;
+  }
+
+  std::shared_ptr<DownloadProgress> DownloadRegistry::find(
+      const std::string &id) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = downloads_.find(id);
+    return it == downloads_.end() ? nullptr : it->second;
+  }
+
+  void DownloadRegistry::remove(const std::string &id)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    downloads_.erase(id);
+  }
+
+  std::map<std::string, uint64_t> DownloadRegistry::received() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, uint64_t> received;
+    for (const auto &download : downloads_)
+    {
+      received[download.first] = download.second->received.load();
+    }
+    return received;
+  }
+
+  Downloader::Downloader(IoLimits *limits, MemoryBudget *budget)
+      : limits_(limits), budget_(budget),
+        wake_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+  {
+    // curl_global_init() is not thread-safe, so it runs once up front.
+    std::call_once(curl_initialized,
+                   []()
+                   { curl_global_init(CURL_GLOBAL_DEFAULT); });
+  }
+
+  Downloader::~Downloader()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake(wake_fd_);
+    if (thread_.joinable())
+    {
+      thread_.join();
+    }
+    close(wake_fd_);
+  }
+
+  bool Downloader::download(const std::string &url, const std::string &path,
+                            uint64_t length, const DownloadOptions &options,
+                            DownloadProgress *progress, DownloadStats *stats,
+                            std::string *error)
+  {
+    *stats = DownloadStats();
+    std::shared_ptr<DownloadDictionary> dictionary;
+    if (!options.dictionary_url.empty())
+    {
+#ifdef DESKTOP_UPDATER_ZSTD
+      dictionary = fetch_dictionary(options.dictionary_url, options.cancel,
+                                    error);
+#else
+      *error = url + ": built without libzstd";
+#endif
+      if (dictionary == nullptr)
+      {
+        return false;
+      }
+    }
+    // Taken here rather than on the download thread, which must never wait
+    // on the budget: the downloads it would wait for run on it too. The
+    // receive and output buffers are reserved in one go, since a download
+    // holding one while waiting for the other could wait forever on others
+    // doing the same.
+    const bool may_split = length >= options.split_threshold &&
+                           options.max_connections > 1 && dictionary == nullptr;
+    size_t output_size = 0;
+#ifdef DESKTOP_UPDATER_ZSTD
+    if (dictionary != nullptr)
+    {
+      output_size = ZSTD_DStreamOutSize();
+    }
+#endif
+    BudgetReservation reserved(
+        budget_,
+        kReceiveBufferSize * (may_split ? options.max_connections : 1) +
+            output_size,
+        options.cancel);
+    if (!reserved.ok())
+    {
+      *error = "cancelled";
+      return false;
+    }
+    std::unique_ptr<BudgetedBuffer> output;
+    if (output_size > 0)
+    {
+      // Already charged by reserved.
+      output.reset(new BudgetedBuffer(nullptr, output_size));
+    }
+    const int fd =
+        open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+      *error = "cannot create " + path + ": " + strerror(errno);
+      return false;
+    }
+    // Reserving the blocks up front keeps ranges landing out of order from
+    // fragmenting the file; where fallocate() is unsupported the file is
+    // only sized. A compressed file's length is not the size it ends up.
+    if (length > 0 && dictionary == nullptr &&
+        fallocate(fd, 0, 0, static_cast<off_t>(length)) != 0 &&
+        ftruncate(fd, static_cast<off_t>(length)) != 0)
+    {
+      *error = "cannot allocate " + path + ": " + strerror(errno);
+      close(fd);
+      unlink(path.c_str());
+      return false;
+    }
+
+    DownloadJob job;
+    job.url = url;
+    job.path = path;
+    job.length = length;
+    job.options = options;
+    job.progress = progress;
+    job.stats = stats;
+    job.error = error;
+    job.limits = limits_;
+    job.fd = fd;
+#ifdef DESKTOP_UPDATER_ZSTD
+    if (dictionary != nullptr)
+    {
+      job.dctx = ZSTD_createDCtx();
+      ZSTD_DCtx_refDDict(job.dctx, dictionary->ddict);
+      job.output = output.get();
+    }
+#endif
+    plan(&job);
+    const bool ok = run_job(&job);
+#ifdef DESKTOP_UPDATER_ZSTD
+    ZSTD_freeDCtx(job.dctx);
+#endif
+    return ok;
+  }
+
+  bool Downloader::run_job(DownloadJob *job)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!thread_.joinable())
+    {
+      thread_ = std::thread(&Downloader::run, this);
+    }
+    queued_.push_back(job);
+    wake(wake_fd_);
+    done_cv_.wait(lock, [job]()
+                  { return job->done; });
+    return !job->failed;
+  }
+
+#ifdef DESKTOP_UPDATER_ZSTD
+  std::shared_ptr<DownloadDictionary> Downloader::fetch_dictionary(
+      const std::string &url, const CancellationToken *cancel,
+      std::string *error)
+  {
+    std::shared_ptr<DownloadDictionary> dictionary;
+    {
+      std::lock_guard<std::mutex> lock(dictionaries_mutex_);
+      if (dictionaries_.count(url) == 0 &&
+          dictionaries_.size() >= kMaxDictionaries)
+      {
+        dictionaries_.clear();
+      }
+      std::shared_ptr<DownloadDictionary> &slot = dictionaries_[url];
+      if (slot == nullptr)
+      {
+        slot.reset(new DownloadDictionary());
+      }
+      dictionary = slot;
+    }
+
+    std::lock_guard<std::mutex> lock(dictionary->mutex);
+    if (dictionary->ddict == nullptr && dictionary->error.empty())
+    {
+      BudgetedBuffer body(budget_, kMaxDictionarySize, cancel);
+      if (!body.ok())
+      {
+        *error = "cancelled";
+        return nullptr;
+      }
+      // Every compressed file waits for it, so it goes first.
+      DownloadProgress progress;
+      DownloadStats stats;
+      DownloadJob job;
+      job.url = url;
+      job.options.stream_weight = kMaxStreamWeight;
+      job.options.cancel = cancel;
+      job.progress = &progress;
+      job.stats = &stats;
+      job.error = &dictionary->error;
+      job.limits = limits_;
+      job.body = &body;
+      plan(&job);
+      // A raw-content dictionary has no ID; bin/archive.dart only publishes
+      // trained ones, so anything else is the wrong file. A failed fetch
+      // has already set the error.
+      if (run_job(&job))
+      {
+        dictionary->ddict =
+            ZSTD_getDictID_fromDict(body.data(), job.body_size) != 0
+                ? ZSTD_createDDict(body.data(), job.body_size)
+                : nullptr;
+        if (dictionary->ddict == nullptr)
+        {
+          dictionary->error = url + ": not a zstd dictionary";
+        }
+      }
+      else if (is_cancelled(cancel))
+      {
+        // Not the dictionary's fault; the next update fetches it again.
+        dictionary->error.clear();
+        *error = "cancelled";
+        return nullptr;
+      }
+    }
+    if (dictionary->ddict == nullptr)
+    {
+      *error = dictionary->error;
+      return nullptr;
+    }
+    return dictionary;
+  }
+#endif
+
+  void Downloader::run()
+  {
+    CURLM *multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, kMaxHostConnections);
+    std::vector<DownloadJob *> jobs;
+    std::vector<std::unique_ptr<Transfer>> active;
+
+    while (true)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs.insert(jobs.end(), queued_.begin(), queued_.end());
+        queued_.clear();
+        if (jobs.empty() && stopping_)
+        {
+          break;
+        }
+      }
+
+      for (DownloadJob *job : jobs)
+      {
+        if (job_cancelled(job))
+        {
+          fail(job, "cancelled");
+        }
+        while (!job->failed && job->active < job->target &&
+               !job->pending.empty())
+        {
+          active.push_back(launch(multi, job, job->pending.front()));
+          job->pending.pop_front();
+        }
+      }
+
+      int running = 0;
+      curl_multi_perform(multi, &running);
+      int queued = 0;
+      while (CURLMsg *message = curl_multi_info_read(multi, &queued))
+      {
+        if (message->msg != CURLMSG_DONE)
+        {
+          continue;
+        }
+        auto it = std::find_if(active.begin(), active.end(),
+                               [message](const std::unique_ptr<Transfer> &t)
+                               { return t->easy == message->easy_handle; });
+        Transfer *transfer = it->get();
+        finish_transfer(transfer->job, transfer, message->data.result);
+        transfer->job->active--;
+        curl_multi_remove_handle(multi, transfer->easy);
+        curl_easy_cleanup(transfer->easy);
+        active.erase(it);
+      }
+
+      // Requests of failed jobs are abandoned; the first 206 of the others
+      // arrives long before its range completes.
+      const Clock::time_point now = Clock::now();
+      for (auto it = active.begin(); it != active.end();)
+      {
+        DownloadJob *job = (*it)->job;
+        if (job->failed)
+        {
+          job->active--;
+          curl_multi_remove_handle(multi, (*it)->easy);
+          curl_easy_cleanup((*it)->easy);
+          it = active.erase(it);
+          continue;
+        }
+        note_ranges(job, **it);
+        ++it;
+      }
+
+      for (auto it = jobs.begin(); it != jobs.end();)
+      {
+        DownloadJob *job = *it;
+        if (job->active > 0 || (!job->failed && !job->pending.empty()))
+        {
+          adjust_target(job, now);
+          ++it;
+          continue;
+        }
+        finish_job(job);
+        it = jobs.erase(it);
+        std::lock_guard<std::mutex> lock(mutex_);
+        job->done = true;
+        done_cv_.notify_all();
+      }
+
+      // Cancellation tokens are polled with the wake fd, so a cancel ends
+      // the wait at once rather than at the next poll interval.
+      std::vector<curl_waitfd> waits(1, curl_waitfd{wake_fd_, CURL_WAIT_POLLIN, 0});
+      for (const DownloadJob *job : jobs)
+      {
+        const CancellationToken *cancel = job->options.cancel;
+        if (cancel != nullptr &&
+            std::none_of(waits.begin(), waits.end(),
+                         [cancel](const curl_waitfd &wait)
+                         { return wait.fd == cancel->fd(); }))
+        {
+          waits.push_back(curl_waitfd{cancel->fd(), CURL_WAIT_POLLIN, 0});
+        }
+      }
+      curl_multi_poll(multi, waits.data(), static_cast<unsigned int>(waits.size()),
+                      jobs.empty() ? kIdlePollMs : kPollMs, nullptr);
+      if (waits[0].revents != 0)
+      {
+        uint64_t count;
+        while (read(wake_fd_, &count, sizeof(count)) > 0)
+        {
+        }
+      }
+    }
+
+    curl_multi_cleanup(multi);
+  }
+
+} // namespace desktop_updater
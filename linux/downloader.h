@@ -0,0 +1,166 @@
+#ifndef DESKTOP_UPDATER_DOWNLOADER_H_
+#define DESKTOP_UPDATER_DOWNLOADER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "cancellation.h"
+#include "memory_budget.h"
+#include "rate_limiter.h"
+
+namespace desktop_updater
+{
+
+  struct DownloadOptions
+  {
+    // Files at least this large are fetched as parallel byte ranges.
+    uint64_t split_threshold = 32ull << 20;
+    // Size of the ranges a split file is cut into. Connections take the next
+    // range as they finish one, so faster connections fetch more of them.
+    uint64_t range_size = 4ull << 20;
+    // Most connections one file is fetched over.
+    int max_connections = 8;
+    // How often throughput is sampled to decide whether another connection
+    // helps.
+    int sample_interval_ms = 500;
+    // Attempts per range before the download fails.
+    int max_attempts = 3;
+    // HTTP/2 stream weight, 1 to 256, of this file's requests; 0 weights
+    // files below small_file_size up so they are not starved by the ranges
+    // of large files sharing their connection.
+    int stream_weight = 0;
+    uint64_t small_file_size = 1ull << 20;
+    // URL of the zstd dictionary the file at url was compressed with, as
+    // bin/archive.dart publishes it; empty for files sent as they are. The
+    // response is decompressed as it arrives, so path receives the original
+    // bytes while length and progress count the compressed ones.
+    std::string dictionary_url;
+    // Cancels the download like DownloadProgress::cancelled does, and wakes
+    // the download thread's poll when it fires. May be null.
+    const CancellationToken *cancel = nullptr;
+  };
+
+  struct DownloadStats
+  {
+    uint64_t bytes = 0;
+    // Completed requests, one per range or one for a whole file.
+    size_t requests = 0;
+    // Most requests in flight at once. Over HTTP/2 these are streams that
+    // share connections with each other and with other downloads.
+    int peak_connections = 0;
+    int retries = 0;
+    // Whether the file was fetched as ranges; false for files below the
+    // threshold and servers that ignore Range.
+    bool split = false;
+    // Whether the responses came over HTTP/2.
+    bool http2 = false;
+  };
+
+  // State of one download shared with the threads that report or cancel it.
+  struct DownloadProgress
+  {
+    std::atomic<uint64_t> received{0};
+    std::atomic<bool> cancelled{false};
+  };
+
+  // Downloads in flight by the id their caller chose, so other threads can
+  // poll or cancel them.
+  class DownloadRegistry
+  {
+  public:
+    // Replaces any download registered under id.
+    std::shared_ptr<DownloadProgress> add(const std::string &id);
+    // Null if no download is registered under id.
+    std::shared_ptr<DownloadProgress> find(const std::string &id) const;
+    void remove(const std::string &id);
+    // Bytes received so far by every registered download, by id.
+    std::map<std::string, uint64_t> received() const;
+
+  private:
+    mutable std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<DownloadProgress>> downloads_;
+  };
+
+  struct DownloadJob;
+  struct DownloadDictionary;
+
+  // Native counterpart of FileDownloader._tryDownloadFile in
+  // lib/src/download.dart.
+  //
+  // All downloads run on one background thread sharing a libcurl multi
+  // handle, so requests to the same host reuse its connections: over HTTP/2
+  // the files in flight are multiplexed as weighted streams over a few
+  // connections, and over HTTP/1.1 at most kMaxHostConnections are opened
+  // however many files are requested at once.
+  //
+  // A file of at least split_threshold bytes is preallocated and fetched as
+  // byte ranges, each range written in place with pwrite(). The first range
+  // goes out alone: if the server answers it with the whole file instead of
+  // 206, that response simply continues as a single-stream download.
+  // Otherwise a second request is added, and every sample interval one more
+  // while the last addition raised the throughput by at least a tenth, up to
+  // max_connections. A request that did not help is retired once its range
+  // is done. Failed ranges are retried from the last byte received.
+  //
+  // Compressed files are never split. Their dictionary is fetched by the
+  // first download that needs it and kept for the ones after it. Built
+  // without DESKTOP_UPDATER_ZSTD, downloads with a dictionary_url fail.
+  //
+  // The buffers a download holds, libcurl's receive buffer per request, the
+  // decompressor's output and a dictionary being fetched, are charged to
+  // budget, if given, before the download is queued.
+  class Downloader
+  {
+  public:
+    explicit Downloader(IoLimits *limits = nullptr,
+                        MemoryBudget *budget = nullptr);
+    // Waits for downloads still running; they should be cancelled first.
+    ~Downloader();
+
+    Downloader(const Downloader &) = delete;
+    Downloader &operator=(const Downloader &) = delete;
+
+    // Downloads url to path, blocking until done; may be called from any
+    // number of threads at once. length is the size hashes.json lists, or 0
+    // if unknown, which disables splitting. On failure path is removed and
+    // error describes why.
+    bool download(const std::string &url, const std::string &path,
+                  uint64_t length, const DownloadOptions &options,
+                  DownloadProgress *progress, DownloadStats *stats,
+                  std::string *error);
+
+  private:
+    // Queues job and blocks until the download thread is done with it.
+    bool run_job(DownloadJob *job);
+    // The dictionary at url, fetched once; null with error set if it cannot
+    // be fetched or is not a zstd dictionary. A cancelled fetch is tried
+    // again by the next download.
+    std::shared_ptr<DownloadDictionary> fetch_dictionary(
+        const std::string &url, const CancellationToken *cancel,
+        std::string *error);
+    void run();
+
+    IoLimits *limits_;
+    MemoryBudget *budget_;
+    // Wakes the download thread when a job is queued or on shutdown.
+    int wake_fd_ = -1;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable done_cv_;
+    std::deque<DownloadJob *> queued_;
+    bool stopping_ = false;
+    // Dictionaries by URL.
+    std::mutex dictionaries_mutex_;
+    std::map<std::string, std::shared_ptr<DownloadDictionary>> dictionaries_;
+  };
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_DOWNLOADER_H_
@@ -0,0 +1,125 @@
+#include "event_ring.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <thread>
+
+namespace desktop_updater
+{
+
+  EventRing::EventRing(size_t capacity)
+  {
+    size_t size = 2;
+    while (size < capacity)
+    {
+      size <<= 1;
+    }
+    slots_.reset(new Slot[size]);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; i++)
+    {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  }
+
+  EventRing::~EventRing()
+  {
+    if (wake_fd_ >= 0)
+    {
+      close(wake_fd_);
+    }
+  }
+
+  bool EventRing::try_push(const MainLoopEvent &event)
+  {
+    size_t position = tail_.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;)
+    {
+      slot = &slots_[position & mask_];
+      const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      const intptr_t difference =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+      if (difference == 0)
+      {
+        if (tail_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (difference < 0)
+      {
+        return false; // the drain has not freed this slot yet
+      }
+      else
+      {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->event = event;
+    slot->sequence.store(position + 1, std::memory_order_release);
+    wake();
+    return true;
+  }
+
+  void EventRing::push(const MainLoopEvent &event)
+  {
+    while (!try_push(event))
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  void EventRing::wake()
+  {
+    // The exchange pairs with the one in drain(): either the drain that
+    // clears the flag sees this event, or this push sees the flag cleared
+    // and wakes the next one.
+    if (wake_pending_.exchange(true, std::memory_order_acq_rel))
+    {
+      return;
+    }
+    const uint64_t one = 1;
+    while (write(wake_fd_, &one, sizeof(one)) < 0 && errno == EINTR)
+    {
+    }
+  }
+
+  size_t EventRing::drain(size_t max_events)
+  {
+    uint64_t count;
+    while (read(wake_fd_, &count, sizeof(count)) < 0 && errno == EINTR)
+    {
+    }
+    wake_pending_.exchange(false, std::memory_order_acq_rel);
+
+    size_t ran = 0;
+    while (ran < max_events)
+    {
+      Slot &slot = slots_[head_ & mask_];
+      if (slot.sequence.load(std::memory_order_acquire) != head_ + 1)
+      {
+        // Empty, or the next producer has claimed its slot but not filled
+        // it yet; its push wakes the next drain.
+        return ran;
+      }
+      const MainLoopEvent event = slot.event;
+      slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+      head_++;
+      event.run(event.data);
+      ran++;
+    }
+    if (slots_[head_ & mask_].sequence.load(std::memory_order_acquire) ==
+        head_ + 1)
+    {
+      wake();
+    }
+    return ran;
+  }
+
+} // namespace desktop_updater
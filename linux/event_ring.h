@@ -0,0 +1,79 @@
+#ifndef DESKTOP_UPDATER_EVENT_RING_H_
+#define DESKTOP_UPDATER_EVENT_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace desktop_updater
+{
+
+  // Work a native thread hands to the GTK main loop: run(data) is called on
+  // the thread that drains the ring.
+  struct MainLoopEvent
+  {
+    void (*run)(void *data) = nullptr;
+    void *data = nullptr;
+  };
+
+  // Bounded lock-free queue of MainLoopEvents that any number of threads
+  // push into and one thread, the GTK main loop, drains in batches.
+  //
+  // Each slot carries a sequence number (Vyukov's bounded queue): producers
+  // claim a slot with one compare-and-swap on the tail and publish it by
+  // bumping its sequence, so they never wait on each other or on the drain.
+  // The drain side is single-threaded and needs no atomic read-modify-write
+  // per event.
+  //
+  // wake_fd() is an eventfd that becomes readable when events are waiting.
+  // It is written only by the push that finds no wakeup pending, so a burst
+  // of events costs one main loop wakeup however many it holds.
+  class EventRing
+  {
+  public:
+    // capacity is rounded up to a power of two.
+    explicit EventRing(size_t capacity);
+    ~EventRing();
+
+    EventRing(const EventRing &) = delete;
+    EventRing &operator=(const EventRing &) = delete;
+
+    int wake_fd() const { return wake_fd_; }
+    size_t capacity() const { return mask_ + 1; }
+
+    // Queues event unless the ring is full.
+    bool try_push(const MainLoopEvent &event);
+    // Queues event, yielding while the ring is full so producers slow down
+    // to the drain rate. Must not be called from the draining thread.
+    void push(const MainLoopEvent &event);
+
+    // Runs up to max_events queued events, in the order they were pushed,
+    // on the calling thread, which must be the only one draining. If more
+    // are left, wake_fd() stays readable for the next round. Returns how
+    // many ran.
+    size_t drain(size_t max_events);
+
+  private:
+    struct Slot
+    {
+      std::atomic<size_t> sequence;
+      MainLoopEvent event;
+    };
+
+    void wake();
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    // Producers and the drain each keep to their own cache line.
+    char pad0_[64];
+    std::atomic<size_t> tail_{0};
+    char pad1_[64];
+    size_t head_ = 0;
+    char pad2_[64];
+    std::atomic<bool> wake_pending_{false};
+    int wake_fd_ = -1;
+  };
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_EVENT_RING_H_
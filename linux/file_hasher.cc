@@ -0,0 +1,763 @@
+#include "file_hasher.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <set>
+
+#include "blake2b.h"
+#include "blake3.h"
+#include "page_cache.h"
+#include "work_scheduler.h"
+
+namespace desktop_updater
+{
+
+  const char kHashesFileName[] = "hashes.json";
+  const char kMerkleTreeFileName[] = "tree.json";
+  const char kZstdDictionaryFileName[] = "update.dict";
+  const char kZstdFileSuffix[] = ".zst";
+  const char kDeltaIndexFileName[] = "deltas.json";
+  const char kDeltaDirectoryName[] = "deltas";
+
+  namespace
+  {
+    const size_t kReadBufferSize = 256 * 1024;
+    // Span whose page cache footprint is undone at a time while hashing a
+    // file sequentially.
+    const uint64_t kCacheWindowSize = 8 * 1024 * 1024;
+    const size_t kDigestSize = 64;
+
+    Blake2bParams tree_params(uint64_t node_offset, uint8_t node_depth,
+                              bool last_node)
+    {
+      Blake2bParams params;
+      params.fanout = 0;
+      params.depth = 2;
+      params.leaf_length = kTreeLeafSize;
+      params.node_offset = node_offset;
+      params.node_depth = node_depth;
+      params.inner_length = kDigestSize;
+      params.last_node = last_node;
+      return params;
+    }
+
+    bool is_excluded(const std::string &path,
+                     const HashDirectoryOptions &options)
+    {
+      for (const std::string &suffix : options.excluded_suffixes)
+      {
+        if (path.size() >= suffix.size() &&
+            path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+          return true;
+        }
+      }
+      for (const std::string &excluded : options.excluded_paths)
+      {
+        if (path.compare(0, excluded.size(), excluded) == 0 &&
+            (path.size() == excluded.size() || path[excluded.size()] == '/'))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    struct WalkEntry
+    {
+      std::string relative_path;
+      FileStat stat;
+    };
+
+    // One directory of a parallel walk: its files and subdirectories in
+    // readdir order, each subdirectory listed by a task of its own.
+    struct WalkNode
+    {
+      struct Item
+      {
+        WalkEntry file;
+        std::unique_ptr<WalkNode> directory;
+      };
+
+      std::string relative_path;
+      std::vector<Item> items;
+    };
+
+    // Pre-order walk in readdir order, which is the order Dart's recursive
+    // Directory.list reports entries in.
+    void walk_directory(const std::string &root, const std::string &relative,
+                        const HashDirectoryOptions &options,
+                        std::vector<WalkEntry> *out)
+    {
+      const std::string dir_path =
+          relative.empty() ? root : root + "/" + relative;
+      DIR *dir = opendir(dir_path.c_str());
+      if (dir == nullptr)
+      {
+        return;
+      }
+      struct dirent *entry;
+      while (!is_cancelled(options.cancel) && (entry = readdir(dir)) != nullptr)
+      {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        {
+          continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+          continue;
+        }
+        const std::string child =
+            relative.empty() ? std::string(name) : relative + "/" + name;
+        if (S_ISDIR(st.st_mode))
+        {
+          walk_directory(root, child, options, out);
+        }
+        else if (S_ISREG(st.st_mode) && !is_excluded(child, options))
+        {
+          out->push_back(WalkEntry{child, to_file_stat(st)});
+        }
+      }
+      closedir(dir);
+    }
+
+    void list_node(ThreadPool *pool, WaitGroup *group, const std::string &root,
+                   const HashDirectoryOptions &options, WalkNode *node)
+    {
+      const std::string &relative = node->relative_path;
+      const std::string dir_path =
+          relative.empty() ? root : root + "/" + relative;
+      DIR *dir = opendir(dir_path.c_str());
+      if (dir == nullptr)
+      {
+        return;
+      }
+      struct dirent *entry;
+      while (!is_cancelled(options.cancel) && (entry = readdir(dir)) != nullptr)
+      {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        {
+          continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+          continue;
+        }
+        const std::string child =
+            relative.empty() ? std::string(name) : relative + "/" + name;
+        WalkNode::Item item;
+        if (S_ISDIR(st.st_mode))
+        {
+          item.directory.reset(new WalkNode());
+          item.directory->relative_path = child;
+          WalkNode *subdirectory = item.directory.get();
+          group->add();
+          pool->submit([pool, group, &root, &options, subdirectory]
+                       {
+                         list_node(pool, group, root, options, subdirectory);
+                         group->done();
+                       });
+        }
+        else if (S_ISREG(st.st_mode) && !is_excluded(child, options))
+        {
+          item.file = WalkEntry{child, to_file_stat(st)};
+        }
+        else
+        {
+          continue;
+        }
+        node->items.push_back(std::move(item));
+      }
+      closedir(dir);
+    }
+
+    void flatten(WalkNode *node, std::vector<WalkEntry> *out)
+    {
+      for (WalkNode::Item &item : node->items)
+      {
+        if (item.directory != nullptr)
+        {
+          flatten(item.directory.get(), out);
+        }
+        else
+        {
+          out->push_back(std::move(item.file));
+        }
+      }
+    }
+
+    // walk_directory() from root with each directory listed on the pool, so
+    // the stat calls of a large tree are in flight together.
+    void walk_parallel(ThreadPool *pool, const std::string &root,
+                       const HashDirectoryOptions &options,
+                       std::vector<WalkEntry> *out)
+    {
+      WalkNode top;
+      WaitGroup group;
+      list_node(pool, &group, root, options, &top);
+      group.wait();
+      flatten(&top, out);
+    }
+
+    // True if path or one of its parent directories is in paths.
+    bool covered_by(const std::set<std::string> &paths, const std::string &path)
+    {
+      if (paths.count("") != 0)
+      {
+        return true;
+      }
+      for (size_t end = path.size(); end != std::string::npos && end > 0;
+           end = path.rfind('/', end - 1))
+      {
+        if (paths.count(path.substr(0, end)) != 0)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Listing built from the index, where only paths the watcher reported
+    // are stat'ed or relisted.
+    void incremental_listing(const std::string &root,
+                             const HashDirectoryOptions &options,
+                             std::vector<WalkEntry> *out)
+    {
+      const std::set<std::string> &dirty = options.dirty->paths;
+      for (const std::string &path : options.index->paths())
+      {
+        if (!covered_by(dirty, path))
+        {
+          out->push_back(WalkEntry{path, options.index->lookup(path)->stat});
+        }
+      }
+      for (const std::string &path : dirty)
+      {
+        const size_t slash = path.rfind('/');
+        if (slash != std::string::npos && covered_by(dirty, path.substr(0, slash)))
+        {
+          continue; // Relisted with its parent.
+        }
+        struct stat st;
+        const std::string full = path.empty() ? root : root + "/" + path;
+        if (lstat(full.c_str(), &st) != 0)
+        {
+          continue; // Deleted or moved away.
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+          walk_directory(root, path, options, out);
+        }
+        else if (S_ISREG(st.st_mode) && !is_excluded(path, options))
+        {
+          out->push_back(WalkEntry{path, to_file_stat(st)});
+        }
+      }
+      std::sort(out->begin(), out->end(),
+                [](const WalkEntry &a, const WalkEntry &b)
+                { return a.relative_path < b.relative_path; });
+    }
+  } // namespace
+
+  void exclude_release_files(HashDirectoryOptions *options)
+  {
+    for (const char *suffix : {kHashesFileName, kZstdFileSuffix, ".DS_Store"})
+    {
+      options->excluded_suffixes.push_back(suffix);
+    }
+    for (const char *path : {kMerkleTreeFileName, kZstdDictionaryFileName,
+                             kDeltaIndexFileName, kDeltaDirectoryName})
+    {
+      options->excluded_paths.push_back(path);
+    }
+  }
+
+  struct FileHasher::FileJob
+  {
+    std::string path;
+    uint64_t size = 0;
+    uint64_t leaf_count = 0;
+    // Per-leaf digests (BLAKE2b tree) or chaining values (BLAKE3).
+    std::string leaf_digests;
+    std::atomic<uint64_t> remaining_leaves{0};
+    std::atomic<bool> failed{false};
+    std::string digest;
+    const CancellationToken *cancel = nullptr;
+  };
+
+  std::string blake2b_tree_root(const std::string &leaf_digests)
+  {
+    Blake2b root(tree_params(0, 1, true));
+    root.update(leaf_digests.data(), leaf_digests.size());
+    std::string digest(kDigestSize, '\0');
+    root.finish(reinterpret_cast<uint8_t *>(&digest[0]));
+    return digest;
+  }
+
+  FileHasher::FileHasher(ThreadPool *pool, MemoryBudget *budget,
+                         IoLimits *limits)
+      : pool_(pool), budget_(budget), limits_(limits) {}
+
+  bool FileHasher::charge_read(size_t bytes, const CancellationToken *cancel)
+  {
+    if (is_cancelled(cancel))
+    {
+      return false;
+    }
+    return limits_ == nullptr || limits_->charge_disk(bytes, cancel);
+  }
+
+  bool FileHasher::read_range(const FileJob &job, uint64_t begin, uint64_t end,
+                              const std::function<void(const uint8_t *, size_t)> &consume)
+  {
+    int fd = open(job.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      return false;
+    }
+    // Held until the range is consumed; blocks while the budget is used up.
+    BudgetedBuffer lease(budget_, kReadBufferSize, job.cancel);
+    if (!lease.ok())
+    {
+      close(fd);
+      return false;
+    }
+    uint8_t *buffer = lease.data();
+    CacheFootprint footprint;
+    footprint.begin(fd, begin, end - begin);
+    bool ok = true;
+    uint64_t offset = begin;
+    // Hands out whole buffers except for the last one, so callers can rely
+    // on chunk-aligned pieces.
+    while (ok && offset < end)
+    {
+      size_t want = static_cast<size_t>(end - offset);
+      if (want > kReadBufferSize)
+      {
+        want = kReadBufferSize;
+      }
+      size_t filled = 0;
+      while (filled < want)
+      {
+        if (!charge_read(want - filled, job.cancel))
+        {
+          ok = false;
+          break;
+        }
+        ssize_t n = pread(fd, buffer + filled, want - filled,
+                          static_cast<off_t>(offset + filled));
+        if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (n <= 0)
+        {
+          // Short read: the file shrank since it was listed.
+          ok = false;
+          break;
+        }
+        filled += static_cast<size_t>(n);
+      }
+      if (ok)
+      {
+        consume(buffer, filled);
+        offset += filled;
+      }
+    }
+    footprint.release();
+    close(fd);
+    return ok;
+  }
+
+  void FileHasher::hash_sequential(FileJob *job)
+  {
+    int fd = open(job->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      job->failed = true;
+      return;
+    }
+    Blake2b hasher;
+    BudgetedBuffer lease(budget_, kReadBufferSize, job->cancel);
+    if (!lease.ok())
+    {
+      close(fd);
+      job->failed = true;
+      return;
+    }
+    uint8_t *buffer = lease.data();
+    CacheFootprint footprint;
+    uint64_t offset = 0;
+    uint64_t window_end = 0;
+    for (;;)
+    {
+      if (offset >= window_end && window_end < job->size)
+      {
+        footprint.begin(fd, window_end,
+                        std::min(kCacheWindowSize, job->size - window_end));
+        window_end += kCacheWindowSize;
+      }
+      if (!charge_read(kReadBufferSize, job->cancel))
+      {
+        job->failed = true;
+        break;
+      }
+      ssize_t n = read(fd, buffer, kReadBufferSize);
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n < 0)
+      {
+        job->failed = true;
+        break;
+      }
+      if (n == 0)
+      {
+        break;
+      }
+      hasher.update(buffer, static_cast<size_t>(n));
+      offset += static_cast<uint64_t>(n);
+    }
+    footprint.release();
+    close(fd);
+    if (!job->failed)
+    {
+      job->digest.assign(kDigestSize, '\0');
+      hasher.finish(reinterpret_cast<uint8_t *>(&job->digest[0]));
+    }
+  }
+
+  void FileHasher::hash_blake2b_leaf(FileJob *job, uint64_t leaf)
+  {
+    const uint64_t begin = leaf * kTreeLeafSize;
+    const uint64_t end = std::min<uint64_t>(begin + kTreeLeafSize, job->size);
+
+    Blake2b hasher(tree_params(leaf, 0, leaf + 1 == job->leaf_count));
+    if (!read_range(*job, begin, end, [&hasher](const uint8_t *data, size_t length)
+                    { hasher.update(data, length); }))
+    {
+      job->failed = true;
+    }
+    if (!job->failed)
+    {
+      hasher.finish(
+          reinterpret_cast<uint8_t *>(&job->leaf_digests[leaf * kDigestSize]));
+    }
+
+    // The worker that completes the last leaf folds them into the root.
+    if (job->remaining_leaves.fetch_sub(1) == 1 && !job->failed)
+    {
+      job->digest = blake2b_tree_root(job->leaf_digests);
+    }
+  }
+
+  void FileHasher::hash_blake3_leaf(FileJob *job, uint64_t leaf)
+  {
+    const uint64_t begin = leaf * kTreeLeafSize;
+    const uint64_t end = std::min<uint64_t>(begin + kTreeLeafSize, job->size);
+    Blake3Cv *leaf_cvs = reinterpret_cast<Blake3Cv *>(&job->leaf_digests[0]);
+
+    if (job->size <= kBlake3ChunkSize)
+    {
+      // A single chunk is its own root and has no chaining value.
+      std::string data;
+      if (read_range(*job, 0, job->size, [&data](const uint8_t *bytes, size_t length)
+                     { data.append(reinterpret_cast<const char *>(bytes), length); }))
+      {
+        job->digest = blake3_hash(data.data(), data.size());
+      }
+      else
+      {
+        job->failed = true;
+      }
+      job->remaining_leaves.fetch_sub(1);
+      return;
+    }
+
+    // kTreeLeafSize is a power-of-two number of chunks, so each leaf is a
+    // complete subtree of the file's BLAKE3 tree (except a shorter last one).
+    std::vector<Blake3Cv> chunk_cvs;
+    chunk_cvs.reserve(kTreeLeafSize / kBlake3ChunkSize);
+    uint64_t chunk_counter = begin / kBlake3ChunkSize;
+    if (!read_range(*job, begin, end, [&](const uint8_t *data, size_t length)
+                    {
+                      const size_t first = chunk_cvs.size();
+                      chunk_cvs.resize(first + (length + kBlake3ChunkSize - 1) / kBlake3ChunkSize);
+                      blake3_chunk_cvs(data, length, chunk_counter, &chunk_cvs[first]);
+                      chunk_counter += chunk_cvs.size() - first; }))
+    {
+      job->failed = true;
+    }
+
+    if (!job->failed)
+    {
+      if (job->leaf_count == 1)
+      {
+        job->digest.assign(kBlake3OutSize, '\0');
+        blake3_merge(chunk_cvs.data(), chunk_cvs.size(), true, nullptr,
+                     reinterpret_cast<uint8_t *>(&job->digest[0]));
+      }
+      else
+      {
+        blake3_merge(chunk_cvs.data(), chunk_cvs.size(), false, &leaf_cvs[leaf],
+                     nullptr);
+      }
+    }
+
+    if (job->remaining_leaves.fetch_sub(1) == 1 && !job->failed &&
+        job->leaf_count > 1)
+    {
+      job->digest.assign(kBlake3OutSize, '\0');
+      blake3_merge(leaf_cvs, job->leaf_count, true, nullptr,
+                   reinterpret_cast<uint8_t *>(&job->digest[0]));
+    }
+  }
+
+  void FileHasher::run(std::vector<FileJob> *jobs, HashAlgorithm algorithm,
+                       const CancellationToken *cancel)
+  {
+    // Submitted longest first, so a large file does not start last and
+    // finish alone while the other workers are idle.
+    std::vector<uint64_t> sizes(jobs->size());
+    for (size_t i = 0; i < jobs->size(); i++)
+    {
+      sizes[i] = (*jobs)[i].size;
+    }
+    const WorkPlan plan =
+        plan_work(sizes, default_work_cost(WorkKind::kHash), pool_->size());
+
+    WaitGroup group;
+    for (size_t index : plan.order)
+    {
+      FileJob &job = (*jobs)[index];
+      FileJob *job_ptr = &job;
+      job.cancel = cancel;
+      if (algorithm == HashAlgorithm::kBlake2b)
+      {
+        group.add();
+        pool_->submit([this, job_ptr, &group]
+                      {
+                        hash_sequential(job_ptr);
+                        group.done();
+                      });
+        continue;
+      }
+
+      // An empty file still has one (empty) leaf.
+      job.leaf_count = job.size == 0 ? 1 : (job.size + kTreeLeafSize - 1) / kTreeLeafSize;
+      const size_t leaf_size = algorithm == HashAlgorithm::kBlake3 ? sizeof(Blake3Cv) : kDigestSize;
+      job.leaf_digests.assign(job.leaf_count * leaf_size, '\0');
+      job.remaining_leaves = job.leaf_count;
+      group.add(job.leaf_count);
+      for (uint64_t leaf = 0; leaf < job.leaf_count; leaf++)
+      {
+        pool_->submit([this, job_ptr, leaf, algorithm, &group]
+                      {
+                        if (algorithm == HashAlgorithm::kBlake3)
+                        {
+                          hash_blake3_leaf(job_ptr, leaf);
+                        }
+                        else
+                        {
+                          hash_blake2b_leaf(job_ptr, leaf);
+                        }
+                        group.done();
+                      });
+      }
+    }
+    group.wait();
+  }
+
+  bool FileHasher::hash_file(const std::string &path, HashAlgorithm algorithm,
+                             std::string *digest,
+                             const CancellationToken *cancel)
+  {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+      return false;
+    }
+    std::vector<FileJob> jobs(1);
+    jobs[0].path = path;
+    jobs[0].size = static_cast<uint64_t>(st.st_size);
+    run(&jobs, algorithm, cancel);
+    if (jobs[0].failed)
+    {
+      return false;
+    }
+    *digest = jobs[0].digest;
+    return true;
+  }
+
+  void FileHasher::hash_files(const std::vector<std::string> &paths,
+                              HashAlgorithm algorithm,
+                              std::vector<std::string> *digests,
+                              const CancellationToken *cancel)
+  {
+    digests->assign(paths.size(), std::string());
+    std::vector<size_t> readable;
+    std::vector<uint64_t> sizes;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+      struct stat st;
+      if (stat(paths[i].c_str(), &st) == 0 && S_ISREG(st.st_mode))
+      {
+        readable.push_back(i);
+        sizes.push_back(static_cast<uint64_t>(st.st_size));
+      }
+    }
+    std::vector<FileJob> jobs(readable.size());
+    for (size_t j = 0; j < readable.size(); j++)
+    {
+      jobs[j].path = paths[readable[j]];
+      jobs[j].size = sizes[j];
+    }
+    run(&jobs, algorithm, cancel);
+    for (size_t j = 0; j < readable.size(); j++)
+    {
+      if (!jobs[j].failed)
+      {
+        (*digests)[readable[j]] = jobs[j].digest;
+      }
+    }
+  }
+
+  bool FileHasher::hash_directory(const std::string &root,
+                                  const HashDirectoryOptions &options,
+                                  std::vector<FileHashEntry> *entries,
+                                  HashDirectoryStats *stats)
+  {
+    struct stat st;
+    if (stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+      return false;
+    }
+
+    std::vector<WalkEntry> listing;
+    if (options.dirty != nullptr && !options.dirty->full_scan &&
+        options.index != nullptr)
+    {
+      incremental_listing(root, options, &listing);
+    }
+    else
+    {
+      walk_parallel(pool_, root, options, &listing);
+    }
+    if (is_cancelled(options.cancel))
+    {
+      return false;
+    }
+
+    HashDirectoryStats counts;
+    const bool use_baseline = options.baseline != nullptr &&
+                              options.baseline_installed_ns > 0 &&
+                              options.baseline->algorithm() == options.algorithm;
+    const int64_t installed_before =
+        options.baseline_installed_ns + kBaselineInstallWindowNs;
+    std::vector<std::string> digests(listing.size());
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < listing.size(); i++)
+    {
+      const WalkEntry &file = listing[i];
+      const HashIndexEntry *known =
+          options.index != nullptr ? options.index->lookup(file.relative_path)
+                                   : nullptr;
+      if (known != nullptr && known->stat == file.stat &&
+          known->algorithm == options.algorithm)
+      {
+        digests[i] = known->digest;
+        counts.from_index++;
+        continue;
+      }
+      // Not touched since install, and unseen or unchanged since first
+      // seen: the build manifest still describes it. A size match alone
+      // proves nothing, so anything written after the install is hashed.
+      ManifestRecord record;
+      if (use_baseline && (known == nullptr || known->stat == file.stat) &&
+          file.stat.mtime_ns <= installed_before &&
+          file.stat.ctime_ns <= installed_before &&
+          options.baseline->find(file.relative_path, &record) &&
+          record.length == file.stat.size)
+      {
+        digests[i].assign(reinterpret_cast<const char *>(record.digest),
+                          options.baseline->digest_size());
+        counts.from_baseline++;
+        continue;
+      }
+      pending.push_back(i);
+    }
+
+    std::vector<FileJob> jobs(pending.size());
+    for (size_t j = 0; j < pending.size(); j++)
+    {
+      jobs[j].path = root + "/" + listing[pending[j]].relative_path;
+      jobs[j].size = listing[pending[j]].stat.size;
+    }
+    run(&jobs, options.algorithm, options.cancel);
+    if (is_cancelled(options.cancel))
+    {
+      return false;
+    }
+    for (size_t j = 0; j < pending.size(); j++)
+    {
+      if (!jobs[j].failed)
+      {
+        digests[pending[j]] = jobs[j].digest;
+        counts.hashed++;
+      }
+    }
+
+    entries->clear();
+    entries->reserve(listing.size());
+    std::vector<std::string> present;
+    present.reserve(listing.size());
+    for (size_t i = 0; i < listing.size(); i++)
+    {
+      if (digests[i].empty())
+      {
+        continue;
+      }
+      FileHashEntry entry;
+      entry.path = listing[i].relative_path;
+      entry.calculated_hash = base64_encode(
+          reinterpret_cast<const uint8_t *>(digests[i].data()),
+          digests[i].size());
+      entry.length = static_cast<int64_t>(listing[i].stat.size);
+      entry.algorithm = options.algorithm;
+      entries->push_back(entry);
+
+      if (options.index != nullptr)
+      {
+        HashIndexEntry indexed;
+        indexed.stat = listing[i].stat;
+        indexed.algorithm = options.algorithm;
+        indexed.digest = digests[i];
+        options.index->update(listing[i].relative_path, indexed);
+        present.push_back(listing[i].relative_path);
+      }
+    }
+    if (options.index != nullptr)
+    {
+      options.index->retain(present);
+    }
+    if (stats != nullptr)
+    {
+      *stats = counts;
+    }
+    return true;
+  }
+
+} // namespace desktop_updater
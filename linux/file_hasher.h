@@ -0,0 +1,150 @@
+#ifndef DESKTOP_UPDATER_FILE_HASHER_H_
+#define DESKTOP_UPDATER_FILE_HASHER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "binary_manifest.h"
+#include "cancellation.h"
+#include "directory_watcher.h"
+#include "hash_index.h"
+#include "manifest.h"
+#include "memory_budget.h"
+#include "rate_limiter.h"
+#include "thread_pool.h"
+
+namespace desktop_updater
+{
+
+  // Leaf size of the "blake2b-tree" algorithm. Changing it changes every
+  // digest, so it is part of the manifest format. BLAKE3 defines its own
+  // tree; the same size is only used there to split work between threads.
+  const uint32_t kTreeLeafSize = 1 << 20;
+
+  // How long unpacking a bundle may take: files written up to this long
+  // after the file carrying the build manifest still count as installed.
+  const int64_t kBaselineInstallWindowNs = 60 * 1000000000LL;
+
+  // Names bin/archive.dart publishes next to a release's files.
+  extern const char kHashesFileName[];
+  extern const char kMerkleTreeFileName[];
+  extern const char kZstdDictionaryFileName[];
+  extern const char kZstdFileSuffix[];
+  // Index of the deltas desktop_updater_delta made for the release, and the
+  // directory they are stored below.
+  extern const char kDeltaIndexFileName[];
+  extern const char kDeltaDirectoryName[];
+
+  struct HashDirectoryOptions
+  {
+    HashAlgorithm algorithm = HashAlgorithm::kBlake2b;
+    // Files whose path ends with one of these are left out of the manifest.
+    std::vector<std::string> excluded_suffixes;
+    // Files at these relative paths, or below them, are left out as well.
+    std::vector<std::string> excluded_paths;
+    // Digests of files whose stat data matches are reused instead of read;
+    // the index is updated with everything hashed. May be null.
+    HashIndex *index = nullptr;
+    // Manifest recorded at build time. Files the index has not seen since
+    // install are taken from it when their size matches and neither their
+    // mtime nor their ctime is later than baseline_installed_ns plus
+    // kBaselineInstallWindowNs; anything else is hashed. May be null.
+    const ManifestView *baseline = nullptr;
+    // When the bundle was installed, see BuildManifest::installed_ns(). With
+    // 0 no file is old enough to be taken from baseline.
+    int64_t baseline_installed_ns = 0;
+    // Changes recorded by a DirectoryWatcher since the index was last
+    // brought up to date. Unless it asks for a full scan, only these paths
+    // are looked at on disk and everything else is taken from the index.
+    // Requires index. May be null.
+    const DirtyPaths *dirty = nullptr;
+    // Checked while walking and between read buffers; once it is cancelled
+    // hash_directory() returns false without touching index. May be null.
+    const CancellationToken *cancel = nullptr;
+  };
+
+  // Leaves out what a release folder carries besides the bundle, as
+  // genFileHashes in bin/archive.dart does: the manifests, the zstd
+  // dictionary and ".zst" copies, the deltas and .DS_Store files. An install
+  // holding any of them then still hashes to the release's entries.
+  void exclude_release_files(HashDirectoryOptions *options);
+
+  struct HashDirectoryStats
+  {
+    size_t from_index = 0;
+    size_t from_baseline = 0;
+    size_t hashed = 0;
+  };
+
+  // Native counterpart of getFileHash/genFileHashes in lib/src/file_hash.dart.
+  //
+  // Legacy BLAKE2b digests are inherently sequential, so those files are
+  // spread across the pool one file per task. With kBlake2bTree, files are
+  // split into kTreeLeafSize leaves that are hashed as independent tasks and
+  // combined by whichever worker finishes the last leaf, so a single large
+  // file keeps every core busy. kBlake3 works the same way: each leaf is a
+  // complete BLAKE3 subtree whose chunks are compressed with SIMD, and the
+  // leaf chaining values are merged into the root. Files are queued in the
+  // order plan_work() gives for hashing, largest first.
+  //
+  // Every read buffer is charged to budget while in use, so workers stall
+  // rather than grow memory when other stages hold the budget. Reads are
+  // also charged to the disk limits, if any.
+  class FileHasher
+  {
+  public:
+    explicit FileHasher(ThreadPool *pool, MemoryBudget *budget = nullptr,
+                        IoLimits *limits = nullptr);
+
+    // Computes the raw digest of the file at path. Returns false if the file
+    // cannot be read or cancel is cancelled before it is done.
+    bool hash_file(const std::string &path, HashAlgorithm algorithm,
+                   std::string *digest,
+                   const CancellationToken *cancel = nullptr);
+
+    // Hashes the files at paths in parallel, each as hash_file would.
+    // digests receives one raw digest per path, empty for files that cannot
+    // be read or were not finished when cancel was cancelled.
+    void hash_files(const std::vector<std::string> &paths,
+                    HashAlgorithm algorithm,
+                    std::vector<std::string> *digests,
+                    const CancellationToken *cancel = nullptr);
+
+    // Hashes every regular file below root (symlinks are skipped, as with
+    // Directory.list(followLinks: false)) and returns the entries in listing
+    // order. Unreadable files are left out, matching the Dart implementation.
+    // Directories are listed in parallel on the pool; the listing order is
+    // still that of a sequential walk.
+    bool hash_directory(const std::string &root,
+                        const HashDirectoryOptions &options,
+                        std::vector<FileHashEntry> *entries,
+                        HashDirectoryStats *stats = nullptr);
+
+  private:
+    struct FileJob;
+
+    void run(std::vector<FileJob> *jobs, HashAlgorithm algorithm,
+             const CancellationToken *cancel);
+    // Charges a read to the disk limits. False once cancel is cancelled.
+    bool charge_read(size_t bytes, const CancellationToken *cancel);
+    bool read_range(const FileJob &job, uint64_t begin, uint64_t end,
+                    const std::function<void(const uint8_t *, size_t)> &consume);
+    void hash_sequential(FileJob *job);
+    void hash_blake2b_leaf(FileJob *job, uint64_t leaf);
+    void hash_blake3_leaf(FileJob *job, uint64_t leaf);
+
+    ThreadPool *pool_;
+    MemoryBudget *budget_;
+    IoLimits *limits_;
+  };
+
+  // Digest of the given leaves under the "blake2b-tree" algorithm. Exposed
+  // for tests; leaf_digests holds 64 bytes per leaf, in file order.
+  std::string blake2b_tree_root(const std::string &leaf_digests);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_FILE_HASHER_H_
@@ -0,0 +1,313 @@
+#include "hash_index.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const char kMagic[4] = {'D', 'U', 'H', 'I'};
+    // Version 2 appends a checksum, since the shared index is written in
+    // place and an interrupted write must not be mistaken for digests.
+    const uint32_t kVersion = 2;
+
+    uint64_t fnv1a(const uint8_t *data, size_t length)
+    {
+      uint64_t hash = 14695981039346656037ull;
+      for (size_t i = 0; i < length; i++)
+      {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+      }
+      return hash;
+    }
+
+    void append_raw(std::string *out, const void *data, size_t length)
+    {
+      out->append(static_cast<const char *>(data), length);
+    }
+
+    // Sequential reader over the loaded index bytes.
+    class Reader
+    {
+    public:
+      Reader(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+      bool read(void *out, size_t length)
+      {
+        if (length > size_ - offset_)
+        {
+          return false;
+        }
+        memcpy(out, data_ + offset_, length);
+        offset_ += length;
+        return true;
+      }
+
+      bool read_string(size_t length, std::string *out)
+      {
+        if (length > size_ - offset_)
+        {
+          return false;
+        }
+        out->assign(reinterpret_cast<const char *>(data_) + offset_, length);
+        offset_ += length;
+        return true;
+      }
+
+    private:
+      const uint8_t *data_;
+      size_t size_;
+      size_t offset_ = 0;
+    };
+  } // namespace
+
+  bool make_parent_directories(const std::string &path)
+  {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos;
+         slash = path.find('/', slash + 1))
+    {
+      if (mkdir(path.substr(0, slash).c_str(), 0700) != 0 && errno != EEXIST)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  FileStat to_file_stat(const struct stat &st)
+  {
+    FileStat out;
+    out.size = static_cast<uint64_t>(st.st_size);
+    out.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                   st.st_mtim.tv_nsec;
+    out.ctime_ns = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 +
+                   st.st_ctim.tv_nsec;
+    out.inode = static_cast<uint64_t>(st.st_ino);
+    return out;
+  }
+
+  bool stat_file(const std::string &path, FileStat *stat)
+  {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+    {
+      return false;
+    }
+    *stat = to_file_stat(st);
+    return true;
+  }
+
+  bool HashIndex::load(const std::string &path)
+  {
+    entries_.clear();
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    std::string data;
+    char buffer[64 * 1024];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+      data.append(buffer, n);
+    }
+    fclose(file);
+    return parse(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+  }
+
+  bool HashIndex::parse(const uint8_t *data, size_t size)
+  {
+    entries_.clear();
+    uint64_t checksum = 0;
+    if (size < sizeof(checksum))
+    {
+      return false;
+    }
+    size -= sizeof(checksum);
+    memcpy(&checksum, data + size, sizeof(checksum));
+    if (checksum != fnv1a(data, size))
+    {
+      return false;
+    }
+
+    Reader reader(data, size);
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t count = 0;
+    if (!reader.read(magic, 4) || memcmp(magic, kMagic, 4) != 0 ||
+        !reader.read(&version, 4) || version != kVersion ||
+        !reader.read(&count, 4))
+    {
+      return false;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+      uint32_t path_length = 0;
+      std::string relative_path;
+      HashIndexEntry entry;
+      uint8_t algorithm = 0;
+      uint8_t digest_length = 0;
+      if (!reader.read(&path_length, 4) ||
+          !reader.read_string(path_length, &relative_path) ||
+          !reader.read(&entry.stat.size, 8) ||
+          !reader.read(&entry.stat.mtime_ns, 8) ||
+          !reader.read(&entry.stat.ctime_ns, 8) ||
+          !reader.read(&entry.stat.inode, 8) || !reader.read(&algorithm, 1) ||
+          !reader.read(&digest_length, 1) ||
+          !reader.read_string(digest_length, &entry.digest) ||
+          algorithm > static_cast<uint8_t>(HashAlgorithm::kBlake3))
+      {
+        entries_.clear();
+        return false;
+      }
+      entry.algorithm = static_cast<HashAlgorithm>(algorithm);
+      entries_[relative_path] = entry;
+    }
+    return true;
+  }
+
+  std::string HashIndex::serialize() const
+  {
+    std::string data;
+    append_raw(&data, kMagic, 4);
+    append_raw(&data, &kVersion, 4);
+    const uint32_t count = static_cast<uint32_t>(entries_.size());
+    append_raw(&data, &count, 4);
+    for (const auto &item : entries_)
+    {
+      const uint32_t path_length = static_cast<uint32_t>(item.first.size());
+      const HashIndexEntry &entry = item.second;
+      const uint8_t algorithm = static_cast<uint8_t>(entry.algorithm);
+      const uint8_t digest_length = static_cast<uint8_t>(entry.digest.size());
+      append_raw(&data, &path_length, 4);
+      data.append(item.first);
+      append_raw(&data, &entry.stat.size, 8);
+      append_raw(&data, &entry.stat.mtime_ns, 8);
+      append_raw(&data, &entry.stat.ctime_ns, 8);
+      append_raw(&data, &entry.stat.inode, 8);
+      append_raw(&data, &algorithm, 1);
+      append_raw(&data, &digest_length, 1);
+      data.append(entry.digest);
+    }
+    const uint64_t checksum =
+        fnv1a(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+    append_raw(&data, &checksum, 8);
+    return data;
+  }
+
+  bool HashIndex::save(const std::string &path) const
+  {
+    const std::string data = serialize();
+    if (!make_parent_directories(path))
+    {
+      return false;
+    }
+    const std::string temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+      unlink(temporary.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  const HashIndexEntry *HashIndex::lookup(const std::string &relative_path) const
+  {
+    auto it = entries_.find(relative_path);
+    return it == entries_.end() ? nullptr : &it->second;
+  }
+
+  void HashIndex::update(const std::string &relative_path,
+                         const HashIndexEntry &entry)
+  {
+    entries_[relative_path] = entry;
+  }
+
+  void HashIndex::erase(const std::string &relative_path)
+  {
+    entries_.erase(relative_path);
+  }
+
+  void HashIndex::retain(const std::vector<std::string> &relative_paths)
+  {
+    std::unordered_set<std::string> keep(relative_paths.begin(),
+                                         relative_paths.end());
+    for (auto it = entries_.begin(); it != entries_.end();)
+    {
+      if (keep.count(it->first) == 0)
+      {
+        it = entries_.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+  std::vector<std::string> HashIndex::paths() const
+  {
+    std::vector<std::string> out;
+    out.reserve(entries_.size());
+    for (const auto &item : entries_)
+    {
+      out.push_back(item.first);
+    }
+    return out;
+  }
+
+  std::string cache_file_name(const std::string &install_dir,
+                              const char *extension)
+  {
+    // FNV-1a keeps one file per install location.
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.",
+             static_cast<unsigned long long>(fnv1a(
+                 reinterpret_cast<const uint8_t *>(install_dir.data()),
+                 install_dir.size())));
+    return name + std::string(extension);
+  }
+
+  std::string default_cache_path(const std::string &install_dir,
+                                 const char *extension)
+  {
+    std::string cache;
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg != nullptr && xdg[0] == '/')
+    {
+      cache = xdg;
+    }
+    else if (home != nullptr && home[0] != '\0')
+    {
+      cache = std::string(home) + "/.cache";
+    }
+    else
+    {
+      cache = "/tmp";
+    }
+
+    return cache + "/desktop_updater/" + cache_file_name(install_dir, extension);
+  }
+
+  std::string default_hash_index_path(const std::string &install_dir)
+  {
+    return default_cache_path(install_dir, "index");
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,88 @@
+#ifndef DESKTOP_UPDATER_HASH_INDEX_H_
+#define DESKTOP_UPDATER_HASH_INDEX_H_
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "manifest.h"
+
+namespace desktop_updater
+{
+
+  // The stat fields that change whenever a file's contents may have.
+  struct FileStat
+  {
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    int64_t ctime_ns = 0;
+    uint64_t inode = 0;
+
+    bool operator==(const FileStat &other) const
+    {
+      return size == other.size && mtime_ns == other.mtime_ns &&
+             ctime_ns == other.ctime_ns && inode == other.inode;
+    }
+    bool operator!=(const FileStat &other) const { return !(*this == other); }
+  };
+
+  FileStat to_file_stat(const struct stat &st);
+  bool stat_file(const std::string &path, FileStat *stat);
+
+  struct HashIndexEntry
+  {
+    FileStat stat;
+    HashAlgorithm algorithm = HashAlgorithm::kBlake2b;
+    std::string digest; // raw bytes
+  };
+
+  // Digests of an install directory keyed by relative path, together with
+  // the stat data each digest was taken at. Persisted between runs so files
+  // whose stat data is unchanged are never read again.
+  class HashIndex
+  {
+  public:
+    // A missing or unreadable index loads as empty.
+    bool load(const std::string &path);
+    // Writes to a temporary file and renames it into place.
+    bool save(const std::string &path) const;
+
+    // The file contents save() writes and load() reads. parse() rejects
+    // truncated or corrupted data, leaving the index empty.
+    std::string serialize() const;
+    bool parse(const uint8_t *data, size_t size);
+
+    const HashIndexEntry *lookup(const std::string &relative_path) const;
+    void update(const std::string &relative_path, const HashIndexEntry &entry);
+    void erase(const std::string &relative_path);
+    // Drops entries for paths that are no longer in the directory.
+    void retain(const std::vector<std::string> &relative_paths);
+
+    std::vector<std::string> paths() const;
+    size_t size() const { return entries_.size(); }
+
+  private:
+    std::unordered_map<std::string, HashIndexEntry> entries_;
+  };
+
+  // <hash of install_dir>.<extension>, the name of an install's cache files.
+  std::string cache_file_name(const std::string &install_dir,
+                              const char *extension);
+
+  // Per-user cache file for an install directory:
+  // $XDG_CACHE_HOME/desktop_updater/<hash of install_dir>.<extension>
+  std::string default_cache_path(const std::string &install_dir,
+                                 const char *extension);
+
+  // default_cache_path() of the hash index.
+  std::string default_hash_index_path(const std::string &install_dir);
+
+  // Creates the missing directories leading up to path.
+  bool make_parent_directories(const std::string &path);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_HASH_INDEX_H_
@@ -0,0 +1,730 @@
+#include "manifest.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    // Just enough of a JSON reader for manifests: an array of flat objects.
+    class JsonReader
+    {
+    public:
+      explicit JsonReader(const std::string &text) : text_(text) {}
+
+      bool consume(char c)
+      {
+        skip_whitespace();
+        if (pos_ < text_.size() && text_[pos_] == c)
+        {
+          pos_++;
+          return true;
+        }
+        return false;
+      }
+
+      bool at_end()
+      {
+        skip_whitespace();
+        return pos_ == text_.size();
+      }
+
+      bool peek_is(char c)
+      {
+        skip_whitespace();
+        return pos_ < text_.size() && text_[pos_] == c;
+      }
+
+      bool read_string(std::string *out)
+      {
+        if (!consume('"'))
+        {
+          return false;
+        }
+        out->clear();
+        while (pos_ < text_.size())
+        {
+          const char c = text_[pos_++];
+          if (c == '"')
+          {
+            return true;
+          }
+          if (c != '\\')
+          {
+            out->push_back(c);
+            continue;
+          }
+          if (pos_ >= text_.size())
+          {
+            return false;
+          }
+          const char escaped = text_[pos_++];
+          switch (escaped)
+          {
+          case '"':
+          case '\\':
+          case '/':
+            out->push_back(escaped);
+            break;
+          case 'b':
+            out->push_back('\b');
+            break;
+          case 'f':
+            out->push_back('\f');
+            break;
+          case 'n':
+            out->push_back('\n');
+            break;
+          case 'r':
+            out->push_back('\r');
+            break;
+          case 't':
+            out->push_back('\t');
+            break;
+          case 'u':
+          {
+            uint32_t code;
+            if (!read_hex4(&code))
+            {
+              return false;
+            }
+            if (code >= 0xd800 && code < 0xdc00)
+            {
+              uint32_t low;
+              if (pos_ + 1 >= text_.size() || text_[pos_] != '\\' ||
+                  text_[pos_ + 1] != 'u')
+              {
+                return false;
+              }
+              pos_ += 2;
+              if (!read_hex4(&low) || low < 0xdc00 || low >= 0xe000)
+              {
+                return false;
+              }
+              code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            }
+            append_utf8(out, code);
+            break;
+          }
+          default:
+            return false;
+          }
+        }
+        return false;
+      }
+
+      bool read_integer(int64_t *out)
+      {
+        skip_whitespace();
+        const char *begin = text_.c_str() + pos_;
+        char *end = nullptr;
+        const long long value = strtoll(begin, &end, 10);
+        if (end == begin)
+        {
+          return false;
+        }
+        pos_ += static_cast<size_t>(end - begin);
+        // Tolerate a fractional part or exponent by skipping it.
+        while (pos_ < text_.size() &&
+               (text_[pos_] == '.' || text_[pos_] == 'e' || text_[pos_] == 'E' ||
+                text_[pos_] == '+' || text_[pos_] == '-' ||
+                (text_[pos_] >= '0' && text_[pos_] <= '9')))
+        {
+          pos_++;
+        }
+        *out = value;
+        return true;
+      }
+
+      // Skips any value, including nested arrays and objects.
+      bool skip_value()
+      {
+        skip_whitespace();
+        if (pos_ >= text_.size())
+        {
+          return false;
+        }
+        const char c = text_[pos_];
+        std::string ignored;
+        if (c == '"')
+        {
+          return read_string(&ignored);
+        }
+        if (c == '[' || c == '{')
+        {
+          const char close = c == '[' ? ']' : '}';
+          pos_++;
+          if (consume(close))
+          {
+            return true;
+          }
+          do
+          {
+            if (close == '}' && (!read_string(&ignored) || !consume(':')))
+            {
+              return false;
+            }
+            if (!skip_value())
+            {
+              return false;
+            }
+          } while (consume(','));
+          return consume(close);
+        }
+        for (const char *literal : {"null", "true", "false"})
+        {
+          const size_t length = strlen(literal);
+          if (text_.compare(pos_, length, literal) == 0)
+          {
+            pos_ += length;
+            return true;
+          }
+        }
+        int64_t number;
+        return read_integer(&number);
+      }
+
+      bool read_null()
+      {
+        skip_whitespace();
+        if (text_.compare(pos_, 4, "null") == 0)
+        {
+          pos_ += 4;
+          return true;
+        }
+        return false;
+      }
+
+    private:
+      void skip_whitespace()
+      {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\n' ||
+                text_[pos_] == '\r' || text_[pos_] == '\t'))
+        {
+          pos_++;
+        }
+      }
+
+      bool read_hex4(uint32_t *out)
+      {
+        if (pos_ + 4 > text_.size())
+        {
+          return false;
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++)
+        {
+          const char c = text_[pos_++];
+          value <<= 4;
+          if (c >= '0' && c <= '9')
+            value |= c - '0';
+          else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+          else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+          else
+            return false;
+        }
+        *out = value;
+        return true;
+      }
+
+      static void append_utf8(std::string *out, uint32_t code)
+      {
+        if (code < 0x80)
+        {
+          out->push_back(static_cast<char>(code));
+        }
+        else if (code < 0x800)
+        {
+          out->push_back(static_cast<char>(0xc0 | (code >> 6)));
+          out->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        }
+        else if (code < 0x10000)
+        {
+          out->push_back(static_cast<char>(0xe0 | (code >> 12)));
+          out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+          out->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        }
+        else
+        {
+          out->push_back(static_cast<char>(0xf0 | (code >> 18)));
+          out->push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+          out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+          out->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+        }
+      }
+
+      const std::string &text_;
+      size_t pos_ = 0;
+    };
+
+    bool parse_entry(JsonReader *reader, FileHashEntry *entry)
+    {
+      if (!reader->consume('{'))
+      {
+        return false;
+      }
+      if (reader->consume('}'))
+      {
+        return true;
+      }
+      std::string key;
+      do
+      {
+        if (!reader->read_string(&key) || !reader->consume(':'))
+        {
+          return false;
+        }
+        bool ok;
+        if (key == "path")
+        {
+          ok = reader->read_string(&entry->path);
+        }
+        else if (key == "calculatedHash")
+        {
+          ok = reader->read_string(&entry->calculated_hash);
+        }
+        else if (key == "length")
+        {
+          ok = reader->read_integer(&entry->length);
+        }
+        else if (key == "algorithm" && !reader->peek_is('"'))
+        {
+          ok = reader->read_null();
+        }
+        else if (key == "algorithm")
+        {
+          std::string name;
+          ok = reader->read_string(&name) &&
+               parse_hash_algorithm(name, &entry->algorithm);
+        }
+        else if (key == "compressedLength")
+        {
+          ok = reader->read_integer(&entry->compressed_length);
+        }
+        else
+        {
+          ok = reader->skip_value();
+        }
+        if (!ok)
+        {
+          return false;
+        }
+      } while (reader->consume(','));
+      return reader->consume('}');
+    }
+
+    bool parse_archive_item(JsonReader *reader, AppArchiveItem *item)
+    {
+      if (!reader->consume('{'))
+      {
+        return false;
+      }
+      if (reader->consume('}'))
+      {
+        return true;
+      }
+      std::string key;
+      do
+      {
+        if (!reader->read_string(&key) || !reader->consume(':'))
+        {
+          return false;
+        }
+        bool ok;
+        if (key == "version")
+        {
+          ok = reader->read_string(&item->version);
+        }
+        else if (key == "shortVersion")
+        {
+          ok = reader->read_integer(&item->short_version);
+        }
+        else if (key == "url")
+        {
+          ok = reader->read_string(&item->url);
+        }
+        else if (key == "platform")
+        {
+          ok = reader->read_string(&item->platform);
+        }
+        else
+        {
+          ok = reader->skip_value();
+        }
+        if (!ok)
+        {
+          return false;
+        }
+      } while (reader->consume(','));
+      return reader->consume('}');
+    }
+
+    std::string parent_directory(const std::string &path)
+    {
+      const size_t slash = path.rfind('/');
+      return slash == std::string::npos ? std::string() : path.substr(0, slash);
+    }
+  } // namespace
+
+  void append_json_string(std::string *out, const std::string &value)
+  {
+    static const char kHex[] = "0123456789abcdef";
+    out->push_back('"');
+    for (unsigned char c : value)
+    {
+      switch (c)
+      {
+      case '"':
+        out->append("\\\"");
+        break;
+      case '\\':
+        out->append("\\\\");
+        break;
+      case '\b':
+        out->append("\\b");
+        break;
+      case '\f':
+        out->append("\\f");
+        break;
+      case '\n':
+        out->append("\\n");
+        break;
+      case '\r':
+        out->append("\\r");
+        break;
+      case '\t':
+        out->append("\\t");
+        break;
+      default:
+        if (c < 0x20)
+        {
+          out->append("\\u00");
+          out->push_back(kHex[c >> 4]);
+          out->push_back(kHex[c & 0xf]);
+        }
+        else
+        {
+          out->push_back(static_cast<char>(c));
+        }
+      }
+    }
+    out->push_back('"');
+  }
+
+  const char *hash_algorithm_name(HashAlgorithm algorithm)
+  {
+    switch (algorithm)
+    {
+    case HashAlgorithm::kBlake2bTree:
+      return "blake2b-tree";
+    case HashAlgorithm::kBlake3:
+      return "blake3";
+    case HashAlgorithm::kBlake2b:
+      break;
+    }
+    return "blake2b";
+  }
+
+  bool parse_hash_algorithm(const std::string &name, HashAlgorithm *algorithm)
+  {
+    if (name.empty() || name == "blake2b")
+    {
+      *algorithm = HashAlgorithm::kBlake2b;
+      return true;
+    }
+    if (name == "blake2b-tree")
+    {
+      *algorithm = HashAlgorithm::kBlake2bTree;
+      return true;
+    }
+    if (name == "blake3")
+    {
+      *algorithm = HashAlgorithm::kBlake3;
+      return true;
+    }
+    return false;
+  }
+
+  std::string base64_encode(const uint8_t *data, size_t length)
+  {
+    static const char kAlphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((length + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < length; i += 3)
+    {
+      uint32_t n = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+      out.push_back(kAlphabet[(n >> 18) & 63]);
+      out.push_back(kAlphabet[(n >> 12) & 63]);
+      out.push_back(kAlphabet[(n >> 6) & 63]);
+      out.push_back(kAlphabet[n & 63]);
+    }
+    if (i + 1 == length)
+    {
+      uint32_t n = data[i] << 16;
+      out.push_back(kAlphabet[(n >> 18) & 63]);
+      out.push_back(kAlphabet[(n >> 12) & 63]);
+      out.append("==");
+    }
+    else if (i + 2 == length)
+    {
+      uint32_t n = (data[i] << 16) | (data[i + 1] << 8);
+      out.push_back(kAlphabet[(n >> 18) & 63]);
+      out.push_back(kAlphabet[(n >> 12) & 63]);
+      out.push_back(kAlphabet[(n >> 6) & 63]);
+      out.push_back('=');
+    }
+    return out;
+  }
+
+  bool base64_decode(const std::string &text, std::string *out)
+  {
+    if (text.size() % 4 != 0)
+    {
+      return false;
+    }
+    out->clear();
+    out->reserve(text.size() / 4 * 3);
+    uint32_t n = 0;
+    size_t padding = 0;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+      const char c = text[i];
+      uint32_t value;
+      if (c >= 'A' && c <= 'Z')
+        value = c - 'A';
+      else if (c >= 'a' && c <= 'z')
+        value = c - 'a' + 26;
+      else if (c >= '0' && c <= '9')
+        value = c - '0' + 52;
+      else if (c == '+')
+        value = 62;
+      else if (c == '/')
+        value = 63;
+      else if (c == '=' && i + 2 >= text.size())
+      {
+        value = 0;
+        padding++;
+      }
+      else
+        return false;
+      if (padding > 0 && c != '=')
+      {
+        return false;
+      }
+      n = (n << 6) | value;
+      if (i % 4 == 3)
+      {
+        out->push_back(static_cast<char>(n >> 16));
+        out->push_back(static_cast<char>(n >> 8));
+        out->push_back(static_cast<char>(n));
+        n = 0;
+      }
+    }
+    out->resize(out->size() - padding);
+    return true;
+  }
+
+  std::string manifest_to_json(const std::vector<FileHashEntry> &entries)
+  {
+    std::string out;
+    out.reserve(entries.size() * 160);
+    out.push_back('[');
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      const FileHashEntry &entry = entries[i];
+      if (i > 0)
+      {
+        out.push_back(',');
+      }
+      out.append("{\"path\":");
+      append_json_string(&out, entry.path);
+      out.append(",\"calculatedHash\":");
+      append_json_string(&out, entry.calculated_hash);
+      out.append(",\"length\":");
+      out.append(std::to_string(entry.length));
+      // The tag is left out for legacy entries so those stay byte-identical
+      // to what older releases wrote.
+      if (entry.algorithm != HashAlgorithm::kBlake2b)
+      {
+        out.append(",\"algorithm\":");
+        append_json_string(&out, hash_algorithm_name(entry.algorithm));
+      }
+      if (entry.compressed_length > 0)
+      {
+        out.append(",\"compressedLength\":");
+        out.append(std::to_string(entry.compressed_length));
+      }
+      out.push_back('}');
+    }
+    out.push_back(']');
+    return out;
+  }
+
+  bool write_manifest_json(const std::string &path,
+                           const std::vector<FileHashEntry> &entries)
+  {
+    const std::string json = manifest_to_json(entries);
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    ok = fclose(file) == 0 && ok;
+    return ok;
+  }
+
+  bool parse_manifest_json(const std::string &json,
+                           std::vector<FileHashEntry> *entries)
+  {
+    entries->clear();
+    JsonReader reader(json);
+    if (!reader.consume('['))
+    {
+      return false;
+    }
+    if (!reader.consume(']'))
+    {
+      do
+      {
+        FileHashEntry entry;
+        if (!parse_entry(&reader, &entry))
+        {
+          return false;
+        }
+        entries->push_back(entry);
+      } while (reader.consume(','));
+      if (!reader.consume(']'))
+      {
+        return false;
+      }
+    }
+    return reader.at_end();
+  }
+
+  bool read_manifest_json(const std::string &path,
+                          std::vector<FileHashEntry> *entries)
+  {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    std::string json;
+    char buffer[64 * 1024];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+      json.append(buffer, n);
+    }
+    fclose(file);
+    return parse_manifest_json(json, entries);
+  }
+
+  bool parse_app_archive_json(const std::string &json,
+                              std::vector<AppArchiveItem> *items)
+  {
+    items->clear();
+    JsonReader reader(json);
+    if (!reader.consume('{'))
+    {
+      return false;
+    }
+    if (reader.consume('}'))
+    {
+      return true;
+    }
+    std::string key;
+    do
+    {
+      if (!reader.read_string(&key) || !reader.consume(':'))
+      {
+        return false;
+      }
+      if (key != "items")
+      {
+        if (!reader.skip_value())
+        {
+          return false;
+        }
+        continue;
+      }
+      if (!reader.consume('['))
+      {
+        return false;
+      }
+      if (reader.consume(']'))
+      {
+        continue;
+      }
+      do
+      {
+        AppArchiveItem item;
+        if (!parse_archive_item(&reader, &item))
+        {
+          return false;
+        }
+        items->push_back(item);
+      } while (reader.consume(','));
+      if (!reader.consume(']'))
+      {
+        return false;
+      }
+    } while (reader.consume(','));
+    return reader.consume('}') && reader.at_end();
+  }
+
+  const AppArchiveItem *latest_archive_item(
+      const std::vector<AppArchiveItem> &items, const std::string &platform)
+  {
+    const AppArchiveItem *latest = nullptr;
+    for (const AppArchiveItem &item : items)
+    {
+      // Ties go to the later item, like the reduce in versionCheckFunction.
+      if (item.platform == platform &&
+          (latest == nullptr || item.short_version >= latest->short_version))
+      {
+        latest = &item;
+      }
+    }
+    return latest;
+  }
+
+  std::vector<FileHashEntry> diff_manifests(
+      const std::vector<FileHashEntry> &local,
+      const std::vector<FileHashEntry> &remote,
+      const std::set<std::string> *only_directories)
+  {
+    std::unordered_map<std::string, const FileHashEntry *> by_path;
+    by_path.reserve(local.size());
+    for (const FileHashEntry &entry : local)
+    {
+      by_path[entry.path] = &entry;
+    }
+    std::vector<FileHashEntry> changes;
+    for (const FileHashEntry &entry : remote)
+    {
+      if (only_directories != nullptr &&
+          only_directories->count(parent_directory(entry.path)) == 0)
+      {
+        continue;
+      }
+      auto it = by_path.find(entry.path);
+      if (it == by_path.end() ||
+          it->second->calculated_hash != entry.calculated_hash)
+      {
+        changes.push_back(entry);
+      }
+    }
+    return changes;
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,86 @@
+#ifndef DESKTOP_UPDATER_MANIFEST_H_
+#define DESKTOP_UPDATER_MANIFEST_H_
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace desktop_updater
+{
+
+  // Digest algorithms a hashes.json manifest can be tagged with. Entries
+  // without an "algorithm" field are kBlake2b, which keeps manifests written
+  // by older releases readable.
+  enum class HashAlgorithm
+  {
+    kBlake2b,
+    kBlake2bTree,
+    kBlake3,
+  };
+
+  const char *hash_algorithm_name(HashAlgorithm algorithm);
+  bool parse_hash_algorithm(const std::string &name, HashAlgorithm *algorithm);
+
+  // One entry of hashes.json; mirrors FileHashModel on the Dart side.
+  struct FileHashEntry
+  {
+    std::string path;
+    std::string calculated_hash; // base64 of the raw digest
+    int64_t length = 0;
+    HashAlgorithm algorithm = HashAlgorithm::kBlake2b;
+    // Size of the dictionary-compressed copy published as path + ".zst", or
+    // 0 if there is none.
+    int64_t compressed_length = 0;
+  };
+
+  std::string base64_encode(const uint8_t *data, size_t length);
+  // Decodes padded standard base64. Returns false on malformed input.
+  bool base64_decode(const std::string &text, std::string *out);
+
+  // Appends value as a JSON string literal escaped the way dart:convert does.
+  void append_json_string(std::string *out, const std::string &value);
+
+  // Serializes entries the way jsonEncode(List<FileHashModel>) does, so
+  // manifests written natively and from Dart are interchangeable.
+  std::string manifest_to_json(const std::vector<FileHashEntry> &entries);
+  bool write_manifest_json(const std::string &path,
+                           const std::vector<FileHashEntry> &entries);
+
+  // Parses a hashes.json document. Unknown keys are ignored, as they are by
+  // FileHashModel.fromJson. Returns false on malformed JSON.
+  bool parse_manifest_json(const std::string &json,
+                           std::vector<FileHashEntry> *entries);
+  bool read_manifest_json(const std::string &path,
+                          std::vector<FileHashEntry> *entries);
+
+  // The fields of an app-archive.json item the update check needs; mirrors
+  // ItemModel on the Dart side.
+  struct AppArchiveItem
+  {
+    std::string version;
+    int64_t short_version = 0;
+    std::string url;
+    std::string platform;
+  };
+
+  // Parses the "items" of an app-archive.json document, ignoring every
+  // other key. Returns false on malformed JSON.
+  bool parse_app_archive_json(const std::string &json,
+                              std::vector<AppArchiveItem> *items);
+
+  // The item for platform with the highest shortVersion, or null.
+  const AppArchiveItem *latest_archive_item(
+      const std::vector<AppArchiveItem> &items, const std::string &platform);
+
+  // Entries of remote that are missing from local or whose digest differs,
+  // like verifyFileHashes in lib/src/file_hash.dart. With only_directories,
+  // remote files whose parent directory is not listed are skipped.
+  std::vector<FileHashEntry> diff_manifests(
+      const std::vector<FileHashEntry> &local,
+      const std::vector<FileHashEntry> &remote,
+      const std::set<std::string> *only_directories);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_MANIFEST_H_
@@ -0,0 +1,182 @@
+// Writes the manifests bin/archive.dart publishes for a release bundle,
+// walking and hashing it in parallel with the plugin's hasher:
+//
+//   desktop_updater_manifest BUNDLE [--algorithm NAME] [--index FILE]
+//       [--exclude PATH]... [--zstd-copies] [--binary FILE]
+//
+// By default BUNDLE/hashes.json and BUNDLE/tree.json are written, byte for
+// byte as genFileHashes writes them. With --binary the binary build
+// manifest is written to FILE instead, as embedBuildManifest encodes it;
+// --exclude the runner it is embedded in and the sidecar. --index keeps
+// digests between runs, so when the manifest is embedded first and the
+// release hashed after, the second run only reads the runner again.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "binary_manifest.h"
+#include "file_hasher.h"
+#include "hash_index.h"
+#include "merkle.h"
+#include "release_manifest.h"
+#include "thread_pool.h"
+
+namespace
+{
+
+  void usage()
+  {
+    fprintf(stderr,
+            "usage: desktop_updater_manifest BUNDLE [--algorithm NAME] "
+            "[--index FILE]\n"
+            "    [--exclude PATH]... [--zstd-copies] [--binary FILE]\n");
+  }
+
+  bool write_file(const std::string &path, const std::string &data)
+  {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+    return ok;
+  }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  std::string bundle;
+  std::string index_path;
+  std::string binary_path;
+  desktop_updater::ReleaseManifestOptions options;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string flag = argv[i];
+    if (flag == "--zstd-copies")
+    {
+      options.zstd_copies = true;
+      continue;
+    }
+    if (flag.compare(0, 2, "--") != 0 && bundle.empty())
+    {
+      bundle = flag;
+      continue;
+    }
+    if (i + 1 >= argc)
+    {
+      usage();
+      return 2;
+    }
+    const std::string value = argv[++i];
+    if (flag == "--algorithm" &&
+        desktop_updater::parse_hash_algorithm(value, &options.algorithm))
+    {
+      continue;
+    }
+    if (flag == "--index")
+    {
+      index_path = value;
+    }
+    else if (flag == "--exclude")
+    {
+      options.excluded_paths.push_back(value);
+    }
+    else if (flag == "--binary")
+    {
+      binary_path = value;
+    }
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+  if (bundle.empty())
+  {
+    usage();
+    return 2;
+  }
+  while (bundle.size() > 1 && bundle.back() == '/')
+  {
+    bundle.pop_back();
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  desktop_updater::HashIndex index;
+  if (!index_path.empty())
+  {
+    index.load(index_path);
+    options.index = &index;
+  }
+  desktop_updater::ThreadPool pool;
+  desktop_updater::FileHasher hasher(&pool);
+  std::vector<desktop_updater::FileHashEntry> entries;
+  if (!desktop_updater::hash_release(&hasher, bundle, options, &entries))
+  {
+    fprintf(stderr, "desktop_updater_manifest: %s is not a directory\n",
+            bundle.c_str());
+    return 1;
+  }
+  if (!index_path.empty() &&
+      (!desktop_updater::make_parent_directories(index_path) ||
+       !index.save(index_path)))
+  {
+    fprintf(stderr, "desktop_updater_manifest: cannot write %s\n",
+            index_path.c_str());
+    return 1;
+  }
+
+  if (!binary_path.empty())
+  {
+    std::string encoded;
+    if (!desktop_updater::encode_binary_manifest(options.algorithm, entries,
+                                                 &encoded) ||
+        !write_file(binary_path, encoded))
+    {
+      fprintf(stderr, "desktop_updater_manifest: cannot write %s\n",
+              binary_path.c_str());
+      return 1;
+    }
+  }
+  else
+  {
+    const std::string hashes_path =
+        bundle + "/" + desktop_updater::kHashesFileName;
+    const std::string tree_path =
+        bundle + "/" + desktop_updater::kMerkleTreeFileName;
+    desktop_updater::MerkleDirectories tree;
+    if (!desktop_updater::write_manifest_json(hashes_path, entries))
+    {
+      fprintf(stderr, "desktop_updater_manifest: cannot write %s\n",
+              hashes_path.c_str());
+      return 1;
+    }
+    if (!desktop_updater::build_merkle_tree(entries, &tree) ||
+        !desktop_updater::write_merkle_tree_json(tree_path, options.algorithm,
+                                                 tree))
+    {
+      fprintf(stderr, "desktop_updater_manifest: cannot write %s\n",
+              tree_path.c_str());
+      return 1;
+    }
+  }
+
+  uint64_t bytes = 0;
+  for (const desktop_updater::FileHashEntry &entry : entries)
+  {
+    bytes += static_cast<uint64_t>(entry.length);
+  }
+  printf("%zu files, %llu bytes, %s, %.0f ms on %zu threads\n",
+         entries.size(), static_cast<unsigned long long>(bytes),
+         desktop_updater::hash_algorithm_name(options.algorithm),
+         std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count(),
+         pool.size());
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include "memory_budget.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    // Longest a cancellable acquire() waits between checks of its token.
+    const std::chrono::milliseconds kCancelCheckInterval(5);
+  } // namespace
+
+  MemoryBudget::MemoryBudget(size_t limit) : limit_(limit) {}
+
+  void MemoryBudget::set_limit(size_t limit)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    limit_ = limit;
+    cv_.notify_all();
+  }
+
+  size_t MemoryBudget::limit() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_;
+  }
+
+  bool MemoryBudget::fits(size_t bytes) const
+  {
+    return limit_ == 0 || in_use_ == 0 || in_use_ + bytes <= limit_;
+  }
+
+  bool MemoryBudget::acquire(size_t bytes, const CancellationToken *cancel)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (cancel == nullptr)
+    {
+      cv_.wait(lock, [this, bytes]
+               { return fits(bytes); });
+    }
+    else
+    {
+      // release() does not know about the token, so wake up now and then to
+      // check it.
+      while (!fits(bytes))
+      {
+        if (cancel->cancelled())
+        {
+          return false;
+        }
+        cv_.wait_for(lock, kCancelCheckInterval);
+      }
+    }
+    in_use_ += bytes;
+    if (in_use_ > peak_)
+    {
+      peak_ = in_use_;
+    }
+    return true;
+  }
+
+  void MemoryBudget::release(size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_use_ = bytes > in_use_ ? 0 : in_use_ - bytes;
+    cv_.notify_all();
+  }
+
+  size_t MemoryBudget::in_use() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_use_;
+  }
+
+  size_t MemoryBudget::peak() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_;
+  }
+
+  void MemoryBudget::reset_peak()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    peak_ = in_use_;
+  }
+
+  BudgetedBuffer::BudgetedBuffer(MemoryBudget *budget, size_t size,
+                                 const CancellationToken *cancel)
+      : budget_(budget), size_(size)
+  {
+    if (budget_ != nullptr && !budget_->acquire(size_, cancel))
+    {
+      budget_ = nullptr;
+      size_ = 0;
+      return;
+    }
+    data_.reset(new uint8_t[size_]);
+  }
+
+  BudgetedBuffer::~BudgetedBuffer()
+  {
+    data_.reset();
+    if (budget_ != nullptr)
+    {
+      budget_->release(size_);
+    }
+  }
+
+  BudgetReservation::BudgetReservation(MemoryBudget *budget, size_t bytes,
+                                       const CancellationToken *cancel)
+      : budget_(budget), bytes_(bytes)
+  {
+    if (budget_ != nullptr && !budget_->acquire(bytes_, cancel))
+    {
+      budget_ = nullptr;
+      ok_ = false;
+    }
+  }
+
+  BudgetReservation::~BudgetReservation()
+  {
+    if (budget_ != nullptr)
+    {
+      budget_->release(bytes_);
+    }
+  }
+
+  size_t peak_rss_bytes()
+  {
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == nullptr)
+    {
+      return 0;
+    }
+    char line[256];
+    size_t kib = 0;
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+      if (strncmp(line, "VmHWM:", 6) == 0)
+      {
+        unsigned long long value = 0;
+        if (sscanf(line + 6, "%llu", &value) == 1)
+        {
+          kib = static_cast<size_t>(value);
+        }
+        break;
+      }
+    }
+    fclose(file);
+    return kib * 1024;
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,107 @@
+#ifndef DESKTOP_UPDATER_MEMORY_BUDGET_H_
+#define DESKTOP_UPDATER_MEMORY_BUDGET_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "cancellation.h"
+
+namespace desktop_updater
+{
+
+  // Default cap on in-flight buffer memory across the update stages.
+  const size_t kDefaultMemoryBudget = 32 * 1024 * 1024;
+
+  // Caps the bytes held in in-flight I/O buffers by all update stages
+  // together. A stage that would exceed the limit blocks in acquire() until
+  // other stages release memory, so memory use stays flat regardless of how
+  // large the bundle or its files are.
+  class MemoryBudget
+  {
+  public:
+    explicit MemoryBudget(size_t limit = kDefaultMemoryBudget);
+
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    // A limit of 0 removes the cap. Lowering the limit does not reclaim
+    // memory already handed out; new requests wait until usage drops.
+    void set_limit(size_t limit);
+    size_t limit() const;
+
+    // Blocks until bytes fit in the remaining budget. A request larger than
+    // the whole limit is granted once nothing else is outstanding, so it
+    // cannot wait forever. Returns false, charging nothing, if cancel is
+    // cancelled first.
+    bool acquire(size_t bytes, const CancellationToken *cancel = nullptr);
+    void release(size_t bytes);
+
+    size_t in_use() const;
+    // Highest in_use() seen since construction or the last reset_peak().
+    size_t peak() const;
+    void reset_peak();
+
+  private:
+    bool fits(size_t bytes) const;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t limit_;
+    size_t in_use_ = 0;
+    size_t peak_ = 0;
+  };
+
+  // Heap buffer whose size is charged to a MemoryBudget for as long as it is
+  // alive. Construction blocks while the budget is exhausted. A null budget
+  // allocates without accounting. If cancel is cancelled while waiting, no
+  // buffer is allocated and ok() is false.
+  class BudgetedBuffer
+  {
+  public:
+    BudgetedBuffer(MemoryBudget *budget, size_t size,
+                   const CancellationToken *cancel = nullptr);
+    ~BudgetedBuffer();
+
+    BudgetedBuffer(const BudgetedBuffer &) = delete;
+    BudgetedBuffer &operator=(const BudgetedBuffer &) = delete;
+
+    bool ok() const { return data_ != nullptr; }
+    uint8_t *data() { return data_.get(); }
+    size_t size() const { return size_; }
+
+  private:
+    MemoryBudget *budget_;
+    size_t size_;
+    std::unique_ptr<uint8_t[]> data_;
+  };
+
+  // Holds bytes of a MemoryBudget for as long as it is alive, for memory
+  // allocated elsewhere, like a library's buffers or a whole-file scratch
+  // area. Blocks like BudgetedBuffer; ok() is false if cancel fired first.
+  class BudgetReservation
+  {
+  public:
+    BudgetReservation(MemoryBudget *budget, size_t bytes,
+                      const CancellationToken *cancel = nullptr);
+    ~BudgetReservation();
+
+    BudgetReservation(const BudgetReservation &) = delete;
+    BudgetReservation &operator=(const BudgetReservation &) = delete;
+
+    bool ok() const { return ok_; }
+
+  private:
+    MemoryBudget *budget_;
+    size_t bytes_;
+    bool ok_ = true;
+  };
+
+  // Peak resident set size of this process (VmHWM), or 0 if unavailable.
+  size_t peak_rss_bytes();
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_MEMORY_BUDGET_H_
@@ -0,0 +1,157 @@
+#include "merkle.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "blake2b.h"
+
+namespace desktop_updater
+{
+  namespace
+  {
+    struct Child
+    {
+      std::string name;
+      bool directory;
+      uint64_t length;
+      std::string digest;
+    };
+
+    std::string parent_of(const std::string &path)
+    {
+      const size_t slash = path.rfind('/');
+      return slash == std::string::npos ? std::string() : path.substr(0, slash);
+    }
+
+    std::string name_of(const std::string &path)
+    {
+      const size_t slash = path.rfind('/');
+      return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    void append_le(std::string *out, uint64_t value, size_t bytes)
+    {
+      for (size_t i = 0; i < bytes; i++)
+      {
+        out->push_back(static_cast<char>(value >> (8 * i)));
+      }
+    }
+
+    size_t depth_of(const std::string &path)
+    {
+      return path.empty() ? 0 : std::count(path.begin(), path.end(), '/') + 1;
+    }
+  } // namespace
+
+  bool build_merkle_tree(const std::vector<FileHashEntry> &entries,
+                         MerkleDirectories *directories)
+  {
+    std::map<std::string, std::vector<Child>> children;
+    children[""];
+    std::string digest;
+    for (const FileHashEntry &entry : entries)
+    {
+      if (!base64_decode(entry.calculated_hash, &digest))
+      {
+        return false;
+      }
+      children[parent_of(entry.path)].push_back(
+          Child{name_of(entry.path), false,
+                static_cast<uint64_t>(entry.length), digest});
+      // Make sure every ancestor directory has a node.
+      for (std::string dir = parent_of(entry.path); !dir.empty();
+           dir = parent_of(dir))
+      {
+        children[dir];
+      }
+    }
+
+    // Deepest directories first, so children are done before their parent.
+    std::vector<std::string> order;
+    for (const auto &item : children)
+    {
+      order.push_back(item.first);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const std::string &a, const std::string &b)
+                     { return depth_of(a) > depth_of(b); });
+
+    directories->clear();
+    for (const std::string &dir : order)
+    {
+      std::vector<Child> &nodes = children[dir];
+      std::sort(nodes.begin(), nodes.end(), [](const Child &a, const Child &b)
+                { return a.name < b.name; });
+      std::string serialized;
+      for (const Child &child : nodes)
+      {
+        serialized.push_back(child.directory ? 1 : 0);
+        append_le(&serialized, child.name.size(), 4);
+        serialized.append(child.name);
+        if (!child.directory)
+        {
+          append_le(&serialized, child.length, 8);
+          serialized.push_back(static_cast<char>(child.digest.size()));
+        }
+        serialized.append(child.digest);
+      }
+
+      Blake2b hasher;
+      hasher.update(serialized.data(), serialized.size());
+      std::string node(Blake2b::kMaxDigestSize, '\0');
+      hasher.finish(reinterpret_cast<uint8_t *>(&node[0]));
+      (*directories)[dir] = node;
+      if (!dir.empty())
+      {
+        children[parent_of(dir)].push_back(Child{name_of(dir), true, 0, node});
+      }
+    }
+    return true;
+  }
+
+  std::string merkle_tree_to_json(HashAlgorithm algorithm,
+                                  const MerkleDirectories &directories)
+  {
+    auto encode = [](const std::string &digest)
+    {
+      return base64_encode(reinterpret_cast<const uint8_t *>(digest.data()),
+                           digest.size());
+    };
+    std::string out = "{\"algorithm\":";
+    append_json_string(&out, hash_algorithm_name(algorithm));
+    out.append(",\"root\":");
+    auto root = directories.find("");
+    append_json_string(&out, root != directories.end() ? encode(root->second)
+                                                        : std::string());
+    out.append(",\"directories\":{");
+    bool first = true;
+    for (const auto &item : directories)
+    {
+      if (!first)
+      {
+        out.push_back(',');
+      }
+      first = false;
+      append_json_string(&out, item.first);
+      out.push_back(':');
+      append_json_string(&out, encode(item.second));
+    }
+    out.append("}}");
+    return out;
+  }
+
+  bool write_merkle_tree_json(const std::string &path, HashAlgorithm algorithm,
+                              const MerkleDirectories &directories)
+  {
+    const std::string json = merkle_tree_to_json(algorithm, directories);
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    ok = fclose(file) == 0 && ok;
+    return ok;
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,39 @@
+#ifndef DESKTOP_UPDATER_MERKLE_H_
+#define DESKTOP_UPDATER_MERKLE_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "manifest.h"
+
+namespace desktop_updater
+{
+
+  // Raw BLAKE2b-512 digest of every directory that contains files, keyed by
+  // relative path; the root is "".
+  typedef std::map<std::string, std::string> MerkleDirectories;
+
+  // Hashes each directory over its children sorted by name bytes. A child is
+  // serialized as
+  //
+  //   file       0x00 | u32 name length | name | u64 length | u8 digest
+  //              length | file digest
+  //   directory  0x01 | u32 name length | name | 64-byte directory digest
+  //
+  // with little-endian integers, so two trees are equal exactly when every
+  // file below them is. lib/src/merkle.dart computes the same digests.
+  // Returns false if an entry's digest is not valid base64.
+  bool build_merkle_tree(const std::vector<FileHashEntry> &entries,
+                         MerkleDirectories *directories);
+
+  // {"algorithm": ..., "root": ..., "directories": {path: digest}} with
+  // base64 digests, as published next to hashes.json in tree.json.
+  std::string merkle_tree_to_json(HashAlgorithm algorithm,
+                                  const MerkleDirectories &directories);
+  bool write_merkle_tree_json(const std::string &path, HashAlgorithm algorithm,
+                              const MerkleDirectories &directories);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_MERKLE_H_
@@ -0,0 +1,163 @@
+#include "page_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef SYS_cachestat
+#define SYS_cachestat 451
+#endif
+
+namespace desktop_updater
+{
+  namespace
+  {
+    // From linux/mman.h, which not every libc exposes.
+    struct CachestatRange
+    {
+      uint64_t off;
+      uint64_t len;
+    };
+
+    struct Cachestat
+    {
+      uint64_t nr_cache;
+      uint64_t nr_dirty;
+      uint64_t nr_writeback;
+      uint64_t nr_evicted;
+      uint64_t nr_recently_evicted;
+    };
+
+    uint64_t page_size()
+    {
+      static const uint64_t size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+      return size;
+    }
+
+    uint64_t page_count(uint64_t length)
+    {
+      return (length + page_size() - 1) / page_size();
+    }
+  } // namespace
+
+  bool cached_page_count(int fd, uint64_t offset, uint64_t length,
+                         uint64_t *pages)
+  {
+    if (length == 0)
+    {
+      *pages = 0;
+      return true;
+    }
+    CachestatRange range = {offset, length};
+    Cachestat stat = {};
+    if (syscall(SYS_cachestat, fd, &range, &stat, 0) != 0)
+    {
+      return false;
+    }
+    *pages = stat.nr_cache;
+    return true;
+  }
+
+  bool resident_pages(int fd, uint64_t offset, uint64_t length,
+                      std::vector<unsigned char> *resident)
+  {
+    resident->assign(page_count(length), 0);
+    if (length == 0)
+    {
+      return true;
+    }
+    void *map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd,
+                     static_cast<off_t>(offset));
+    if (map == MAP_FAILED)
+    {
+      return false;
+    }
+    const bool ok = mincore(map, length, resident->data()) == 0;
+    munmap(map, length);
+    return ok;
+  }
+
+  void CacheFootprint::begin(int fd, uint64_t offset, uint64_t length)
+  {
+    release();
+    if (length == 0)
+    {
+      return;
+    }
+    fd_ = fd;
+    offset_ = offset;
+    length_ = length;
+
+    uint64_t cached = 0;
+    if (!cached_page_count(fd, offset, length, &cached))
+    {
+      // Without cachestat, always ask mincore.
+      cached = 1;
+    }
+    if (cached == 0)
+    {
+      resident_ = Resident::kNone;
+    }
+    else if (cached >= page_count(length))
+    {
+      resident_ = Resident::kAll;
+    }
+    else if (resident_pages(fd, offset, length, &pages_))
+    {
+      resident_ = Resident::kSome;
+    }
+    else
+    {
+      // Residency unknown: leave the cache alone rather than evict the
+      // app's pages.
+      resident_ = Resident::kAll;
+    }
+
+    if (resident_ != Resident::kAll)
+    {
+      posix_fadvise(fd, static_cast<off_t>(offset),
+                    static_cast<off_t>(length), POSIX_FADV_SEQUENTIAL);
+      readahead(fd, static_cast<off64_t>(offset), length);
+    }
+  }
+
+  void CacheFootprint::release()
+  {
+    if (fd_ < 0)
+    {
+      return;
+    }
+    if (resident_ == Resident::kNone)
+    {
+      posix_fadvise(fd_, static_cast<off_t>(offset_),
+                    static_cast<off_t>(length_), POSIX_FADV_DONTNEED);
+    }
+    else if (resident_ == Resident::kSome)
+    {
+      // Drop each run of pages that were not cached before.
+      const uint64_t size = page_size();
+      size_t page = 0;
+      while (page < pages_.size())
+      {
+        if (pages_[page] & 1)
+        {
+          page++;
+          continue;
+        }
+        size_t end = page;
+        while (end < pages_.size() && !(pages_[end] & 1))
+        {
+          end++;
+        }
+        posix_fadvise(fd_, static_cast<off_t>(offset_ + page * size),
+                      static_cast<off_t>((end - page) * size),
+                      POSIX_FADV_DONTNEED);
+        page = end;
+      }
+    }
+    fd_ = -1;
+    pages_.clear();
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,56 @@
+#ifndef DESKTOP_UPDATER_PAGE_CACHE_H_
+#define DESKTOP_UPDATER_PAGE_CACHE_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace desktop_updater
+{
+
+  // Number of pages of [offset, offset + length) of fd in the page cache,
+  // via cachestat(2). Returns false where the kernel lacks it (before 6.5).
+  bool cached_page_count(int fd, uint64_t offset, uint64_t length,
+                         uint64_t *pages);
+
+  // Residency of each page of [offset, offset + length) of fd, via
+  // mincore(2) on a temporary mapping. offset must be page aligned.
+  bool resident_pages(int fd, uint64_t offset, uint64_t length,
+                      std::vector<unsigned char> *resident);
+
+  // Keeps a one-pass read of a file range from pushing other data out of
+  // the page cache. begin() notes which pages are cached already and starts
+  // sequential readahead of the range; release() drops the pages the read
+  // brought in and keeps those that were cached before, which are usually
+  // the running app's own.
+  class CacheFootprint
+  {
+  public:
+    CacheFootprint() = default;
+    ~CacheFootprint() { release(); }
+
+    CacheFootprint(const CacheFootprint &) = delete;
+    CacheFootprint &operator=(const CacheFootprint &) = delete;
+
+    // offset must be page aligned.
+    void begin(int fd, uint64_t offset, uint64_t length);
+    void release();
+
+  private:
+    enum class Resident
+    {
+      kNone,
+      kAll,
+      kSome,
+    };
+
+    int fd_ = -1;
+    uint64_t offset_ = 0;
+    uint64_t length_ = 0;
+    Resident resident_ = Resident::kNone;
+    // Per page, filled only for kSome.
+    std::vector<unsigned char> pages_;
+  };
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_PAGE_CACHE_H_
@@ -0,0 +1,83 @@
+#include "rate_limiter.h"
+
+#include <algorithm>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    // Longest a cancellable acquire() sleeps between checks of its token.
+    const double kCancelCheckSeconds = 0.005;
+  } // namespace
+
+  TokenBucket::TokenBucket(uint64_t rate)
+      : rate_(rate), tokens_(static_cast<double>(rate)),
+        last_refill_(Clock::now()) {}
+
+  void TokenBucket::set_rate(uint64_t rate)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refill(Clock::now());
+    // A newly set limit starts with a full burst. Otherwise the burst
+    // shrinks with the rate, and debt is kept and still paid back.
+    if (rate == 0 || rate_ == 0)
+    {
+      tokens_ = static_cast<double>(rate);
+    }
+    else
+    {
+      tokens_ = std::min(tokens_, static_cast<double>(rate));
+    }
+    rate_ = rate;
+    cv_.notify_all();
+  }
+
+  uint64_t TokenBucket::rate() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rate_;
+  }
+
+  void TokenBucket::refill(Clock::time_point now)
+  {
+    const double elapsed =
+        std::chrono::duration<double>(now - last_refill_).count();
+    last_refill_ = now;
+    if (rate_ != 0)
+    {
+      tokens_ = std::min(static_cast<double>(rate_),
+                         tokens_ + elapsed * static_cast<double>(rate_));
+    }
+  }
+
+  bool TokenBucket::acquire(uint64_t tokens, const CancellationToken *cancel)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (rate_ == 0)
+    {
+      return true;
+    }
+    // Wait for earlier debt to be paid back before taking on more.
+    refill(Clock::now());
+    while (rate_ != 0 && tokens_ < 0)
+    {
+      if (is_cancelled(cancel))
+      {
+        return false;
+      }
+      double seconds = -tokens_ / static_cast<double>(rate_);
+      if (cancel != nullptr)
+      {
+        seconds = std::min(seconds, kCancelCheckSeconds);
+      }
+      cv_.wait_for(lock, std::chrono::duration<double>(seconds));
+      refill(Clock::now());
+    }
+    if (rate_ != 0)
+    {
+      tokens_ -= static_cast<double>(tokens);
+    }
+    return true;
+  }
+
+} // namespace desktop_updater
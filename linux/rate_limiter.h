@@ -0,0 +1,69 @@
+#ifndef DESKTOP_UPDATER_RATE_LIMITER_H_
+#define DESKTOP_UPDATER_RATE_LIMITER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "cancellation.h"
+
+namespace desktop_updater
+{
+
+  // Token bucket that lets through rate tokens per second on average, with
+  // bursts of up to one second's worth. A request larger than what is
+  // available is granted at once and paid back by the callers after it, so
+  // large I/O is not split up and the long-run rate still holds.
+  class TokenBucket
+  {
+  public:
+    // A rate of 0, the default, disables the limit.
+    explicit TokenBucket(uint64_t rate = 0);
+
+    TokenBucket(const TokenBucket &) = delete;
+    TokenBucket &operator=(const TokenBucket &) = delete;
+
+    // Takes effect for callers already waiting.
+    void set_rate(uint64_t rate);
+    uint64_t rate() const;
+
+    // Blocks until tokens may be spent. With cancel, the wait is checked
+    // every few milliseconds and given up, without spending anything, once
+    // it is cancelled; returns false then.
+    bool acquire(uint64_t tokens, const CancellationToken *cancel = nullptr);
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    void refill(Clock::time_point now);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    uint64_t rate_;
+    // Goes negative while callers pay back a request larger than the burst.
+    double tokens_;
+    Clock::time_point last_refill_;
+  };
+
+  // Limits shared by every update stage of the process. Disk limits apply to
+  // reads and writes of the install and staging directories, the network
+  // limit to bytes received by native downloads.
+  struct IoLimits
+  {
+    TokenBucket disk_bytes;
+    TokenBucket disk_ops;
+    TokenBucket network_bytes;
+
+    // Charges one disk request of bytes. Returns false if cancel was
+    // cancelled while waiting.
+    bool charge_disk(size_t bytes, const CancellationToken *cancel = nullptr)
+    {
+      return disk_ops.acquire(1, cancel) && disk_bytes.acquire(bytes, cancel);
+    }
+  };
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_RATE_LIMITER_H_
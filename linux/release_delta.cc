@@ -0,0 +1,335 @@
+#include "release_delta.h"
+
+#include <dirent.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <zstd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "binary_delta.h"
+#include "build_manifest.h"
+#include "hash_index.h"
+#include "manifest.h"
+
+namespace desktop_updater
+{
+
+  namespace
+  {
+    bool is_directory(const std::string &path)
+    {
+      struct stat st;
+      return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    std::vector<std::string> list_directories(const std::string &path)
+    {
+      std::vector<std::string> names;
+      DIR *dir = opendir(path.c_str());
+      if (dir == nullptr)
+      {
+        return names;
+      }
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != nullptr)
+      {
+        const std::string name = entry->d_name;
+        if (name != "." && name != ".." && is_directory(path + "/" + name))
+        {
+          names.push_back(name);
+        }
+      }
+      closedir(dir);
+      std::sort(names.begin(), names.end());
+      return names;
+    }
+
+    bool is_number(const std::string &text)
+    {
+      return !text.empty() &&
+             text.find_first_not_of("0123456789") == std::string::npos;
+    }
+
+    bool build_before(const std::string &a, const std::string &b)
+    {
+      if (is_number(a) && is_number(b))
+      {
+        return strtoull(a.c_str(), nullptr, 10) <
+               strtoull(b.c_str(), nullptr, 10);
+      }
+      return a < b;
+    }
+
+    std::string base_name(const std::string &path)
+    {
+      const size_t slash = path.find_last_of('/');
+      return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    int remove_entry(const char *path, const struct stat *, int, struct FTW *)
+    {
+      return remove(path);
+    }
+
+    bool write_file(const std::string &path, const std::string &data)
+    {
+      if (!make_parent_directories(path))
+      {
+        return false;
+      }
+      FILE *file = fopen(path.c_str(), "wb");
+      if (file == nullptr)
+      {
+        return false;
+      }
+      bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+      ok = fclose(file) == 0 && ok;
+      return ok;
+    }
+
+    // What a client downloads for a file without a delta, worked out once
+    // however many bases have a delta for it.
+    struct FullDownload
+    {
+      std::once_flag once;
+      uint64_t size = 0;
+    };
+
+    struct DeltaJob
+    {
+      const FileHashEntry *target = nullptr;
+      const FileHashEntry *source = nullptr;
+      std::string base;
+      FullDownload *full = nullptr;
+      DeltaIndexEntry entry;
+      bool kept = false;
+    };
+
+    uint64_t full_download_size(const FileHashEntry &target,
+                                const MappedFile &file,
+                                const ReleaseDeltaOptions &options)
+    {
+      uint64_t size = static_cast<uint64_t>(target.length);
+      if (target.compressed_length > 0)
+      {
+        size = std::min(size, static_cast<uint64_t>(target.compressed_length));
+      }
+      const size_t bound = ZSTD_compressBound(file.size());
+      BudgetReservation reservation(options.budget, bound);
+      std::unique_ptr<char[]> compressed(new char[bound]);
+      const size_t compressed_size =
+          ZSTD_compress(compressed.get(), bound, file.data(), file.size(),
+                        options.level);
+      if (!ZSTD_isError(compressed_size))
+      {
+        size = std::min(size, static_cast<uint64_t>(compressed_size));
+      }
+      return size;
+    }
+
+    // Returns false only if a kept delta cannot be written.
+    bool run_job(const std::string &release, const ReleaseDeltaOptions &options,
+                 DeltaJob *job)
+    {
+      MappedFile target;
+      MappedFile source;
+      if (!target.open(release + "/" + job->target->path) ||
+          !source.open(job->base + "/" + job->source->path) ||
+          source.size() > kMaxDeltaSourceSize)
+      {
+        return true;
+      }
+      std::call_once(job->full->once, [&]
+                     { job->full->size = full_download_size(*job->target,
+                                                            target, options); });
+
+      // The suffix arrays, plus the delta streams and their frames.
+      const size_t scratch_size = binary_delta_scratch_size(source.size());
+      BudgetReservation reservation(options.budget,
+                                    scratch_size + 3 * target.size());
+      std::unique_ptr<int32_t[]> scratch(
+          new int32_t[scratch_size / sizeof(int32_t)]);
+      std::string delta;
+      if (!make_binary_delta(source.data(), source.size(), target.data(),
+                             target.size(), options.level,
+                             reinterpret_cast<uint8_t *>(scratch.get()),
+                             &delta) ||
+          delta.size() >= job->full->size)
+      {
+        return true;
+      }
+      scratch.reset();
+      if (!write_file(release + "/" + job->entry.delta, delta))
+      {
+        return false;
+      }
+      job->entry.length = static_cast<int64_t>(delta.size());
+      job->kept = true;
+      return true;
+    }
+  } // namespace
+
+  std::string delta_index_to_json(const std::vector<DeltaIndexEntry> &entries)
+  {
+    std::string out = "[";
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      const DeltaIndexEntry &entry = entries[i];
+      if (i > 0)
+      {
+        out.push_back(',');
+      }
+      out.append("{\"path\":");
+      append_json_string(&out, entry.path);
+      out.append(",\"fromHash\":");
+      append_json_string(&out, entry.from_hash);
+      out.append(",\"toHash\":");
+      append_json_string(&out, entry.to_hash);
+      out.append(",\"delta\":");
+      append_json_string(&out, entry.delta);
+      out.append(",\"length\":");
+      out.append(std::to_string(entry.length));
+      out.push_back('}');
+    }
+    out.push_back(']');
+    return out;
+  }
+
+  std::vector<std::string> find_release_bundles(const std::string &dist,
+                                                const std::string &platform)
+  {
+    std::vector<std::string> builds = list_directories(dist);
+    std::stable_sort(builds.begin(), builds.end(), build_before);
+    const std::string suffix = "-" + platform;
+    std::vector<std::string> bundles;
+    for (const std::string &build : builds)
+    {
+      const std::string build_dir = dist + "/" + build;
+      for (const std::string &name : list_directories(build_dir))
+      {
+        const std::string bundle = build_dir + "/" + name;
+        struct stat st;
+        if (name.size() > suffix.size() &&
+            name.compare(name.size() - suffix.size(), suffix.size(),
+                         suffix) == 0 &&
+            stat((bundle + "/" + kHashesFileName).c_str(), &st) == 0)
+        {
+          bundles.push_back(bundle);
+          break;
+        }
+      }
+    }
+    return bundles;
+  }
+
+  bool make_release_deltas(ThreadPool *pool, const std::string &release,
+                           const std::vector<std::string> &bases,
+                           const ReleaseDeltaOptions &options,
+                           std::vector<DeltaIndexEntry> *entries,
+                           ReleaseDeltaStats *stats)
+  {
+    std::vector<FileHashEntry> targets;
+    if (!read_manifest_json(release + "/" + kHashesFileName, &targets))
+    {
+      return false;
+    }
+    std::vector<std::vector<FileHashEntry>> sources(bases.size());
+    for (size_t i = 0; i < bases.size(); i++)
+    {
+      if (!read_manifest_json(bases[i] + "/" + kHashesFileName, &sources[i]))
+      {
+        return false;
+      }
+    }
+
+    std::map<std::string, const FileHashEntry *> by_path;
+    for (const FileHashEntry &target : targets)
+    {
+      by_path[target.path] = &target;
+    }
+    std::map<std::string, std::unique_ptr<FullDownload>> full_downloads;
+    std::map<std::pair<std::string, std::string>, bool> planned;
+    std::vector<std::unique_ptr<DeltaJob>> jobs;
+    for (size_t i = 0; i < bases.size(); i++)
+    {
+      for (const FileHashEntry &source : sources[i])
+      {
+        auto target = by_path.find(source.path);
+        if (target == by_path.end() ||
+            target->second->calculated_hash == source.calculated_hash ||
+            planned[{source.path, source.calculated_hash}])
+        {
+          continue;
+        }
+        planned[{source.path, source.calculated_hash}] = true;
+        std::unique_ptr<FullDownload> &full = full_downloads[source.path];
+        if (full == nullptr)
+        {
+          full.reset(new FullDownload());
+        }
+        std::unique_ptr<DeltaJob> job(new DeltaJob());
+        job->target = target->second;
+        job->source = &source;
+        job->base = bases[i];
+        job->full = full.get();
+        job->entry.path = source.path;
+        job->entry.from_hash = source.calculated_hash;
+        job->entry.to_hash = target->second->calculated_hash;
+        job->entry.delta = std::string(kDeltaDirectoryName) + "/" +
+                           base_name(bases[i]) + "/" + source.path + ".delta";
+        jobs.push_back(std::move(job));
+      }
+    }
+
+    // Deltas left from an earlier run may be from bases no longer listed.
+    nftw((release + "/" + kDeltaDirectoryName).c_str(), remove_entry, 16,
+         FTW_DEPTH | FTW_PHYS);
+    std::atomic<bool> failed(false);
+    WaitGroup group;
+    group.add(jobs.size());
+    for (const std::unique_ptr<DeltaJob> &job : jobs)
+    {
+      DeltaJob *pending = job.get();
+      pool->submit([&release, &options, &failed, &group, pending]
+                   {
+                     if (!run_job(release, options, pending))
+                     {
+                       failed = true;
+                     }
+                     group.done();
+                   });
+    }
+    group.wait();
+    if (failed)
+    {
+      return false;
+    }
+
+    *stats = ReleaseDeltaStats();
+    stats->changed_files = full_downloads.size();
+    entries->clear();
+    for (const std::unique_ptr<DeltaJob> &job : jobs)
+    {
+      if (job->kept)
+      {
+        entries->push_back(job->entry);
+        stats->deltas++;
+        stats->delta_bytes += static_cast<uint64_t>(job->entry.length);
+        stats->full_bytes += job->full->size;
+      }
+    }
+    std::stable_sort(entries->begin(), entries->end(),
+                     [](const DeltaIndexEntry &a, const DeltaIndexEntry &b)
+                     { return a.path < b.path; });
+    return write_file(release + "/" + kDeltaIndexFileName,
+                      delta_index_to_json(*entries));
+  }
+
+} // namespace desktop_updater
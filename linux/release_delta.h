@@ -0,0 +1,67 @@
+#ifndef DESKTOP_UPDATER_RELEASE_DELTA_H_
+#define DESKTOP_UPDATER_RELEASE_DELTA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "memory_budget.h"
+#include "release_manifest.h"
+#include "thread_pool.h"
+
+namespace desktop_updater
+{
+
+  // One entry of deltas.json; mirrors DeltaFileModel on the Dart side.
+  struct DeltaIndexEntry
+  {
+    std::string path;      // the file in this release
+    std::string from_hash; // calculatedHash of the file the delta applies to
+    std::string to_hash;   // calculatedHash of the file it rebuilds
+    std::string delta;     // delta file, relative to the release
+    int64_t length = 0;    // size of the delta file
+  };
+
+  std::string delta_index_to_json(const std::vector<DeltaIndexEntry> &entries);
+
+  // The release bundles bin/archive.dart left in dist/<build> folders,
+  // oldest build first. A bundle is a folder ending in "-<platform>" that
+  // holds a hashes.json. Build folders are ordered by number where both
+  // names are numbers, and by name otherwise.
+  std::vector<std::string> find_release_bundles(const std::string &dist,
+                                                const std::string &platform);
+
+  struct ReleaseDeltaOptions
+  {
+    // zstd level of the delta streams and of the full files they must beat.
+    int level = 19;
+    // Caps the suffix arrays and delta buffers of the files in progress,
+    // about ten bytes per byte of file. May be null.
+    MemoryBudget *budget = nullptr;
+  };
+
+  struct ReleaseDeltaStats
+  {
+    size_t changed_files = 0;
+    size_t deltas = 0;
+    uint64_t delta_bytes = 0;
+    // Compressed size of the files the deltas replace.
+    uint64_t full_bytes = 0;
+  };
+
+  // Makes a delta to release from each of bases for every file whose
+  // digest differs, on the pool, and writes them below release/deltas/
+  // with their index as release/deltas.json. Bases listed first win when
+  // two hold the same file. A delta is only kept if it is smaller than the
+  // compressed file, and the published .zst copy where there is one.
+  // Returns false if a manifest cannot be read or a file cannot be written.
+  bool make_release_deltas(ThreadPool *pool, const std::string &release,
+                           const std::vector<std::string> &bases,
+                           const ReleaseDeltaOptions &options,
+                           std::vector<DeltaIndexEntry> *entries,
+                           ReleaseDeltaStats *stats);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_RELEASE_DELTA_H_
@@ -0,0 +1,72 @@
+#include "release_manifest.h"
+
+#include <cstring>
+#include <map>
+
+namespace desktop_updater
+{
+
+  bool hash_release(FileHasher *hasher, const std::string &bundle,
+                    const ReleaseManifestOptions &options,
+                    std::vector<FileHashEntry> *entries)
+  {
+    HashDirectoryOptions hash_options;
+    hash_options.algorithm = options.algorithm;
+    hash_options.excluded_suffixes = {kHashesFileName, ".DS_Store"};
+    hash_options.excluded_paths = options.excluded_paths;
+    hash_options.excluded_paths.push_back(kMerkleTreeFileName);
+    hash_options.excluded_paths.push_back(kDeltaIndexFileName);
+    hash_options.excluded_paths.push_back(kDeltaDirectoryName);
+    hash_options.index = options.index;
+    std::vector<FileHashEntry> listed;
+    if (!hasher->hash_directory(bundle, hash_options, &listed))
+    {
+      return false;
+    }
+    entries->clear();
+    if (!options.zstd_copies)
+    {
+      entries->swap(listed);
+      return true;
+    }
+
+    // A copy may be listed before or after its file, so the pairs are found
+    // first and the entries filtered after.
+    std::map<std::string, size_t> positions;
+    for (size_t i = 0; i < listed.size(); i++)
+    {
+      positions[listed[i].path] = i;
+    }
+    const size_t suffix_length = strlen(kZstdFileSuffix);
+    std::vector<bool> is_copy(listed.size(), false);
+    bool any_copy = false;
+    for (size_t i = 0; i < listed.size(); i++)
+    {
+      const std::string &path = listed[i].path;
+      if (path.size() <= suffix_length ||
+          path.compare(path.size() - suffix_length, suffix_length,
+                       kZstdFileSuffix) != 0)
+      {
+        continue;
+      }
+      auto original =
+          positions.find(path.substr(0, path.size() - suffix_length));
+      if (original != positions.end())
+      {
+        listed[original->second].compressed_length = listed[i].length;
+        is_copy[i] = true;
+        any_copy = true;
+      }
+    }
+    for (size_t i = 0; i < listed.size(); i++)
+    {
+      if (!is_copy[i] &&
+          !(any_copy && listed[i].path == kZstdDictionaryFileName))
+      {
+        entries->push_back(listed[i]);
+      }
+    }
+    return true;
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,40 @@
+#ifndef DESKTOP_UPDATER_RELEASE_MANIFEST_H_
+#define DESKTOP_UPDATER_RELEASE_MANIFEST_H_
+
+#include <string>
+#include <vector>
+
+#include "file_hasher.h"
+#include "hash_index.h"
+#include "manifest.h"
+
+namespace desktop_updater
+{
+
+  struct ReleaseManifestOptions
+  {
+    HashAlgorithm algorithm = HashAlgorithm::kBlake2b;
+    // Left out besides the manifests themselves, such as the runner and
+    // sidecar a build manifest is stored in.
+    std::vector<std::string> excluded_paths;
+    // Whether "<path>.zst" next to a listed file is its compressed copy, as
+    // bin/archive.dart --zstd-dictionary writes them. Copies are then
+    // recorded as the compressed_length of their file instead of listed,
+    // and the dictionary is left out.
+    bool zstd_copies = false;
+    // Digests of files whose stat data is unchanged since the last run are
+    // reused; the index is updated with everything hashed. May be null.
+    HashIndex *index = nullptr;
+  };
+
+  // Hashes a release bundle and returns its entries as genFileHashes and
+  // embedBuildManifest in bin/archive.dart list them: in listing order,
+  // without hashes.json, tree.json, the deltas and .DS_Store files. Returns
+  // false if bundle is not a directory.
+  bool hash_release(FileHasher *hasher, const std::string &bundle,
+                    const ReleaseManifestOptions &options,
+                    std::vector<FileHashEntry> *entries);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_RELEASE_MANIFEST_H_
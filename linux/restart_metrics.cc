@@ -0,0 +1,178 @@
+#include "restart_metrics.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "hash_index.h"
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const char kMagic[4] = {'D', 'U', 'R', 'M'};
+    const uint32_t kVersion = 2;
+    const size_t kFieldsPerRecord = 7;
+    // Version 1 records lack applied_ns and warmed_ns.
+    const size_t kVersion1FieldsPerRecord = 5;
+
+    void append_raw(std::string *out, const void *data, size_t length)
+    {
+      out->append(static_cast<const char *>(data), length);
+    }
+  } // namespace
+
+  int64_t boottime_ns()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+  }
+
+  int64_t process_start_ns()
+  {
+    FILE *file = fopen("/proc/self/stat", "r");
+    if (file == nullptr)
+    {
+      return 0;
+    }
+    char buffer[1024];
+    const size_t n = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+    buffer[n] = '\0';
+
+    // Field 22, counted from after the name in field 2, which may contain
+    // spaces.
+    const char *field = strrchr(buffer, ')');
+    if (field == nullptr)
+    {
+      return 0;
+    }
+    field++;
+    for (int i = 3; i < 22 && field != nullptr; i++)
+    {
+      field = strchr(field + 1, ' ');
+    }
+    if (field == nullptr)
+    {
+      return 0;
+    }
+    const unsigned long long ticks = strtoull(field + 1, nullptr, 10);
+    const long hz = sysconf(_SC_CLK_TCK);
+    if (hz <= 0)
+    {
+      return 0;
+    }
+    return static_cast<int64_t>(ticks * (1000000000ull / hz));
+  }
+
+  bool RestartLog::load(const std::string &path)
+  {
+    records_.clear();
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t count = 0;
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+              memcmp(magic, kMagic, sizeof(magic)) == 0 &&
+              fread(&version, sizeof(version), 1, file) == 1 &&
+              (version == kVersion || version == 1) &&
+              fread(&count, sizeof(count), 1, file) == 1 &&
+              count <= kRestartLogCapacity;
+    const size_t field_count =
+        version == 1 ? kVersion1FieldsPerRecord : kFieldsPerRecord;
+    for (uint32_t i = 0; ok && i < count; i++)
+    {
+      int64_t fields[kFieldsPerRecord] = {};
+      ok = fread(fields, sizeof(int64_t), field_count, file) == field_count;
+      if (ok)
+      {
+        const int64_t *field = fields;
+        RestartRecord record;
+        record.requested_ns = *field++;
+        if (version != 1)
+        {
+          record.applied_ns = *field++;
+          record.warmed_ns = *field++;
+        }
+        record.exited_ns = *field++;
+        record.started_ns = *field++;
+        record.registered_ns = *field++;
+        record.first_frame_ns = *field++;
+        records_.push_back(record);
+      }
+    }
+    ok = ok && fgetc(file) == EOF;
+    fclose(file);
+    if (!ok)
+    {
+      records_.clear();
+    }
+    return ok;
+  }
+
+  bool RestartLog::save(const std::string &path) const
+  {
+    std::string data;
+    append_raw(&data, kMagic, sizeof(kMagic));
+    append_raw(&data, &kVersion, sizeof(kVersion));
+    const uint32_t count = static_cast<uint32_t>(records_.size());
+    append_raw(&data, &count, sizeof(count));
+    for (const RestartRecord &record : records_)
+    {
+      const int64_t fields[kFieldsPerRecord] = {
+          record.requested_ns, record.applied_ns, record.warmed_ns,
+          record.exited_ns, record.started_ns, record.registered_ns,
+          record.first_frame_ns};
+      append_raw(&data, fields, sizeof(fields));
+    }
+
+    if (!make_parent_directories(path))
+    {
+      return false;
+    }
+    const std::string temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+      unlink(temporary.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  void RestartLog::add(const RestartRecord &record)
+  {
+    if (records_.size() >= kRestartLogCapacity)
+    {
+      records_.erase(records_.begin(),
+                     records_.begin() + (records_.size() - kRestartLogCapacity + 1));
+    }
+    records_.push_back(record);
+  }
+
+  RestartRecord *RestartLog::newest()
+  {
+    return records_.empty() ? nullptr : &records_.back();
+  }
+
+  RestartRecord *RestartLog::pending()
+  {
+    RestartRecord *record = newest();
+    return record != nullptr && record->started_ns == 0 ? record : nullptr;
+  }
+
+} // namespace desktop_updater
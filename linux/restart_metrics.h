@@ -0,0 +1,67 @@
+#ifndef DESKTOP_UPDATER_RESTART_METRICS_H_
+#define DESKTOP_UPDATER_RESTART_METRICS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace desktop_updater
+{
+
+  // Restarts kept in the log; older ones are dropped.
+  const size_t kRestartLogCapacity = 16;
+
+  // Phases of one restartApp, as CLOCK_BOOTTIME nanoseconds so that times
+  // taken by the old and the new process are comparable. 0 means the phase
+  // was not reached or not recorded. The update is applied by applyUpdate
+  // beforehand, so applied_ns precedes requested_ns.
+  struct RestartRecord
+  {
+    int64_t requested_ns = 0;   // restartApp called in the old process
+    int64_t applied_ns = 0;     // applyUpdate moved the update into place
+    int64_t warmed_ns = 0;      // startup pages handed to the warming child
+    int64_t exited_ns = 0;      // old process about to exit
+    int64_t started_ns = 0;     // new process exec'd
+    int64_t registered_ns = 0;  // plugin registered in the new process
+    int64_t first_frame_ns = 0; // first Flutter frame of the new process
+  };
+
+  int64_t boottime_ns();
+  // When this process was started, from /proc/self/stat, in the clock of
+  // boottime_ns() but only to clock tick precision.
+  int64_t process_start_ns();
+
+  // The last kRestartLogCapacity restarts, persisted in a small file outside
+  // the install directory so it survives the update it measures.
+  //
+  //   "DURM" | u32 version | u32 count | count x 7 x i64, oldest first
+  //
+  // with the fields in the order of RestartRecord. Version 1 logs, without
+  // applied_ns and warmed_ns, are still read.
+  class RestartLog
+  {
+  public:
+    // A missing or malformed file leaves the log empty and returns false.
+    bool load(const std::string &path);
+    // Written to a temporary file and renamed over path.
+    bool save(const std::string &path) const;
+
+    // Appends record, dropping the oldest when full.
+    void add(const RestartRecord &record);
+
+    // The newest record, or null when the log is empty.
+    RestartRecord *newest();
+    // The newest record if the new process has not claimed it yet, else
+    // null.
+    RestartRecord *pending();
+
+    const std::vector<RestartRecord> &records() const { return records_; }
+
+  private:
+    std::vector<RestartRecord> records_;
+  };
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_RESTART_METRICS_H_
@@ -0,0 +1,331 @@
+#include "rollback.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <linux/fs.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace desktop_updater
+{
+
+  const char kHealthFdVariable[] = "DESKTOP_UPDATER_HEALTH_FD";
+
+  namespace
+  {
+    // Below the snapshot directory: the replaced files at their relative
+    // paths, and the NUL-separated list of what the update adds, with a
+    // trailing slash on added directories.
+    const char kFilesDirectory[] = "files";
+    const char kAddedList[] = "added";
+
+    std::vector<std::string> list_names(const std::string &path)
+    {
+      std::vector<std::string> names;
+      DIR *dir = opendir(path.c_str());
+      if (dir == nullptr)
+      {
+        return names;
+      }
+      while (struct dirent *entry = readdir(dir))
+      {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+        {
+          names.push_back(entry->d_name);
+        }
+      }
+      closedir(dir);
+      return names;
+    }
+
+    int remove_entry(const char *path, const struct stat *, int, struct FTW *)
+    {
+      return remove(path);
+    }
+
+    void remove_tree(const std::string &path)
+    {
+      nftw(path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    // Reflinks source to the new file target, keeping its mode and times,
+    // and hard-links it where the file system cannot share extents.
+    bool clone_file(const std::string &source, const std::string &target,
+                    const struct stat &source_stat, bool *cloned)
+    {
+      *cloned = false;
+      const int in = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+      if (in >= 0)
+      {
+        const int out = open(target.c_str(),
+                             O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (out >= 0)
+        {
+          const struct timespec times[2] = {source_stat.st_atim,
+                                            source_stat.st_mtim};
+          *cloned = ioctl(out, FICLONE, in) == 0 &&
+                    fchmod(out, source_stat.st_mode & 07777) == 0 &&
+                    futimens(out, times) == 0;
+          close(out);
+          if (!*cloned)
+          {
+            unlink(target.c_str());
+          }
+        }
+        close(in);
+      }
+      return *cloned || link(source.c_str(), target.c_str()) == 0;
+    }
+
+    bool snapshot_directory(const std::string &install_dir,
+                            const std::string &staging_dir,
+                            const std::string &files_dir,
+                            const std::string &relative, std::string *added,
+                            SnapshotStats *stats, std::string *error)
+    {
+      for (const std::string &name : list_names(
+               relative.empty() ? staging_dir : staging_dir + "/" + relative))
+      {
+        const std::string child =
+            relative.empty() ? name : relative + "/" + name;
+        const std::string source = staging_dir + "/" + child;
+        const std::string installed = install_dir + "/" + child;
+        struct stat source_stat;
+        if (lstat(source.c_str(), &source_stat) != 0)
+        {
+          *error = "Cannot stat " + source + ": " + strerror(errno);
+          return false;
+        }
+        struct stat installed_stat;
+        if (lstat(installed.c_str(), &installed_stat) != 0)
+        {
+          // Removed whole on restore, with anything below it.
+          added->append(child);
+          if (S_ISDIR(source_stat.st_mode))
+          {
+            added->push_back('/');
+          }
+          added->push_back('\0');
+          stats->added++;
+          continue;
+        }
+        if (S_ISDIR(source_stat.st_mode))
+        {
+          if (!S_ISDIR(installed_stat.st_mode))
+          {
+            continue; // the apply fails on this before changing it
+          }
+          const std::string copy = files_dir + "/" + child;
+          if (mkdir(copy.c_str(), 0755) != 0)
+          {
+            *error = "Cannot create " + copy + ": " + strerror(errno);
+            return false;
+          }
+          if (!snapshot_directory(install_dir, staging_dir, files_dir, child,
+                                  added, stats, error))
+          {
+            return false;
+          }
+          continue;
+        }
+        if (!S_ISREG(installed_stat.st_mode))
+        {
+          continue;
+        }
+        bool cloned = false;
+        if (!clone_file(installed, files_dir + "/" + child, installed_stat,
+                        &cloned))
+        {
+          *error = "Cannot snapshot " + installed + ": " + strerror(errno);
+          return false;
+        }
+        if (cloned)
+        {
+          stats->cloned++;
+        }
+        else
+        {
+          stats->linked++;
+        }
+      }
+      return true;
+    }
+
+    bool restore_directory(const std::string &install_dir,
+                           const std::string &files_dir,
+                           const std::string &relative, std::string *error)
+    {
+      bool ok = true;
+      for (const std::string &name : list_names(
+               relative.empty() ? files_dir : files_dir + "/" + relative))
+      {
+        const std::string child =
+            relative.empty() ? name : relative + "/" + name;
+        const std::string copy = files_dir + "/" + child;
+        struct stat st;
+        if (lstat(copy.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+          ok = restore_directory(install_dir, files_dir, child, error) && ok;
+        }
+        else if (rename(copy.c_str(), (install_dir + "/" + child).c_str()) != 0)
+        {
+          *error = "Cannot restore " + child + ": " + strerror(errno);
+          ok = false;
+        }
+      }
+      return ok;
+    }
+  } // namespace
+
+  bool take_update_snapshot(const std::string &install_dir,
+                            const std::string &staging_dir,
+                            const std::string &snapshot_dir,
+                            SnapshotStats *stats, std::string *error)
+  {
+    *stats = SnapshotStats();
+    const std::string files_dir = snapshot_dir + "/" + kFilesDirectory;
+    if (mkdir(snapshot_dir.c_str(), 0700) != 0 ||
+        mkdir(files_dir.c_str(), 0700) != 0)
+    {
+      *error = "Cannot create " + snapshot_dir + ": " + strerror(errno);
+      return false;
+    }
+    std::string added;
+    if (!snapshot_directory(install_dir, staging_dir, files_dir, "", &added,
+                            stats, error))
+    {
+      return false;
+    }
+    const std::string list = snapshot_dir + "/" + kAddedList;
+    FILE *file = fopen(list.c_str(), "wb");
+    bool ok = file != nullptr &&
+              fwrite(added.data(), 1, added.size(), file) == added.size();
+    ok = file != nullptr && fclose(file) == 0 && ok;
+    if (!ok)
+    {
+      *error = "Cannot write " + list;
+    }
+    return ok;
+  }
+
+  bool restore_update_snapshot(const std::string &install_dir,
+                               const std::string &snapshot_dir,
+                               std::string *error)
+  {
+    std::string added;
+    FILE *file = fopen((snapshot_dir + "/" + kAddedList).c_str(), "rb");
+    if (file == nullptr)
+    {
+      *error = "No snapshot in " + snapshot_dir;
+      return false;
+    }
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+      added.append(buffer, read);
+    }
+    fclose(file);
+
+    bool ok = restore_directory(
+        install_dir, snapshot_dir + "/" + kFilesDirectory, "", error);
+    for (size_t start = 0; start < added.size();)
+    {
+      size_t end = added.find('\0', start);
+      if (end == std::string::npos)
+      {
+        end = added.size();
+      }
+      remove_tree(install_dir + "/" + added.substr(start, end - start));
+      start = end + 1;
+    }
+    discard_update_snapshot(snapshot_dir);
+    return ok;
+  }
+
+  void discard_update_snapshot(const std::string &snapshot_dir)
+  {
+    remove_tree(snapshot_dir);
+  }
+
+  HealthResult wait_for_health(int fd, pid_t pid, int timeout_ms)
+  {
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(timeout_ms);
+    auto remaining_ms = [&deadline]()
+    {
+      const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      return left.count() > 0 ? static_cast<int>(left.count()) : 0;
+    };
+
+    for (;;)
+    {
+      struct pollfd poll_fd = {fd, POLLIN, 0};
+      const int ready = poll(&poll_fd, 1, remaining_ms());
+      if (ready < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (ready <= 0)
+      {
+        return HealthResult::kTimedOut;
+      }
+      char byte;
+      const ssize_t n = ::read(fd, &byte, 1);
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n == 1)
+      {
+        return HealthResult::kHealthy;
+      }
+      break;
+    }
+
+    // The pipe closed without a report, which normally means the app is
+    // gone; tell a clean exit from a crash.
+    for (;;)
+    {
+      int status = 0;
+      const pid_t waited = waitpid(pid, &status, WNOHANG);
+      if (waited == pid)
+      {
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0
+                   ? HealthResult::kExited
+                   : HealthResult::kFailed;
+      }
+      if (waited < 0 && errno != EINTR)
+      {
+        return HealthResult::kFailed;
+      }
+      if (remaining_ms() == 0)
+      {
+        return HealthResult::kTimedOut;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  void report_healthy(int fd)
+  {
+    const char byte = 1;
+    while (write(fd, &byte, 1) < 0 && errno == EINTR)
+    {
+    }
+    close(fd);
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,63 @@
+#ifndef DESKTOP_UPDATER_ROLLBACK_H_
+#define DESKTOP_UPDATER_ROLLBACK_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string>
+
+namespace desktop_updater
+{
+
+  // Environment variable the relaunched app finds its health pipe in.
+  extern const char kHealthFdVariable[];
+
+  struct SnapshotStats
+  {
+    size_t cloned = 0;
+    size_t linked = 0;
+    size_t added = 0;
+  };
+
+  // Records what apply_staged_update(install_dir, staging_dir) is about to
+  // change, so restore_update_snapshot() can undo it. Every installed file
+  // the staging directory replaces is reflinked (FICLONE) below
+  // snapshot_dir, which copies no data on copy-on-write file systems. Where
+  // reflinks are not supported it is hard-linked instead; that is enough
+  // because the apply only ever renames over installed files and never
+  // writes into them. Files the update adds are listed so they can be
+  // removed. Returns false, describing why in error, if a file cannot be
+  // recorded; snapshot_dir must not exist yet.
+  bool take_update_snapshot(const std::string &install_dir,
+                            const std::string &staging_dir,
+                            const std::string &snapshot_dir,
+                            SnapshotStats *stats, std::string *error);
+
+  // Renames the recorded files back into install_dir, removes the added
+  // ones and then snapshot_dir. Keeps going past failures so as much as
+  // possible is restored; returns false if anything could not be.
+  bool restore_update_snapshot(const std::string &install_dir,
+                               const std::string &snapshot_dir,
+                               std::string *error);
+
+  // Removes snapshot_dir, if there is one.
+  void discard_update_snapshot(const std::string &snapshot_dir);
+
+  enum class HealthResult
+  {
+    kHealthy,  // the app reported that it is up
+    kExited,   // it exited with status 0 before reporting
+    kFailed,   // it crashed or exited with an error before reporting
+    kTimedOut, // it did neither in time
+  };
+
+  // Waits up to timeout_ms for the app running as child pid to report on
+  // the read end of its health pipe.
+  HealthResult wait_for_health(int fd, pid_t pid, int timeout_ms);
+
+  // Reports on the write end of the health pipe and closes it.
+  void report_healthy(int fd);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_ROLLBACK_H_
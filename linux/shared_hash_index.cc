@@ -0,0 +1,212 @@
+#include "shared_hash_index.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const char kSystemCacheDirectory[] = "/var/cache/desktop_updater";
+    const int kLockPollMs = 20;
+
+    bool write_all(int fd, const std::string &data)
+    {
+      size_t offset = 0;
+      while (offset < data.size())
+      {
+        const ssize_t n = pwrite(fd, data.data() + offset, data.size() - offset,
+                                 static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (n <= 0)
+        {
+          return false;
+        }
+        offset += static_cast<size_t>(n);
+      }
+      return true;
+    }
+
+    // A directory only root, the caller and its group can create files in,
+    // and the caller can.
+    bool trusted_directory(const std::string &path, struct stat *st)
+    {
+      return lstat(path.c_str(), st) == 0 && S_ISDIR(st->st_mode) &&
+             (st->st_uid == 0 || st->st_uid == geteuid()) &&
+             (st->st_mode & S_IWOTH) == 0 &&
+             access(path.c_str(), W_OK | X_OK) == 0;
+    }
+
+    // See the SharedHashIndex comment.
+    bool trusted_file(const struct stat &file, const struct stat &directory)
+    {
+      if (!S_ISREG(file.st_mode) || file.st_nlink != 1 ||
+          (file.st_mode & S_IWOTH) != 0)
+      {
+        return false;
+      }
+      if ((file.st_mode & S_IWGRP) != 0 && file.st_gid != directory.st_gid)
+      {
+        return false;
+      }
+      return file.st_uid == 0 || file.st_uid == geteuid() ||
+             (directory.st_uid == 0 && file.st_gid == directory.st_gid);
+    }
+
+    std::string parent_directory(const std::string &path)
+    {
+      const size_t slash = path.rfind('/');
+      if (slash == std::string::npos)
+      {
+        return ".";
+      }
+      return slash == 0 ? "/" : path.substr(0, slash);
+    }
+  } // namespace
+
+  SharedHashIndex::SharedHashIndex(const std::string &path) : path_(path) {}
+
+  SharedHashIndex::~SharedHashIndex() { release(); }
+
+  bool SharedHashIndex::acquire(HashIndex *index, int timeout_ms)
+  {
+    release();
+    struct stat directory;
+    if (!trusted_directory(parent_directory(path_), &directory))
+    {
+      return false;
+    }
+    // O_CREAT on another user's file in a sticky directory is refused when
+    // fs.protected_regular is set, so it is only used to create the file.
+    const int flags = O_RDWR | O_CLOEXEC | O_NOFOLLOW | O_NOCTTY;
+    bool created = false;
+    fd_ = open(path_.c_str(), flags);
+    if (fd_ < 0 && errno == ENOENT)
+    {
+      fd_ = open(path_.c_str(), flags | O_CREAT | O_EXCL, 0600);
+      created = fd_ >= 0;
+      if (fd_ < 0 && errno == EEXIST)
+      {
+        fd_ = open(path_.c_str(), flags);
+      }
+    }
+    if (fd_ < 0)
+    {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+    {
+      release();
+      return false;
+    }
+    if (created)
+    {
+      // Shared with the directory's group only, whatever the creator's
+      // umask and primary group; private if the caller is not a member. An
+      // existing file is never loosened or tightened, only checked.
+      if (st.st_gid != directory.st_gid &&
+          fchown(fd_, static_cast<uid_t>(-1), directory.st_gid) == 0)
+      {
+        st.st_gid = directory.st_gid;
+      }
+      const mode_t mode = st.st_gid == directory.st_gid ? 0660 : 0600;
+      if ((st.st_mode & 07777) != mode && fchmod(fd_, mode) == 0)
+      {
+        st.st_mode = (st.st_mode & ~07777) | mode;
+      }
+    }
+    if (!trusted_file(st, directory))
+    {
+      release();
+      return false;
+    }
+
+    // Polled rather than blocking so a hung instance cannot stall the others
+    // forever; they fall back to hashing on their own.
+    for (int waited = 0;; waited += kLockPollMs)
+    {
+      if (flock(fd_, LOCK_EX | LOCK_NB) == 0)
+      {
+        break;
+      }
+      if ((errno != EWOULDBLOCK && errno != EINTR) || waited >= timeout_ms)
+      {
+        close(fd_);
+        fd_ = -1;
+        return false;
+      }
+      struct timespec pause = {0, kLockPollMs * 1000000L};
+      nanosleep(&pause, nullptr);
+    }
+
+    if (fstat(fd_, &st) != 0 || st.st_size == 0)
+    {
+      index->parse(nullptr, 0);
+      return true;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (mapped == MAP_FAILED)
+    {
+      index->parse(nullptr, 0);
+      return true;
+    }
+    index->parse(static_cast<const uint8_t *>(mapped), size);
+    munmap(mapped, size);
+    return true;
+  }
+
+  bool SharedHashIndex::commit(const HashIndex &index)
+  {
+    if (fd_ < 0)
+    {
+      return false;
+    }
+    // Shrinking first means a write cut short leaves a file whose checksum
+    // fails rather than one with stale bytes after the new contents.
+    const std::string data = index.serialize();
+    const bool ok = ftruncate(fd_, 0) == 0 && write_all(fd_, data) &&
+                    fdatasync(fd_) == 0;
+    release();
+    return ok;
+  }
+
+  void SharedHashIndex::release()
+  {
+    if (fd_ >= 0)
+    {
+      // Closing the last descriptor drops the lock.
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  std::string shared_cache_path(const std::string &install_dir,
+                                const char *extension)
+  {
+    struct stat st;
+    if (!trusted_directory(kSystemCacheDirectory, &st))
+    {
+      return std::string();
+    }
+    return std::string(kSystemCacheDirectory) + "/" +
+           cache_file_name(install_dir, extension);
+  }
+
+  std::string shared_hash_index_path(const std::string &install_dir)
+  {
+    return shared_cache_path(install_dir, "index");
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,71 @@
+#ifndef DESKTOP_UPDATER_SHARED_HASH_INDEX_H_
+#define DESKTOP_UPDATER_SHARED_HASH_INDEX_H_
+
+#include <string>
+
+#include "hash_index.h"
+
+namespace desktop_updater
+{
+
+  // A hash index file shared by every user running from one install, for
+  // read-only installs on multi-user hosts where each instance would
+  // otherwise hash the same tree.
+  //
+  // The whole check is serialized with flock(): acquire() takes an exclusive
+  // lock on the index file, so while one instance hashes the others wait for
+  // it and then load its results instead of reading the tree again. The
+  // kernel drops the lock if the holder dies. The file is mapped while the
+  // lock is held and rewritten in place by commit(), because files owned by
+  // other users cannot be renamed over; its checksum makes an interrupted
+  // write load as an empty index.
+  //
+  // Other users' digests are only as good as those users, so the index is
+  // trusted only where no one outside the sharing group can write it: its
+  // directory must belong to root or the caller and not be world-writable,
+  // and the file must be a regular file with one link that is not
+  // world-writable. A file owned by someone other than root or the caller
+  // is accepted only in a root-owned directory and with the directory's
+  // group, which is how an administrator provisions a group of users that
+  // share one install. Symlinks are never followed.
+  class SharedHashIndex
+  {
+  public:
+    explicit SharedHashIndex(const std::string &path);
+    ~SharedHashIndex();
+
+    SharedHashIndex(const SharedHashIndex &) = delete;
+    SharedHashIndex &operator=(const SharedHashIndex &) = delete;
+
+    // Waits up to timeout_ms for the lock and loads the shared contents into
+    // index; a missing or corrupted file loads as empty. Returns false if the
+    // file cannot be opened, is not trusted or the lock is not granted in
+    // time; the caller then uses its own index.
+    bool acquire(HashIndex *index, int timeout_ms);
+
+    // Replaces the shared contents with index and releases the lock.
+    bool commit(const HashIndex &index);
+
+    // Releases the lock without writing.
+    void release();
+
+  private:
+    std::string path_;
+    int fd_ = -1;
+  };
+
+  // shared_cache_path() of the hash index.
+  std::string shared_hash_index_path(const std::string &install_dir);
+
+  // Cache file for an install directory shared between users, in the
+  // administrator-provided /var/cache/desktop_updater, typically root-owned,
+  // group-writable and setgid for the group of users sharing the install.
+  // Returns an empty string if it does not exist, is not writable by the
+  // caller or is writable by everyone; each user then keeps an index of
+  // their own.
+  std::string shared_cache_path(const std::string &install_dir,
+                                const char *extension);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_SHARED_HASH_INDEX_H_
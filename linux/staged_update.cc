@@ -0,0 +1,267 @@
+#include "staged_update.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const size_t kCopyBufferSize = 256 * 1024;
+
+    bool copy_to_sibling(const std::string &source, const std::string &target,
+                         mode_t mode, IoLimits *limits,
+                         const CancellationToken *cancel, MemoryBudget *budget)
+    {
+      const size_t slash = target.rfind('/');
+      const std::string temporary =
+          target.substr(0, slash + 1) + "." + target.substr(slash + 1) +
+          ".desktop_updater-" + std::to_string(getpid());
+      BudgetedBuffer buffer(budget, kCopyBufferSize, cancel);
+      if (!buffer.ok())
+      {
+        return false;
+      }
+      const int in = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+      if (in < 0)
+      {
+        return false;
+      }
+      const int out = open(temporary.c_str(),
+                           O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+      if (out < 0)
+      {
+        close(in);
+        return false;
+      }
+      bool ok = true;
+      for (;;)
+      {
+        if (is_cancelled(cancel) ||
+            (limits != nullptr && !limits->charge_disk(buffer.size(), cancel)))
+        {
+          ok = false;
+          break;
+        }
+        ssize_t n = read(in, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (n <= 0)
+        {
+          ok = n == 0;
+          break;
+        }
+        for (ssize_t written = 0; ok && written < n;)
+        {
+          ssize_t w = write(out, buffer.data() + written,
+                            static_cast<size_t>(n - written));
+          if (w < 0 && errno == EINTR)
+          {
+            continue;
+          }
+          ok = w > 0;
+          written += w > 0 ? w : 0;
+        }
+        if (!ok)
+        {
+          break;
+        }
+      }
+      close(in);
+      // The rename must not become visible before the data it points to.
+      ok = ok && fchmod(out, mode) == 0 && fsync(out) == 0;
+      ok = close(out) == 0 && ok;
+      if (!ok || rename(temporary.c_str(), target.c_str()) != 0)
+      {
+        unlink(temporary.c_str());
+        return false;
+      }
+      unlink(source.c_str());
+      return true;
+    }
+
+    int remove_entry(const char *path, const struct stat *, int, struct FTW *)
+    {
+      return remove(path);
+    }
+
+    bool apply_directory(const std::string &install_dir,
+                         const std::string &staging_dir,
+                         const std::string &relative, IoLimits *limits,
+                         const CancellationToken *cancel, MemoryBudget *budget,
+                         ApplyStats *stats, std::string *error)
+    {
+      const std::string source_dir =
+          relative.empty() ? staging_dir : staging_dir + "/" + relative;
+      DIR *dir = opendir(source_dir.c_str());
+      if (dir == nullptr)
+      {
+        *error = "Cannot list " + source_dir + ": " + strerror(errno);
+        return false;
+      }
+      // Collected first: renaming entries away while reading the directory
+      // would make readdir skip or repeat some.
+      std::vector<std::string> names;
+      while (struct dirent *entry = readdir(dir))
+      {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+        {
+          names.push_back(entry->d_name);
+        }
+      }
+      closedir(dir);
+
+      for (const std::string &name : names)
+      {
+        if (is_cancelled(cancel))
+        {
+          *error = "cancelled";
+          return false;
+        }
+        const std::string child =
+            relative.empty() ? name : relative + "/" + name;
+        const std::string source = staging_dir + "/" + child;
+        const std::string target = install_dir + "/" + child;
+        struct stat source_stat;
+        if (lstat(source.c_str(), &source_stat) != 0)
+        {
+          *error = "Cannot stat " + source + ": " + strerror(errno);
+          return false;
+        }
+        struct stat target_stat;
+        const bool target_exists = lstat(target.c_str(), &target_stat) == 0;
+        if (S_ISDIR(source_stat.st_mode))
+        {
+          if (!target_exists)
+          {
+            if (mkdir(target.c_str(), 0755) != 0)
+            {
+              *error = "Cannot create " + target + ": " + strerror(errno);
+              return false;
+            }
+            stats->directories_created++;
+          }
+          else if (!S_ISDIR(target_stat.st_mode))
+          {
+            *error = target + " is not a directory";
+            return false;
+          }
+          if (!apply_directory(install_dir, staging_dir, child, limits, cancel,
+                               budget, stats, error))
+          {
+            return false;
+          }
+          rmdir(source.c_str());
+          continue;
+        }
+        if (target_exists && S_ISDIR(target_stat.st_mode))
+        {
+          *error = target + " is a directory";
+          return false;
+        }
+        bool copied = false;
+        if (!replace_file(source, target, limits, &copied, cancel, budget))
+        {
+          if (is_cancelled(cancel))
+          {
+            *error = "cancelled";
+            return false;
+          }
+          *error = "Cannot replace " + target + ": " + strerror(errno);
+          return false;
+        }
+        stats->files.push_back(child);
+        if (copied)
+        {
+          stats->copied++;
+        }
+        else
+        {
+          stats->renamed++;
+        }
+      }
+      return true;
+    }
+  } // namespace
+
+  bool replace_file(const std::string &source, const std::string &target,
+                    IoLimits *limits, bool *copied,
+                    const CancellationToken *cancel, MemoryBudget *budget)
+  {
+    *copied = false;
+    struct stat source_stat;
+    if (lstat(source.c_str(), &source_stat) != 0)
+    {
+      return false;
+    }
+    mode_t mode = source_stat.st_mode & 07777;
+    struct stat target_stat;
+    if (lstat(target.c_str(), &target_stat) == 0 && S_ISREG(target_stat.st_mode))
+    {
+      // Downloads do not carry permissions; keep the installed ones, which
+      // is what makes the new executable executable.
+      mode = target_stat.st_mode & 07777;
+      if (S_ISREG(source_stat.st_mode) && chmod(source.c_str(), mode) != 0)
+      {
+        return false;
+      }
+    }
+    if (limits != nullptr && !limits->disk_ops.acquire(1, cancel))
+    {
+      return false;
+    }
+    if (rename(source.c_str(), target.c_str()) == 0)
+    {
+      return true;
+    }
+    if (errno != EXDEV || !S_ISREG(source_stat.st_mode))
+    {
+      return false;
+    }
+    *copied = true;
+    return copy_to_sibling(source, target, mode, limits, cancel, budget);
+  }
+
+  bool apply_staged_update(const std::string &install_dir,
+                           const std::string &staging_dir, IoLimits *limits,
+                           ApplyStats *stats, std::string *error,
+                           const CancellationToken *cancel,
+                           MemoryBudget *budget)
+  {
+    *stats = ApplyStats();
+    if (!apply_directory(install_dir, staging_dir, "", limits, cancel, budget,
+                         stats, error))
+    {
+      return false;
+    }
+    if (rmdir(staging_dir.c_str()) != 0)
+    {
+      *error = "Cannot remove " + staging_dir + ": " + strerror(errno);
+      return false;
+    }
+    return true;
+  }
+
+  bool discard_staged_update(const std::string &staging_dir)
+  {
+    struct stat st;
+    if (lstat(staging_dir.c_str(), &st) != 0)
+    {
+      return errno == ENOENT;
+    }
+    // Depth first, so each directory is empty by the time it is removed.
+    return nftw(staging_dir.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS) ==
+           0;
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,56 @@
+#ifndef DESKTOP_UPDATER_STAGED_UPDATE_H_
+#define DESKTOP_UPDATER_STAGED_UPDATE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "cancellation.h"
+#include "memory_budget.h"
+#include "rate_limiter.h"
+
+namespace desktop_updater
+{
+
+  struct ApplyStats
+  {
+    size_t renamed = 0;
+    size_t copied = 0;
+    size_t directories_created = 0;
+    // Relative paths of the files moved into place, in the order they were.
+    std::vector<std::string> files;
+  };
+
+  // Puts source in place of target without ever writing into target's
+  // inode: source is renamed over it, or, across file systems, copied to a
+  // temporary sibling of target that is then renamed over it. A process
+  // that has the old file mapped, like a running app its libraries, keeps
+  // the old inode and is unaffected. An existing target's permissions carry
+  // over. Sets *copied when the copy path was taken. A copy stops between
+  // buffers once cancel is cancelled, leaving target as it was. The copy
+  // buffer is charged to budget, which may be null.
+  bool replace_file(const std::string &source, const std::string &target,
+                    IoLimits *limits, bool *copied,
+                    const CancellationToken *cancel = nullptr,
+                    MemoryBudget *budget = nullptr);
+
+  // Moves every file below staging_dir to the same relative path below
+  // install_dir with replace_file, creating missing directories, then
+  // removes staging_dir. Renames are charged as disk operations and copies
+  // as disk bytes to limits, which may be null, and copy buffers to budget.
+  // Stops at the first failure and describes it in error; files moved until
+  // then stay in place. A cancel is checked before every file and fails
+  // with "cancelled".
+  bool apply_staged_update(const std::string &install_dir,
+                           const std::string &staging_dir, IoLimits *limits,
+                           ApplyStats *stats, std::string *error,
+                           const CancellationToken *cancel = nullptr,
+                           MemoryBudget *budget = nullptr);
+
+  // Removes staging_dir and everything below it, for an update that was
+  // cancelled before it was applied. A missing directory is not an error.
+  bool discard_staged_update(const std::string &staging_dir);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_STAGED_UPDATE_H_
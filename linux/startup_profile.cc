@@ -0,0 +1,246 @@
+#include "startup_profile.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "hash_index.h"
+#include "page_cache.h"
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const char kProfileHeader[] = "desktop_updater startup profile 1";
+
+    void record_file(const std::string &root, const std::string &relative,
+                     uint64_t size, std::vector<ProfileExtent> *extents)
+    {
+      const int fd = open((root + "/" + relative).c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+      {
+        return;
+      }
+      uint64_t cached = 1;
+      std::vector<unsigned char> pages;
+      // cachestat is cheap, so untouched files are never mapped.
+      if ((cached_page_count(fd, 0, size, &cached) && cached == 0) ||
+          !resident_pages(fd, 0, size, &pages))
+      {
+        close(fd);
+        return;
+      }
+      close(fd);
+
+      const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+      size_t page = 0;
+      while (page < pages.size())
+      {
+        if (!(pages[page] & 1))
+        {
+          page++;
+          continue;
+        }
+        size_t end = page;
+        while (end < pages.size() && (pages[end] & 1))
+        {
+          end++;
+        }
+        ProfileExtent extent;
+        extent.path = relative;
+        extent.offset = page * page_size;
+        extent.length = (end - page) * page_size;
+        extents->push_back(extent);
+        page = end;
+      }
+    }
+
+    void record_directory(const std::string &root, const std::string &relative,
+                          const std::vector<std::string> &skipped,
+                          std::vector<ProfileExtent> *extents)
+    {
+      const std::string dir_path =
+          relative.empty() ? root : root + "/" + relative;
+      DIR *dir = opendir(dir_path.c_str());
+      if (dir == nullptr)
+      {
+        return;
+      }
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != nullptr)
+      {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        {
+          continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+          continue;
+        }
+        const std::string child =
+            relative.empty() ? std::string(name) : relative + "/" + name;
+        if (S_ISDIR(st.st_mode))
+        {
+          bool skip = false;
+          for (const std::string &skipped_dir : skipped)
+          {
+            skip = skip || child == skipped_dir;
+          }
+          if (!skip)
+          {
+            record_directory(root, child, skipped, extents);
+          }
+        }
+        // The profile is line based.
+        else if (S_ISREG(st.st_mode) && st.st_size > 0 &&
+                 child.find('\n') == std::string::npos)
+        {
+          record_file(root, child, static_cast<uint64_t>(st.st_size), extents);
+        }
+      }
+      closedir(dir);
+    }
+  } // namespace
+
+  void record_startup_profile(const std::string &root,
+                              const std::vector<std::string> &skipped_directories,
+                              std::vector<ProfileExtent> *extents)
+  {
+    extents->clear();
+    record_directory(root, "", skipped_directories, extents);
+  }
+
+  bool write_startup_profile(const std::string &path,
+                             const std::vector<ProfileExtent> &extents)
+  {
+    if (!make_parent_directories(path))
+    {
+      return false;
+    }
+    const std::string temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    bool ok = fprintf(file, "%s\n", kProfileHeader) > 0;
+    for (const ProfileExtent &extent : extents)
+    {
+      ok = ok && fprintf(file, "%" PRIu64 " %" PRIu64 " %s\n", extent.offset,
+                         extent.length, extent.path.c_str()) > 0;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+      unlink(temporary.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  bool read_startup_profile(const std::string &path,
+                            std::vector<ProfileExtent> *extents)
+  {
+    extents->clear();
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    char *line = nullptr;
+    size_t capacity = 0;
+    ssize_t length = getline(&line, &capacity, file);
+    bool ok = length > 0 &&
+              strncmp(line, kProfileHeader, strlen(kProfileHeader)) == 0;
+    while (ok && (length = getline(&line, &capacity, file)) > 0)
+    {
+      if (line[length - 1] == '\n')
+      {
+        line[--length] = '\0';
+      }
+      ProfileExtent extent;
+      int path_start = 0;
+      if (sscanf(line, "%" SCNu64 " %" SCNu64 "%n", &extent.offset,
+                 &extent.length, &path_start) != 2 ||
+          path_start + 1 >= length || line[path_start] != ' ')
+      {
+        ok = false;
+        break;
+      }
+      extent.path.assign(line + path_start + 1);
+      extents->push_back(extent);
+    }
+    free(line);
+    fclose(file);
+    return ok;
+  }
+
+  pid_t warm_startup_profile(const std::string &root,
+                             const std::string &staging_dir,
+                             const std::vector<ProfileExtent> &extents,
+                             uint64_t *requested)
+  {
+    // Everything the child needs is opened and laid out here, so that after
+    // fork() it only makes system calls.
+    struct Range
+    {
+      int fd;
+      off64_t offset;
+      size_t length;
+    };
+    std::vector<Range> ranges;
+    std::vector<int> fds;
+    *requested = 0;
+    int fd = -1;
+    const std::string *open_path = nullptr;
+    for (const ProfileExtent &extent : extents)
+    {
+      if (open_path == nullptr || *open_path != extent.path)
+      {
+        open_path = &extent.path;
+        fd = open((staging_dir + "/" + extent.path).c_str(),
+                  O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+          fd = open((root + "/" + extent.path).c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (fd >= 0)
+        {
+          fds.push_back(fd);
+        }
+      }
+      if (fd >= 0)
+      {
+        ranges.push_back({fd, static_cast<off64_t>(extent.offset),
+                          static_cast<size_t>(extent.length)});
+        *requested += extent.length;
+      }
+    }
+    const pid_t pid = ranges.empty() ? -1 : fork();
+    if (pid == 0)
+    {
+      for (const Range &range : ranges)
+      {
+        readahead(range.fd, range.offset, range.length);
+      }
+      _exit(0);
+    }
+    for (int open_fd : fds)
+    {
+      close(open_fd);
+    }
+    if (pid < 0)
+    {
+      *requested = 0;
+    }
+    return pid;
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,50 @@
+#ifndef DESKTOP_UPDATER_STARTUP_PROFILE_H_
+#define DESKTOP_UPDATER_STARTUP_PROFILE_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace desktop_updater
+{
+
+  // A run of pages of an install file, relative to the install directory.
+  struct ProfileExtent
+  {
+    std::string path;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+  };
+
+  // Records which pages of the files below root are in the page cache. Taken
+  // shortly after startup, this is the set of pages the app needed to come
+  // up: libapp.so, the engine, ICU data and the assets it loaded. Files below
+  // a directory named in skipped_directories are left out. Extents of a file
+  // are consecutive and in offset order.
+  void record_startup_profile(const std::string &root,
+                              const std::vector<std::string> &skipped_directories,
+                              std::vector<ProfileExtent> *extents);
+
+  // One extent per line, "<offset> <length> <path>", after a version line.
+  bool write_startup_profile(const std::string &path,
+                             const std::vector<ProfileExtent> &extents);
+  bool read_startup_profile(const std::string &path,
+                            std::vector<ProfileExtent> *extents);
+
+  // Reads the profiled pages into the page cache from a child process, so
+  // the next process does not fault them in from disk one by one. readahead
+  // blocks until the pages are read, so the child does it while the caller
+  // relaunches the app. A file staged under staging_dir replaces the
+  // installed one, so it is warmed instead. Returns the child's pid, which
+  // the caller may leave unwaited if it exits soon, or -1 if there was
+  // nothing to warm; *requested is the number of bytes the child reads.
+  pid_t warm_startup_profile(const std::string &root,
+                             const std::string &staging_dir,
+                             const std::vector<ProfileExtent> &extents,
+                             uint64_t *requested);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_STARTUP_PROFILE_H_
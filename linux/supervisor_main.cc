@@ -0,0 +1,126 @@
+// Watches the first start of an app after an update was applied, and rolls
+// the update back if that start fails:
+//
+//   desktop_updater_supervisor INSTALL_DIR SNAPSHOT_DIR TIMEOUT_MS EXECUTABLE
+//
+// The plugin execs it straight from a fork() of the app, so everything
+// below runs in a fresh single-threaded process. It starts EXECUTABLE with
+// the write end of a health pipe in kHealthFdVariable and waits up to
+// TIMEOUT_MS for it to report its first frame. If the app crashes or hangs
+// before that, it is killed, SNAPSHOT_DIR is restored into INSTALL_DIR and
+// the old version is started instead. Built and installed into the bundle's
+// lib directory along with the plugin.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "rollback.h"
+
+namespace
+{
+
+  // Closes everything inherited from the app, so that the display server
+  // sees the old app's connection go away with it.
+  void close_inherited_fds()
+  {
+    std::vector<int> fds;
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == nullptr)
+    {
+      return;
+    }
+    while (struct dirent *entry = readdir(dir))
+    {
+      const int fd = atoi(entry->d_name);
+      if (fd > 2 && fd != dirfd(dir))
+      {
+        fds.push_back(fd);
+      }
+    }
+    closedir(dir);
+    for (int fd : fds)
+    {
+      close(fd);
+    }
+  }
+
+  int exec_app(const char *executable)
+  {
+    execl(executable, executable, (char *)NULL);
+    fprintf(stderr, "desktop_updater: cannot start %s\n", executable);
+    return 1;
+  }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  if (argc != 5)
+  {
+    fprintf(stderr, "usage: desktop_updater_supervisor INSTALL_DIR "
+                    "SNAPSHOT_DIR TIMEOUT_MS EXECUTABLE\n");
+    return 2;
+  }
+  const std::string install_dir = argv[1];
+  const std::string snapshot = argv[2];
+  const int timeout_ms = atoi(argv[3]);
+  const char *executable = argv[4];
+  close_inherited_fds();
+
+  // Without a snapshot there is nothing to roll back to.
+  struct stat st;
+  int health[2];
+  if (stat(snapshot.c_str(), &st) != 0 || pipe2(health, O_CLOEXEC) != 0)
+  {
+    desktop_updater::discard_update_snapshot(snapshot);
+    return exec_app(executable);
+  }
+  // The duplicate is not close-on-exec, so the app inherits it.
+  const int app_fd = dup(health[1]);
+  setenv(desktop_updater::kHealthFdVariable, std::to_string(app_fd).c_str(),
+         1);
+  const pid_t app = app_fd >= 0 ? fork() : -1;
+  if (app == 0)
+  {
+    execl(executable, executable, (char *)NULL);
+    _exit(1);
+  }
+  close(app_fd);
+  close(health[1]);
+  unsetenv(desktop_updater::kHealthFdVariable);
+
+  const desktop_updater::HealthResult result =
+      app > 0 ? desktop_updater::wait_for_health(health[0], app, timeout_ms)
+              : desktop_updater::HealthResult::kFailed;
+  close(health[0]);
+  if (result == desktop_updater::HealthResult::kHealthy ||
+      result == desktop_updater::HealthResult::kExited)
+  {
+    desktop_updater::discard_update_snapshot(snapshot);
+    return 0;
+  }
+  if (app > 0)
+  {
+    kill(app, SIGKILL);
+    waitpid(app, nullptr, 0);
+  }
+  std::string error;
+  if (!desktop_updater::restore_update_snapshot(install_dir, snapshot,
+                                                &error))
+  {
+    fprintf(stderr, "desktop_updater: rollback incomplete: %s\n",
+            error.c_str());
+  }
+  fprintf(stderr, "desktop_updater: new version failed to start, "
+                  "rolled back\n");
+  return exec_app(executable);
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "apply_verification.h"
+#include "file_hasher.h"
+#include "staged_update.h"
+#include "test_util.h"
+#include "thread_pool.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+// An install with an update of two files staged in it, and the manifest
+// the update check found those files in.
+void StageUpdate(TempDir* dir, FileHasher* hasher,
+                 std::vector<FileHashEntry>* expected) {
+  for (const char* name : {"app", "app/lib", "update", "update/lib"}) {
+    ASSERT_EQ(mkdir((dir->path() + "/" + name).c_str(), 0755), 0);
+  }
+  dir->Write("app/runner", "old runner");
+  dir->Write("app/untouched", "untouched");
+  dir->Write("update/runner", "new runner");
+  dir->Write("update/lib/libapp.so", PatternBytes(3 * kTreeLeafSize / 2));
+  dir->Write("update/download.log", "not in the manifest");
+  expected->clear();
+  for (const char* name : {"runner", "lib/libapp.so"}) {
+    const std::string path = dir->path() + "/update/" + name;
+    std::string digest;
+    ASSERT_TRUE(hasher->hash_file(path, HashAlgorithm::kBlake2bTree, &digest));
+    struct stat st;
+    ASSERT_EQ(stat(path.c_str(), &st), 0);
+    FileHashEntry entry;
+    entry.path = name;
+    entry.calculated_hash = base64_encode(
+        reinterpret_cast<const uint8_t*>(digest.data()), digest.size());
+    entry.length = st.st_size;
+    entry.algorithm = HashAlgorithm::kBlake2bTree;
+    expected->push_back(entry);
+  }
+}
+
+// Records the digest of a staged file the way downloadFile does.
+void RecordStaged(FileHasher* hasher, const std::string& path,
+                  StagedDigests* staged) {
+  HashIndexEntry entry;
+  entry.algorithm = HashAlgorithm::kBlake2bTree;
+  ASSERT_TRUE(hasher->hash_file(path, entry.algorithm, &entry.digest));
+  ASSERT_TRUE(stat_file(path, &entry.stat));
+  staged->record(path, entry);
+}
+
+}  // namespace
+
+TEST(ApplyVerification, ChecksOnlyWrittenFilesAndWarmsTheIndex) {
+  TempDir dir;
+  ThreadPool pool(4);
+  FileHasher hasher(&pool);
+  std::vector<FileHashEntry> expected;
+  StageUpdate(&dir, &hasher, &expected);
+  const std::string install = dir.path() + "/app";
+  const std::string staging = dir.path() + "/update";
+  StagedDigests staged;
+  RecordStaged(&hasher, staging + "/lib/libapp.so", &staged);
+
+  ApplyStats apply_stats;
+  std::string error;
+  ASSERT_TRUE(
+      apply_staged_update(install, staging, nullptr, &apply_stats, &error))
+      << error;
+  EXPECT_EQ(apply_stats.files.size(), 3u);
+
+  HashIndex index;
+  VerifyStats stats;
+  ASSERT_TRUE(verify_applied_files(&hasher, install, staging,
+                                   apply_stats.files, expected, &staged,
+                                   &index, &stats, &error))
+      << error;
+  EXPECT_EQ(stats.reused, 1u);
+  EXPECT_EQ(stats.hashed, 1u);
+  EXPECT_EQ(index.size(), 2u);
+
+  // The next check reads neither file again.
+  HashDirectoryOptions options;
+  options.algorithm = HashAlgorithm::kBlake2bTree;
+  options.index = &index;
+  std::vector<FileHashEntry> entries;
+  HashDirectoryStats hash_stats;
+  ASSERT_TRUE(hasher.hash_directory(install, options, &entries, &hash_stats));
+  EXPECT_EQ(hash_stats.from_index, 2u);
+  EXPECT_EQ(hash_stats.hashed, 2u);  // untouched and download.log
+}
+
+TEST(ApplyVerification, RejectsDamagedAndMissingFiles) {
+  TempDir dir;
+  ThreadPool pool(2);
+  FileHasher hasher(&pool);
+  std::vector<FileHashEntry> expected;
+  StageUpdate(&dir, &hasher, &expected);
+  const std::string install = dir.path() + "/app";
+  const std::string staging = dir.path() + "/update";
+  // Damaged after its digest was taken, in place, so the inode and size
+  // stay the same while the modification time moves.
+  StagedDigests staged;
+  RecordStaged(&hasher, staging + "/runner", &staged);
+  dir.Write("update/runner", "bad runner");
+  struct timespec times[2] = {{0, UTIME_OMIT}, {1, 0}};
+  ASSERT_EQ(utimensat(AT_FDCWD, (staging + "/runner").c_str(), times, 0), 0);
+
+  ApplyStats apply_stats;
+  std::string error;
+  ASSERT_TRUE(
+      apply_staged_update(install, staging, nullptr, &apply_stats, &error));
+  HashIndex index;
+  VerifyStats stats;
+  EXPECT_FALSE(verify_applied_files(&hasher, install, staging,
+                                    apply_stats.files, expected, &staged,
+                                    &index, &stats, &error));
+  EXPECT_EQ(error, "runner does not match the manifest");
+  EXPECT_EQ(stats.reused, 0u);
+  EXPECT_EQ(index.size(), 0u);
+
+  std::vector<std::string> written = {"runner"};
+  EXPECT_FALSE(verify_applied_files(&hasher, install, staging, written,
+                                    expected, nullptr, &index, &stats,
+                                    &error));
+  EXPECT_EQ(error, "lib/libapp.so was not applied");
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "binary_delta.h"
+#include "manifest.h"
+#include "release_delta.h"
+#include "test_util.h"
+#include "thread_pool.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+// Bytes that do not compress, so only a delta can make them smaller.
+std::string RandomBytes(size_t length, uint32_t seed) {
+  std::string data(length, '\0');
+  for (size_t i = 0; i < length; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    data[i] = static_cast<char>(seed >> 24);
+  }
+  return data;
+}
+
+// old with a few bytes changed, a block inserted and a block removed, the
+// way a rebuilt binary differs from the last one.
+std::string Edited(const std::string& old) {
+  std::string edited = old;
+  for (size_t i = 1000; i < edited.size(); i += 4096) {
+    edited[i] = static_cast<char>(edited[i] + 1);
+  }
+  edited.insert(edited.size() / 3, RandomBytes(500, 7));
+  edited.erase(edited.size() / 2, 700);
+  return edited;
+}
+
+std::string MakeDelta(const std::string& old_data,
+                      const std::string& new_data) {
+  std::vector<int32_t> scratch(binary_delta_scratch_size(old_data.size()) /
+                               sizeof(int32_t));
+  std::string delta;
+  EXPECT_TRUE(make_binary_delta(
+      reinterpret_cast<const uint8_t*>(old_data.data()), old_data.size(),
+      reinterpret_cast<const uint8_t*>(new_data.data()), new_data.size(), 3,
+      reinterpret_cast<uint8_t*>(scratch.data()), &delta));
+  return delta;
+}
+
+bool ApplyDelta(const std::string& old_data, const std::string& delta,
+                std::string* out) {
+  return apply_binary_delta(reinterpret_cast<const uint8_t*>(old_data.data()),
+                            old_data.size(),
+                            reinterpret_cast<const uint8_t*>(delta.data()),
+                            delta.size(), out);
+}
+
+// Writes a release as bin/archive.dart leaves it in dist/<build>.
+std::string WriteRelease(TempDir* dist, const std::string& build,
+                         const std::vector<FileHashEntry>& files,
+                         const std::vector<std::string>& contents) {
+  const std::string bundle = build + "/1.0.0+" + build + "-linux";
+  mkdir((dist->path() + "/" + build).c_str(), 0755);
+  mkdir((dist->path() + "/" + bundle).c_str(), 0755);
+  mkdir((dist->path() + "/" + bundle + "/lib").c_str(), 0755);
+  for (size_t i = 0; i < files.size(); i++) {
+    dist->Write(bundle + "/" + files[i].path, contents[i]);
+  }
+  EXPECT_TRUE(
+      write_manifest_json(dist->path() + "/" + bundle + "/hashes.json", files));
+  return dist->path() + "/" + bundle;
+}
+
+FileHashEntry Entry(const std::string& path, const std::string& hash,
+                    size_t length) {
+  FileHashEntry entry;
+  entry.path = path;
+  entry.calculated_hash = hash;
+  entry.length = static_cast<int64_t>(length);
+  return entry;
+}
+
+}  // namespace
+
+TEST(BinaryDelta, RebuildsAnEditedFileFromASmallDelta) {
+  const std::string old_data = RandomBytes(256 * 1024, 1);
+  const std::string new_data = Edited(old_data);
+  const std::string delta = MakeDelta(old_data, new_data);
+  EXPECT_LT(delta.size(), new_data.size() / 20);
+  std::string rebuilt;
+  ASSERT_TRUE(ApplyDelta(old_data, delta, &rebuilt));
+  EXPECT_EQ(rebuilt, new_data);
+}
+
+TEST(BinaryDelta, HandlesEmptyAndRepetitiveFiles) {
+  const std::string zeros(100000, '\0');
+  const std::string pattern = PatternBytes(70000);
+  const std::vector<std::pair<std::string, std::string>> cases = {
+      {"", pattern}, {pattern, ""}, {zeros, pattern}, {pattern, zeros + "x"}};
+  for (const auto& pair : cases) {
+    std::string rebuilt;
+    ASSERT_TRUE(ApplyDelta(pair.first, MakeDelta(pair.first, pair.second),
+                           &rebuilt));
+    EXPECT_EQ(rebuilt, pair.second);
+  }
+}
+
+TEST(BinaryDelta, RejectsDamagedDeltasAndOtherSources) {
+  const std::string old_data = RandomBytes(10000, 2);
+  const std::string delta = MakeDelta(old_data, Edited(old_data));
+  std::string rebuilt;
+  EXPECT_FALSE(ApplyDelta(old_data + "x", delta, &rebuilt));
+  EXPECT_FALSE(ApplyDelta(old_data, delta.substr(0, delta.size() - 1),
+                          &rebuilt));
+  std::string damaged = delta;
+  damaged[kBinaryDeltaHeaderSize + 2] ^= 0x40;
+  EXPECT_FALSE(ApplyDelta(old_data, damaged, &rebuilt));
+  damaged = delta;
+  damaged[24] ^= 1;  // control size
+  EXPECT_FALSE(ApplyDelta(old_data, damaged, &rebuilt));
+}
+
+TEST(ReleaseDelta, KeepsDeltasSmallerThanTheFilesForTheLastReleases) {
+  TempDir dist;
+  const std::string app_v1 = RandomBytes(64 * 1024, 3);
+  const std::string app_v2 = Edited(app_v1);
+  const std::string app_v10 = Edited(app_v2);
+  const std::string data = RandomBytes(4096, 4);
+  const std::string fresh = RandomBytes(4096, 5);
+  WriteRelease(&dist, "1",
+               {Entry("lib/libapp.so", "A1", app_v1.size()),
+                Entry("lib/data", "D1", data.size())},
+               {app_v1, data});
+  const std::string v2 = WriteRelease(
+      &dist, "2",
+      {Entry("lib/libapp.so", "A2", app_v2.size()),
+       Entry("lib/data", "D1", data.size())},
+      {app_v2, data});
+  const std::string v10 = WriteRelease(
+      &dist, "10",
+      {Entry("lib/libapp.so", "A10", app_v10.size()),
+       Entry("lib/data", "D10", fresh.size())},
+      {app_v10, fresh});
+  // Not an archived release: no hashes.json.
+  mkdir((dist.path() + "/10/app-1.0.0+10-linux").c_str(), 0755);
+
+  const std::vector<std::string> bundles =
+      find_release_bundles(dist.path(), "linux");
+  ASSERT_EQ(bundles.size(), 3u);
+  EXPECT_EQ(bundles[1], v2);
+  EXPECT_EQ(bundles[2], v10);
+  EXPECT_TRUE(find_release_bundles(dist.path(), "windows").empty());
+
+  ThreadPool pool(2);
+  MemoryBudget budget(1024 * 1024);
+  ReleaseDeltaOptions options;
+  options.level = 3;
+  options.budget = &budget;
+  std::vector<DeltaIndexEntry> entries;
+  ReleaseDeltaStats stats;
+  ASSERT_TRUE(make_release_deltas(&pool, v10, {bundles[1], bundles[0]},
+                                  options, &entries, &stats));
+  // lib/data is random in both, so its delta is no smaller than the file.
+  ASSERT_EQ(entries.size(), 2u);
+  EXPECT_EQ(stats.changed_files, 2u);
+  EXPECT_EQ(stats.deltas, 2u);
+  EXPECT_EQ(budget.in_use(), 0u);
+  EXPECT_EQ(entries[0].path, "lib/libapp.so");
+  EXPECT_EQ(entries[0].from_hash, "A2");
+  EXPECT_EQ(entries[0].to_hash, "A10");
+  EXPECT_EQ(entries[0].delta, "deltas/1.0.0+2-linux/lib/libapp.so.delta");
+  EXPECT_EQ(entries[1].from_hash, "A1");
+
+  for (const DeltaIndexEntry& entry : entries) {
+    const std::string delta = ReadFile(v10 + "/" + entry.delta);
+    EXPECT_EQ(static_cast<int64_t>(delta.size()), entry.length);
+    std::string rebuilt;
+    ASSERT_TRUE(ApplyDelta(entry.from_hash == "A2" ? app_v2 : app_v1, delta,
+                           &rebuilt));
+    EXPECT_EQ(rebuilt, app_v10);
+  }
+  EXPECT_EQ(ReadFile(v10 + "/deltas.json"), delta_index_to_json(entries));
+  EXPECT_NE(delta_index_to_json(entries).find(
+                "{\"path\":\"lib/libapp.so\",\"fromHash\":\"A2\","
+                "\"toHash\":\"A10\",\"delta\":"),
+            std::string::npos);
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "binary_manifest.h"
+#include "build_manifest.h"
+#include "file_hasher.h"
+#include "hash_index.h"
+#include "test_util.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+FileHashEntry Entry(const std::string& path, int64_t length, char fill) {
+  FileHashEntry entry;
+  entry.path = path;
+  entry.length = length;
+  entry.algorithm = HashAlgorithm::kBlake3;
+  const std::string digest(32, fill);
+  entry.calculated_hash = base64_encode(
+      reinterpret_cast<const uint8_t*>(digest.data()), digest.size());
+  return entry;
+}
+
+}  // namespace
+
+TEST(BinaryManifest, RoundTripsAndFindsPaths) {
+  std::vector<FileHashEntry> entries = {
+      Entry("lib/libapp.so", 1000, 'a'),
+      Entry("data/icudtl.dat", 20, 'b'),
+      Entry("app", 3, 'c'),
+  };
+  entries[0].compressed_length = 400;
+  std::string encoded;
+  ASSERT_TRUE(encode_binary_manifest(HashAlgorithm::kBlake3, entries, &encoded));
+
+  ManifestView view;
+  ASSERT_TRUE(view.parse(reinterpret_cast<const uint8_t*>(encoded.data()),
+                         encoded.size()));
+  EXPECT_EQ(view.algorithm(), HashAlgorithm::kBlake3);
+  ASSERT_EQ(view.size(), 3u);
+  EXPECT_EQ(std::string(view.record(0).path, view.record(0).path_length), "app");
+
+  ManifestRecord record;
+  ASSERT_TRUE(view.find("data/icudtl.dat", &record));
+  EXPECT_EQ(record.length, 20u);
+  EXPECT_EQ(record.digest[0], 'b');
+  EXPECT_EQ(record.compressed_length, 0u);
+  ASSERT_TRUE(view.find("lib/libapp.so", &record));
+  EXPECT_EQ(record.compressed_length, 400u);
+  EXPECT_FALSE(view.find("data", &record));
+}
+
+// Runners built before compressed lengths were recorded embed version 1.
+TEST(BinaryManifest, ReadsVersion1Records) {
+  std::string encoded;
+  ASSERT_TRUE(encode_binary_manifest(
+      HashAlgorithm::kBlake3, {Entry("a", 5, 'x'), Entry("b", 6, 'y')},
+      &encoded));
+  std::string v1 = encoded.substr(0, kBinaryManifestHeaderSize);
+  v1[4] = 1;
+  for (size_t i = 0; i < 2; i++) {
+    v1.append(encoded, kBinaryManifestHeaderSize + i * kBinaryManifestRecordSize,
+              kBinaryManifestV1RecordSize);
+  }
+  v1.append(encoded, kBinaryManifestHeaderSize + 2 * kBinaryManifestRecordSize,
+            std::string::npos);
+
+  ManifestView view;
+  ASSERT_TRUE(
+      view.parse(reinterpret_cast<const uint8_t*>(v1.data()), v1.size()));
+  ManifestRecord record;
+  ASSERT_TRUE(view.find("b", &record));
+  EXPECT_EQ(record.length, 6u);
+  EXPECT_EQ(record.compressed_length, 0u);
+  EXPECT_EQ(record.digest[0], 'y');
+}
+
+TEST(BinaryManifest, RejectsTruncatedInput) {
+  std::string encoded;
+  ASSERT_TRUE(encode_binary_manifest(HashAlgorithm::kBlake3,
+                                     {Entry("a", 1, 'x')}, &encoded));
+  ManifestView view;
+  EXPECT_FALSE(view.parse(reinterpret_cast<const uint8_t*>(encoded.data()),
+                          encoded.size() - 1));
+  EXPECT_FALSE(encode_binary_manifest(HashAlgorithm::kBlake2b,
+                                      {Entry("a", 1, 'x')}, &encoded));
+}
+
+TEST(BuildManifest, ReadsEmbeddedSection) {
+  if (system("command -v objcopy >/dev/null 2>&1") != 0) {
+    GTEST_SKIP() << "objcopy is not installed";
+  }
+  TempDir dir;
+  std::string encoded;
+  ASSERT_TRUE(encode_binary_manifest(HashAlgorithm::kBlake3,
+                                     {Entry("lib/libapp.so", 7, 'z')}, &encoded));
+  const std::string payload = dir.Write("manifest.bin", encoded);
+  const std::string runner = dir.path() + "/runner";
+  const std::string command = "objcopy --add-section " +
+                              std::string(kBuildManifestSection) + "='" +
+                              payload + "' /proc/self/exe '" + runner + "'";
+  ASSERT_EQ(system(command.c_str()), 0);
+
+  BuildManifest manifest;
+  ASSERT_TRUE(manifest.load(runner, dir.path()));
+  EXPECT_STREQ(manifest.source(), "section");
+  ManifestRecord record;
+  EXPECT_TRUE(manifest.view().find("lib/libapp.so", &record));
+}
+
+TEST(BuildManifest, FallsBackToSidecar) {
+  TempDir dir;
+  ASSERT_EQ(mkdir((dir.path() + "/data").c_str(), 0755), 0);
+  std::string encoded;
+  ASSERT_TRUE(encode_binary_manifest(HashAlgorithm::kBlake3,
+                                     {Entry("a", 1, 'x')}, &encoded));
+  dir.Write(kBuildManifestSidecar, encoded);
+
+  BuildManifest manifest;
+  ASSERT_TRUE(manifest.load("/proc/self/exe", dir.path()));
+  EXPECT_STREQ(manifest.source(), "sidecar");
+  EXPECT_EQ(manifest.view().size(), 1u);
+}
+
+TEST(HashIndex, HashesOnlyFilesWhoseStatChanged) {
+  TempDir dir;
+  dir.Write("a.bin", std::string(5000, 'a'));
+  dir.Write("b.bin", std::string(3000, 'b'));
+  ThreadPool pool(2);
+  FileHasher hasher(&pool);
+  HashIndex index;
+  HashDirectoryOptions options;
+  options.algorithm = HashAlgorithm::kBlake3;
+  options.index = &index;
+
+  std::vector<FileHashEntry> first;
+  HashDirectoryStats stats;
+  ASSERT_TRUE(hasher.hash_directory(dir.path(), options, &first, &stats));
+  EXPECT_EQ(stats.hashed, 2u);
+
+  TempDir cache;
+  const std::string index_path = cache.path() + "/nested/hashes.index";
+  ASSERT_TRUE(index.save(index_path));
+  HashIndex reloaded;
+  ASSERT_TRUE(reloaded.load(index_path));
+  EXPECT_EQ(reloaded.size(), 2u);
+  options.index = &reloaded;
+
+  dir.Write("b.bin", std::string(3001, 'c'));
+  std::vector<FileHashEntry> second;
+  ASSERT_TRUE(hasher.hash_directory(dir.path(), options, &second, &stats));
+  EXPECT_EQ(stats.from_index, 1u);
+  EXPECT_EQ(stats.hashed, 1u);
+}
+
+TEST(HashIndex, TrustsBuildManifestForUnseenFiles) {
+  TempDir dir;
+  dir.Write("a.bin", "abc");
+  dir.Write("b.bin", "defg");
+  std::string encoded;
+  // a.bin matches in size and is trusted; b.bin does not and gets hashed.
+  ASSERT_TRUE(encode_binary_manifest(
+      HashAlgorithm::kBlake3, {Entry("a.bin", 3, 'x'), Entry("b.bin", 9, 'y')},
+      &encoded));
+  ManifestView baseline;
+  ASSERT_TRUE(baseline.parse(reinterpret_cast<const uint8_t*>(encoded.data()),
+                             encoded.size()));
+
+  ThreadPool pool(2);
+  FileHasher hasher(&pool);
+  HashIndex index;
+  HashDirectoryOptions options;
+  options.algorithm = HashAlgorithm::kBlake3;
+  options.index = &index;
+  options.baseline = &baseline;
+  FileStat installed;
+  ASSERT_TRUE(stat_file(dir.path() + "/a.bin", &installed));
+  options.baseline_installed_ns = installed.ctime_ns;
+  std::vector<FileHashEntry> entries;
+  HashDirectoryStats stats;
+  ASSERT_TRUE(hasher.hash_directory(dir.path(), options, &entries, &stats));
+  EXPECT_EQ(stats.from_baseline, 1u);
+  EXPECT_EQ(stats.hashed, 1u);
+  ASSERT_NE(index.lookup("a.bin"), nullptr);
+  EXPECT_EQ(index.lookup("a.bin")->digest, std::string(32, 'x'));
+}
+
+TEST(HashIndex, HashesFilesChangedAfterInstall) {
+  TempDir dir;
+  dir.Write("a.bin", "abc");
+  std::string encoded;
+  ASSERT_TRUE(encode_binary_manifest(HashAlgorithm::kBlake3,
+                                     {Entry("a.bin", 3, 'x')}, &encoded));
+  ManifestView baseline;
+  ASSERT_TRUE(baseline.parse(reinterpret_cast<const uint8_t*>(encoded.data()),
+                             encoded.size()));
+  FileStat written;
+  ASSERT_TRUE(stat_file(dir.path() + "/a.bin", &written));
+
+  ThreadPool pool(2);
+  FileHasher hasher(&pool);
+  HashDirectoryOptions options;
+  options.algorithm = HashAlgorithm::kBlake3;
+  options.baseline = &baseline;
+  std::vector<FileHashEntry> entries;
+  HashDirectoryStats stats;
+  // Without install evidence a matching size is not enough.
+  ASSERT_TRUE(hasher.hash_directory(dir.path(), options, &entries, &stats));
+  EXPECT_EQ(stats.from_baseline, 0u);
+  EXPECT_EQ(stats.hashed, 1u);
+
+  // Same size, but written well after the bundle was installed.
+  options.baseline_installed_ns =
+      written.ctime_ns - 2 * kBaselineInstallWindowNs;
+  ASSERT_TRUE(hasher.hash_directory(dir.path(), options, &entries, &stats));
+  EXPECT_EQ(stats.from_baseline, 0u);
+  EXPECT_EQ(stats.hashed, 1u);
+  ASSERT_EQ(entries.size(), 1u);
+  const std::string hashed = entries[0].calculated_hash;
+
+  options.baseline_installed_ns = written.ctime_ns;
+  ASSERT_TRUE(hasher.hash_directory(dir.path(), options, &entries, &stats));
+  EXPECT_EQ(stats.from_baseline, 1u);
+  ASSERT_EQ(entries.size(), 1u);
+  EXPECT_NE(entries[0].calculated_hash, hashed);
+}
+
+}  // namespace test
+}  // namespace desktop_updater
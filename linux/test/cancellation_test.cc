@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+
+#include <poll.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cancellation.h"
+#include "downloader.h"
+#include "file_hasher.h"
+#include "staged_update.h"
+#include "test_util.h"
+#include "thread_pool.h"
+#include "update_server.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+bool Readable(int fd) {
+  struct pollfd poll_fd = {fd, POLLIN, 0};
+  return poll(&poll_fd, 1, 0) == 1;
+}
+
+int64_t MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                               start)
+      .count();
+}
+
+}  // namespace
+
+TEST(Cancellation, SignalsThroughFdAndTracksRunningStages) {
+  CancellationToken token;
+  EXPECT_FALSE(token.cancelled());
+  EXPECT_FALSE(is_cancelled(&token));
+  EXPECT_FALSE(is_cancelled(nullptr));
+  EXPECT_FALSE(Readable(token.fd()));
+  EXPECT_TRUE(token.wait_idle(0));
+
+  {
+    CancellationToken::Work work(&token);
+    EXPECT_EQ(token.active(), 1u);
+    EXPECT_FALSE(token.wait_idle(10));
+    token.cancel();
+    token.cancel();
+    EXPECT_TRUE(token.cancelled());
+    EXPECT_TRUE(Readable(token.fd()));
+  }
+  EXPECT_TRUE(token.wait_idle(0));
+
+  token.reset();
+  EXPECT_FALSE(token.cancelled());
+  EXPECT_FALSE(Readable(token.fd()));
+
+  // A stage that outlives the cancel keeps seeing it until it ends.
+  {
+    CancellationToken::Work work(&token);
+    token.cancel();
+    EXPECT_FALSE(token.reset_when_idle());
+    EXPECT_TRUE(token.cancelled());
+    EXPECT_TRUE(Readable(token.fd()));
+  }
+  EXPECT_FALSE(token.cancelled());
+  EXPECT_FALSE(Readable(token.fd()));
+  token.cancel();
+  EXPECT_TRUE(token.reset_when_idle());
+  EXPECT_FALSE(token.cancelled());
+}
+
+// Hashing, a download and an apply run at once, each slowed down so it is
+// well under way when the cancel comes, the way a large update is on a
+// slow disk and network. All of them have to wind down within 100 ms.
+TEST(Cancellation, EveryStageGoesIdleWithin100Ms) {
+  TempDir dir;
+  for (const char* name : {"install", "tree", "update"}) {
+    ASSERT_EQ(mkdir((dir.path() + "/" + name).c_str(), 0755), 0);
+  }
+  const std::string data = PatternBytes(4 << 20);
+  for (int i = 0; i < 8; i++) {
+    dir.Write("tree/file" + std::to_string(i), data);
+  }
+  const int kStagedFiles = 400;
+  for (int i = 0; i < kStagedFiles; i++) {
+    dir.Write("update/file" + std::to_string(i), "new");
+  }
+  dir.Write("served.bin", PatternBytes(16 << 20));
+
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  server_options.connection_bytes_per_second = 2 << 20;
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  // Hashing and the apply share these limits: 32 MB of tree at 8 MB/s, 400
+  // renames at 100 per second.
+  IoLimits limits;
+  limits.disk_bytes.set_rate(8 << 20);
+  limits.disk_ops.set_rate(100);
+  ThreadPool pool(4);
+  FileHasher hasher(&pool, nullptr, &limits);
+  Downloader downloader;
+  CancellationToken token;
+
+  bool hashed = true;
+  std::thread hashing([&]() {
+    CancellationToken::Work work(&token);
+    HashDirectoryOptions options;
+    options.algorithm = HashAlgorithm::kBlake2bTree;
+    options.cancel = &token;
+    std::vector<FileHashEntry> entries;
+    hashed = hasher.hash_directory(dir.path() + "/tree", options, &entries);
+  });
+
+  const std::string download_path = dir.path() + "/update.bin";
+  DownloadProgress progress;
+  bool downloaded = true;
+  std::string download_error;
+  std::thread downloading([&]() {
+    CancellationToken::Work work(&token);
+    DownloadOptions options;
+    options.cancel = &token;
+    DownloadStats stats;
+    downloaded =
+        downloader.download(server.url() + "/served.bin", download_path,
+                            16 << 20, options, &progress, &stats,
+                            &download_error);
+  });
+
+  ApplyStats apply_stats;
+  bool applied = true;
+  std::string apply_error;
+  std::thread applying([&]() {
+    CancellationToken::Work work(&token);
+    applied = apply_staged_update(dir.path() + "/install",
+                                  dir.path() + "/update", &limits,
+                                  &apply_stats, &apply_error, &token);
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  const Clock::time_point start = Clock::now();
+  token.cancel();
+  EXPECT_TRUE(token.wait_idle(5000));
+  const int64_t latency_ms = MillisecondsSince(start);
+  hashing.join();
+  downloading.join();
+  applying.join();
+  EXPECT_LT(latency_ms, 100);
+
+  EXPECT_FALSE(hashed);
+  EXPECT_FALSE(downloaded);
+  EXPECT_EQ(download_error, "cancelled");
+  EXPECT_GT(progress.received, 0u);
+  EXPECT_FALSE(Exists(download_path));
+  EXPECT_FALSE(applied);
+  EXPECT_EQ(apply_error, "cancelled");
+  EXPECT_GT(apply_stats.files.size(), 0u);
+  EXPECT_LT(apply_stats.files.size(), static_cast<size_t>(kStagedFiles));
+
+  // What is left staged is removed, and the token works for the next run.
+  EXPECT_TRUE(discard_staged_update(dir.path() + "/update"));
+  EXPECT_FALSE(Exists(dir.path() + "/update"));
+  EXPECT_TRUE(discard_staged_update(dir.path() + "/update"));
+  token.reset();
+  limits.disk_bytes.set_rate(0);
+  std::string digest;
+  EXPECT_TRUE(hasher.hash_file(dir.path() + "/tree/file0",
+                               HashAlgorithm::kBlake2bTree, &digest, &token));
+}
+
+}  // namespace test
+}  // namespace desktop_updater
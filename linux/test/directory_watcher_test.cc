@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "directory_watcher.h"
+#include "file_hasher.h"
+#include "hash_index.h"
+#include "test_util.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+// Waits for the watcher thread to see pending inotify events.
+DirtyPaths TakeWhenDirty(DirectoryWatcher* watcher) {
+  DirtyPaths dirty;
+  for (int i = 0; i < 200; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    DirtyPaths next = watcher->take();
+    dirty.full_scan = dirty.full_scan && next.full_scan;
+    dirty.paths.insert(next.paths.begin(), next.paths.end());
+    if (!dirty.paths.empty()) {
+      // Let the rest of the burst arrive.
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      next = watcher->take();
+      dirty.paths.insert(next.paths.begin(), next.paths.end());
+      break;
+    }
+  }
+  return dirty;
+}
+
+}  // namespace
+
+TEST(DirectoryWatcher, FirstSnapshotIsFullScan) {
+  TempDir dir;
+  DirectoryWatcher watcher;
+  ASSERT_TRUE(watcher.start(dir.path()));
+  EXPECT_TRUE(watcher.take().full_scan);
+  EXPECT_FALSE(watcher.take().full_scan);
+
+  watcher.invalidate();
+  EXPECT_TRUE(watcher.take().full_scan);
+}
+
+TEST(DirectoryWatcher, RecordsChangedFilesAndNewDirectories) {
+  TempDir dir;
+  ASSERT_EQ(mkdir((dir.path() + "/lib").c_str(), 0755), 0);
+  dir.Write("lib/libapp.so", "old");
+  DirectoryWatcher watcher;
+  ASSERT_TRUE(watcher.start(dir.path()));
+  watcher.take();
+
+  dir.Write("lib/libapp.so", "new");
+  DirtyPaths dirty = TakeWhenDirty(&watcher);
+  EXPECT_FALSE(dirty.full_scan);
+  EXPECT_EQ(dirty.paths.count("lib/libapp.so"), 1u);
+
+  ASSERT_EQ(mkdir((dir.path() + "/data").c_str(), 0755), 0);
+  dirty = TakeWhenDirty(&watcher);
+  EXPECT_EQ(dirty.paths.count("data"), 1u);
+
+  // Files in the new directory are reported through the added watch.
+  dir.Write("data/icudtl.dat", "x");
+  dirty = TakeWhenDirty(&watcher);
+  EXPECT_EQ(dirty.paths.count("data/icudtl.dat"), 1u);
+}
+
+TEST(DirectoryWatcher, IncrementalHashMatchesFullScan) {
+  TempDir dir;
+  ASSERT_EQ(mkdir((dir.path() + "/lib").c_str(), 0755), 0);
+  dir.Write("app", "runner");
+  dir.Write("lib/libapp.so", "old");
+  dir.Write("lib/removed.so", "gone soon");
+
+  ThreadPool pool(2);
+  FileHasher hasher(&pool);
+  HashIndex index;
+  DirectoryWatcher watcher;
+  ASSERT_TRUE(watcher.start(dir.path()));
+
+  HashDirectoryOptions options;
+  options.algorithm = HashAlgorithm::kBlake3;
+  options.index = &index;
+  DirtyPaths dirty = watcher.take();
+  options.dirty = &dirty;
+  std::vector<FileHashEntry> entries;
+  HashDirectoryStats stats;
+  ASSERT_TRUE(hasher.hash_directory(dir.path(), options, &entries, &stats));
+  EXPECT_EQ(stats.hashed, 3u);
+
+  dir.Write("lib/libapp.so", "new contents");
+  ASSERT_EQ(unlink((dir.path() + "/lib/removed.so").c_str()), 0);
+  ASSERT_EQ(mkdir((dir.path() + "/data").c_str(), 0755), 0);
+  dir.Write("data/added", "added");
+  dirty = TakeWhenDirty(&watcher);
+  ASSERT_FALSE(dirty.full_scan);
+
+  ASSERT_TRUE(hasher.hash_directory(dir.path(), options, &entries, &stats));
+  EXPECT_EQ(stats.from_index, 1u);
+  EXPECT_EQ(stats.hashed, 2u);
+
+  HashDirectoryOptions full;
+  full.algorithm = HashAlgorithm::kBlake3;
+  std::vector<FileHashEntry> expected;
+  ASSERT_TRUE(hasher.hash_directory(dir.path(), full, &expected));
+  ASSERT_EQ(entries.size(), expected.size());
+  for (const FileHashEntry& entry : expected) {
+    const HashIndexEntry* indexed = index.lookup(entry.path);
+    ASSERT_NE(indexed, nullptr) << entry.path;
+    EXPECT_EQ(base64_encode(
+                  reinterpret_cast<const uint8_t*>(indexed->digest.data()),
+                  indexed->digest.size()),
+              entry.calculated_hash);
+  }
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,641 @@
+#include <curl/curl.h>
+#include <gtest/gtest.h>
+#include <zdict.h>
+#include <zstd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "downloader.h"
+#include "test_util.h"
+#include "update_server.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+// Text sharing most of its structure with the other indexes, like the JSON
+// and SVG files in flutter_assets.
+std::string AssetBytes(int index, int entries) {
+  std::string data = "{\"asset\":\"asset" + std::to_string(index) +
+                     "\",\"entries\":[";
+  uint32_t state = static_cast<uint32_t>(index) * 2654435761u + 1;
+  for (int i = 0; i < entries; i++) {
+    state = state * 1103515245u + 12345u;
+    data += std::string(i > 0 ? "," : "") + "{\"id\":" + std::to_string(i) +
+            ",\"kind\":\"" + (state & 1 ? "glyph" : "path") +
+            "\",\"width\":" + std::to_string(state % 997) +
+            ",\"fill\":\"#" + std::to_string(state % 9973) +
+            "\",\"visible\":true}";
+  }
+  return data + "]}";
+}
+
+// Writes each asset as <name>.zst, compressed with a dictionary trained on
+// all of them that is written as update.dict, the way bin/archive.dart
+// publishes a release. Returns the total compressed size.
+size_t PublishCompressed(TempDir* dir,
+                         const std::vector<std::pair<std::string,
+                                                     std::string>>& assets) {
+  std::string samples;
+  std::vector<size_t> sizes;
+  for (const auto& asset : assets) {
+    samples += asset.second;
+    sizes.push_back(asset.second.size());
+  }
+  std::string dictionary(16 << 10, '\0');
+  const size_t dictionary_size = ZDICT_trainFromBuffer(
+      &dictionary[0], dictionary.size(), samples.data(), sizes.data(),
+      static_cast<unsigned>(sizes.size()));
+  if (ZDICT_isError(dictionary_size)) {
+    return 0;
+  }
+  dictionary.resize(dictionary_size);
+  dir->Write("update.dict", dictionary);
+  ZSTD_CCtx* context = ZSTD_createCCtx();
+  size_t total = 0;
+  for (const auto& asset : assets) {
+    std::string compressed(ZSTD_compressBound(asset.second.size()), '\0');
+    const size_t size = ZSTD_compress_usingDict(
+        context, &compressed[0], compressed.size(), asset.second.data(),
+        asset.second.size(), dictionary.data(), dictionary.size(), 19);
+    compressed.resize(size);
+    dir->Write(asset.first + ".zst", compressed);
+    total += size;
+  }
+  ZSTD_freeCCtx(context);
+  return total;
+}
+
+DownloadOptions SmallRanges() {
+  DownloadOptions options;
+  options.split_threshold = 1 << 20;
+  options.range_size = 256 << 10;
+  options.max_connections = 4;
+  options.sample_interval_ms = 100;
+  return options;
+}
+
+}  // namespace
+
+TEST(Downloader, FetchesSmallFilesInOneRequest) {
+  TempDir dir;
+  const std::string data = PatternBytes(100000);
+  dir.Write("small.bin", data);
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  Downloader downloader;
+  DownloadProgress progress;
+  DownloadStats stats;
+  std::string error;
+  const std::string target = dir.path() + "/out.bin";
+  ASSERT_TRUE(downloader.download(server.url() + "/small.bin", target,
+                                  data.size(), SmallRanges(), &progress,
+                                  &stats, &error))
+      << error;
+  EXPECT_EQ(ReadFile(target), data);
+  EXPECT_FALSE(stats.split);
+  EXPECT_EQ(stats.requests, 1u);
+  EXPECT_EQ(progress.received, data.size());
+  EXPECT_EQ(server.stats().range_requests, 0u);
+}
+
+TEST(Downloader, SplitsLargeFilesIntoParallelRanges) {
+  TempDir dir;
+  const std::string data = PatternBytes(6 << 20);
+  dir.Write("libapp.so", data);
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  server_options.connection_bytes_per_second = 8 << 20;
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  Downloader downloader;
+  DownloadProgress progress;
+  DownloadStats stats;
+  std::string error;
+  const std::string target = dir.path() + "/out.so";
+  ASSERT_TRUE(downloader.download(server.url() + "/libapp.so", target,
+                                  data.size(), SmallRanges(), &progress,
+                                  &stats, &error))
+      << error;
+  EXPECT_EQ(ReadFile(target), data);
+  EXPECT_TRUE(stats.split);
+  EXPECT_EQ(stats.requests, 24u);
+  EXPECT_GE(stats.peak_connections, 2);
+  EXPECT_LE(stats.peak_connections, 4);
+  EXPECT_EQ(server.stats().range_requests, 24u);
+}
+
+TEST(Downloader, FallsBackToOneStreamWhenRangesAreIgnored) {
+  TempDir dir;
+  const std::string data = PatternBytes(3 << 20);
+  dir.Write("libapp.so", data);
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  server_options.ignore_ranges = true;
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  Downloader downloader;
+  DownloadProgress progress;
+  DownloadStats stats;
+  std::string error;
+  const std::string target = dir.path() + "/out.so";
+  ASSERT_TRUE(downloader.download(server.url() + "/libapp.so", target,
+                                  data.size(), SmallRanges(), &progress,
+                                  &stats, &error))
+      << error;
+  EXPECT_EQ(ReadFile(target), data);
+  EXPECT_FALSE(stats.split);
+  EXPECT_EQ(stats.peak_connections, 1);
+  EXPECT_EQ(server.stats().requests, 1u);
+  EXPECT_EQ(stats.bytes, data.size());
+}
+
+TEST(Downloader, ResumesFailedRanges) {
+  TempDir dir;
+  const std::string data = PatternBytes(3 << 20);
+  dir.Write("libapp.so", data);
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  server_options.failure_every = 4;
+  server_options.failure_mode = FailureMode::kReset;
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  Downloader downloader;
+  DownloadProgress progress;
+  DownloadStats stats;
+  std::string error;
+  const std::string target = dir.path() + "/out.so";
+  ASSERT_TRUE(downloader.download(server.url() + "/libapp.so", target,
+                                  data.size(), SmallRanges(), &progress,
+                                  &stats, &error))
+      << error;
+  EXPECT_EQ(ReadFile(target), data);
+  EXPECT_GT(stats.retries, 0);
+  // Resumed ranges only fetch what the reset cut off.
+  EXPECT_LT(stats.bytes, data.size() + (data.size() / 2));
+}
+
+TEST(Downloader, FailsAndRemovesTheFileAfterRepeatedErrors) {
+  TempDir dir;
+  dir.Write("libapp.so", PatternBytes(100));
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  server_options.failure_every = 1;
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  Downloader downloader;
+  DownloadProgress progress;
+  DownloadStats stats;
+  std::string error;
+  const std::string target = dir.path() + "/out.so";
+  EXPECT_FALSE(downloader.download(server.url() + "/libapp.so", target, 100,
+                                   SmallRanges(), &progress, &stats, &error));
+  EXPECT_NE(error.find("503"), std::string::npos) << error;
+  EXPECT_FALSE(Exists(target));
+  EXPECT_EQ(server.stats().requests, 3u);
+}
+
+TEST(Downloader, AddsConnectionsOnlyWhileThroughputGrows) {
+  TempDir dir;
+  const std::string data = PatternBytes(16 << 20);
+  dir.Write("libapp.so", data);
+  DownloadOptions options = SmallRanges();
+  options.max_connections = 8;
+
+  // Each connection is capped, so more connections mean more throughput.
+  UpdateServerOptions per_connection;
+  per_connection.root = dir.path();
+  per_connection.connection_bytes_per_second = 2 << 20;
+  UpdateServer shaped(per_connection);
+  ASSERT_TRUE(shaped.Start());
+  Downloader downloader;
+  DownloadProgress progress;
+  DownloadStats grown;
+  std::string error;
+  ASSERT_TRUE(downloader.download(shaped.url() + "/libapp.so",
+                                  dir.path() + "/a.so", data.size(), options,
+                                  &progress, &grown, &error))
+      << error;
+
+  // Only the link as a whole is capped, so extra connections do not help.
+  UpdateServerOptions total;
+  total.root = dir.path();
+  total.total_bytes_per_second = 8 << 20;
+  UpdateServer capped(total);
+  ASSERT_TRUE(capped.Start());
+  DownloadProgress capped_progress;
+  DownloadStats flat;
+  ASSERT_TRUE(downloader.download(capped.url() + "/libapp.so",
+                                  dir.path() + "/b.so", data.size(), options,
+                                  &capped_progress, &flat, &error))
+      << error;
+
+  EXPECT_GT(grown.peak_connections, flat.peak_connections);
+  EXPECT_LT(flat.peak_connections, 8);
+}
+
+TEST(Downloader, StopsWhenCancelled) {
+  TempDir dir;
+  dir.Write("libapp.so", PatternBytes(8 << 20));
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  server_options.connection_bytes_per_second = 1 << 20;
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  Downloader downloader;
+  DownloadProgress progress;
+  DownloadStats stats;
+  std::string error;
+  std::thread canceller([&progress]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    progress.cancelled = true;
+  });
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(downloader.download(server.url() + "/libapp.so",
+                                   dir.path() + "/out.so", 8 << 20,
+                                   SmallRanges(), &progress, &stats, &error));
+  canceller.join();
+  EXPECT_EQ(error, "cancelled");
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(3));
+}
+
+TEST(Downloader, MultiplexesConcurrentDownloadsOverHttp2) {
+  TempDir dir;
+  const int kFiles = 200;
+  for (int i = 0; i < kFiles; i++) {
+    dir.Write("asset" + std::to_string(i) + ".bin", PatternBytes(4096 + i));
+  }
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  server_options.http2 = true;
+  server_options.latency_ms = 50;
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  // As many callers as FileDownloader runs at once.
+  Downloader downloader;
+  std::vector<std::thread> callers;
+  std::atomic<int> next(0);
+  std::atomic<int> failed(0);
+  std::atomic<int> http2(0);
+  const auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < 64; t++) {
+    callers.emplace_back([&]() {
+      for (int i = next++; i < kFiles; i = next++) {
+        const std::string name = "asset" + std::to_string(i) + ".bin";
+        DownloadProgress progress;
+        DownloadStats stats;
+        std::string error;
+        if (!downloader.download(server.url() + "/" + name,
+                                 dir.path() + "/out" + name, 4096 + i, SmallRanges(),
+                                 &progress, &stats, &error)) {
+          failed++;
+        }
+        http2 += stats.http2;
+      }
+    });
+  }
+  for (std::thread& caller : callers) {
+    caller.join();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ(failed, 0);
+  EXPECT_EQ(http2, kFiles);
+  EXPECT_EQ(ReadFile(dir.path() + "/outasset7.bin"), PatternBytes(4096 + 7));
+  const UpdateServerStats stats = server.stats();
+  EXPECT_EQ(stats.requests, static_cast<uint64_t>(kFiles));
+  EXPECT_LE(stats.connections, 2u);
+  EXPECT_GE(stats.peak_streams, 32u);
+  // Round trips overlap: 200 files at 50 ms each, in well under a second.
+  EXPECT_LT(elapsed, std::chrono::milliseconds(1000));
+}
+
+TEST(Downloader, WeightsSmallFilesAboveRangesOfLargeFiles) {
+  TempDir dir;
+  const std::string large = PatternBytes(3 << 20);
+  dir.Write("libapp.so", large);
+  dir.Write("icon.png", PatternBytes(5000));
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  server_options.http2 = true;
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  // The request that upgrades the connection to HTTP/2 carries no weight.
+  Downloader downloader;
+  DownloadProgress progress;
+  DownloadStats stats;
+  std::string error;
+  ASSERT_TRUE(downloader.download(server.url() + "/icon.png",
+                                  dir.path() + "/first.png", 5000,
+                                  SmallRanges(), &progress, &stats, &error))
+      << error;
+
+  DownloadProgress large_progress;
+  DownloadStats large_stats;
+  std::string large_error;
+  std::thread large_download([&]() {
+    EXPECT_TRUE(downloader.download(server.url() + "/libapp.so",
+                                    dir.path() + "/out.so", large.size(),
+                                    SmallRanges(), &large_progress, &large_stats,
+                                    &large_error))
+        << large_error;
+  });
+  EXPECT_TRUE(downloader.download(server.url() + "/icon.png",
+                                  dir.path() + "/out.png", 5000, SmallRanges(),
+                                  &progress, &stats, &error))
+      << error;
+  EXPECT_EQ(server.stream_weight("/icon.png"), 256);
+  DownloadOptions pinned = SmallRanges();
+  pinned.stream_weight = 100;
+  EXPECT_TRUE(downloader.download(server.url() + "/icon.png",
+                                  dir.path() + "/pinned.png", 5000, pinned,
+                                  &progress, &stats, &error))
+      << error;
+  large_download.join();
+
+  EXPECT_EQ(ReadFile(dir.path() + "/out.so"), large);
+  EXPECT_TRUE(large_stats.split);
+  EXPECT_EQ(server.stream_weight("/libapp.so"), 16);
+  EXPECT_EQ(server.stream_weight("/icon.png"), 100);
+  EXPECT_EQ(server.stats().http2_connections, 1u);
+}
+
+TEST(Downloader, ResumesRangesWhoseStreamsAreReset) {
+  TempDir dir;
+  const std::string data = PatternBytes(3 << 20);
+  dir.Write("libapp.so", data);
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  server_options.http2 = true;
+  server_options.failure_every = 4;
+  server_options.failure_mode = FailureMode::kReset;
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  Downloader downloader;
+  DownloadProgress progress;
+  DownloadStats stats;
+  std::string error;
+  const std::string target = dir.path() + "/out.so";
+  ASSERT_TRUE(downloader.download(server.url() + "/libapp.so", target,
+                                  data.size(), SmallRanges(), &progress, &stats,
+                                  &error))
+      << error;
+  EXPECT_EQ(ReadFile(target), data);
+  EXPECT_GT(stats.retries, 0);
+  EXPECT_TRUE(stats.http2);
+}
+
+TEST(Downloader, DecompressesFilesSharingOneDictionary) {
+  TempDir dir;
+  std::vector<std::pair<std::string, std::string>> assets;
+  size_t total = 0;
+  for (int i = 0; i < 300; i++) {
+    assets.emplace_back("asset" + std::to_string(i) + ".json",
+                        AssetBytes(i, 40));
+    total += assets.back().second.size();
+  }
+  const size_t compressed = PublishCompressed(&dir, assets);
+  ASSERT_GT(compressed, 0u);
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  // Room for four downloads' buffers at once, while 16 are requested.
+  const size_t per_download = ZSTD_DStreamOutSize() + CURL_MAX_WRITE_SIZE;
+  MemoryBudget budget(4 * per_download);
+  Downloader downloader(nullptr, &budget);
+  DownloadOptions options;
+  options.dictionary_url = server.url() + "/update.dict";
+  std::atomic<uint64_t> bytes(0);
+  {
+    // Fetches the dictionary, whose buffer is charged while it arrives.
+    const std::string& name = assets[0].first;
+    DownloadProgress progress;
+    DownloadStats stats;
+    std::string error;
+    ASSERT_TRUE(downloader.download(
+        server.url() + "/" + name + ".zst", dir.path() + "/out_" + name,
+        ReadFile(dir.path() + "/" + name + ".zst").size(), options, &progress,
+        &stats, &error))
+        << error;
+    bytes += stats.bytes;
+    EXPECT_EQ(budget.in_use(), 0u);
+    budget.reset_peak();
+  }
+  std::atomic<size_t> next(1);
+  std::atomic<int> failures(0);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < 16; i++) {
+    workers.emplace_back([&]() {
+      for (size_t index = next++; index < assets.size(); index = next++) {
+        const std::string& name = assets[index].first;
+        DownloadProgress progress;
+        DownloadStats stats;
+        std::string error;
+        const std::string compressed_path = dir.path() + "/" + name + ".zst";
+        if (!downloader.download(server.url() + "/" + name + ".zst",
+                                 dir.path() + "/out_" + name,
+                                 ReadFile(compressed_path).size(), options,
+                                 &progress, &stats, &error)) {
+          ADD_FAILURE() << error;
+          failures++;
+        }
+        bytes += stats.bytes;
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  ASSERT_EQ(failures, 0);
+  for (const auto& asset : assets) {
+    EXPECT_EQ(ReadFile(dir.path() + "/out_" + asset.first), asset.second);
+  }
+  EXPECT_EQ(bytes, compressed);
+  EXPECT_LT(bytes * 4, total);
+  // One request for the dictionary, one per file.
+  EXPECT_EQ(server.stats().requests, assets.size() + 1);
+  EXPECT_GE(budget.peak(), per_download);
+  EXPECT_LE(budget.peak(), budget.limit());
+  EXPECT_EQ(budget.in_use(), 0u);
+}
+
+TEST(Downloader, DoesNotDeadlockWhenReceiveBuffersFillTheBudget) {
+  TempDir dir;
+  std::vector<std::pair<std::string, std::string>> assets;
+  for (int i = 0; i < 64; i++) {
+    assets.emplace_back("asset" + std::to_string(i) + ".json",
+                        AssetBytes(i, 40));
+  }
+  ASSERT_GT(PublishCompressed(&dir, assets), 0u);
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  // Exactly the receive buffers of all concurrent downloads: a download
+  // holding its receive buffer while waiting for its output buffer would
+  // never get it.
+  const int kConcurrency = 16;
+  MemoryBudget budget(kConcurrency * CURL_MAX_WRITE_SIZE);
+  Downloader downloader(nullptr, &budget);
+  CancellationToken cancel;
+  DownloadOptions options;
+  options.dictionary_url = server.url() + "/update.dict";
+  options.cancel = &cancel;
+  std::atomic<size_t> next(0);
+  std::atomic<int> finished(0);
+  std::atomic<int> failures(0);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < kConcurrency; i++) {
+    workers.emplace_back([&]() {
+      for (size_t index = next++; index < assets.size(); index = next++) {
+        const std::string& name = assets[index].first;
+        DownloadProgress progress;
+        DownloadStats stats;
+        std::string error;
+        if (!downloader.download(
+                server.url() + "/" + name + ".zst",
+                dir.path() + "/out_" + name,
+                ReadFile(dir.path() + "/" + name + ".zst").size(), options,
+                &progress, &stats, &error)) {
+          failures++;
+        }
+      }
+      finished++;
+    });
+  }
+  // Cancelling wakes downloads waiting on the budget, so a deadlock fails
+  // the test instead of hanging it.
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  while (finished < kConcurrency &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  cancel.cancel();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  EXPECT_EQ(failures, 0);
+  for (const auto& asset : assets) {
+    EXPECT_EQ(ReadFile(dir.path() + "/out_" + asset.first), asset.second);
+  }
+  EXPECT_EQ(budget.in_use(), 0u);
+}
+
+TEST(Downloader, RestartsCompressedFilesWhoseResponsesAreCut) {
+  TempDir dir;
+  std::vector<std::pair<std::string, std::string>> assets;
+  for (int i = 0; i < 12; i++) {
+    assets.emplace_back("glyphs" + std::to_string(i) + ".json",
+                        AssetBytes(i, 2000));
+  }
+  ASSERT_GT(PublishCompressed(&dir, assets), 0u);
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  server_options.failure_every = 3;
+  server_options.failure_mode = FailureMode::kReset;
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  Downloader downloader;
+  DownloadOptions options;
+  options.dictionary_url = server.url() + "/update.dict";
+  int retries = 0;
+  for (const auto& asset : assets) {
+    DownloadProgress progress;
+    DownloadStats stats;
+    std::string error;
+    const std::string target = dir.path() + "/out_" + asset.first;
+    ASSERT_TRUE(downloader.download(
+        server.url() + "/" + asset.first + ".zst", target,
+        ReadFile(dir.path() + "/" + asset.first + ".zst").size(), options,
+        &progress, &stats, &error))
+        << error;
+    EXPECT_EQ(ReadFile(target), asset.second);
+    retries += stats.retries;
+  }
+  EXPECT_GT(retries, 0);
+}
+
+TEST(Downloader, FailsWithoutAUsableDictionary) {
+  TempDir dir;
+  std::vector<std::pair<std::string, std::string>> assets;
+  for (int i = 0; i < 100; i++) {
+    assets.emplace_back("asset" + std::to_string(i) + ".json",
+                        AssetBytes(i, 40));
+  }
+  ASSERT_GT(PublishCompressed(&dir, assets), 0u);
+  const std::string& asset = assets[1].second;
+  dir.Write("plain.json.zst", asset);
+  UpdateServerOptions server_options;
+  server_options.root = dir.path();
+  UpdateServer server(server_options);
+  ASSERT_TRUE(server.Start());
+
+  Downloader downloader;
+  DownloadProgress progress;
+  DownloadStats stats;
+  std::string error;
+  DownloadOptions options;
+  options.dictionary_url = server.url() + "/missing.dict";
+  const std::string target = dir.path() + "/out.json";
+  EXPECT_FALSE(downloader.download(server.url() + "/asset0.json.zst", target,
+                                   0, options, &progress, &stats, &error));
+  EXPECT_NE(error.find("missing.dict"), std::string::npos) << error;
+  EXPECT_FALSE(Exists(target));
+  // The failure is remembered rather than fetched again for every file.
+  const uint64_t requests = server.stats().requests;
+  EXPECT_FALSE(downloader.download(server.url() + "/asset1.json.zst", target,
+                                   0, options, &progress, &stats, &error));
+  EXPECT_EQ(server.stats().requests, requests);
+
+  options.dictionary_url = server.url() + "/plain.json.zst";
+  EXPECT_FALSE(downloader.download(server.url() + "/asset0.json.zst", target,
+                                   0, options, &progress, &stats, &error));
+  EXPECT_NE(error.find("not a zstd dictionary"), std::string::npos) << error;
+
+  options.dictionary_url = server.url() + "/update.dict";
+  EXPECT_FALSE(downloader.download(server.url() + "/plain.json.zst", target,
+                                   0, options, &progress, &stats, &error));
+  EXPECT_FALSE(Exists(target));
+  EXPECT_TRUE(downloader.download(server.url() + "/asset1.json.zst", target,
+                                  0, options, &progress, &stats, &error))
+      << error;
+  EXPECT_EQ(ReadFile(target), asset);
+}
+
+TEST(DownloadRegistry, ReportsEveryDownloadInFlight) {
+  DownloadRegistry registry;
+  registry.add("a")->received = 10;
+  registry.add("b")->received = 20;
+  registry.add("c");
+  registry.remove("c");
+  const std::map<std::string, uint64_t> received = registry.received();
+  EXPECT_EQ(received, (std::map<std::string, uint64_t>{{"a", 10}, {"b", 20}}));
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <poll.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "event_ring.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+// Values the drained events carried, in the order they ran. Only the
+// draining thread touches it.
+std::vector<uintptr_t>* g_received = nullptr;
+
+// The tests pass the value itself as the event's data.
+void Record(void* data) {
+  g_received->push_back(reinterpret_cast<uintptr_t>(data));
+}
+
+MainLoopEvent Event(uintptr_t value) {
+  MainLoopEvent event;
+  event.run = Record;
+  event.data = reinterpret_cast<void*>(value);
+  return event;
+}
+
+bool Readable(int fd) {
+  struct pollfd poll_fd = {fd, POLLIN, 0};
+  return poll(&poll_fd, 1, 0) == 1;
+}
+
+}  // namespace
+
+TEST(EventRing, DrainsInOrderInBatchesAndRefusesWhenFull) {
+  std::vector<uintptr_t> received;
+  g_received = &received;
+  EventRing ring(5);
+  EXPECT_EQ(ring.capacity(), 8u);
+  EXPECT_FALSE(Readable(ring.wake_fd()));
+  for (uintptr_t i = 0; i < 8; i++) {
+    EXPECT_TRUE(ring.try_push(Event(i)));
+  }
+  EXPECT_FALSE(ring.try_push(Event(8)));
+  EXPECT_TRUE(Readable(ring.wake_fd()));
+
+  EXPECT_EQ(ring.drain(3), 3u);
+  EXPECT_TRUE(Readable(ring.wake_fd()));  // five left
+  EXPECT_TRUE(ring.try_push(Event(8)));
+  EXPECT_EQ(ring.drain(100), 6u);
+  EXPECT_FALSE(Readable(ring.wake_fd()));
+  EXPECT_EQ(ring.drain(100), 0u);
+  EXPECT_EQ(received,
+            (std::vector<uintptr_t>{0, 1, 2, 3, 4, 5, 6, 7, 8}));
+  g_received = nullptr;
+}
+
+TEST(EventRing, DeliversEveryEventFromConcurrentProducers) {
+  const int kProducers = 4;
+  const uintptr_t kEvents = 50000;
+  std::vector<uintptr_t> received;
+  g_received = &received;
+  EventRing ring(256);  // small, so producers also hit a full ring
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; p++) {
+    producers.emplace_back([&ring, p, kEvents]() {
+      for (uintptr_t i = 0; i < kEvents; i++) {
+        ring.push(Event(static_cast<uintptr_t>(p) << 32 | i));
+      }
+    });
+  }
+
+  // What the main loop does: sleep on the wake fd, drain what is there.
+  size_t wakeups = 0;
+  while (received.size() < kProducers * kEvents) {
+    struct pollfd poll_fd = {ring.wake_fd(), POLLIN, 0};
+    ASSERT_EQ(poll(&poll_fd, 1, 5000), 1) << "lost wakeup";
+    ring.drain(1024);
+    wakeups++;
+  }
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  EXPECT_EQ(ring.drain(1024), 0u);
+  EXPECT_LT(wakeups, received.size());
+
+  // Each producer's events arrive whole and in its order.
+  std::vector<uintptr_t> next(kProducers, 0);
+  for (uintptr_t value : received) {
+    const int producer = static_cast<int>(value >> 32);
+    ASSERT_EQ(value & 0xffffffffu, next[producer]);
+    next[producer]++;
+  }
+  g_received = nullptr;
+}
+
+}  // namespace test
+}  // namespace desktop_updater
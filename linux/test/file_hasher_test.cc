@@ -0,0 +1,271 @@
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "blake2b.h"
+#include "blake3.h"
+#include "file_hasher.h"
+#include "manifest.h"
+#include "memory_budget.h"
+#include "test_util.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+std::string Base64(const std::string& digest) {
+  return base64_encode(reinterpret_cast<const uint8_t*>(digest.data()),
+                       digest.size());
+}
+
+}  // namespace
+
+TEST(Blake2b, MatchesReferenceDigest) {
+  Blake2b hasher;
+  hasher.update("abc", 3);
+  std::string digest(64, '\0');
+  hasher.finish(reinterpret_cast<uint8_t*>(&digest[0]));
+  EXPECT_EQ(Base64(digest),
+            "uoClP5gcTQ1qJ5e2nxL26UwhLxRoWsS3SxK7b9v/otF9h8U5Kqt5LcJS1d5FM8yVGNOKqNvxklq5I4bt1ACZIw==");
+}
+
+std::string Hex(const std::string& digest) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string out;
+  for (unsigned char c : digest) {
+    out.push_back(kHex[c >> 4]);
+    out.push_back(kHex[c & 0xf]);
+  }
+  return out;
+}
+
+// Official BLAKE3 test vectors, covering single chunks, partial chunks and
+// inputs long enough to use every SIMD batch width.
+TEST(Blake3, MatchesReferenceVectors) {
+  const struct {
+    size_t length;
+    const char* hex;
+  } kVectors[] = {
+      {0, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+      {1, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+      {1023, "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11"},
+      {1024, "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7"},
+      {1025, "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444"},
+      {2048, "e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a"},
+      {4097, "9b4052b38f1c5fc8b1f9ff7ac7b27cd242487b3d890d15c96a1c25b8aa0fb995"},
+      {8193, "bab6c09cb8ce8cf459261398d2e7aef35700bf488116ceb94a36d0f5f1b7bc3b"},
+      {31744, "62b6960e1a44bcc1eb1a611a8d6235b6b4b78f32e7abc4fb4c6cdcce94895c47"},
+      {102400, "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085"},
+  };
+  for (const auto& vector : kVectors) {
+    const std::string input = PatternBytes(vector.length);
+    EXPECT_EQ(Hex(blake3_hash(input.data(), input.size())), vector.hex)
+        << vector.length << " bytes, " << blake3_backend_name();
+  }
+}
+
+TEST(FileHasher, Blake3DigestIsIndependentOfThreadCount) {
+  TempDir dir;
+  const struct {
+    size_t length;
+    const char* hex;
+  } kFiles[] = {
+      {1, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+      {102400, "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085"},
+      {2621441, "91d2175f794f733b0d03440884c1c380676bc8343d077a28dfc3697bdabdf58b"},
+      {5242880, "54c35c1e2f19bca26898eb1d23bbee04deff9b67f1f0544a3e38423961eb6bd5"},
+  };
+  for (const auto& file : kFiles) {
+    const std::string path = dir.Write("asset.bin", PatternBytes(file.length));
+    for (size_t threads : {1, 4}) {
+      ThreadPool pool(threads);
+      FileHasher hasher(&pool);
+      std::string digest;
+      ASSERT_TRUE(hasher.hash_file(path, HashAlgorithm::kBlake3, &digest));
+      EXPECT_EQ(Hex(digest), file.hex) << file.length << " bytes";
+    }
+  }
+}
+
+TEST(FileHasher, LegacyDigestMatchesDartBlake2b) {
+  TempDir dir;
+  const std::string path = dir.Write("asset.bin", PatternBytes(2621441));
+  ThreadPool pool(4);
+  FileHasher hasher(&pool);
+  std::string digest;
+  ASSERT_TRUE(hasher.hash_file(path, HashAlgorithm::kBlake2b, &digest));
+  EXPECT_EQ(Base64(digest),
+            "RUJuvoYpnmkJhjGcnFxi+nSwIHB+y1CJaIYvmkfc+DclSBS4I+FxQdwUsXvHaToj9qapcNq07vvDoTjZP8vsOg==");
+}
+
+TEST(FileHasher, TreeDigestIsIndependentOfThreadCount) {
+  TempDir dir;
+  // Two and a half leaves plus one byte, so the last leaf is partial.
+  const std::string path = dir.Write("asset.bin", PatternBytes(2621441));
+  const char* expected =
+      "twPajUdkvcg7nnC8RCbsN4/gtOCSizGhT5ddWlnAfaqbDZ/tmmL5/T3Dq5tv9NrJcWn9sENukKVLRAG4pYStZQ==";
+  for (size_t threads : {1, 3, 8}) {
+    ThreadPool pool(threads);
+    FileHasher hasher(&pool);
+    std::string digest;
+    ASSERT_TRUE(hasher.hash_file(path, HashAlgorithm::kBlake2bTree, &digest));
+    EXPECT_EQ(Base64(digest), expected) << threads << " threads";
+  }
+}
+
+TEST(FileHasher, ReadBuffersStayWithinMemoryBudget) {
+  TempDir dir;
+  const std::string path = dir.Write("asset.bin", PatternBytes(8 << 20));
+  // Room for two read buffers while eight workers compete for them.
+  MemoryBudget budget(512 * 1024);
+  ThreadPool pool(8);
+  FileHasher hasher(&pool, &budget);
+  std::string digest;
+  ASSERT_TRUE(hasher.hash_file(path, HashAlgorithm::kBlake3, &digest));
+  EXPECT_LE(budget.peak(), budget.limit());
+  EXPECT_GT(budget.peak(), 0u);
+  EXPECT_EQ(budget.in_use(), 0u);
+
+  ThreadPool single(1);
+  FileHasher reference(&single);
+  std::string expected;
+  ASSERT_TRUE(reference.hash_file(path, HashAlgorithm::kBlake3, &expected));
+  EXPECT_EQ(digest, expected);
+}
+
+TEST(FileHasher, TreeDigestOfEmptyFileHasOneLeaf) {
+  TempDir dir;
+  const std::string path = dir.Write("empty", "");
+  ThreadPool pool(2);
+  FileHasher hasher(&pool);
+  std::string digest;
+  ASSERT_TRUE(hasher.hash_file(path, HashAlgorithm::kBlake2bTree, &digest));
+  EXPECT_EQ(Base64(digest),
+            "3YomOckPB9f793JtrmMXoyeQKTKb5CJDKa8nqSuLQBTvrLk/KJEgb54GAbx63eFj6apw8y0zRzER89ZjlpMZGQ==");
+}
+
+TEST(FileHasher, HashDirectoryTagsEntriesAndSkipsExcluded) {
+  TempDir dir;
+  ASSERT_EQ(mkdir((dir.path() + "/data").c_str(), 0755), 0);
+  dir.Write("data/a.txt", "a");
+  dir.Write("hashes.json", "[]");
+  ThreadPool pool(2);
+  FileHasher hasher(&pool);
+  HashDirectoryOptions options;
+  options.algorithm = HashAlgorithm::kBlake2bTree;
+  options.excluded_suffixes.push_back("hashes.json");
+  std::vector<FileHashEntry> entries;
+  ASSERT_TRUE(hasher.hash_directory(dir.path(), options, &entries));
+  ASSERT_EQ(entries.size(), 1u);
+  EXPECT_EQ(entries[0].path, "data/a.txt");
+  EXPECT_EQ(entries[0].length, 1);
+  EXPECT_NE(manifest_to_json(entries).find("\"algorithm\":\"blake2b-tree\"}"),
+            std::string::npos);
+}
+
+TEST(Manifest, LegacyJsonMatchesDartEncoding) {
+  FileHashEntry entry;
+  entry.path = "data/\"quoted\"\n.txt";
+  entry.calculated_hash = "AAAA";
+  entry.length = 3;
+  EXPECT_EQ(manifest_to_json({entry}),
+            "[{\"path\":\"data/\\\"quoted\\\"\\n.txt\",\"calculatedHash\":"
+            "\"AAAA\",\"length\":3}]");
+}
+
+TEST(Manifest, ParsesWhatItWrites) {
+  FileHashEntry legacy;
+  legacy.path = "data/\"quoted\"\n\xc3\xa9.txt";
+  legacy.calculated_hash = "AAAA";
+  legacy.length = 3;
+  FileHashEntry tagged;
+  tagged.path = "lib/libapp.so";
+  tagged.calculated_hash = "BBBB";
+  tagged.length = 1 << 20;
+  tagged.algorithm = HashAlgorithm::kBlake3;
+  tagged.compressed_length = 1000;
+
+  const std::string json = manifest_to_json({legacy, tagged});
+  EXPECT_NE(json.find("\"algorithm\":\"blake3\",\"compressedLength\":1000}"),
+            std::string::npos);
+  std::vector<FileHashEntry> parsed;
+  ASSERT_TRUE(parse_manifest_json(json, &parsed));
+  ASSERT_EQ(parsed.size(), 2u);
+  EXPECT_EQ(parsed[0].path, legacy.path);
+  EXPECT_EQ(parsed[0].algorithm, HashAlgorithm::kBlake2b);
+  EXPECT_EQ(parsed[0].compressed_length, 0);
+  EXPECT_EQ(parsed[1].length, tagged.length);
+  EXPECT_EQ(parsed[1].algorithm, HashAlgorithm::kBlake3);
+  EXPECT_EQ(parsed[1].compressed_length, 1000);
+}
+
+TEST(Manifest, ParsesEscapesAndSkipsUnknownKeys) {
+  std::vector<FileHashEntry> parsed;
+  ASSERT_TRUE(parse_manifest_json(
+      " [ {\"extra\": {\"a\": [1, true, null]}, \"path\": \"\\u00e9\\ud83d\\ude00\","
+      " \"calculatedHash\": \"AAAA\", \"length\": 7, \"algorithm\": null} ] ",
+      &parsed));
+  ASSERT_EQ(parsed.size(), 1u);
+  EXPECT_EQ(parsed[0].path, "\xc3\xa9\xf0\x9f\x98\x80");
+  EXPECT_EQ(parsed[0].length, 7);
+
+  EXPECT_FALSE(parse_manifest_json("[{\"path\": \"a\"}", &parsed));
+  EXPECT_FALSE(parse_manifest_json("[{\"algorithm\": \"md5\"}]", &parsed));
+}
+
+TEST(Manifest, PicksLatestArchiveItemForPlatform) {
+  std::vector<AppArchiveItem> items;
+  ASSERT_TRUE(parse_app_archive_json(
+      "{\"appName\": \"App\", \"items\": ["
+      "{\"version\": \"1.0.0\", \"shortVersion\": 1, \"platform\": \"linux\","
+      " \"changes\": [{\"message\": \"x\"}], \"url\": \"https://h/1\"},"
+      "{\"version\": \"1.2.0\", \"shortVersion\": 3, \"platform\": \"windows\","
+      " \"url\": \"https://h/3w\"},"
+      "{\"version\": \"1.1.0\", \"shortVersion\": 2, \"platform\": \"linux\","
+      " \"mandatory\": true, \"url\": \"https://h/2\"}],"
+      " \"description\": \"d\"}",
+      &items));
+  ASSERT_EQ(items.size(), 3u);
+  const AppArchiveItem* latest = latest_archive_item(items, "linux");
+  ASSERT_NE(latest, nullptr);
+  EXPECT_EQ(latest->version, "1.1.0");
+  EXPECT_EQ(latest->url, "https://h/2");
+  EXPECT_EQ(latest_archive_item(items, "macos"), nullptr);
+
+  EXPECT_FALSE(parse_app_archive_json("{\"items\": [{]}", &items));
+}
+
+TEST(Manifest, DiffListsMissingAndChangedFiles) {
+  auto entry = [](const std::string& path, const std::string& hash) {
+    FileHashEntry e;
+    e.path = path;
+    e.calculated_hash = hash;
+    return e;
+  };
+  const std::vector<FileHashEntry> local = {
+      entry("app", "A"), entry("lib/a.so", "B"), entry("data/x", "C")};
+  const std::vector<FileHashEntry> remote = {
+      entry("app", "A"), entry("lib/a.so", "b"), entry("data/x", "C"),
+      entry("data/y", "D")};
+
+  std::vector<FileHashEntry> changes = diff_manifests(local, remote, nullptr);
+  ASSERT_EQ(changes.size(), 2u);
+  EXPECT_EQ(changes[0].path, "lib/a.so");
+  EXPECT_EQ(changes[1].path, "data/y");
+
+  const std::set<std::string> only = {"data"};
+  changes = diff_manifests(local, remote, &only);
+  ASSERT_EQ(changes.size(), 1u);
+  EXPECT_EQ(changes[0].path, "data/y");
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "memory_budget.h"
+
+namespace desktop_updater {
+namespace test {
+
+TEST(MemoryBudget, AcquireWaitsForRelease) {
+  MemoryBudget budget(100);
+  budget.acquire(80);
+
+  std::atomic<bool> acquired(false);
+  std::thread waiter([&] {
+    budget.acquire(40);
+    acquired = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(acquired);
+
+  budget.release(80);
+  waiter.join();
+  EXPECT_TRUE(acquired);
+  EXPECT_EQ(budget.in_use(), 40u);
+  budget.release(40);
+}
+
+TEST(MemoryBudget, OversizedRequestIsGrantedAlone) {
+  MemoryBudget budget(100);
+  budget.acquire(250);
+  EXPECT_EQ(budget.in_use(), 250u);
+  budget.release(250);
+  EXPECT_EQ(budget.in_use(), 0u);
+}
+
+TEST(MemoryBudget, RaisingLimitWakesWaiters) {
+  MemoryBudget budget(100);
+  budget.acquire(100);
+  std::thread waiter([&] { budget.acquire(50); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  budget.set_limit(200);
+  waiter.join();
+  EXPECT_EQ(budget.in_use(), 150u);
+}
+
+TEST(MemoryBudget, CancelStopsAWaitingAcquire) {
+  MemoryBudget budget(100);
+  budget.acquire(100);
+  CancellationToken token;
+  bool acquired = true;
+  bool leased = true;
+  std::thread waiter([&] {
+    acquired = budget.acquire(50, &token);
+    BudgetedBuffer lease(&budget, 50, &token);
+    leased = lease.ok();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  const auto start = std::chrono::steady_clock::now();
+  token.cancel();
+  waiter.join();
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(100));
+  EXPECT_FALSE(acquired);
+  EXPECT_FALSE(leased);
+  EXPECT_EQ(budget.in_use(), 100u);
+}
+
+TEST(MemoryBudget, PeakTracksHighWaterMark) {
+  MemoryBudget budget(0);
+  {
+    BudgetedBuffer a(&budget, 64);
+    BudgetedBuffer b(&budget, 32);
+    EXPECT_EQ(budget.in_use(), 96u);
+  }
+  EXPECT_EQ(budget.in_use(), 0u);
+  EXPECT_EQ(budget.peak(), 96u);
+
+  budget.reset_peak();
+  EXPECT_EQ(budget.peak(), 0u);
+}
+
+TEST(MemoryBudget, ReportsPeakRss) {
+  EXPECT_GT(peak_rss_bytes(), 0u);
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "manifest.h"
+#include "merkle.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+FileHashEntry Entry(const std::string& path, int64_t length, char fill) {
+  FileHashEntry entry;
+  entry.path = path;
+  entry.length = length;
+  const std::string digest(64, fill);
+  entry.calculated_hash = base64_encode(
+      reinterpret_cast<const uint8_t*>(digest.data()), digest.size());
+  return entry;
+}
+
+std::string Base64(const std::string& digest) {
+  return base64_encode(reinterpret_cast<const uint8_t*>(digest.data()),
+                       digest.size());
+}
+
+std::vector<FileHashEntry> Bundle() {
+  return {
+      Entry("app", 3, 1),
+      Entry("lib/libapp.so", 10, 2),
+      Entry("data/flutter_assets/a.txt", 1, 3),
+      Entry("data/icudtl.dat", 7, 4),
+  };
+}
+
+}  // namespace
+
+TEST(Merkle, MatchesReferenceDigests) {
+  MerkleDirectories tree;
+  ASSERT_TRUE(build_merkle_tree(Bundle(), &tree));
+  ASSERT_EQ(tree.size(), 4u);
+  EXPECT_EQ(Base64(tree[""]),
+            "RfKrZL4siGkfTo+BeaKZfcgvnGkb+7jr023/v2OCrl8Rnn8VW/bGbGwixeNS8deYcbMP4NLtve3SZYZyYDj0VA==");
+  EXPECT_EQ(Base64(tree["data"]),
+            "2oHjqmAHPDJqJL48ENtosZ3wFc+xDY3i2Ld3O6JEedR94ATQOgK57i7/9HDGjwaXkT1Y9CohEcT/kvg3rfMTyQ==");
+  EXPECT_EQ(Base64(tree["data/flutter_assets"]),
+            "XvTjPcTKtCCeEaCnN+vfCFwtb7E95a33r/0944xQ/IlyX7JGstvcYxqoWukxXJ2R2wGzjdSwIGaKYSBaFOqHxA==");
+  EXPECT_EQ(Base64(tree["lib"]),
+            "aY29NkB4iexVk3YZy8f+9iqDtc3a/OHo7BUFN5FK7Hc1f34+sNykDzzqIeNQITciKILHGizHhbOIf9QIKi9yow==");
+}
+
+TEST(Merkle, ChangeOnlyTouchesItsBranch) {
+  MerkleDirectories before;
+  ASSERT_TRUE(build_merkle_tree(Bundle(), &before));
+  std::vector<FileHashEntry> entries = Bundle();
+  entries[2] = Entry("data/flutter_assets/a.txt", 1, 9);
+  MerkleDirectories after;
+  ASSERT_TRUE(build_merkle_tree(entries, &after));
+
+  EXPECT_NE(before[""], after[""]);
+  EXPECT_NE(before["data"], after["data"]);
+  EXPECT_NE(before["data/flutter_assets"], after["data/flutter_assets"]);
+  EXPECT_EQ(before["lib"], after["lib"]);
+}
+
+TEST(Merkle, OrderOfEntriesDoesNotMatter) {
+  std::vector<FileHashEntry> entries = Bundle();
+  MerkleDirectories forward;
+  ASSERT_TRUE(build_merkle_tree(entries, &forward));
+  std::reverse(entries.begin(), entries.end());
+  MerkleDirectories reversed;
+  ASSERT_TRUE(build_merkle_tree(entries, &reversed));
+  EXPECT_EQ(forward, reversed);
+}
+
+TEST(Merkle, JsonListsRootAndDirectories) {
+  MerkleDirectories tree;
+  ASSERT_TRUE(build_merkle_tree({Entry("a", 1, 1)}, &tree));
+  const std::string root = Base64(tree[""]);
+  EXPECT_EQ(merkle_tree_to_json(HashAlgorithm::kBlake2b, tree),
+            "{\"algorithm\":\"blake2b\",\"root\":\"" + root +
+                "\",\"directories\":{\"\":\"" + root + "\"}}");
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "file_hasher.h"
+#include "page_cache.h"
+#include "test_util.h"
+#include "thread_pool.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+const size_t kFileSize = 4 << 20;
+const size_t kWarmSize = 1 << 20;
+
+// Counts resident pages in [begin, end) of the file at path.
+size_t ResidentPages(const std::string& path, size_t begin, size_t end) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  std::vector<unsigned char> pages;
+  EXPECT_TRUE(resident_pages(fd, 0, kFileSize, &pages));
+  close(fd);
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t count = 0;
+  for (size_t i = begin / page; i < end / page; i++) {
+    count += pages[i] & 1;
+  }
+  return count;
+}
+
+// Writes a file, evicts it and reads its first kWarmSize bytes back in, as
+// if the app were using them. Readahead is turned off so that exactly those
+// pages are cached.
+std::string WriteHalfWarmFile(TempDir* dir) {
+  const std::string path = dir->Write("asset.bin", PatternBytes(kFileSize));
+  const int fd = open(path.c_str(), O_RDONLY);
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+  std::string warm(kWarmSize, '\0');
+  EXPECT_EQ(pread(fd, &warm[0], warm.size(), 0),
+            static_cast<ssize_t>(warm.size()));
+  close(fd);
+  return path;
+}
+
+}  // namespace
+
+TEST(PageCache, HashingKeepsOnlyPagesThatWereCached) {
+  for (HashAlgorithm algorithm :
+       {HashAlgorithm::kBlake2b, HashAlgorithm::kBlake3}) {
+    TempDir dir;
+    const std::string path = WriteHalfWarmFile(&dir);
+    const size_t warm_pages = ResidentPages(path, 0, kWarmSize);
+    if (ResidentPages(path, kWarmSize, kFileSize) != 0) {
+      GTEST_SKIP() << "The file system ignores POSIX_FADV_DONTNEED";
+    }
+
+    ThreadPool pool(2);
+    FileHasher hasher(&pool);
+    std::string digest;
+    ASSERT_TRUE(hasher.hash_file(path, algorithm, &digest));
+
+    EXPECT_EQ(ResidentPages(path, 0, kWarmSize), warm_pages);
+    EXPECT_EQ(ResidentPages(path, kWarmSize, kFileSize), 0u);
+  }
+}
+
+TEST(PageCache, CachestatAgreesWithMincore) {
+  TempDir dir;
+  const std::string path = WriteHalfWarmFile(&dir);
+  const int fd = open(path.c_str(), O_RDONLY);
+  uint64_t cached = 0;
+  if (!cached_page_count(fd, 0, kFileSize, &cached)) {
+    close(fd);
+    GTEST_SKIP() << "cachestat is not available";
+  }
+  close(fd);
+  EXPECT_EQ(cached, ResidentPages(path, 0, kFileSize));
+}
+
+}  // namespace test
+}  // namespace desktop_updater
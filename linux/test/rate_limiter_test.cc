@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "file_hasher.h"
+#include "rate_limiter.h"
+#include "test_util.h"
+#include "thread_pool.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+}  // namespace
+
+TEST(TokenBucket, UnlimitedNeverWaits) {
+  TokenBucket bucket;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 1000; i++) {
+    bucket.acquire(1 << 30);
+  }
+  EXPECT_LT(SecondsSince(start), 0.1);
+}
+
+TEST(TokenBucket, HoldsTheAverageRateAfterTheBurst) {
+  TokenBucket bucket(10000);
+  const auto start = std::chrono::steady_clock::now();
+  bucket.acquire(10000);  // the burst
+  for (int i = 0; i < 3; i++) {
+    bucket.acquire(1000);
+  }
+  // The first 1000 go out as debt, the next two wait 0.1 s each.
+  const double elapsed = SecondsSince(start);
+  EXPECT_GE(elapsed, 0.18);
+  EXPECT_LT(elapsed, 0.5);
+}
+
+TEST(TokenBucket, RemovingTheLimitWakesWaiters) {
+  TokenBucket bucket(10);
+  bucket.acquire(10);
+  bucket.acquire(100);  // ten seconds of debt
+
+  const auto start = std::chrono::steady_clock::now();
+  std::thread waiter([&] { bucket.acquire(1); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  bucket.set_rate(0);
+  waiter.join();
+  EXPECT_LT(SecondsSince(start), 1.0);
+}
+
+TEST(IoLimits, HasherReadsAreChargedToDiskLimits) {
+  TempDir dir;
+  const std::string path = dir.Write("asset.bin", PatternBytes(6 << 20));
+  ThreadPool pool(4);
+  IoLimits limits;
+  limits.disk_bytes.set_rate(4 << 20);
+  FileHasher hasher(&pool, nullptr, &limits);
+
+  const auto start = std::chrono::steady_clock::now();
+  std::string digest;
+  ASSERT_TRUE(hasher.hash_file(path, HashAlgorithm::kBlake3, &digest));
+  // One second of burst, then 2 MiB at 4 MiB/s, less one read of debt.
+  const double elapsed = SecondsSince(start);
+  EXPECT_GE(elapsed, 0.3);
+  EXPECT_LT(elapsed, 1.2);
+}
+
+}  // namespace test
+}  // namespace desktop_updater
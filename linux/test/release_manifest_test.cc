@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "file_hasher.h"
+#include "merkle.h"
+#include "release_manifest.h"
+#include "test_util.h"
+#include "thread_pool.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+void MakeDirectory(const TempDir& dir, const std::string& name) {
+  ASSERT_EQ(mkdir((dir.path() + "/" + name).c_str(), 0755), 0);
+}
+
+std::vector<std::string> Paths(const std::vector<FileHashEntry>& entries) {
+  std::vector<std::string> paths;
+  for (const FileHashEntry& entry : entries) {
+    paths.push_back(entry.path);
+  }
+  return paths;
+}
+
+// The order Dart's recursive Directory.list reports files in.
+void ListSequentially(const std::string& root, const std::string& relative,
+                      std::vector<std::string>* out) {
+  DIR* dir = opendir((relative.empty() ? root : root + "/" + relative).c_str());
+  ASSERT_NE(dir, nullptr);
+  while (struct dirent* entry = readdir(dir)) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    const std::string child =
+        relative.empty() ? entry->d_name : relative + "/" + entry->d_name;
+    struct stat st;
+    ASSERT_EQ(lstat((root + "/" + child).c_str(), &st), 0);
+    if (S_ISDIR(st.st_mode)) {
+      ListSequentially(root, child, out);
+    } else {
+      out->push_back(child);
+    }
+  }
+  closedir(dir);
+}
+
+}  // namespace
+
+TEST(ReleaseManifest, LeavesOutTheManifestsAndExcludedPaths) {
+  TempDir dir;
+  MakeDirectory(dir, "data");
+  dir.Write("app", "runner");
+  dir.Write("app.manifest", "sidecar");
+  dir.Write("hashes.json", "[]");
+  dir.Write("tree.json", "{}");
+  dir.Write(".DS_Store", "");
+  dir.Write("data/tree.json", "asset");
+  dir.Write("data/old.hashes.json", "[]");
+  MakeDirectory(dir, "deltas");
+  dir.Write("deltas.json", "[]");
+  dir.Write("deltas/app.delta", "delta");
+  dir.Write("deltas.txt", "asset");
+  ThreadPool pool(2);
+  FileHasher hasher(&pool);
+  ReleaseManifestOptions options;
+  options.excluded_paths = {"app", "app.manifest"};
+  std::vector<FileHashEntry> entries;
+  ASSERT_TRUE(hash_release(&hasher, dir.path(), options, &entries));
+  std::vector<std::string> paths = Paths(entries);
+  std::sort(paths.begin(), paths.end());
+  EXPECT_EQ(paths, (std::vector<std::string>{"data/tree.json", "deltas.txt"}));
+
+  EXPECT_FALSE(hash_release(&hasher, dir.path() + "/missing", options,
+                            &entries));
+}
+
+TEST(ReleaseManifest, RecordsZstdCopiesAsCompressedLengths) {
+  TempDir dir;
+  MakeDirectory(dir, "data");
+  dir.Write("data/a.json", std::string(100, 'a'));
+  dir.Write("data/a.json.zst", std::string(10, 'z'));
+  dir.Write("data/b.json", std::string(50, 'b'));
+  dir.Write("orphan.zst", "z");
+  dir.Write(kZstdDictionaryFileName, "dict");
+  ThreadPool pool(2);
+  FileHasher hasher(&pool);
+  ReleaseManifestOptions options;
+  std::vector<FileHashEntry> entries;
+  ASSERT_TRUE(hash_release(&hasher, dir.path(), options, &entries));
+  EXPECT_EQ(entries.size(), 5u);
+
+  options.zstd_copies = true;
+  ASSERT_TRUE(hash_release(&hasher, dir.path(), options, &entries));
+  ASSERT_EQ(entries.size(), 3u);
+  for (const FileHashEntry& entry : entries) {
+    if (entry.path == "data/a.json") {
+      EXPECT_EQ(entry.length, 100);
+      EXPECT_EQ(entry.compressed_length, 10);
+    } else {
+      EXPECT_TRUE(entry.path == "data/b.json" || entry.path == "orphan.zst")
+          << entry.path;
+      EXPECT_EQ(entry.compressed_length, 0);
+    }
+  }
+}
+
+TEST(ReleaseManifest, InstallCarryingReleaseFilesKeepsTheReleaseRoot) {
+  TempDir release;
+  TempDir install;
+  for (TempDir* dir : {&release, &install}) {
+    MakeDirectory(*dir, "data");
+    MakeDirectory(*dir, "deltas");
+    dir->Write("app", "runner");
+    dir->Write("data/a.json", std::string(100, 'a'));
+    dir->Write("data/a.json.zst", std::string(10, 'z'));
+    dir->Write(kHashesFileName, "[]");
+    dir->Write(kMerkleTreeFileName, "{}");
+    dir->Write(kZstdDictionaryFileName, "dict");
+    dir->Write(kDeltaIndexFileName, "[]");
+    dir->Write("deltas/app.delta", "delta");
+  }
+  // What the updater leaves in an install between check and restart.
+  MakeDirectory(install, "update");
+  MakeDirectory(install, "rollback");
+  install.Write("update/app", "staged");
+  install.Write("rollback/app", "old");
+  install.Write("update.hashes.json", "[]");
+  install.Write("update_script.sh", "#!/bin/sh");
+  ThreadPool pool(2);
+  FileHasher hasher(&pool);
+  ReleaseManifestOptions release_options;
+  release_options.zstd_copies = true;
+  std::vector<FileHashEntry> released;
+  ASSERT_TRUE(hash_release(&hasher, release.path(), release_options,
+                           &released));
+  MerkleDirectories release_tree;
+  ASSERT_TRUE(build_merkle_tree(released, &release_tree));
+
+  // As handle_generate_file_hashes sets them up.
+  HashDirectoryOptions options;
+  exclude_release_files(&options);
+  options.excluded_paths.insert(
+      options.excluded_paths.end(),
+      {"update", "rollback", "update.hashes.json", "update_script.sh"});
+  std::vector<FileHashEntry> installed;
+  ASSERT_TRUE(hasher.hash_directory(install.path(), options, &installed));
+  std::vector<std::string> paths = Paths(installed);
+  std::sort(paths.begin(), paths.end());
+  EXPECT_EQ(paths, (std::vector<std::string>{"app", "data/a.json"}));
+  MerkleDirectories install_tree;
+  ASSERT_TRUE(build_merkle_tree(installed, &install_tree));
+  EXPECT_EQ(install_tree[""], release_tree[""]);
+}
+
+TEST(ReleaseManifest, ParallelListingKeepsTheSequentialOrder) {
+  TempDir dir;
+  for (int i = 0; i < 8; i++) {
+    const std::string top = "d" + std::to_string(i);
+    MakeDirectory(dir, top);
+    dir.Write(top + "/file", std::to_string(i));
+    for (int j = 0; j < 8; j++) {
+      const std::string nested = top + "/n" + std::to_string(j);
+      MakeDirectory(dir, nested);
+      for (int k = 0; k < 4; k++) {
+        dir.Write(nested + "/f" + std::to_string(k), nested);
+      }
+    }
+    dir.Write("f" + std::to_string(i), "top");
+  }
+  std::vector<std::string> expected;
+  ListSequentially(dir.path(), "", &expected);
+  ASSERT_EQ(expected.size(), 8u * (2 + 8 * 4));
+
+  ThreadPool pool(4);
+  FileHasher hasher(&pool);
+  std::vector<FileHashEntry> entries;
+  ASSERT_TRUE(hash_release(&hasher, dir.path(), ReleaseManifestOptions(),
+                           &entries));
+  EXPECT_EQ(Paths(entries), expected);
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+
+#include "restart_metrics.h"
+#include "test_util.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+RestartRecord Record(int64_t base) {
+  RestartRecord record;
+  record.requested_ns = base;
+  record.applied_ns = base + 1;
+  record.warmed_ns = base + 2;
+  record.exited_ns = base + 3;
+  record.started_ns = base + 4;
+  record.registered_ns = base + 5;
+  record.first_frame_ns = base + 6;
+  return record;
+}
+
+}  // namespace
+
+TEST(RestartLog, RoundTripsAndKeepsTheNewestRecords) {
+  TempDir dir;
+  const std::string path = dir.path() + "/cache/app.restarts";
+  RestartLog log;
+  for (size_t i = 0; i < kRestartLogCapacity + 3; i++) {
+    log.add(Record(static_cast<int64_t>(i) * 10));
+  }
+  ASSERT_TRUE(log.save(path));
+
+  RestartLog loaded;
+  ASSERT_TRUE(loaded.load(path));
+  ASSERT_EQ(loaded.records().size(), kRestartLogCapacity);
+  EXPECT_EQ(loaded.records().front().requested_ns, 30);
+  EXPECT_EQ(loaded.records().front().applied_ns, 31);
+  EXPECT_EQ(loaded.records().front().warmed_ns, 32);
+  EXPECT_EQ(loaded.records().back().first_frame_ns,
+            static_cast<int64_t>(kRestartLogCapacity + 2) * 10 + 6);
+  EXPECT_EQ(loaded.pending(), nullptr);
+}
+
+TEST(RestartLog, PendingIsTheUnclaimedNewestRecord) {
+  RestartLog log;
+  EXPECT_EQ(log.pending(), nullptr);
+  RestartRecord record;
+  record.requested_ns = 5;
+  record.exited_ns = 6;
+  log.add(record);
+  ASSERT_NE(log.pending(), nullptr);
+  log.pending()->started_ns = 7;
+  EXPECT_EQ(log.pending(), nullptr);
+  EXPECT_EQ(log.newest()->started_ns, 7);
+}
+
+TEST(RestartLog, ReadsVersionOneLogs) {
+  TempDir dir;
+  std::string data = "DURM";
+  const uint32_t header[2] = {1, 1};
+  const int64_t fields[5] = {10, 11, 12, 13, 14};
+  data.append(reinterpret_cast<const char*>(header), sizeof(header));
+  data.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+  RestartLog log;
+  ASSERT_TRUE(log.load(dir.Write("v1.restarts", data)));
+  ASSERT_EQ(log.records().size(), 1u);
+  const RestartRecord& record = log.records()[0];
+  EXPECT_EQ(record.requested_ns, 10);
+  EXPECT_EQ(record.applied_ns, 0);
+  EXPECT_EQ(record.warmed_ns, 0);
+  EXPECT_EQ(record.exited_ns, 11);
+  EXPECT_EQ(record.first_frame_ns, 14);
+}
+
+TEST(RestartLog, RejectsCorruptFiles) {
+  TempDir dir;
+  RestartLog log;
+  log.add(Record(100));
+  const std::string path = dir.path() + "/app.restarts";
+  ASSERT_TRUE(log.save(path));
+
+  // Truncated record.
+  FILE* file = fopen(path.c_str(), "r+b");
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  fclose(file);
+  ASSERT_EQ(truncate(path.c_str(), size - 1), 0);
+  RestartLog loaded;
+  EXPECT_FALSE(loaded.load(path));
+  EXPECT_TRUE(loaded.records().empty());
+
+  EXPECT_FALSE(loaded.load(dir.Write("bad.restarts", "DURMxxxxxxxxxxxxxxx")));
+  EXPECT_FALSE(loaded.load(dir.path() + "/missing"));
+}
+
+TEST(RestartLog, ProcessStartIsOnTheBoottimeClock) {
+  const int64_t start = process_start_ns();
+  const int64_t now = boottime_ns();
+  ASSERT_GT(start, 0);
+  EXPECT_LE(start, now);
+  // The test binary was started moments ago.
+  EXPECT_LT(now - start, 600ll * 1000000000);
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+
+#include "rollback.h"
+#include "staged_update.h"
+#include "test_util.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+// An install with an update staged in it the way restartApp finds one.
+void StageUpdate(TempDir* dir) {
+  for (const char* name : {"app", "app/lib", "update", "update/lib",
+                           "update/assets", "update/assets/fonts"}) {
+    ASSERT_EQ(mkdir((dir->path() + "/" + name).c_str(), 0755), 0);
+  }
+  dir->Write("app/runner", "old runner");
+  dir->Write("app/lib/libapp.so", "old library");
+  dir->Write("app/kept", "kept");
+  dir->Write("update/runner", "new runner");
+  dir->Write("update/lib/libapp.so", "new library");
+  dir->Write("update/lib/libnew.so", "added library");
+  dir->Write("update/assets/fonts/font.ttf", "added font");
+  ASSERT_EQ(chmod((dir->path() + "/app/runner").c_str(), 0755), 0);
+}
+
+pid_t Spawn(void (*body)(int fd), int* read_fd) {
+  int fds[2];
+  EXPECT_EQ(pipe(fds), 0);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    body(fds[1]);
+    _exit(0);
+  }
+  close(fds[1]);
+  *read_fd = fds[0];
+  return pid;
+}
+
+// Applies an update whose runner is new_runner over one that is
+// old_runner, snapshotting it first. Both are shell scripts.
+void ApplyRunnerUpdate(TempDir* dir, const std::string& old_runner,
+                       const std::string& new_runner) {
+  ASSERT_EQ(mkdir((dir->path() + "/app").c_str(), 0755), 0);
+  ASSERT_EQ(mkdir((dir->path() + "/update").c_str(), 0755), 0);
+  dir->Write("app/runner", "#!/bin/sh\n" + old_runner + "\n");
+  dir->Write("update/runner", "#!/bin/sh\n" + new_runner + "\n");
+  ASSERT_EQ(chmod((dir->path() + "/app/runner").c_str(), 0755), 0);
+  ASSERT_EQ(chmod((dir->path() + "/update/runner").c_str(), 0755), 0);
+  SnapshotStats snapshot_stats;
+  ApplyStats apply_stats;
+  std::string error;
+  ASSERT_TRUE(take_update_snapshot(dir->path() + "/app",
+                                   dir->path() + "/update",
+                                   dir->path() + "/snapshot", &snapshot_stats,
+                                   &error))
+      << error;
+  ASSERT_TRUE(apply_staged_update(dir->path() + "/app",
+                                  dir->path() + "/update", nullptr,
+                                  &apply_stats, &error))
+      << error;
+}
+
+// Runs the supervisor the way restartApp does and returns its exit status.
+int Supervise(TempDir* dir) {
+  const std::string install = dir->path() + "/app";
+  const std::string snapshot = dir->path() + "/snapshot";
+  const std::string runner = install + "/runner";
+  const pid_t pid = fork();
+  if (pid == 0) {
+    execl(DESKTOP_UPDATER_SUPERVISOR, DESKTOP_UPDATER_SUPERVISOR,
+          install.c_str(), snapshot.c_str(), "5000", runner.c_str(),
+          (char*)NULL);
+    _exit(127);
+  }
+  int status = 0;
+  EXPECT_EQ(waitpid(pid, &status, 0), pid);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+}  // namespace
+
+TEST(Rollback, RestoresReplacedFilesAndRemovesAddedOnes) {
+  TempDir dir;
+  StageUpdate(&dir);
+  const std::string install = dir.path() + "/app";
+  const std::string snapshot = dir.path() + "/snapshot";
+
+  SnapshotStats snapshot_stats;
+  std::string error;
+  ASSERT_TRUE(take_update_snapshot(install, dir.path() + "/update", snapshot,
+                                   &snapshot_stats, &error))
+      << error;
+  EXPECT_EQ(snapshot_stats.cloned + snapshot_stats.linked, 2u);
+  EXPECT_EQ(snapshot_stats.added, 2u);  // lib/libnew.so and assets/
+
+  ApplyStats apply_stats;
+  ASSERT_TRUE(apply_staged_update(install, dir.path() + "/update", nullptr,
+                                  &apply_stats, &error))
+      << error;
+  EXPECT_EQ(ReadFile(install + "/runner"), "new runner");
+  EXPECT_EQ(ReadFile(install + "/assets/fonts/font.ttf"), "added font");
+
+  ASSERT_TRUE(restore_update_snapshot(install, snapshot, &error)) << error;
+  EXPECT_EQ(ReadFile(install + "/runner"), "old runner");
+  EXPECT_EQ(ReadFile(install + "/lib/libapp.so"), "old library");
+  EXPECT_EQ(ReadFile(install + "/kept"), "kept");
+  EXPECT_FALSE(Exists(install + "/lib/libnew.so"));
+  EXPECT_FALSE(Exists(install + "/assets"));
+  EXPECT_FALSE(Exists(snapshot));
+  struct stat st;
+  ASSERT_EQ(stat((install + "/runner").c_str(), &st), 0);
+  EXPECT_EQ(st.st_mode & 0777, 0755u);
+}
+
+TEST(Rollback, RestoresAfterAPartialApply) {
+  TempDir dir;
+  StageUpdate(&dir);
+  const std::string install = dir.path() + "/app";
+  const std::string snapshot = dir.path() + "/snapshot";
+  SnapshotStats stats;
+  std::string error;
+  ASSERT_TRUE(take_update_snapshot(install, dir.path() + "/update", snapshot,
+                                   &stats, &error));
+  // Only the runner made it before the apply stopped.
+  ASSERT_EQ(rename((dir.path() + "/update/runner").c_str(),
+                   (install + "/runner").c_str()),
+            0);
+
+  ASSERT_TRUE(restore_update_snapshot(install, snapshot, &error)) << error;
+  EXPECT_EQ(ReadFile(install + "/runner"), "old runner");
+  EXPECT_EQ(ReadFile(install + "/lib/libapp.so"), "old library");
+  EXPECT_FALSE(Exists(snapshot));
+}
+
+TEST(Rollback, SnapshotNeedsAFreshDirectory) {
+  TempDir dir;
+  StageUpdate(&dir);
+  const std::string snapshot = dir.path() + "/snapshot";
+  ASSERT_EQ(mkdir(snapshot.c_str(), 0755), 0);
+  SnapshotStats stats;
+  std::string error;
+  EXPECT_FALSE(take_update_snapshot(dir.path() + "/app",
+                                    dir.path() + "/update", snapshot, &stats,
+                                    &error));
+  discard_update_snapshot(snapshot);
+  EXPECT_FALSE(Exists(snapshot));
+}
+
+TEST(Rollback, TellsHealthyAppsFromFailedOnes) {
+  int fd;
+  pid_t pid = Spawn([](int write_fd) { report_healthy(write_fd); }, &fd);
+  EXPECT_EQ(wait_for_health(fd, pid, 5000), HealthResult::kHealthy);
+  close(fd);
+  waitpid(pid, nullptr, 0);
+
+  pid = Spawn([](int) { _exit(0); }, &fd);
+  EXPECT_EQ(wait_for_health(fd, pid, 5000), HealthResult::kExited);
+  close(fd);
+
+  pid = Spawn([](int) { _exit(3); }, &fd);
+  EXPECT_EQ(wait_for_health(fd, pid, 5000), HealthResult::kFailed);
+  close(fd);
+
+  pid = Spawn([](int) { abort(); }, &fd);
+  EXPECT_EQ(wait_for_health(fd, pid, 5000), HealthResult::kFailed);
+  close(fd);
+
+  pid = Spawn([](int) { pause(); }, &fd);
+  EXPECT_EQ(wait_for_health(fd, pid, 100), HealthResult::kTimedOut);
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+  close(fd);
+}
+
+TEST(Rollback, SupervisorRestartsTheOldVersionWhenTheNewOneFails) {
+  TempDir dir;
+  const std::string marker = dir.path() + "/old_started";
+  ApplyRunnerUpdate(&dir, "echo old > " + marker, "exit 3");
+  EXPECT_EQ(Supervise(&dir), 0);
+  EXPECT_EQ(ReadFile(marker), "old\n");
+  EXPECT_EQ(ReadFile(dir.path() + "/app/runner"),
+            "#!/bin/sh\necho old > " + marker + "\n");
+  EXPECT_FALSE(Exists(dir.path() + "/snapshot"));
+}
+
+TEST(Rollback, SupervisorKeepsAnUpdateThatExitsCleanly) {
+  TempDir dir;
+  ApplyRunnerUpdate(&dir, "true", "exit 0");
+  EXPECT_EQ(Supervise(&dir), 0);
+  EXPECT_FALSE(Exists(dir.path() + "/snapshot"));
+  EXPECT_EQ(ReadFile(dir.path() + "/app/runner"), "#!/bin/sh\nexit 0\n");
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "hash_index.h"
+#include "shared_hash_index.h"
+#include "test_util.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+HashIndexEntry Entry(uint64_t size, char fill) {
+  HashIndexEntry entry;
+  entry.stat.size = size;
+  entry.stat.inode = size + 1;
+  entry.algorithm = HashAlgorithm::kBlake3;
+  entry.digest = std::string(32, fill);
+  return entry;
+}
+
+}  // namespace
+
+TEST(SharedHashIndex, LoadsWhatAnotherInstanceCommitted) {
+  TempDir dir;
+  const std::string path = dir.path() + "/shared.index";
+  SharedHashIndex first(path);
+  HashIndex index;
+  ASSERT_TRUE(first.acquire(&index, 1000));
+  EXPECT_EQ(index.size(), 0u);
+  index.update("lib/app.so", Entry(4096, 'a'));
+  ASSERT_TRUE(first.commit(index));
+
+  SharedHashIndex second(path);
+  HashIndex loaded;
+  ASSERT_TRUE(second.acquire(&loaded, 1000));
+  const HashIndexEntry* entry = loaded.lookup("lib/app.so");
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(entry->stat.size, 4096u);
+  EXPECT_EQ(entry->digest, std::string(32, 'a'));
+}
+
+TEST(SharedHashIndex, CorruptedFileLoadsEmptyAndIsRewritten) {
+  TempDir dir;
+  const std::string path = dir.path() + "/shared.index";
+  HashIndex valid;
+  valid.update("data/a.bin", Entry(10, 'x'));
+  valid.update("data/b.bin", Entry(20, 'y'));
+  const std::string good = valid.serialize();
+
+  std::string flipped = good;
+  flipped[flipped.size() / 2] ^= 0x40;
+  const std::string corruptions[] = {
+      std::string("garbage that is not an index"),
+      good.substr(0, good.size() - 3),
+      flipped,
+      std::string(good.size(), '\0'),
+  };
+  for (const std::string& contents : corruptions) {
+    dir.Write("shared.index", contents);
+    SharedHashIndex shared(path);
+    HashIndex index;
+    index.update("stale", Entry(1, 's'));
+    ASSERT_TRUE(shared.acquire(&index, 1000));
+    EXPECT_EQ(index.size(), 0u);
+
+    index.update("data/a.bin", Entry(10, 'x'));
+    ASSERT_TRUE(shared.commit(index));
+    HashIndex reloaded;
+    ASSERT_TRUE(shared.acquire(&reloaded, 1000));
+    EXPECT_EQ(reloaded.size(), 1u);
+    shared.release();
+  }
+}
+
+TEST(SharedHashIndex, SecondInstanceReusesTheFirstOnesResult) {
+  TempDir dir;
+  const std::string path = dir.path() + "/shared.index";
+  SharedHashIndex computing(path);
+  HashIndex index;
+  ASSERT_TRUE(computing.acquire(&index, 1000));
+
+  bool reused = false;
+  std::thread waiting([&]() {
+    SharedHashIndex other(path);
+    HashIndex loaded;
+    if (other.acquire(&loaded, 5000)) {
+      reused = loaded.lookup("big.bin") != nullptr;
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  index.update("big.bin", Entry(1 << 20, 'b'));
+  ASSERT_TRUE(computing.commit(index));
+  waiting.join();
+  EXPECT_TRUE(reused);
+}
+
+TEST(SharedHashIndex, GivesUpWhenTheLockIsHeldTooLong) {
+  TempDir dir;
+  const std::string path = dir.path() + "/shared.index";
+  SharedHashIndex holder(path);
+  HashIndex index;
+  ASSERT_TRUE(holder.acquire(&index, 1000));
+
+  SharedHashIndex other(path);
+  HashIndex loaded;
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(other.acquire(&loaded, 100));
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(100));
+  EXPECT_FALSE(other.commit(loaded));
+}
+
+TEST(SharedHashIndex, ConcurrentWritersKeepEveryEntry) {
+  TempDir dir;
+  const std::string path = dir.path() + "/shared.index";
+  const int kProcesses = 8;
+  const int kRounds = 25;
+  for (int p = 0; p < kProcesses; p++) {
+    if (fork() == 0) {
+      bool ok = true;
+      for (int round = 0; round < kRounds; round++) {
+        SharedHashIndex shared(path);
+        HashIndex index;
+        ok = ok && shared.acquire(&index, 10000);
+        index.update(std::to_string(p) + "/" + std::to_string(round),
+                     Entry(round, static_cast<char>('a' + p)));
+        ok = ok && shared.commit(index);
+      }
+      _exit(ok ? 0 : 1);
+    }
+  }
+  for (int p = 0; p < kProcesses; p++) {
+    int status = 0;
+    wait(&status);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  SharedHashIndex shared(path);
+  HashIndex index;
+  ASSERT_TRUE(shared.acquire(&index, 1000));
+  EXPECT_EQ(index.size(), static_cast<size_t>(kProcesses * kRounds));
+  const HashIndexEntry* entry = index.lookup("3/7");
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(entry->digest, std::string(32, 'd'));
+}
+
+TEST(SharedHashIndex, NeverFollowsSymlinks) {
+  TempDir dir;
+  const std::string victim = dir.Write("victim", "do not truncate");
+  const std::string path = dir.path() + "/shared.index";
+  ASSERT_EQ(symlink(victim.c_str(), path.c_str()), 0);
+
+  SharedHashIndex shared(path);
+  HashIndex index;
+  EXPECT_FALSE(shared.acquire(&index, 100));
+  index.update("lib/app.so", Entry(4096, 'a'));
+  EXPECT_FALSE(shared.commit(index));
+  char contents[64] = {};
+  FILE* file = fopen(victim.c_str(), "rb");
+  ASSERT_NE(file, nullptr);
+  const size_t read = fread(contents, 1, sizeof(contents) - 1, file);
+  fclose(file);
+  EXPECT_EQ(std::string(contents, read), "do not truncate");
+}
+
+TEST(SharedHashIndex, DistrustsIndexesOtherUsersCanWrite) {
+  TempDir dir;
+  const std::string path = dir.path() + "/shared.index";
+  HashIndex planted;
+  planted.update("lib/app.so", Entry(4096, 'p'));
+  dir.Write("shared.index", planted.serialize());
+
+  SharedHashIndex shared(path);
+  HashIndex index;
+  ASSERT_EQ(chmod(path.c_str(), 0666), 0);
+  EXPECT_FALSE(shared.acquire(&index, 100));
+
+  // A second link could be anyone's file.
+  ASSERT_EQ(chmod(path.c_str(), 0600), 0);
+  const std::string link = dir.path() + "/link";
+  ASSERT_EQ(::link(path.c_str(), link.c_str()), 0);
+  EXPECT_FALSE(shared.acquire(&index, 100));
+  ASSERT_EQ(unlink(link.c_str()), 0);
+  ASSERT_TRUE(shared.acquire(&index, 100));
+  shared.release();
+
+  // Nor is a directory everyone can create files in.
+  ASSERT_EQ(chmod(dir.path().c_str(), 01777), 0);
+  EXPECT_FALSE(shared.acquire(&index, 100));
+  ASSERT_EQ(chmod(dir.path().c_str(), 0700), 0);
+}
+
+TEST(SharedHashIndex, AcceptsOtherOwnersOnlyFromTheProvisionedGroup) {
+  if (geteuid() != 0) {
+    GTEST_SKIP() << "Needs root to create files owned by another user";
+  }
+  TempDir dir;
+  struct stat directory;
+  ASSERT_EQ(stat(dir.path().c_str(), &directory), 0);
+  const std::string path = dir.path() + "/shared.index";
+  HashIndex planted;
+  planted.update("lib/app.so", Entry(4096, 'p'));
+  dir.Write("shared.index", planted.serialize());
+  const uid_t other = 4242;
+
+  SharedHashIndex shared(path);
+  HashIndex index;
+  ASSERT_EQ(chown(path.c_str(), other, directory.st_gid + 1), 0);
+  ASSERT_EQ(chmod(path.c_str(), 0660), 0);
+  EXPECT_FALSE(shared.acquire(&index, 100));
+
+  ASSERT_EQ(chown(path.c_str(), other, directory.st_gid), 0);
+  ASSERT_EQ(chmod(path.c_str(), 0660), 0);
+  ASSERT_TRUE(shared.acquire(&index, 100));
+  EXPECT_NE(index.lookup("lib/app.so"), nullptr);
+}
+
+}  // namespace test
+}  // namespace desktop_updater
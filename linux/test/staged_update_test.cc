@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "staged_update.h"
+#include "test_util.h"
+
+namespace desktop_updater {
+namespace test {
+
+TEST(StagedUpdate, RenamesFilesIntoPlaceAndKeepsPermissions) {
+  TempDir dir;
+  const std::string install = dir.path();
+  mkdir((install + "/lib").c_str(), 0755);
+  mkdir((install + "/update").c_str(), 0755);
+  mkdir((install + "/update/lib").c_str(), 0755);
+  mkdir((install + "/update/data").c_str(), 0755);
+  mkdir((install + "/update/data/new").c_str(), 0755);
+  const std::string app = dir.Write("app", "old app");
+  chmod(app.c_str(), 0755);
+  dir.Write("lib/libapp.so", "old lib");
+  dir.Write("update/app", "new app");
+  dir.Write("update/lib/libapp.so", "new lib");
+  dir.Write("update/data/new/asset.txt", "asset");
+
+  ApplyStats stats;
+  std::string error;
+  ASSERT_TRUE(apply_staged_update(install, install + "/update", nullptr,
+                                  &stats, &error))
+      << error;
+  EXPECT_EQ(stats.renamed, 3u);
+  EXPECT_EQ(stats.copied, 0u);
+  EXPECT_EQ(stats.directories_created, 2u);
+  EXPECT_EQ(ReadFile(app), "new app");
+  EXPECT_EQ(ReadFile(install + "/lib/libapp.so"), "new lib");
+  EXPECT_EQ(ReadFile(install + "/data/new/asset.txt"), "asset");
+  struct stat st;
+  ASSERT_EQ(stat(app.c_str(), &st), 0);
+  EXPECT_EQ(st.st_mode & 0777, 0755u);
+  EXPECT_FALSE(Exists(install + "/update"));
+}
+
+TEST(StagedUpdate, MappedFileKeepsItsContents) {
+  TempDir dir;
+  const std::string old_contents(8192, 'o');
+  const std::string target = dir.Write("libapp.so", old_contents);
+  const std::string staged = dir.Write("staged.so", std::string(8192, 'n'));
+
+  const int fd = open(target.c_str(), O_RDONLY);
+  void* map = mmap(nullptr, old_contents.size(), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  ASSERT_NE(map, MAP_FAILED);
+
+  bool copied = true;
+  ASSERT_TRUE(replace_file(staged, target, nullptr, &copied));
+  EXPECT_FALSE(copied);
+  // The old inode was never written to, so the mapping still sees it.
+  EXPECT_EQ(memcmp(map, old_contents.data(), old_contents.size()), 0);
+  EXPECT_EQ(ReadFile(target), std::string(8192, 'n'));
+  munmap(map, old_contents.size());
+}
+
+TEST(StagedUpdate, CopiesAcrossFileSystems) {
+  TempDir dir;
+  struct stat shm;
+  struct stat tmp;
+  if (stat("/dev/shm", &shm) != 0 || stat(dir.path().c_str(), &tmp) != 0 ||
+      shm.st_dev == tmp.st_dev || access("/dev/shm", W_OK) != 0) {
+    GTEST_SKIP() << "No second writable file system";
+  }
+  const std::string staged =
+      "/dev/shm/desktop_updater_test_" + std::to_string(getpid());
+  {
+    std::ofstream out(staged, std::ios::binary);
+    out << "staged";
+  }
+  const std::string target = dir.Write("asset.bin", "installed");
+  chmod(target.c_str(), 0640);
+
+  MemoryBudget budget(0);
+  bool copied = false;
+  ASSERT_TRUE(replace_file(staged, target, nullptr, &copied, nullptr, &budget));
+  EXPECT_TRUE(copied);
+  // The copy buffer was charged while it was in use.
+  EXPECT_GT(budget.peak(), 0u);
+  EXPECT_EQ(budget.in_use(), 0u);
+  EXPECT_EQ(ReadFile(target), "staged");
+  EXPECT_FALSE(Exists(staged));
+  struct stat st;
+  ASSERT_EQ(stat(target.c_str(), &st), 0);
+  EXPECT_EQ(st.st_mode & 0777, 0640u);
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "page_cache.h"
+#include "startup_profile.h"
+#include "test_util.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+const size_t kFileSize = 1 << 20;
+
+void Evict(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+// Reads [offset, offset + length) without readahead, like a page fault.
+void Touch(const std::string& path, size_t offset, size_t length) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+  std::string data(length, '\0');
+  EXPECT_EQ(pread(fd, &data[0], length, static_cast<off_t>(offset)),
+            static_cast<ssize_t>(length));
+  close(fd);
+}
+
+uint64_t CachedPages(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  std::vector<unsigned char> pages;
+  EXPECT_TRUE(resident_pages(fd, 0, kFileSize, &pages));
+  close(fd);
+  uint64_t count = 0;
+  for (unsigned char page : pages) {
+    count += page & 1;
+  }
+  return count;
+}
+
+}  // namespace
+
+TEST(StartupProfile, RecordsCachedPagesAndWarmsThem) {
+  TempDir dir;
+  mkdir((dir.path() + "/lib").c_str(), 0700);
+  mkdir((dir.path() + "/update").c_str(), 0700);
+  mkdir((dir.path() + "/update/lib").c_str(), 0700);
+  const std::string used = dir.Write("lib/libapp.so", PatternBytes(kFileSize));
+  const std::string unused = dir.Write("unused.bin", PatternBytes(kFileSize));
+  const std::string staged =
+      dir.Write("update/lib/libapp.so", PatternBytes(kFileSize));
+  for (const std::string& path : {used, unused, staged}) {
+    Evict(path);
+  }
+  if (CachedPages(used) != 0) {
+    GTEST_SKIP() << "The file system ignores POSIX_FADV_DONTNEED";
+  }
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  Touch(used, 4 * page, 2 * page);
+
+  std::vector<ProfileExtent> extents;
+  record_startup_profile(dir.path(), {"update"}, &extents);
+  ASSERT_EQ(extents.size(), 1u);
+  EXPECT_EQ(extents[0].path, "lib/libapp.so");
+  EXPECT_EQ(extents[0].offset, 4 * page);
+  EXPECT_EQ(extents[0].length, 2 * page);
+
+  const std::string profile = dir.path() + "/cache/startup.profile";
+  ASSERT_TRUE(write_startup_profile(profile, extents));
+  std::vector<ProfileExtent> loaded;
+  ASSERT_TRUE(read_startup_profile(profile, &loaded));
+  ASSERT_EQ(loaded.size(), 1u);
+  EXPECT_EQ(loaded[0].path, extents[0].path);
+  EXPECT_EQ(loaded[0].length, extents[0].length);
+
+  // The staged copy replaces the installed file, so it is the one warmed.
+  Evict(used);
+  uint64_t requested = 0;
+  const pid_t warmer = warm_startup_profile(
+      dir.path(), dir.path() + "/update", loaded, &requested);
+  ASSERT_GT(warmer, 0);
+  EXPECT_EQ(requested, 2 * page);
+  int status = 0;
+  ASSERT_EQ(waitpid(warmer, &status, 0), warmer);
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  EXPECT_GE(CachedPages(staged), 2u);
+  EXPECT_EQ(CachedPages(used), 0u);
+}
+
+TEST(StartupProfile, RejectsMalformedProfiles) {
+  TempDir dir;
+  std::vector<ProfileExtent> extents;
+  EXPECT_FALSE(read_startup_profile(dir.path() + "/missing", &extents));
+  EXPECT_FALSE(read_startup_profile(dir.Write("bad", "not a profile\n"),
+                                    &extents));
+  EXPECT_FALSE(read_startup_profile(
+      dir.Write("truncated", "desktop_updater startup profile 1\n4096\n"),
+      &extents));
+}
+
+}  // namespace test
+}  // namespace desktop_updater
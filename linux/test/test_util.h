@@ -0,0 +1,73 @@
+#ifndef DESKTOP_UPDATER_TEST_TEST_UTIL_H_
+#define DESKTOP_UPDATER_TEST_TEST_UTIL_H_
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <string>
+
+namespace desktop_updater {
+namespace test {
+
+// Creates a scratch directory that is removed when the fixture goes away.
+class TempDir {
+ public:
+  TempDir() {
+    char tmpl[] = "/tmp/desktop_updater_test_XXXXXX";
+    path_ = mkdtemp(tmpl);
+  }
+  ~TempDir() {
+    int result = system(("rm -rf '" + path_ + "'").c_str());
+    (void)result;
+  }
+
+  const std::string& path() const { return path_; }
+
+  std::string Write(const std::string& name, const std::string& contents) {
+    const std::string full = path_ + "/" + name;
+    FILE* file = fopen(full.c_str(), "wb");
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+    return full;
+  }
+
+ private:
+  std::string path_;
+};
+
+// Contents of the file at path; empty if it cannot be read.
+inline std::string ReadFile(const std::string& path) {
+  std::string data;
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return data;
+  }
+  char buffer[65536];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.append(buffer, read);
+  }
+  fclose(file);
+  return data;
+}
+
+// Whether anything, even a dangling symlink, is at path.
+inline bool Exists(const std::string& path) {
+  struct stat st;
+  return lstat(path.c_str(), &st) == 0;
+}
+
+// Bytes i % 251, the pattern the reference digests in the tests use.
+inline std::string PatternBytes(size_t length) {
+  std::string data(length, '\0');
+  for (size_t i = 0; i < length; i++) {
+    data[i] = static_cast<char>(i % 251);
+  }
+  return data;
+}
+
+}  // namespace test
+}  // namespace desktop_updater
+
+#endif  // DESKTOP_UPDATER_TEST_TEST_UTIL_H_
@@ -0,0 +1,789 @@
+// Runs a whole update -- check, diff, download, verify, apply and relaunch --
+// against an update host and reports how long each phase took, so update
+// performance can be measured offline and compared between changes.
+//
+//   desktop_updater_update_bench --install DIR
+//       (--archive URL | --serve DIR [server options])
+//       [--connections N] [--order planned|largest|listing]
+//       [--current-version N] [--relaunch COMMAND]
+//
+// With --serve, DIR is served by an in-process UpdateServer that takes the
+// same --latency-ms, --connection-rate, --total-rate, --fail-every,
+// --fail-mode, --no-ranges and --http2 options as
+// desktop_updater_update_server. --connections is how many files are
+// requested at once, like FileDownloader's concurrency. --order is the
+// order they are started in: planned by plan_work for downloads, as
+// updateAppFunction does on Linux (the default), largest first, or as
+// hashes.json lists them.
+// Item URLs in app-archive.json may be relative to the archive's URL.
+//
+//   desktop_updater_update_bench --make-fixture DIR [--files N]
+//       [--file-size BYTES] [--changed PERCENT] [--huge N] [--algorithm NAME]
+//       [--compress]
+//
+// writes DIR/install and DIR/server, a synthetic install and a release of
+// it in which the given share of the files changed, plus N new files 64
+// times the size, to run the above with
+// --install DIR/install --serve DIR/server. With --compress the files are
+// JSON text, published with a shared zstd dictionary like bin/archive.dart
+// does, and the download phase fetches the compressed copies.
+//
+//   desktop_updater_update_bench --event-ring [--producers N] [--events N]
+//
+// has N producer threads post events to a consumer that waits on them like
+// the GTK main loop does, once through the plugin's EventRing and once
+// through a mutex-protected queue that wakes the consumer per event, as a
+// g_idle_add per event would. Reports throughput, wakeups and the time from
+// post to handling.
+
+#include <curl/curl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zdict.h>
+#include <zstd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "downloader.h"
+#include "event_ring.h"
+#include "file_hasher.h"
+#include "hash_index.h"
+#include "manifest.h"
+#include "staged_update.h"
+#include "thread_pool.h"
+#include "update_server.h"
+#include "work_scheduler.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const char kStagingDirectory[] = "update";
+// Name bin/archive.dart publishes a release's zstd dictionary under.
+const char kDictionaryFileName[] = "update.dict";
+
+struct BenchOptions {
+  std::string install;
+  std::string archive_url;
+  std::string serve_root;
+  UpdateServerOptions server;
+  int connections = 64;
+  std::string order = "planned";
+  int64_t current_version = -1;
+  std::string relaunch;
+};
+
+struct Phase {
+  const char* name;
+  double ms;
+};
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+size_t AppendToString(char* data, size_t size, size_t count, void* out) {
+  static_cast<std::string*>(out)->append(data, size * count);
+  return size * count;
+}
+
+// GETs url into body. Returns false on transport errors and non-2xx.
+bool FetchToString(CURL* curl, const std::string& url, std::string* body) {
+  body->clear();
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, AppendToString);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, body);
+  long status = 0;
+  return curl_easy_perform(curl) == CURLE_OK &&
+         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status) ==
+             CURLE_OK &&
+         status >= 200 && status < 300;
+}
+
+// Encodes each path segment like Uri.encodeComponent in FileDownloader.
+std::string EncodePath(const std::string& path) {
+  static const char kHex[] = "0123456789ABCDEF";
+  std::string out;
+  for (unsigned char c : path) {
+    if (isalnum(c) || strchr("-_.!~*'()/", c) != nullptr) {
+      out.push_back(static_cast<char>(c));
+    } else {
+      out.push_back('%');
+      out.push_back(kHex[c >> 4]);
+      out.push_back(kHex[c & 15]);
+    }
+  }
+  return out;
+}
+
+// Resolves an item URL that may be relative to the archive's URL.
+std::string ResolveUrl(const std::string& base, const std::string& url) {
+  if (url.find("://") != std::string::npos) {
+    return url;
+  }
+  return base.substr(0, base.rfind('/') + 1) + url;
+}
+
+bool RemoveTree(const std::string& path) {
+  const std::string command = "rm -rf '" + path + "'";
+  return system(command.c_str()) == 0;
+}
+
+bool WriteFile(const std::string& path, const std::string& data) {
+  if (!make_parent_directories(path)) {
+    return false;
+  }
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  const bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  return fclose(file) == 0 && ok;
+}
+
+bool ReadFile(const std::string& path, std::string* data) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  char buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data->append(buffer, n);
+  }
+  const bool ok = ferror(file) == 0;
+  fclose(file);
+  return ok;
+}
+
+// Deterministic, poorly compressible file contents.
+std::string FixtureBytes(size_t length, uint64_t seed) {
+  std::string data(length, '\0');
+  uint64_t state = seed * 0x9e3779b97f4a7c15ull + 1;
+  for (size_t i = 0; i < length; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    data[i] = static_cast<char>(state);
+  }
+  return data;
+}
+
+// Deterministic JSON records, as repetitive across files as the asset
+// manifests and SVGs of a Flutter bundle.
+std::string FixtureText(size_t length, uint64_t seed) {
+  static const char* const kKinds[] = {"glyph", "path", "group", "image"};
+  std::string data = "[";
+  uint64_t state = seed * 0x9e3779b97f4a7c15ull + 1;
+  while (data.size() < length) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    char record[160];
+    snprintf(record, sizeof(record),
+             "%s{\"id\":%llu,\"kind\":\"%s\",\"width\":%u,\"fill\":"
+             "\"#%06x\",\"visible\":%s}",
+             data.size() > 1 ? "," : "",
+             static_cast<unsigned long long>(state % 100000), kKinds[state % 4],
+             static_cast<unsigned>(state >> 20) % 1024,
+             static_cast<unsigned>(state >> 32) & 0xffffff,
+             state & 1 ? "true" : "false");
+    data += record;
+  }
+  data.resize(length - 1);
+  return data + "]";
+}
+
+// Trains a dictionary on the files of entries and publishes each as
+// "<path>.zst" where that saves at least a tenth, recording its size.
+bool PublishCompressed(const std::string& release,
+                       std::vector<FileHashEntry>* entries) {
+  std::string samples;
+  std::vector<size_t> sizes;
+  std::vector<std::string> contents;
+  for (const FileHashEntry& entry : *entries) {
+    std::string data;
+    if (!ReadFile(release + "/" + entry.path, &data)) {
+      return false;
+    }
+    samples += data;
+    sizes.push_back(data.size());
+    contents.push_back(data);
+  }
+  std::string dictionary(110 << 10, '\0');
+  const size_t dictionary_size = ZDICT_trainFromBuffer(
+      &dictionary[0], dictionary.size(), samples.data(), sizes.data(),
+      static_cast<unsigned>(sizes.size()));
+  if (ZDICT_isError(dictionary_size)) {
+    fprintf(stderr, "cannot train a dictionary: %s\n",
+            ZDICT_getErrorName(dictionary_size));
+    return false;
+  }
+  dictionary.resize(dictionary_size);
+  if (!WriteFile(release + "/" + kDictionaryFileName, dictionary)) {
+    return false;
+  }
+  std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> context(
+      ZSTD_createCCtx(), ZSTD_freeCCtx);
+  for (size_t i = 0; i < entries->size(); i++) {
+    const std::string& data = contents[i];
+    std::string compressed(ZSTD_compressBound(data.size()), '\0');
+    const size_t size = ZSTD_compress_usingDict(
+        context.get(), &compressed[0], compressed.size(), data.data(),
+        data.size(), dictionary.data(), dictionary.size(), 19);
+    if (ZSTD_isError(size)) {
+      return false;
+    }
+    if (size * 10 > data.size() * 9) {
+      continue;
+    }
+    compressed.resize(size);
+    if (!WriteFile(release + "/" + (*entries)[i].path + ".zst", compressed)) {
+      return false;
+    }
+    (*entries)[i].compressed_length = static_cast<int64_t>(size);
+  }
+  return true;
+}
+
+int MakeFixture(const std::string& dir, int files, size_t file_size,
+                int changed_percent, int huge, HashAlgorithm algorithm,
+                bool compress) {
+  const std::string install = dir + "/install";
+  const std::string release = dir + "/server/release";
+  RemoveTree(install);
+  RemoveTree(dir + "/server");
+  std::string (*contents)(size_t, uint64_t) =
+      compress ? FixtureText : FixtureBytes;
+  for (int i = 0; i < files; i++) {
+    char name[64];
+    snprintf(name, sizeof(name), compress ? "/data/asset_%04d.json"
+                                          : "/lib/part_%04d.bin",
+             i);
+    const std::string old_data = contents(file_size, i);
+    const bool changed = i * 100 < files * changed_percent;
+    if (!WriteFile(install + name, old_data) ||
+        !WriteFile(release + name,
+                   changed ? contents(file_size, files + i) : old_data)) {
+      fprintf(stderr, "cannot write the fixture below %s\n", dir.c_str());
+      return 1;
+    }
+  }
+  for (int i = 0; i < huge; i++) {
+    char name[64];
+    snprintf(name, sizeof(name), compress ? "/data/huge_%02d.json"
+                                          : "/lib/huge_%02d.bin",
+             i);
+    if (!WriteFile(release + name, contents(64 * file_size, 2 * files + i))) {
+      fprintf(stderr, "cannot write the fixture below %s\n", dir.c_str());
+      return 1;
+    }
+  }
+
+  ThreadPool pool;
+  FileHasher hasher(&pool);
+  HashDirectoryOptions options;
+  options.algorithm = algorithm;
+  std::vector<FileHashEntry> entries;
+  if (!hasher.hash_directory(release, options, &entries) ||
+      (compress && !PublishCompressed(release, &entries)) ||
+      !write_manifest_json(release + "/hashes.json", entries) ||
+      !WriteFile(dir + "/server/app-archive.json",
+                 "{\"appName\":\"bench\",\"description\":\"\",\"items\":[{"
+                 "\"version\":\"1.0.1\",\"shortVersion\":2,\"changes\":[],"
+                 "\"date\":\"2025-01-01\",\"mandatory\":false,"
+                 "\"url\":\"release\",\"platform\":\"linux\"}]}")) {
+    fprintf(stderr, "cannot write the fixture manifests\n");
+    return 1;
+  }
+  printf("fixture: %d %s files of %zu bytes, %d%% changed, %d new of %zu "
+         "bytes\n",
+         files, compress ? "compressed text" : "binary", file_size,
+         changed_percent, huge, 64 * file_size);
+  return 0;
+}
+
+int RunBench(const BenchOptions& options) {
+  std::unique_ptr<UpdateServer> server;
+  std::string archive_url = options.archive_url;
+  if (!options.serve_root.empty()) {
+    UpdateServerOptions server_options = options.server;
+    server_options.root = options.serve_root;
+    server.reset(new UpdateServer(server_options));
+    if (!server->Start()) {
+      fprintf(stderr, "cannot start the update server\n");
+      return 1;
+    }
+    archive_url = server->url() + "/app-archive.json";
+  }
+
+  std::vector<Phase> phases;
+  std::unique_ptr<CURL, void (*)(CURL*)> handle(curl_easy_init(),
+                                                curl_easy_cleanup);
+  CURL* curl = handle.get();
+  std::string body;
+
+  // check
+  Clock::time_point start = Clock::now();
+  std::vector<AppArchiveItem> items;
+  if (!FetchToString(curl, archive_url, &body) ||
+      !parse_app_archive_json(body, &items)) {
+    fprintf(stderr, "cannot read %s\n", archive_url.c_str());
+    return 1;
+  }
+  const AppArchiveItem* latest = latest_archive_item(items, "linux");
+  if (latest == nullptr) {
+    fprintf(stderr, "no linux release in %s\n", archive_url.c_str());
+    return 1;
+  }
+  if (latest->short_version <= options.current_version) {
+    printf("up to date at %s\n", latest->version.c_str());
+    return 0;
+  }
+  const std::string release = ResolveUrl(archive_url, latest->url);
+  phases.push_back({"check", MillisecondsSince(start)});
+
+  // diff
+  start = Clock::now();
+  std::vector<FileHashEntry> remote;
+  if (!FetchToString(curl, release + "/hashes.json", &body) ||
+      !parse_manifest_json(body, &remote)) {
+    fprintf(stderr, "cannot read %s/hashes.json\n", release.c_str());
+    return 1;
+  }
+  HashDirectoryOptions hash_options;
+  if (!remote.empty()) {
+    hash_options.algorithm = remote[0].algorithm;
+  }
+  ThreadPool pool;
+  FileHasher hasher(&pool);
+  const std::string staging = options.install + "/" + kStagingDirectory;
+  RemoveTree(staging);
+  std::vector<FileHashEntry> local;
+  if (!hasher.hash_directory(options.install, hash_options, &local)) {
+    fprintf(stderr, "cannot hash %s\n", options.install.c_str());
+    return 1;
+  }
+  const std::vector<FileHashEntry> changes =
+      diff_manifests(local, remote, nullptr);
+  phases.push_back({"diff", MillisecondsSince(start)});
+
+  // download
+  start = Clock::now();
+  // As many callers as FileDownloader runs at once, sharing one Downloader
+  // like the plugin does.
+  Downloader downloader;
+  DownloadOptions compressed_options;
+  compressed_options.dictionary_url =
+      release + "/" + kDictionaryFileName;
+  std::atomic<size_t> next(0);
+  std::atomic<uint64_t> bytes(0);
+  std::atomic<int> retries(0);
+  std::atomic<bool> failed(false);
+  std::vector<std::thread> workers;
+  const int connections =
+      std::max(1, std::min<int>(options.connections,
+                                static_cast<int>(changes.size())));
+  std::vector<uint64_t> sizes;
+  for (const FileHashEntry& entry : changes) {
+    sizes.push_back(static_cast<uint64_t>(
+        entry.compressed_length > 0 ? entry.compressed_length : entry.length));
+  }
+  std::vector<size_t> order(changes.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  if (options.order == "planned") {
+    order = plan_work(sizes, default_work_cost(WorkKind::kDownload),
+                      static_cast<size_t>(connections))
+                .order;
+  } else if (options.order == "largest") {
+    std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) {
+      return sizes[a] > sizes[b];
+    });
+  }
+  for (int i = 0; i < connections; i++) {
+    workers.emplace_back([&]() {
+      for (size_t index = next++; index < changes.size(); index = next++) {
+        const FileHashEntry& entry = changes[order[index]];
+        const std::string target = staging + "/" + entry.path;
+        const bool compressed = entry.compressed_length > 0;
+        const std::string url = release + "/" + EncodePath(entry.path) +
+                                (compressed ? ".zst" : "");
+        DownloadProgress progress;
+        DownloadStats stats;
+        std::string error;
+        if (!make_parent_directories(target) ||
+            !downloader.download(
+                url, target,
+                static_cast<uint64_t>(compressed ? entry.compressed_length
+                                                 : entry.length),
+                compressed ? compressed_options : DownloadOptions(),
+                &progress, &stats, &error)) {
+          fprintf(stderr, "cannot download %s: %s\n", url.c_str(),
+                  error.c_str());
+          failed = true;
+        }
+        bytes += stats.bytes;
+        retries += stats.retries;
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  if (failed) {
+    return 1;
+  }
+  const double download_ms = MillisecondsSince(start);
+  phases.push_back({"download", download_ms});
+
+  // verify
+  start = Clock::now();
+  for (const FileHashEntry& entry : changes) {
+    std::string digest;
+    if (!hasher.hash_file(staging + "/" + entry.path, entry.algorithm,
+                          &digest) ||
+        base64_encode(reinterpret_cast<const uint8_t*>(digest.data()),
+                      digest.size()) != entry.calculated_hash) {
+      fprintf(stderr, "%s does not match hashes.json\n", entry.path.c_str());
+      return 1;
+    }
+  }
+  phases.push_back({"verify", MillisecondsSince(start)});
+
+  // apply
+  start = Clock::now();
+  ApplyStats apply_stats;
+  std::string error;
+  if (!changes.empty() &&
+      !apply_staged_update(options.install, staging, nullptr, &apply_stats,
+                           &error)) {
+    fprintf(stderr, "apply failed: %s\n", error.c_str());
+    return 1;
+  }
+  phases.push_back({"apply", MillisecondsSince(start)});
+
+  // relaunch
+  if (!options.relaunch.empty()) {
+    start = Clock::now();
+    const int status = system(options.relaunch.c_str());
+    if (status != 0) {
+      fprintf(stderr, "relaunch command exited with %d\n", status);
+      return 1;
+    }
+    phases.push_back({"relaunch", MillisecondsSince(start)});
+  }
+
+  double total = 0;
+  for (const Phase& phase : phases) {
+    printf("%-9s %10.1f ms\n", phase.name, phase.ms);
+    total += phase.ms;
+  }
+  printf("%-9s %10.1f ms\n", "total", total);
+  printf("%zu of %zu files changed, %llu bytes downloaded (%.1f MB/s), "
+         "%d retries, %zu renamed, %zu copied\n",
+         changes.size(), remote.size(),
+         static_cast<unsigned long long>(bytes.load()),
+         download_ms > 0 ? bytes / download_ms / 1000.0 : 0.0, retries.load(),
+         apply_stats.renamed, apply_stats.copied);
+  if (server) {
+    server->Stop();
+    const UpdateServerStats stats = server->stats();
+    printf("server: %llu requests (%llu ranged, %llu failed) on %llu "
+           "connections (%llu HTTP/2, up to %llu streams)\n",
+           static_cast<unsigned long long>(stats.requests),
+           static_cast<unsigned long long>(stats.range_requests),
+           static_cast<unsigned long long>(stats.failures),
+           static_cast<unsigned long long>(stats.connections),
+           static_cast<unsigned long long>(stats.http2_connections),
+           static_cast<unsigned long long>(stats.peak_streams));
+  }
+  return 0;
+}
+
+// Post times of the events in flight, by event number, and how long each
+// took to be handled. Written by the consumer thread only, apart from the
+// post times, which the queue under test orders.
+struct EventBenchState {
+  std::vector<int64_t> posted_ns;
+  std::vector<int64_t> latency_ns;
+  size_t handled = 0;
+};
+
+EventBenchState* g_event_bench = nullptr;
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+void HandleBenchEvent(void* data) {
+  const size_t id = reinterpret_cast<uintptr_t>(data);
+  g_event_bench->latency_ns[id] = NowNs() - g_event_bench->posted_ns[id];
+  g_event_bench->handled++;
+}
+
+// The baseline: a locked queue and one wakeup per event.
+class LockedEventQueue {
+ public:
+  LockedEventQueue() : wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+  ~LockedEventQueue() { close(wake_fd_); }
+
+  int wake_fd() const { return wake_fd_; }
+
+  void push(const MainLoopEvent& event) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      events_.push_back(event);
+    }
+    const uint64_t one = 1;
+    ssize_t written = write(wake_fd_, &one, sizeof(one));
+    (void)written;
+  }
+
+  // Runs at most max_events, like EventRing::drain, and wakes the next
+  // drain if more are left.
+  size_t drain(size_t max_events) {
+    uint64_t count;
+    ssize_t read_bytes = read(wake_fd_, &count, sizeof(count));
+    (void)read_bytes;
+    std::vector<MainLoopEvent> batch;
+    bool more;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const size_t take = std::min(max_events, events_.size());
+      batch.assign(events_.begin(), events_.begin() + take);
+      events_.erase(events_.begin(), events_.begin() + take);
+      more = !events_.empty();
+    }
+    for (const MainLoopEvent& event : batch) {
+      event.run(event.data);
+    }
+    if (more) {
+      const uint64_t one = 1;
+      ssize_t written = write(wake_fd_, &one, sizeof(one));
+      (void)written;
+    }
+    return batch.size();
+  }
+
+ private:
+  int wake_fd_;
+  std::mutex mutex_;
+  std::deque<MainLoopEvent> events_;
+};
+
+// Events run per main loop dispatch, as in the plugin.
+const size_t kEventsPerDispatch = 1024;
+
+template <typename Queue>
+void RunEventQueue(const char* name, Queue* queue, int producers,
+                   size_t events_per_producer) {
+  const size_t total = producers * events_per_producer;
+  EventBenchState state;
+  state.posted_ns.assign(total, 0);
+  state.latency_ns.assign(total, 0);
+  g_event_bench = &state;
+
+  const Clock::time_point start = Clock::now();
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([queue, &state, p, events_per_producer]() {
+      for (size_t i = 0; i < events_per_producer; i++) {
+        const size_t id = p * events_per_producer + i;
+        state.posted_ns[id] = NowNs();
+        MainLoopEvent event;
+        event.run = HandleBenchEvent;
+        event.data = reinterpret_cast<void*>(static_cast<uintptr_t>(id));
+        queue->push(event);
+      }
+    });
+  }
+  size_t wakeups = 0;
+  while (state.handled < total) {
+    struct pollfd poll_fd = {queue->wake_fd(), POLLIN, 0};
+    if (poll(&poll_fd, 1, -1) == 1) {
+      queue->drain(kEventsPerDispatch);
+      wakeups++;
+    }
+  }
+  const double ms = MillisecondsSince(start);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  g_event_bench = nullptr;
+
+  std::sort(state.latency_ns.begin(), state.latency_ns.end());
+  printf("%-7s %8.1f ms  %6.2f M events/s  %8zu wakeups (%6.1f events "
+         "each)  latency p50 %7.1f us  p99 %8.1f us  max %8.1f us\n",
+         name, ms, total / ms / 1000.0, wakeups,
+         static_cast<double>(total) / wakeups,
+         state.latency_ns[total / 2] / 1000.0,
+         state.latency_ns[total * 99 / 100] / 1000.0,
+         state.latency_ns[total - 1] / 1000.0);
+}
+
+int RunEventRingBench(int producers, size_t events_per_producer) {
+  printf("%d producers, %zu events each\n", producers, events_per_producer);
+  EventRing ring(16384);
+  RunEventQueue("ring", &ring, producers, events_per_producer);
+  LockedEventQueue locked;
+  RunEventQueue("locked", &locked, producers, events_per_producer);
+  return 0;
+}
+
+void Usage() {
+  fprintf(stderr,
+          "usage: desktop_updater_update_bench --install DIR "
+          "(--archive URL | --serve DIR)\n"
+          "    [--latency-ms N] [--connection-rate BYTES] "
+          "[--total-rate BYTES]\n"
+          "    [--fail-every N] [--fail-mode status|reset] [--no-ranges] "
+          "[--http2]\n"
+          "    [--connections N] [--order planned|largest|listing]\n"
+          "    [--current-version N] [--relaunch COMMAND]\n"
+          "       desktop_updater_update_bench --make-fixture DIR "
+          "[--files N]\n"
+          "    [--file-size BYTES] [--changed PERCENT] [--huge N]\n"
+          "    [--algorithm NAME] [--compress]\n"
+          "       desktop_updater_update_bench --event-ring [--producers N] "
+          "[--events N]\n");
+}
+
+}  // namespace
+
+int Main(int argc, char** argv) {
+  BenchOptions options;
+  std::string fixture;
+  int files = 200;
+  size_t file_size = 1 << 20;
+  int changed_percent = 25;
+  int huge = 0;
+  HashAlgorithm algorithm = HashAlgorithm::kBlake3;
+  bool compress = false;
+  bool event_ring = false;
+  int producers = 8;
+  size_t events = 100000;
+  for (int i = 1; i < argc; i++) {
+    const std::string flag = argv[i];
+    if (flag == "--compress") {
+      compress = true;
+      continue;
+    }
+    if (flag == "--event-ring") {
+      event_ring = true;
+      continue;
+    }
+    if (flag == "--no-ranges") {
+      options.server.ignore_ranges = true;
+      continue;
+    }
+    if (flag == "--http2") {
+      options.server.http2 = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      Usage();
+      return 2;
+    }
+    const std::string value = argv[++i];
+    const long long number = atoll(value.c_str());
+    if (flag == "--install") {
+      options.install = value;
+    } else if (flag == "--archive") {
+      options.archive_url = value;
+    } else if (flag == "--serve") {
+      options.serve_root = value;
+    } else if (flag == "--latency-ms") {
+      options.server.latency_ms = static_cast<int>(number);
+    } else if (flag == "--connection-rate") {
+      options.server.connection_bytes_per_second = number;
+    } else if (flag == "--total-rate") {
+      options.server.total_bytes_per_second = number;
+    } else if (flag == "--fail-every") {
+      options.server.failure_every = static_cast<int>(number);
+    } else if (flag == "--fail-mode" && value == "status") {
+      options.server.failure_mode = FailureMode::kStatus;
+    } else if (flag == "--fail-mode" && value == "reset") {
+      options.server.failure_mode = FailureMode::kReset;
+    } else if (flag == "--connections") {
+      options.connections = static_cast<int>(number);
+    } else if (flag == "--order" &&
+               (value == "planned" || value == "largest" ||
+                value == "listing")) {
+      options.order = value;
+    } else if (flag == "--current-version") {
+      options.current_version = number;
+    } else if (flag == "--relaunch") {
+      options.relaunch = value;
+    } else if (flag == "--make-fixture") {
+      fixture = value;
+    } else if (flag == "--files") {
+      files = static_cast<int>(number);
+    } else if (flag == "--file-size") {
+      file_size = static_cast<size_t>(number);
+    } else if (flag == "--changed") {
+      changed_percent = static_cast<int>(number);
+    } else if (flag == "--huge") {
+      huge = static_cast<int>(number);
+    } else if (flag == "--algorithm" && parse_hash_algorithm(value, &algorithm)) {
+      continue;
+    } else if (flag == "--producers") {
+      producers = static_cast<int>(number);
+    } else if (flag == "--events") {
+      events = static_cast<size_t>(number);
+    } else {
+      Usage();
+      return 2;
+    }
+  }
+
+  if (event_ring) {
+    if (producers < 1 || events < 1) {
+      Usage();
+      return 2;
+    }
+    return RunEventRingBench(producers, events);
+  }
+  if (!fixture.empty()) {
+    return MakeFixture(fixture, files, file_size, changed_percent, huge,
+                       algorithm, compress);
+  }
+  if (options.install.empty() ||
+      options.archive_url.empty() == options.serve_root.empty()) {
+    Usage();
+    return 2;
+  }
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  const int result = RunBench(options);
+  curl_global_cleanup();
+  return result;
+}
+
+}  // namespace test
+}  // namespace desktop_updater
+
+int main(int argc, char** argv) {
+  return desktop_updater::test::Main(argc, argv);
+}
@@ -0,0 +1,855 @@
+#include "update_server.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <nghttp2/nghttp2.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t kMaxRequestHead = 16 * 1024;
+const size_t kSendChunk = 64 * 1024;
+const int kDefaultStreamWeight = 16;
+
+std::string Lowercase(std::string text) {
+  std::transform(text.begin(), text.end(), text.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return text;
+}
+
+std::string Trim(const std::string& text) {
+  const size_t begin = text.find_first_not_of(" \t");
+  if (begin == std::string::npos) {
+    return std::string();
+  }
+  const size_t end = text.find_last_not_of(" \t");
+  return text.substr(begin, end - begin + 1);
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Decodes the path of a request target and rejects anything that could
+// leave the served root.
+bool DecodePath(const std::string& target, std::string* path) {
+  const std::string raw = target.substr(0, target.find_first_of("?#"));
+  if (raw.empty() || raw[0] != '/') {
+    return false;
+  }
+  path->clear();
+  for (size_t i = 0; i < raw.size(); i++) {
+    if (raw[i] != '%') {
+      path->push_back(raw[i]);
+      continue;
+    }
+    if (i + 2 >= raw.size() || HexValue(raw[i + 1]) < 0 ||
+        HexValue(raw[i + 2]) < 0) {
+      return false;
+    }
+    path->push_back(
+        static_cast<char>(HexValue(raw[i + 1]) * 16 + HexValue(raw[i + 2])));
+    i += 2;
+  }
+  if (path->find('\0') != std::string::npos) {
+    return false;
+  }
+  const std::string wrapped = *path + "/";
+  return wrapped.find("/../") == std::string::npos;
+}
+
+bool ParseNumber(const std::string& text, uint64_t* value) {
+  if (text.empty() ||
+      text.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  errno = 0;
+  *value = strtoull(text.c_str(), nullptr, 10);
+  return errno == 0;
+}
+
+// Decodes the unpadded base64url of an HTTP2-Settings header.
+bool DecodeBase64Url(const std::string& text, std::string* out) {
+  out->clear();
+  uint32_t bits = 0;
+  int count = 0;
+  for (char c : text) {
+    int value;
+    if (c >= 'A' && c <= 'Z') {
+      value = c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+      value = c - 'a' + 26;
+    } else if (c >= '0' && c <= '9') {
+      value = c - '0' + 52;
+    } else if (c == '-') {
+      value = 62;
+    } else if (c == '_') {
+      value = 63;
+    } else {
+      return false;
+    }
+    bits = (bits << 6) | static_cast<uint32_t>(value);
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out->push_back(static_cast<char>((bits >> count) & 0xff));
+    }
+  }
+  return true;
+}
+
+const char* StatusText(int status) {
+  switch (status) {
+    case 200:
+      return "200 OK";
+    case 206:
+      return "206 Partial Content";
+    case 404:
+      return "404 Not Found";
+    case 405:
+      return "405 Method Not Allowed";
+    case 416:
+      return "416 Range Not Satisfiable";
+    default:
+      return "503 Service Unavailable";
+  }
+}
+
+// One request on an HTTP/2 connection.
+struct Http2Stream {
+  std::string method;
+  std::string path;
+  std::string range;
+  int weight = kDefaultStreamWeight;
+  // Set once the request is complete; the response goes out at ready.
+  bool requested = false;
+  bool responded = false;
+  Clock::time_point ready;
+  int file = -1;
+  uint64_t offset = 0;
+  uint64_t end = 0;
+  // Where the stream is reset to inject a failure, or end.
+  uint64_t stop_at = 0;
+};
+
+struct Http2Connection {
+  std::map<int32_t, Http2Stream> streams;
+  int latency_ms = 0;
+  std::atomic<uint64_t>* bytes_sent = nullptr;
+};
+
+int OnBeginHeaders(nghttp2_session*, const nghttp2_frame* frame,
+                   void* user_data) {
+  Http2Connection* connection = static_cast<Http2Connection*>(user_data);
+  if (frame->hd.type == NGHTTP2_HEADERS &&
+      frame->headers.cat == NGHTTP2_HCAT_REQUEST) {
+    Http2Stream& stream = connection->streams[frame->hd.stream_id];
+    if (frame->hd.flags & NGHTTP2_FLAG_PRIORITY) {
+      stream.weight = frame->headers.pri_spec.weight;
+    }
+  }
+  return 0;
+}
+
+int OnHeader(nghttp2_session*, const nghttp2_frame* frame,
+             const uint8_t* name, size_t name_length, const uint8_t* value,
+             size_t value_length, uint8_t, void* user_data) {
+  Http2Connection* connection = static_cast<Http2Connection*>(user_data);
+  auto it = connection->streams.find(frame->hd.stream_id);
+  if (it == connection->streams.end()) {
+    return 0;
+  }
+  const std::string header(reinterpret_cast<const char*>(name), name_length);
+  const std::string text(reinterpret_cast<const char*>(value), value_length);
+  if (header == ":method") {
+    it->second.method = text;
+  } else if (header == ":path") {
+    it->second.path = text;
+  } else if (header == "range") {
+    it->second.range = text;
+  }
+  return 0;
+}
+
+int OnFrameReceived(nghttp2_session*, const nghttp2_frame* frame,
+                    void* user_data) {
+  Http2Connection* connection = static_cast<Http2Connection*>(user_data);
+  if ((frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA) ||
+      !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+    return 0;
+  }
+  auto it = connection->streams.find(frame->hd.stream_id);
+  if (it != connection->streams.end() && !it->second.requested) {
+    it->second.requested = true;
+    it->second.ready =
+        Clock::now() + std::chrono::milliseconds(connection->latency_ms);
+  }
+  return 0;
+}
+
+int OnStreamClose(nghttp2_session*, int32_t stream_id, uint32_t,
+                  void* user_data) {
+  Http2Connection* connection = static_cast<Http2Connection*>(user_data);
+  auto it = connection->streams.find(stream_id);
+  if (it != connection->streams.end()) {
+    if (it->second.file >= 0) {
+      close(it->second.file);
+    }
+    connection->streams.erase(it);
+  }
+  return 0;
+}
+
+ssize_t ReadBody(nghttp2_session*, int32_t, uint8_t* buffer, size_t length,
+                 uint32_t* data_flags, nghttp2_data_source* source,
+                 void* user_data) {
+  Http2Connection* connection = static_cast<Http2Connection*>(user_data);
+  Http2Stream* stream = static_cast<Http2Stream*>(source->ptr);
+  if (stream->offset >= stream->stop_at && stream->stop_at < stream->end) {
+    // Resets the stream, the HTTP/2 counterpart of a dropped connection.
+    return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+  }
+  const size_t want = static_cast<size_t>(
+      std::min<uint64_t>(length, stream->stop_at - stream->offset));
+  const ssize_t n = want == 0 ? 0
+                              : pread(stream->file, buffer, want,
+                                      static_cast<off_t>(stream->offset));
+  if (n < 0 || (n == 0 && want > 0)) {
+    return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+  }
+  stream->offset += static_cast<uint64_t>(n);
+  *connection->bytes_sent += static_cast<uint64_t>(n);
+  if (stream->offset == stream->end) {
+    *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+  }
+  return n;
+}
+
+// nghttp2 copies headers when a response is submitted.
+nghttp2_nv Header(const char* name, const char* value) {
+  nghttp2_nv header = {reinterpret_cast<uint8_t*>(const_cast<char*>(name)),
+                       reinterpret_cast<uint8_t*>(const_cast<char*>(value)),
+                       strlen(name), strlen(value), NGHTTP2_NV_FLAG_NONE};
+  return header;
+}
+
+}  // namespace
+
+struct UpdateServer::Upgrade {
+  // Decoded HTTP2-Settings of the request.
+  std::string settings;
+  std::string method;
+  std::string target;
+  std::string range;
+};
+
+struct UpdateServer::Response {
+  int status = 503;
+  // Open for 200 and 206 responses, -1 otherwise.
+  int file = -1;
+  uint64_t begin = 0;
+  uint64_t end = 0;
+  uint64_t size = 0;
+  bool reset_halfway = false;
+};
+
+bool ParseByteRange(const std::string& value, uint64_t size, uint64_t* begin,
+                    uint64_t* end, bool* satisfiable) {
+  const std::string spec = Trim(value);
+  if (spec.compare(0, 6, "bytes=") != 0 ||
+      spec.find(',') != std::string::npos) {
+    return false;
+  }
+  const std::string range = Trim(spec.substr(6));
+  const size_t dash = range.find('-');
+  if (dash == std::string::npos) {
+    return false;
+  }
+  const std::string first = range.substr(0, dash);
+  const std::string last = range.substr(dash + 1);
+  uint64_t a = 0;
+  uint64_t b = 0;
+  *satisfiable = true;
+  if (first.empty()) {
+    // "bytes=-n": the last n bytes.
+    if (!ParseNumber(last, &b)) {
+      return false;
+    }
+    if (b == 0 || size == 0) {
+      *satisfiable = false;
+      return true;
+    }
+    *begin = b >= size ? 0 : size - b;
+    *end = size;
+    return true;
+  }
+  if (!ParseNumber(first, &a)) {
+    return false;
+  }
+  if (last.empty()) {
+    b = size;
+  } else if (!ParseNumber(last, &b) || b < a) {
+    return false;
+  } else {
+    b = std::min(b + 1, size);
+  }
+  if (a >= size) {
+    *satisfiable = false;
+    return true;
+  }
+  *begin = a;
+  *end = b;
+  return true;
+}
+
+UpdateServer::UpdateServer(const UpdateServerOptions& options)
+    : options_(options), total_bandwidth_(options.total_bytes_per_second) {
+  // Start without the bucket's burst, so shaped throughput holds from the
+  // first byte instead of favoring whoever comes first.
+  total_bandwidth_.acquire(options.total_bytes_per_second);
+}
+
+UpdateServer::~UpdateServer() { Stop(); }
+
+bool UpdateServer::Start() {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    return false;
+  }
+  const int one = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(options_.port);
+  socklen_t length = sizeof(address);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+      listen(listen_fd_, 128) != 0 ||
+      getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address),
+                  &length) != 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  port_ = ntohs(address.sin_port);
+  stopping_ = false;
+  accept_thread_ = std::thread(&UpdateServer::AcceptLoop, this);
+  return true;
+}
+
+void UpdateServer::Stop() {
+  if (listen_fd_ < 0) {
+    return;
+  }
+  stopping_ = true;
+  // Wakes up accept().
+  shutdown(listen_fd_, SHUT_RDWR);
+  accept_thread_.join();
+  close(listen_fd_);
+  listen_fd_ = -1;
+
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int fd : open_fds_) {
+      shutdown(fd, SHUT_RDWR);
+    }
+    threads.swap(connection_threads_);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+std::string UpdateServer::url() const {
+  return "http://127.0.0.1:" + std::to_string(port_);
+}
+
+UpdateServerStats UpdateServer::stats() const {
+  UpdateServerStats out;
+  out.requests = requests_;
+  out.range_requests = range_requests_;
+  out.failures = failures_;
+  out.bytes_sent = bytes_sent_;
+  out.connections = connections_;
+  out.http2_connections = http2_connections_;
+  out.peak_streams = peak_streams_;
+  return out;
+}
+
+int UpdateServer::stream_weight(const std::string& path) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = stream_weights_.find(path);
+  return it == stream_weights_.end() ? 0 : it->second;
+}
+
+void UpdateServer::AcceptLoop() {
+  while (!stopping_) {
+    const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      return;
+    }
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      close(fd);
+      return;
+    }
+    connections_++;
+    open_fds_.insert(fd);
+    connection_threads_.emplace_back(&UpdateServer::Serve, this, fd);
+  }
+}
+
+void UpdateServer::Serve(int fd) {
+  TokenBucket bandwidth(options_.connection_bytes_per_second);
+  bandwidth.acquire(options_.connection_bytes_per_second);
+  std::string buffer;
+  char chunk[4096];
+  bool keep_open = true;
+  while (keep_open && !stopping_) {
+    size_t head_end;
+    while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+      if (buffer.size() > kMaxRequestHead) {
+        keep_open = false;
+        break;
+      }
+      const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        keep_open = false;
+        break;
+      }
+      buffer.append(chunk, static_cast<size_t>(n));
+    }
+    if (!keep_open) {
+      break;
+    }
+    const std::string head = buffer.substr(0, head_end);
+    buffer.erase(0, head_end + 4);
+
+    const size_t line_end = head.find("\r\n");
+    const std::string request_line = head.substr(0, line_end);
+    const size_t first_space = request_line.find(' ');
+    const size_t second_space = request_line.rfind(' ');
+    if (first_space == std::string::npos || second_space <= first_space) {
+      const char kBadRequest[] =
+          "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n"
+          "Connection: close\r\n\r\n";
+      SendAll(fd, kBadRequest, sizeof(kBadRequest) - 1);
+      break;
+    }
+    const std::string method = request_line.substr(0, first_space);
+    const std::string target = request_line.substr(
+        first_space + 1, second_space - first_space - 1);
+    const std::string version = request_line.substr(second_space + 1);
+    if (options_.http2 && method == "PRI" && version == "HTTP/2.0") {
+      ServeHttp2(fd, &bandwidth, head + "\r\n\r\n" + buffer, nullptr);
+      break;
+    }
+
+    std::string range;
+    std::string connection;
+    std::string upgrade;
+    std::string http2_settings;
+    size_t position = line_end;
+    while (position != std::string::npos && position < head.size()) {
+      const size_t begin = position + 2;
+      const size_t end = head.find("\r\n", begin);
+      const std::string line =
+          head.substr(begin, end == std::string::npos ? std::string::npos
+                                                      : end - begin);
+      const size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        const std::string name = Lowercase(Trim(line.substr(0, colon)));
+        if (name == "range") {
+          range = Trim(line.substr(colon + 1));
+        } else if (name == "connection") {
+          connection = Lowercase(Trim(line.substr(colon + 1)));
+        } else if (name == "upgrade") {
+          upgrade = Lowercase(Trim(line.substr(colon + 1)));
+        } else if (name == "http2-settings") {
+          http2_settings = Trim(line.substr(colon + 1));
+        }
+      }
+      position = end;
+    }
+    const bool keep_alive = version == "HTTP/1.1" ? connection != "close"
+                                                  : connection == "keep-alive";
+    Upgrade switch_to;
+    if (options_.http2 && upgrade == "h2c" &&
+        DecodeBase64Url(http2_settings, &switch_to.settings)) {
+      const char kSwitching[] =
+          "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\n"
+          "Upgrade: h2c\r\n\r\n";
+      if (SendAll(fd, kSwitching, sizeof(kSwitching) - 1)) {
+        switch_to.method = method;
+        switch_to.target = target;
+        switch_to.range = range;
+        ServeHttp2(fd, &bandwidth, buffer, &switch_to);
+      }
+      break;
+    }
+    keep_open = Respond(fd, &bandwidth, method, target, range, keep_alive) &&
+                keep_alive;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  open_fds_.erase(fd);
+  close(fd);
+}
+
+UpdateServer::Response UpdateServer::Plan(const std::string& method,
+                                          const std::string& target,
+                                          const std::string& range) {
+  Response response;
+  const uint64_t number = ++requests_;
+  const bool fail =
+      options_.failure_every > 0 && number % options_.failure_every == 0;
+  if (fail && options_.failure_mode == FailureMode::kStatus) {
+    failures_++;
+    return response;
+  }
+
+  std::string path;
+  int file = -1;
+  struct stat st;
+  const bool allowed = method == "GET" || method == "HEAD";
+  if (allowed && DecodePath(target, &path)) {
+    file = open((options_.root + path).c_str(), O_RDONLY | O_CLOEXEC);
+  }
+  if (file >= 0 && (fstat(file, &st) != 0 || !S_ISREG(st.st_mode))) {
+    close(file);
+    file = -1;
+  }
+  if (file < 0) {
+    response.status = allowed ? 404 : 405;
+    return response;
+  }
+
+  response.size = static_cast<uint64_t>(st.st_size);
+  response.end = response.size;
+  bool satisfiable = true;
+  const bool ranged =
+      !range.empty() && !options_.ignore_ranges &&
+      ParseByteRange(range, response.size, &response.begin, &response.end,
+                     &satisfiable);
+  if (ranged && !satisfiable) {
+    close(file);
+    response.status = 416;
+    return response;
+  }
+  if (ranged) {
+    range_requests_++;
+  }
+  response.status = ranged ? 206 : 200;
+  response.file = file;
+  if (fail && method == "GET") {
+    failures_++;
+    response.reset_halfway = true;
+  }
+  return response;
+}
+
+bool UpdateServer::Respond(int fd, TokenBucket* bandwidth,
+                           const std::string& method,
+                           const std::string& target, const std::string& range,
+                           bool keep_alive) {
+  if (options_.latency_ms > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(options_.latency_ms));
+  }
+  const Response response = Plan(method, target, range);
+  const char* connection = keep_alive ? "keep-alive" : "close";
+  char header[512];
+  int n;
+  if (response.status == 206) {
+    n = snprintf(header, sizeof(header),
+                 "HTTP/1.1 206 Partial Content\r\n"
+                 "Content-Range: bytes %llu-%llu/%llu\r\n"
+                 "Content-Length: %llu\r\nAccept-Ranges: bytes\r\n"
+                 "Content-Type: application/octet-stream\r\n"
+                 "Connection: %s\r\n\r\n",
+                 static_cast<unsigned long long>(response.begin),
+                 static_cast<unsigned long long>(response.end - 1),
+                 static_cast<unsigned long long>(response.size),
+                 static_cast<unsigned long long>(response.end - response.begin),
+                 connection);
+  } else if (response.status == 200) {
+    n = snprintf(header, sizeof(header),
+                 "HTTP/1.1 200 OK\r\nContent-Length: %llu\r\n"
+                 "Accept-Ranges: %s\r\n"
+                 "Content-Type: application/octet-stream\r\n"
+                 "Connection: %s\r\n\r\n",
+                 static_cast<unsigned long long>(response.size),
+                 options_.ignore_ranges ? "none" : "bytes", connection);
+  } else if (response.status == 416) {
+    n = snprintf(header, sizeof(header),
+                 "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                 "Content-Range: bytes */%llu\r\nContent-Length: 0\r\n"
+                 "Connection: %s\r\n\r\n",
+                 static_cast<unsigned long long>(response.size), connection);
+  } else {
+    n = snprintf(header, sizeof(header),
+                 "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                 StatusText(response.status), connection);
+  }
+  bool ok = SendAll(fd, header, static_cast<size_t>(n));
+  if (ok && method == "GET" && response.file >= 0) {
+    ok = SendBody(fd, bandwidth, response.file, response.begin,
+                  response.end - response.begin, response.reset_halfway);
+  }
+  if (response.file >= 0) {
+    close(response.file);
+  }
+  return ok;
+}
+
+void UpdateServer::ServeHttp2(int fd, TokenBucket* bandwidth,
+                              const std::string& received,
+                              const Upgrade* upgrade) {
+  http2_connections_++;
+  Http2Connection connection;
+  connection.latency_ms = options_.latency_ms;
+  connection.bytes_sent = &bytes_sent_;
+
+  nghttp2_session_callbacks* callbacks;
+  nghttp2_session_callbacks_new(&callbacks);
+  nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks,
+                                                          OnBeginHeaders);
+  nghttp2_session_callbacks_set_on_header_callback(callbacks, OnHeader);
+  nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks,
+                                                       OnFrameReceived);
+  nghttp2_session_callbacks_set_on_stream_close_callback(callbacks,
+                                                         OnStreamClose);
+  nghttp2_session* session;
+  nghttp2_session_server_new(&session, callbacks, &connection);
+  nghttp2_session_callbacks_del(callbacks);
+  const nghttp2_settings_entry settings[] = {
+      {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS,
+       options_.max_concurrent_streams}};
+  nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, settings, 1);
+
+  bool open = true;
+  if (upgrade != nullptr) {
+    // The request that asked for the upgrade becomes stream 1.
+    open = nghttp2_session_upgrade2(
+               session,
+               reinterpret_cast<const uint8_t*>(upgrade->settings.data()),
+               upgrade->settings.size(), upgrade->method == "HEAD",
+               nullptr) == 0;
+    Http2Stream& stream = connection.streams[1];
+    stream.method = upgrade->method;
+    stream.path = upgrade->target;
+    stream.range = upgrade->range;
+    stream.requested = true;
+    stream.ready =
+        Clock::now() + std::chrono::milliseconds(options_.latency_ms);
+  }
+  open = open && nghttp2_session_mem_recv(
+                     session,
+                     reinterpret_cast<const uint8_t*>(received.data()),
+                     received.size()) >= 0;
+  std::vector<uint8_t> chunk(kSendChunk);
+  while (open && !stopping_) {
+    // Answer the requests whose latency has passed.
+    const Clock::time_point now = Clock::now();
+    Clock::time_point next_ready = Clock::time_point::max();
+    uint64_t open_streams = 0;
+    for (auto& entry : connection.streams) {
+      Http2Stream& stream = entry.second;
+      open_streams++;
+      if (!stream.requested || stream.responded) {
+        continue;
+      }
+      if (stream.ready > now) {
+        next_ready = std::min(next_ready, stream.ready);
+        continue;
+      }
+      stream.responded = true;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string path;
+        if (DecodePath(stream.path, &path)) {
+          stream_weights_[path] = stream.weight;
+        }
+      }
+      const Response response = Plan(stream.method, stream.path, stream.range);
+      const std::string status = std::to_string(response.status);
+      const std::string content_length =
+          std::to_string(response.end - response.begin);
+      char content_range[96];
+      if (response.status == 206) {
+        snprintf(content_range, sizeof(content_range), "bytes %llu-%llu/%llu",
+                 static_cast<unsigned long long>(response.begin),
+                 static_cast<unsigned long long>(response.end - 1),
+                 static_cast<unsigned long long>(response.size));
+      } else {
+        snprintf(content_range, sizeof(content_range), "bytes */%llu",
+                 static_cast<unsigned long long>(response.size));
+      }
+      std::vector<nghttp2_nv> headers = {Header(":status", status.c_str())};
+      if (response.status == 200 || response.status == 206) {
+        headers.push_back(Header("content-length", content_length.c_str()));
+        headers.push_back(Header(
+            "accept-ranges", options_.ignore_ranges ? "none" : "bytes"));
+      }
+      if (response.status == 206 || response.status == 416) {
+        headers.push_back(Header("content-range", content_range));
+      }
+      nghttp2_data_provider body;
+      body.source.ptr = &stream;
+      body.read_callback = ReadBody;
+      const bool has_body = stream.method == "GET" && response.file >= 0 &&
+                            response.end > response.begin;
+      if (has_body) {
+        stream.file = response.file;
+        stream.offset = response.begin;
+        stream.end = response.end;
+        stream.stop_at =
+            response.reset_halfway
+                ? response.begin + (response.end - response.begin) / 2
+                : response.end;
+      } else if (response.file >= 0) {
+        close(response.file);
+      }
+      nghttp2_submit_response(session, entry.first, headers.data(),
+                              headers.size(), has_body ? &body : nullptr);
+    }
+    uint64_t peak = peak_streams_;
+    while (open_streams > peak &&
+           !peak_streams_.compare_exchange_weak(peak, open_streams)) {
+    }
+
+    // Send a bounded amount before looking for new requests, so streams
+    // opened meanwhile are not held up by the ones already going.
+    size_t budget = kSendChunk;
+    while (open && budget > 0) {
+      const uint8_t* data;
+      const ssize_t n = nghttp2_session_mem_send(session, &data);
+      if (n < 0) {
+        open = false;
+      }
+      if (n <= 0) {
+        break;
+      }
+      bandwidth->acquire(static_cast<uint64_t>(n));
+      total_bandwidth_.acquire(static_cast<uint64_t>(n));
+      open = SendAll(fd, reinterpret_cast<const char*>(data),
+                     static_cast<size_t>(n));
+      budget -= std::min(budget, static_cast<size_t>(n));
+    }
+    if (!open || (!nghttp2_session_want_read(session) &&
+                  !nghttp2_session_want_write(session))) {
+      break;
+    }
+
+    int timeout_ms = -1;
+    if (nghttp2_session_want_write(session) && budget == 0) {
+      timeout_ms = 0;
+    } else if (next_ready != Clock::time_point::max()) {
+      timeout_ms = static_cast<int>(
+          std::chrono::duration_cast<std::chrono::milliseconds>(next_ready -
+                                                                Clock::now())
+              .count() +
+          1);
+      timeout_ms = std::max(timeout_ms, 0);
+    }
+    pollfd readable = {fd, POLLIN, 0};
+    const int ready = poll(&readable, 1, timeout_ms);
+    if (ready < 0 && errno != EINTR) {
+      break;
+    }
+    if (ready > 0) {
+      const ssize_t n = recv(fd, chunk.data(), chunk.size(), 0);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      open = n > 0 && nghttp2_session_mem_recv(session, chunk.data(),
+                                               static_cast<size_t>(n)) >= 0;
+    }
+  }
+
+  for (auto& entry : connection.streams) {
+    if (entry.second.file >= 0) {
+      close(entry.second.file);
+    }
+  }
+  connection.streams.clear();
+  nghttp2_session_del(session);
+}
+
+bool UpdateServer::SendAll(int fd, const char* data, size_t length) {
+  while (length > 0) {
+    const ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    length -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool UpdateServer::SendBody(int fd, TokenBucket* bandwidth, int file,
+                            uint64_t offset, uint64_t length,
+                            bool reset_halfway) {
+  const uint64_t stop_at = reset_halfway ? length / 2 : length;
+  std::vector<char> chunk(kSendChunk);
+  uint64_t sent = 0;
+  while (sent < stop_at && !stopping_) {
+    const size_t want =
+        static_cast<size_t>(std::min<uint64_t>(kSendChunk, stop_at - sent));
+    const ssize_t n = pread(file, chunk.data(), want,
+                            static_cast<off_t>(offset + sent));
+    if (n <= 0) {
+      return false;
+    }
+    bandwidth->acquire(static_cast<uint64_t>(n));
+    total_bandwidth_.acquire(static_cast<uint64_t>(n));
+    if (!SendAll(fd, chunk.data(), static_cast<size_t>(n))) {
+      return false;
+    }
+    sent += static_cast<uint64_t>(n);
+    bytes_sent_ += static_cast<uint64_t>(n);
+  }
+  if (reset_halfway) {
+    // A zero linger timeout makes close() send RST instead of FIN.
+    const linger abort = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+    return false;
+  }
+  return sent == length;
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,137 @@
+#ifndef DESKTOP_UPDATER_TEST_UPDATE_SERVER_H_
+#define DESKTOP_UPDATER_TEST_UPDATE_SERVER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rate_limiter.h"
+
+namespace desktop_updater {
+namespace test {
+
+// How an injected failure shows up to the client.
+enum class FailureMode {
+  // A "503 Service Unavailable" response.
+  kStatus,
+  // The connection is reset halfway through the body.
+  kReset,
+};
+
+struct UpdateServerOptions {
+  // Directory served at "/": app-archive.json, and per release a directory
+  // with hashes.json and the release files.
+  std::string root;
+  // 0 picks a free port.
+  uint16_t port = 0;
+  // Delay before every response, standing in for a round trip.
+  int latency_ms = 0;
+  // Per-connection and whole-server send rates, without an initial burst;
+  // 0 is unlimited.
+  uint64_t connection_bytes_per_second = 0;
+  uint64_t total_bytes_per_second = 0;
+  // Every failure_every-th request fails; 0 disables failures.
+  int failure_every = 0;
+  FailureMode failure_mode = FailureMode::kStatus;
+  // Serve whole files even when a Range is requested, like servers that do
+  // not support ranges.
+  bool ignore_ranges = false;
+  // Also speak HTTP/2 without TLS (h2c), to clients that ask to upgrade to
+  // it or open the connection with the HTTP/2 preface, serving requests as
+  // multiplexed streams.
+  bool http2 = false;
+  uint32_t max_concurrent_streams = 100;
+};
+
+struct UpdateServerStats {
+  uint64_t requests = 0;
+  uint64_t range_requests = 0;
+  uint64_t failures = 0;
+  uint64_t bytes_sent = 0;
+  uint64_t connections = 0;
+  uint64_t http2_connections = 0;
+  // Most requests open at once on one HTTP/2 connection.
+  uint64_t peak_streams = 0;
+};
+
+// Stand-in for the static file host an app-archive.json points at, so whole
+// updates can be run and timed without network access. Speaks HTTP/1.1 on
+// 127.0.0.1 with keep-alive, GET and HEAD, and single byte ranges, and
+// optionally h2c; it can add latency, shape bandwidth and inject failures.
+class UpdateServer {
+ public:
+  explicit UpdateServer(const UpdateServerOptions& options);
+  ~UpdateServer();
+
+  UpdateServer(const UpdateServer&) = delete;
+  UpdateServer& operator=(const UpdateServer&) = delete;
+
+  // Binds and starts serving on a background thread.
+  bool Start();
+  // Closes the listening socket and every open connection.
+  void Stop();
+
+  uint16_t port() const { return port_; }
+  // "http://127.0.0.1:<port>"
+  std::string url() const;
+  UpdateServerStats stats() const;
+  // Weight of the last HTTP/2 stream that requested path, or 0 if none did.
+  int stream_weight(const std::string& path) const;
+
+ private:
+  struct Response;
+  struct Upgrade;
+
+  void AcceptLoop();
+  void Serve(int fd);
+  // Serves an HTTP/2 connection; received holds what was read of it so far.
+  // upgrade is the HTTP/1.1 request that switched to it, if any.
+  void ServeHttp2(int fd, TokenBucket* bandwidth, const std::string& received,
+                  const Upgrade* upgrade);
+  // Decides the response to a request and counts it.
+  Response Plan(const std::string& method, const std::string& target,
+                const std::string& range);
+  // Handles one request; returns false when the connection should close.
+  bool Respond(int fd, TokenBucket* bandwidth, const std::string& method,
+               const std::string& target, const std::string& range,
+               bool keep_alive);
+  bool SendAll(int fd, const char* data, size_t length);
+  bool SendBody(int fd, TokenBucket* bandwidth, int file, uint64_t offset,
+                uint64_t length, bool reset_halfway);
+
+  UpdateServerOptions options_;
+  int listen_fd_ = -1;
+  uint16_t port_ = 0;
+  std::thread accept_thread_;
+  mutable std::mutex mutex_;
+  std::set<int> open_fds_;
+  std::map<std::string, int> stream_weights_;
+  std::vector<std::thread> connection_threads_;
+  TokenBucket total_bandwidth_;
+  std::atomic<bool> stopping_{false};
+
+  std::atomic<uint64_t> requests_{0};
+  std::atomic<uint64_t> range_requests_{0};
+  std::atomic<uint64_t> failures_{0};
+  std::atomic<uint64_t> bytes_sent_{0};
+  std::atomic<uint64_t> connections_{0};
+  std::atomic<uint64_t> http2_connections_{0};
+  std::atomic<uint64_t> peak_streams_{0};
+};
+
+// Parses the value of a Range header against a file of size bytes. Only a
+// single "bytes=" range is understood; returns false for anything else,
+// including multiple ranges. Sets *satisfiable to false for a well-formed
+// range that starts past the end.
+bool ParseByteRange(const std::string& value, uint64_t size, uint64_t* begin,
+                    uint64_t* end, bool* satisfiable);
+
+}  // namespace test
+}  // namespace desktop_updater
+
+#endif  // DESKTOP_UPDATER_TEST_UPDATE_SERVER_H_
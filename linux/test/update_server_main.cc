@@ -0,0 +1,103 @@
+// Serves a directory as an update host until interrupted:
+//
+//   desktop_updater_update_server --root DIR [--port N] [--latency-ms N]
+//       [--connection-rate BYTES] [--total-rate BYTES] [--fail-every N]
+//       [--fail-mode status|reset] [--no-ranges] [--http2]
+//
+// Point an app's appArchiveUrl at <printed url>/app-archive.json.
+
+#include <signal.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "update_server.h"
+
+namespace {
+
+void Usage() {
+  fprintf(stderr,
+          "usage: desktop_updater_update_server --root DIR [--port N] "
+          "[--latency-ms N]\n"
+          "    [--connection-rate BYTES] [--total-rate BYTES] "
+          "[--fail-every N]\n"
+          "    [--fail-mode status|reset] [--no-ranges] [--http2]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  desktop_updater::test::UpdateServerOptions options;
+  for (int i = 1; i < argc; i++) {
+    const std::string flag = argv[i];
+    if (flag == "--no-ranges") {
+      options.ignore_ranges = true;
+      continue;
+    }
+    if (flag == "--http2") {
+      options.http2 = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      Usage();
+      return 2;
+    }
+    const char* value = argv[++i];
+    if (flag == "--root") {
+      options.root = value;
+    } else if (flag == "--port") {
+      options.port = static_cast<uint16_t>(atoi(value));
+    } else if (flag == "--latency-ms") {
+      options.latency_ms = atoi(value);
+    } else if (flag == "--connection-rate") {
+      options.connection_bytes_per_second = strtoull(value, nullptr, 10);
+    } else if (flag == "--total-rate") {
+      options.total_bytes_per_second = strtoull(value, nullptr, 10);
+    } else if (flag == "--fail-every") {
+      options.failure_every = atoi(value);
+    } else if (flag == "--fail-mode" && strcmp(value, "status") == 0) {
+      options.failure_mode = desktop_updater::test::FailureMode::kStatus;
+    } else if (flag == "--fail-mode" && strcmp(value, "reset") == 0) {
+      options.failure_mode = desktop_updater::test::FailureMode::kReset;
+    } else {
+      Usage();
+      return 2;
+    }
+  }
+  if (options.root.empty()) {
+    Usage();
+    return 2;
+  }
+
+  // Blocked before any thread starts so sigwait() below receives them.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  desktop_updater::test::UpdateServer server(options);
+  if (!server.Start()) {
+    perror("desktop_updater_update_server: cannot listen");
+    return 1;
+  }
+  printf("%s\n", server.url().c_str());
+  fflush(stdout);
+
+  int signal_number = 0;
+  sigwait(&signals, &signal_number);
+  server.Stop();
+  const desktop_updater::test::UpdateServerStats stats = server.stats();
+  fprintf(stderr,
+          "%llu requests (%llu ranged, %llu failed) on %llu connections "
+          "(%llu HTTP/2), %llu bytes sent\n",
+          static_cast<unsigned long long>(stats.requests),
+          static_cast<unsigned long long>(stats.range_requests),
+          static_cast<unsigned long long>(stats.failures),
+          static_cast<unsigned long long>(stats.connections),
+          static_cast<unsigned long long>(stats.http2_connections),
+          static_cast<unsigned long long>(stats.bytes_sent));
+  return 0;
+}
@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+#include "test_util.h"
+#include "update_server.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+// Sends one request with "Connection: close" and returns everything the
+// server wrote back.
+std::string Request(uint16_t port, const std::string& path,
+                    const std::string& extra_headers = "",
+                    const std::string& method = "GET") {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+      0) {
+    close(fd);
+    return std::string();
+  }
+  const std::string request = method + " " + path +
+                              " HTTP/1.1\r\nHost: localhost\r\n" +
+                              extra_headers + "Connection: close\r\n\r\n";
+  send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+  std::string response;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    response.append(buffer, static_cast<size_t>(n));
+  }
+  close(fd);
+  return response;
+}
+
+std::string StatusLine(const std::string& response) {
+  return response.substr(0, response.find("\r\n"));
+}
+
+std::string Body(const std::string& response) {
+  const size_t end = response.find("\r\n\r\n");
+  return end == std::string::npos ? std::string() : response.substr(end + 4);
+}
+
+}  // namespace
+
+TEST(UpdateServer, ParsesByteRanges) {
+  uint64_t begin = 0;
+  uint64_t end = 0;
+  bool satisfiable = false;
+  ASSERT_TRUE(ParseByteRange("bytes=10-19", 100, &begin, &end, &satisfiable));
+  EXPECT_TRUE(satisfiable);
+  EXPECT_EQ(begin, 10u);
+  EXPECT_EQ(end, 20u);
+  ASSERT_TRUE(ParseByteRange("bytes=90-", 100, &begin, &end, &satisfiable));
+  EXPECT_EQ(begin, 90u);
+  EXPECT_EQ(end, 100u);
+  ASSERT_TRUE(ParseByteRange("bytes=50-500", 100, &begin, &end, &satisfiable));
+  EXPECT_EQ(end, 100u);
+  ASSERT_TRUE(ParseByteRange("bytes=-30", 100, &begin, &end, &satisfiable));
+  EXPECT_EQ(begin, 70u);
+  EXPECT_EQ(end, 100u);
+  ASSERT_TRUE(ParseByteRange("bytes=100-", 100, &begin, &end, &satisfiable));
+  EXPECT_FALSE(satisfiable);
+  EXPECT_FALSE(ParseByteRange("bytes=0-1,5-6", 100, &begin, &end,
+                              &satisfiable));
+  EXPECT_FALSE(ParseByteRange("items=0-1", 100, &begin, &end, &satisfiable));
+  EXPECT_FALSE(ParseByteRange("bytes=9-3", 100, &begin, &end, &satisfiable));
+}
+
+TEST(UpdateServer, ServesFilesAndRanges) {
+  TempDir dir;
+  const std::string data = PatternBytes(100000);
+  dir.Write("libapp.so", data);
+  UpdateServerOptions options;
+  options.root = dir.path();
+  UpdateServer server(options);
+  ASSERT_TRUE(server.Start());
+
+  const std::string whole = Request(server.port(), "/libapp.so");
+  EXPECT_EQ(StatusLine(whole), "HTTP/1.1 200 OK");
+  EXPECT_NE(whole.find("Accept-Ranges: bytes"), std::string::npos);
+  EXPECT_EQ(Body(whole), data);
+
+  const std::string part =
+      Request(server.port(), "/libapp.so", "Range: bytes=1000-1999\r\n");
+  EXPECT_EQ(StatusLine(part), "HTTP/1.1 206 Partial Content");
+  EXPECT_NE(part.find("Content-Range: bytes 1000-1999/100000"),
+            std::string::npos);
+  EXPECT_EQ(Body(part), data.substr(1000, 1000));
+
+  const std::string past_end =
+      Request(server.port(), "/libapp.so", "Range: bytes=200000-\r\n");
+  EXPECT_EQ(StatusLine(past_end), "HTTP/1.1 416 Range Not Satisfiable");
+
+  const std::string head =
+      Request(server.port(), "/libapp.so", "", "HEAD");
+  EXPECT_NE(head.find("Content-Length: 100000"), std::string::npos);
+  EXPECT_EQ(Body(head), "");
+
+  EXPECT_EQ(StatusLine(Request(server.port(), "/missing.so")),
+            "HTTP/1.1 404 Not Found");
+  const UpdateServerStats stats = server.stats();
+  EXPECT_EQ(stats.requests, 5u);
+  EXPECT_EQ(stats.range_requests, 1u);
+}
+
+TEST(UpdateServer, DecodesPathsAndStaysInsideRoot) {
+  TempDir dir;
+  const std::string mkdir = "mkdir -p '" + dir.path() + "/root/data dir'";
+  ASSERT_EQ(system(mkdir.c_str()), 0);
+  dir.Write("root/data dir/a b.txt", "spaced");
+  dir.Write("secret.txt", "outside");
+  UpdateServerOptions options;
+  options.root = dir.path() + "/root";
+  UpdateServer server(options);
+  ASSERT_TRUE(server.Start());
+
+  EXPECT_EQ(Body(Request(server.port(), "/data%20dir/a%20b.txt")), "spaced");
+  EXPECT_EQ(StatusLine(Request(server.port(), "/../secret.txt")),
+            "HTTP/1.1 404 Not Found");
+  EXPECT_EQ(
+      StatusLine(Request(server.port(), "/data%20dir/%2e%2e/../secret.txt")),
+      "HTTP/1.1 404 Not Found");
+}
+
+TEST(UpdateServer, IgnoresRangesLikeServersWithoutSupport) {
+  TempDir dir;
+  dir.Write("file.bin", PatternBytes(5000));
+  UpdateServerOptions options;
+  options.root = dir.path();
+  options.ignore_ranges = true;
+  UpdateServer server(options);
+  ASSERT_TRUE(server.Start());
+
+  const std::string response =
+      Request(server.port(), "/file.bin", "Range: bytes=0-99\r\n");
+  EXPECT_EQ(StatusLine(response), "HTTP/1.1 200 OK");
+  EXPECT_EQ(Body(response).size(), 5000u);
+}
+
+TEST(UpdateServer, InjectsFailures) {
+  TempDir dir;
+  dir.Write("file.bin", PatternBytes(200000));
+  UpdateServerOptions options;
+  options.root = dir.path();
+  options.failure_every = 2;
+  UpdateServer server(options);
+  ASSERT_TRUE(server.Start());
+  EXPECT_EQ(StatusLine(Request(server.port(), "/file.bin")),
+            "HTTP/1.1 200 OK");
+  EXPECT_EQ(StatusLine(Request(server.port(), "/file.bin")),
+            "HTTP/1.1 503 Service Unavailable");
+  server.Stop();
+
+  options.failure_mode = FailureMode::kReset;
+  options.failure_every = 1;
+  UpdateServer resetting(options);
+  ASSERT_TRUE(resetting.Start());
+  const std::string response = Request(resetting.port(), "/file.bin");
+  EXPECT_EQ(StatusLine(response), "HTTP/1.1 200 OK");
+  EXPECT_LT(Body(response).size(), 200000u);
+  EXPECT_EQ(resetting.stats().failures, 1u);
+}
+
+TEST(UpdateServer, AddsLatencyAndShapesBandwidth) {
+  TempDir dir;
+  dir.Write("file.bin", PatternBytes(3 << 20));
+  UpdateServerOptions options;
+  options.root = dir.path();
+  options.latency_ms = 50;
+  options.connection_bytes_per_second = 2 << 20;
+  UpdateServer server(options);
+  ASSERT_TRUE(server.Start());
+
+  const auto start = std::chrono::steady_clock::now();
+  const std::string response = Request(server.port(), "/file.bin");
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(Body(response).size(), 3u << 20);
+  EXPECT_GE(elapsed, std::chrono::milliseconds(50 + 1400));
+  EXPECT_LT(elapsed, std::chrono::seconds(5));
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "work_scheduler.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+// A release like the ones the updater ships: flutter_assets with thousands
+// of small files, a few dozen libraries and one large one.
+std::vector<uint64_t> ReleaseSizes() {
+  std::vector<uint64_t> sizes;
+  for (int i = 0; i < 10000; i++) {
+    sizes.push_back(2000 + (i * 7919) % 30000);
+  }
+  for (int i = 0; i < 60; i++) {
+    sizes.push_back(static_cast<uint64_t>(4 + i % 16) << 20);
+  }
+  sizes.push_back(40u << 20);
+  return sizes;
+}
+
+std::vector<size_t> LargestFirst(const std::vector<uint64_t>& sizes) {
+  std::vector<size_t> order(sizes.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) {
+    return sizes[a] > sizes[b];
+  });
+  return order;
+}
+
+}  // namespace
+
+TEST(WorkScheduler, ClassifiesItemsByCost) {
+  WorkKind kind;
+  ASSERT_TRUE(parse_work_kind("download", &kind));
+  EXPECT_EQ(kind, WorkKind::kDownload);
+  EXPECT_FALSE(parse_work_kind("upload", &kind));
+
+  WorkCost cost;
+  cost.seconds_per_item = 0.05;
+  cost.bytes_per_second = 1e6;
+  EXPECT_FALSE(throughput_bound(cost, 10000));
+  EXPECT_TRUE(throughput_bound(cost, 100000));
+  EXPECT_DOUBLE_EQ(estimated_seconds(cost, 2000000), 2.05);
+  EXPECT_FALSE(throughput_bound(default_work_cost(WorkKind::kApply), 1 << 30));
+}
+
+TEST(WorkScheduler, OverlapsSmallFilesWithHugeTransfers) {
+  const std::vector<uint64_t> sizes = ReleaseSizes();
+  const WorkCost cost = default_work_cost(WorkKind::kDownload);
+  const size_t workers = 64;
+  const WorkPlan plan = plan_work(sizes, cost, workers);
+
+  std::vector<size_t> sorted = plan.order;
+  std::sort(sorted.begin(), sorted.end());
+  ASSERT_EQ(sorted.size(), sizes.size());
+  for (size_t i = 0; i < sorted.size(); i++) {
+    ASSERT_EQ(sorted[i], i);
+  }
+
+  // The largest starts first, and the first wave holds just enough
+  // transfers to fill the link next to small files.
+  EXPECT_EQ(sizes[plan.order[0]], 40u << 20);
+  size_t heavy = 0;
+  for (size_t i = 0; i < workers; i++) {
+    heavy += throughput_bound(cost, sizes[plan.order[i]]) ? 1 : 0;
+  }
+  EXPECT_EQ(heavy, 7u);  // 50 MB/s over 8 MB/s connections
+
+  uint64_t total = 0;
+  for (uint64_t size : sizes) {
+    total += size;
+  }
+  // Neither the link nor the largest file's own connection can go faster.
+  const double bound =
+      std::max(static_cast<double>(total) / cost.shared_bytes_per_second,
+               estimated_seconds(cost, 40u << 20));
+  const double largest_first =
+      simulate_makespan(sizes, LargestFirst(sizes), cost, workers);
+  EXPECT_DOUBLE_EQ(simulate_makespan(sizes, plan.order, cost, workers),
+                   plan.makespan_seconds);
+  EXPECT_LT(plan.makespan_seconds, largest_first * 0.9);
+  EXPECT_LT(plan.makespan_seconds, bound * 1.05);
+}
+
+TEST(WorkScheduler, IsLongestFirstWithoutASharedLimit) {
+  const std::vector<uint64_t> sizes = {10, 5 << 20, 300, 1 << 30, 7 << 20};
+  const WorkCost cost = default_work_cost(WorkKind::kHash);
+  const WorkPlan plan = plan_work(sizes, cost, 2);
+  EXPECT_EQ(plan.order, (std::vector<size_t>{3, 4, 1, 2, 0}));
+  // The gigabyte runs alone on one worker while the other takes the rest.
+  EXPECT_NEAR(plan.makespan_seconds, estimated_seconds(cost, 1 << 30), 1e-9);
+
+  const WorkPlan single = plan_work(sizes, cost, 1);
+  double sum = 0;
+  for (uint64_t size : sizes) {
+    sum += estimated_seconds(cost, size);
+  }
+  EXPECT_NEAR(single.makespan_seconds, sum, 1e-9);
+  EXPECT_EQ(plan_work({}, cost, 4).order.size(), 0u);
+}
+
+}  // namespace test
+}  // namespace desktop_updater
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include <sched.h>
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "thread_pool.h"
+#include "worker_priority.h"
+
+namespace desktop_updater {
+namespace test {
+
+namespace {
+
+// Runs one task on every worker and counts those running under SCHED_IDLE.
+size_t CountBackgroundWorkers(ThreadPool* pool) {
+  std::atomic<size_t> background(0);
+  std::atomic<size_t> arrived(0);
+  WaitGroup group;
+  group.add(pool->size());
+  for (size_t i = 0; i < pool->size(); i++) {
+    pool->submit([&] {
+      if (in_background()) {
+        background++;
+      }
+      // Hold every worker until all have arrived, so each runs one task.
+      arrived++;
+      while (arrived < pool->size()) {
+        sched_yield();
+      }
+      group.done();
+    });
+  }
+  group.wait();
+  return background;
+}
+
+}  // namespace
+
+TEST(WorkerPriority, RespawnLowersAndRestoresWorkers) {
+  ThreadPool pool(3);
+  EXPECT_EQ(CountBackgroundWorkers(&pool), 0u);
+
+  const std::vector<int> cpus = background_cpus();
+  pool.respawn([cpus] { enter_background(cpus); });
+  EXPECT_EQ(CountBackgroundWorkers(&pool), 3u);
+  EXPECT_FALSE(in_background());
+
+  pool.respawn(nullptr);
+  EXPECT_EQ(CountBackgroundWorkers(&pool), 0u);
+}
+
+// downloadUpdate toggles the workers on every update, so replaced ones
+// must not pile up unjoined.
+TEST(WorkerPriority, RespawnJoinsReplacedWorkers) {
+  ThreadPool pool(4);
+  for (int i = 0; i < 50; i++) {
+    pool.respawn(nullptr);
+    CountBackgroundWorkers(&pool);
+  }
+  EXPECT_LE(pool.retired(), 2 * pool.size());
+
+  // Once the last replaced workers are out, the next submit joins them.
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (pool.retired() > 0 && std::chrono::steady_clock::now() < deadline) {
+    CountBackgroundWorkers(&pool);
+  }
+  EXPECT_EQ(pool.retired(), 0u);
+}
+
+TEST(WorkerPriority, BackgroundCpusAvoidTheCallingThread) {
+  cpu_set_t allowed;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+  const std::vector<int> cpus = background_cpus();
+  if (CPU_COUNT(&allowed) == 1) {
+    EXPECT_TRUE(cpus.empty());
+    return;
+  }
+  EXPECT_LT(cpus.size(), static_cast<size_t>(CPU_COUNT(&allowed)));
+  for (int cpu : cpus) {
+    EXPECT_TRUE(CPU_ISSET(cpu, &allowed));
+  }
+}
+
+}  // namespace test
+}  // namespace desktop_updater
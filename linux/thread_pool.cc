@@ -0,0 +1,158 @@
+#include "thread_pool.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace desktop_updater
+{
+
+  void WaitGroup::add(size_t count)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ += count;
+  }
+
+  void WaitGroup::done()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_ > 0 && --pending_ == 0)
+    {
+      cv_.notify_all();
+    }
+  }
+
+  void WaitGroup::wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]
+             { return pending_ == 0; });
+  }
+
+  ThreadPool::ThreadPool(size_t thread_count)
+  {
+    if (thread_count == 0)
+    {
+      long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      thread_count = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+    }
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; i++)
+    {
+      threads_.emplace_back(&ThreadPool::worker_loop, this, generation_,
+                            std::function<void()>());
+    }
+  }
+
+  ThreadPool::~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread &thread : threads_)
+    {
+      thread.join();
+    }
+    for (std::thread &thread : retired_)
+    {
+      thread.join();
+    }
+  }
+
+  void ThreadPool::submit(std::function<void()> task)
+  {
+    std::vector<std::thread> done;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+      take_exited(&done);
+    }
+    cv_.notify_one();
+    for (std::thread &thread : done)
+    {
+      thread.join();
+    }
+  }
+
+  void ThreadPool::respawn(std::function<void()> setup)
+  {
+    std::vector<std::thread> done;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      take_exited(&done);
+      generation_++;
+      for (std::thread &thread : threads_)
+      {
+        retired_.push_back(std::move(thread));
+      }
+      for (std::thread &thread : threads_)
+      {
+        thread = std::thread(&ThreadPool::worker_loop, this, generation_, setup);
+      }
+    }
+    cv_.notify_all();
+    for (std::thread &thread : done)
+    {
+      thread.join();
+    }
+  }
+
+  size_t ThreadPool::retired()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retired_.size();
+  }
+
+  void ThreadPool::take_exited(std::vector<std::thread> *done)
+  {
+    if (exited_.empty())
+    {
+      return;
+    }
+    for (auto it = retired_.begin(); it != retired_.end();)
+    {
+      auto found = std::find(exited_.begin(), exited_.end(), it->get_id());
+      if (found == exited_.end())
+      {
+        ++it;
+        continue;
+      }
+      exited_.erase(found);
+      done->push_back(std::move(*it));
+      it = retired_.erase(it);
+    }
+  }
+
+  void ThreadPool::worker_loop(size_t generation, std::function<void()> setup)
+  {
+    if (setup)
+    {
+      setup();
+    }
+    for (;;)
+    {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this, generation]
+                 { return stopping_ || generation != generation_ ||
+                          !tasks_.empty(); });
+        if (generation != generation_)
+        {
+          exited_.push_back(std::this_thread::get_id());
+          return;
+        }
+        if (tasks_.empty())
+        {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,78 @@
+#ifndef DESKTOP_UPDATER_THREAD_POOL_H_
+#define DESKTOP_UPDATER_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace desktop_updater
+{
+
+  // Counts outstanding tasks of one job so a caller can wait for just its own
+  // work on a pool that is shared with other jobs.
+  class WaitGroup
+  {
+  public:
+    void add(size_t count = 1);
+    void done();
+    void wait();
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t pending_ = 0;
+  };
+
+  // Fixed-size pool of native worker threads shared by the update stages.
+  // Tasks must not block waiting on other tasks of the same pool.
+  class ThreadPool
+  {
+  public:
+    // A thread_count of 0 uses one thread per online CPU.
+    explicit ThreadPool(size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Replaces every worker with a new thread that runs setup (if any)
+    // before taking tasks. Workers busy with a task finish it first. New
+    // threads inherit the scheduling attributes of the calling thread, so
+    // this is also how workers that lowered their own priority are brought
+    // back up without privileges.
+    void respawn(std::function<void()> setup);
+
+    size_t size() const { return threads_.size(); }
+
+    // Replaced workers not joined yet. Those that have exited are joined
+    // by the next submit or respawn.
+    size_t retired();
+
+  private:
+    void worker_loop(size_t generation, std::function<void()> setup);
+    // Moves retired workers that have exited to done, to be joined once
+    // mutex_ is released. Requires mutex_.
+    void take_exited(std::vector<std::thread> *done);
+
+    std::vector<std::thread> threads_;
+    // Replaced workers; they exit once their current task is done.
+    std::vector<std::thread> retired_;
+    // Retired workers that have left worker_loop and can be joined without
+    // waiting on a task.
+    std::vector<std::thread::id> exited_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t generation_ = 0;
+    bool stopping_ = false;
+  };
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_THREAD_POOL_H_
@@ -0,0 +1,249 @@
+#include "work_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    const size_t kNone = static_cast<size_t>(-1);
+    // Bytes left below which a simulated transfer counts as done; rates
+    // are doubles, so the last step rarely lands on exactly zero.
+    const double kBytesEpsilon = 0.5;
+    const double kSecondsEpsilon = 1e-12;
+
+    struct RunningItem
+    {
+      size_t index;
+      double latency_left;
+      double bytes_left;
+      bool throughput_bound;
+    };
+
+    // Simulates workers that each run one item at a time, asking pick for
+    // the next item whenever one is free until it returns kNone. Appends
+    // the items started to order, if given, and returns when the last one
+    // finished. Every item first waits out its latency, then moves its
+    // bytes at the per-worker rate or an equal share of the shared rate,
+    // whichever is lower.
+    template <typename Pick>
+    double simulate(const std::vector<uint64_t> &sizes, const WorkCost &cost,
+                    size_t workers, Pick pick, std::vector<size_t> *order)
+    {
+      std::vector<RunningItem> running;
+      running.reserve(workers);
+      double now = 0;
+      for (;;)
+      {
+        while (running.size() < workers)
+        {
+          const size_t next = pick(running);
+          if (next == kNone)
+          {
+            break;
+          }
+          if (order != nullptr)
+          {
+            order->push_back(next);
+          }
+          RunningItem item;
+          item.index = next;
+          item.latency_left = cost.seconds_per_item;
+          item.bytes_left =
+              cost.bytes_per_second > 0 ? static_cast<double>(sizes[next]) : 0;
+          item.throughput_bound = throughput_bound(cost, sizes[next]);
+          running.push_back(item);
+        }
+        if (running.empty())
+        {
+          return now;
+        }
+
+        size_t streaming = 0;
+        for (const RunningItem &item : running)
+        {
+          if (item.latency_left <= 0 && item.bytes_left > 0)
+          {
+            streaming++;
+          }
+        }
+        double rate = cost.bytes_per_second;
+        if (cost.shared_bytes_per_second > 0 && streaming > 0)
+        {
+          rate = std::min(rate, cost.shared_bytes_per_second /
+                                    static_cast<double>(streaming));
+        }
+        double step = std::numeric_limits<double>::infinity();
+        for (const RunningItem &item : running)
+        {
+          if (item.latency_left > 0)
+          {
+            step = std::min(step, item.latency_left);
+          }
+          else if (item.bytes_left > 0)
+          {
+            step = std::min(step, item.bytes_left / rate);
+          }
+          else
+          {
+            step = 0;
+          }
+        }
+
+        now += step;
+        for (auto it = running.begin(); it != running.end();)
+        {
+          if (it->latency_left > 0)
+          {
+            it->latency_left -= step;
+            if (it->latency_left <= kSecondsEpsilon)
+            {
+              it->latency_left = 0;
+            }
+          }
+          else
+          {
+            it->bytes_left -= step * rate;
+          }
+          if (it->latency_left <= 0 && it->bytes_left <= kBytesEpsilon)
+          {
+            it = running.erase(it);
+          }
+          else
+          {
+            ++it;
+          }
+        }
+      }
+    }
+  } // namespace
+
+  bool parse_work_kind(const std::string &name, WorkKind *kind)
+  {
+    if (name == "hash")
+    {
+      *kind = WorkKind::kHash;
+    }
+    else if (name == "download")
+    {
+      *kind = WorkKind::kDownload;
+    }
+    else if (name == "apply")
+    {
+      *kind = WorkKind::kApply;
+    }
+    else
+    {
+      return false;
+    }
+    return true;
+  }
+
+  WorkCost default_work_cost(WorkKind kind)
+  {
+    WorkCost cost;
+    switch (kind)
+    {
+    case WorkKind::kHash:
+      // One core per file; an open, fstat and close per item. The page
+      // cache usually keeps up with every core, so nothing is shared.
+      cost.seconds_per_item = 0.0002;
+      cost.bytes_per_second = 1e9;
+      break;
+    case WorkKind::kDownload:
+      // A round trip per request, a few MB/s per connection, and a link
+      // that several connections fill.
+      cost.seconds_per_item = 0.05;
+      cost.bytes_per_second = 8e6;
+      cost.shared_bytes_per_second = 50e6;
+      break;
+    case WorkKind::kApply:
+      // A rename per file, whatever its size.
+      cost.seconds_per_item = 0.0005;
+      break;
+    }
+    return cost;
+  }
+
+  bool throughput_bound(const WorkCost &cost, uint64_t bytes)
+  {
+    return cost.bytes_per_second > 0 &&
+           static_cast<double>(bytes) / cost.bytes_per_second >
+               cost.seconds_per_item;
+  }
+
+  double estimated_seconds(const WorkCost &cost, uint64_t bytes)
+  {
+    return cost.seconds_per_item +
+           (cost.bytes_per_second > 0
+                ? static_cast<double>(bytes) / cost.bytes_per_second
+                : 0);
+  }
+
+  WorkPlan plan_work(const std::vector<uint64_t> &sizes, const WorkCost &cost,
+                     size_t workers)
+  {
+    WorkPlan plan;
+    workers = std::max<size_t>(workers, 1);
+    std::vector<size_t> heavy;
+    std::vector<size_t> light;
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+      (throughput_bound(cost, sizes[i]) ? heavy : light).push_back(i);
+    }
+    // Longest first within each kind; ties keep their listing order.
+    const auto longer = [&sizes](size_t a, size_t b)
+    { return sizes[a] > sizes[b]; };
+    std::stable_sort(heavy.begin(), heavy.end(), longer);
+    std::stable_sort(light.begin(), light.end(), longer);
+
+    // Transfers it takes to fill the shared rate.
+    size_t streams = workers;
+    if (cost.shared_bytes_per_second > 0 && cost.bytes_per_second > 0)
+    {
+      streams = static_cast<size_t>(
+          std::ceil(cost.shared_bytes_per_second / cost.bytes_per_second));
+      streams = std::max<size_t>(1, std::min(streams, workers));
+    }
+
+    size_t next_heavy = 0;
+    size_t next_light = 0;
+    const auto pick = [&](const std::vector<RunningItem> &running)
+    {
+      size_t heavy_running = 0;
+      for (const RunningItem &item : running)
+      {
+        heavy_running += item.throughput_bound ? 1 : 0;
+      }
+      const bool heavy_left = next_heavy < heavy.size();
+      const bool light_left = next_light < light.size();
+      if (heavy_left && (heavy_running < streams || !light_left))
+      {
+        return heavy[next_heavy++];
+      }
+      if (light_left)
+      {
+        return light[next_light++];
+      }
+      return kNone;
+    };
+    plan.order.reserve(sizes.size());
+    plan.makespan_seconds = simulate(sizes, cost, workers, pick, &plan.order);
+    return plan;
+  }
+
+  double simulate_makespan(const std::vector<uint64_t> &sizes,
+                           const std::vector<size_t> &order,
+                           const WorkCost &cost, size_t workers)
+  {
+    size_t next = 0;
+    return simulate(
+        sizes, cost, std::max<size_t>(workers, 1),
+        [&](const std::vector<RunningItem> &)
+        { return next < order.size() ? order[next++] : kNone; },
+        nullptr);
+  }
+
+} // namespace desktop_updater
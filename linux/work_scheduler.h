@@ -0,0 +1,81 @@
+#ifndef DESKTOP_UPDATER_WORK_SCHEDULER_H_
+#define DESKTOP_UPDATER_WORK_SCHEDULER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace desktop_updater
+{
+
+  // The update stages whose items are scheduled, each with its own cost
+  // model (see default_work_cost).
+  enum class WorkKind
+  {
+    kHash,
+    kDownload,
+    kApply,
+  };
+
+  // Parses "hash", "download" or "apply".
+  bool parse_work_kind(const std::string &name, WorkKind *kind);
+
+  // How long an item of a stage takes: a fixed latency, then its bytes at
+  // the rate one worker gets, which is capped by a share of what all
+  // workers together can move.
+  struct WorkCost
+  {
+    // Paid by every item whatever its size: a request round trip, an open
+    // and a stat, a rename.
+    double seconds_per_item = 0;
+    // Rate one worker moves an item's bytes at; 0 makes size irrelevant.
+    double bytes_per_second = 0;
+    // Rate all workers together move bytes at, the link or the disk; 0 is
+    // unlimited.
+    double shared_bytes_per_second = 0;
+  };
+
+  // Rough figures for the update stages: downloads are round-trip bound
+  // for small files and share the link, hashing is bound by one core per
+  // file, and applying is one rename per file.
+  WorkCost default_work_cost(WorkKind kind);
+
+  // Whether an item of bytes spends longer moving its bytes than on its
+  // fixed latency.
+  bool throughput_bound(const WorkCost &cost, uint64_t bytes);
+
+  // Time an item of bytes takes on its own.
+  double estimated_seconds(const WorkCost &cost, uint64_t bytes);
+
+  struct WorkPlan
+  {
+    // Indexes into the planned sizes, in the order workers should take
+    // them.
+    std::vector<size_t> order;
+    // Simulated time until the last item finishes.
+    double makespan_seconds = 0;
+  };
+
+  // Orders items of the given byte sizes for workers that each take the
+  // next item as they finish one, so the last items finish together
+  // instead of one huge item running alone at the end.
+  //
+  // Throughput-bound items go first, longest first, but only as many at
+  // once as it takes to use the shared rate; more would just split it.
+  // The other workers meanwhile take latency-bound items, whose round
+  // trips or metadata updates then overlap the transfers instead of
+  // queueing behind them. Once one kind runs out the rest is longest
+  // first. The plan is made by simulating the workers under cost.
+  WorkPlan plan_work(const std::vector<uint64_t> &sizes, const WorkCost &cost,
+                     size_t workers);
+
+  // Simulated makespan of workers taking items in the given order, under
+  // the same model plan_work uses. For comparing orders.
+  double simulate_makespan(const std::vector<uint64_t> &sizes,
+                           const std::vector<size_t> &order,
+                           const WorkCost &cost, size_t workers);
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_WORK_SCHEDULER_H_
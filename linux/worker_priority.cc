@@ -0,0 +1,163 @@
+#include "worker_priority.h"
+
+#include <dirent.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+
+namespace desktop_updater
+{
+  namespace
+  {
+    // From linux/ioprio.h, which not every libc exposes.
+    const int kIoprioWhoProcess = 1;
+    const int kIoprioClassIdle = 3;
+    const int kIoprioClassShift = 13;
+
+    // Thread name prefixes of the engine threads that produce frames. Names
+    // are cut to 15 characters by the kernel.
+    const char *const kFlutterThreadPrefixes[] = {"io.flutter.ui",
+                                                  "io.flutter.rast"};
+
+    std::string read_small_file(const std::string &path)
+    {
+      FILE *file = fopen(path.c_str(), "r");
+      if (file == nullptr)
+      {
+        return std::string();
+      }
+      char buffer[1024];
+      const size_t n = fread(buffer, 1, sizeof(buffer) - 1, file);
+      fclose(file);
+      return std::string(buffer, n);
+    }
+
+    bool is_frame_thread(const std::string &comm)
+    {
+      for (const char *prefix : kFlutterThreadPrefixes)
+      {
+        if (comm.compare(0, strlen(prefix), prefix) == 0)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Field 39 of /proc/<pid>/task/<tid>/stat: the CPU the thread last ran on.
+    int last_cpu(const std::string &task_dir)
+    {
+      const std::string stat = read_small_file(task_dir + "/stat");
+      // The name in field 2 may contain spaces, so count from its end.
+      const size_t name_end = stat.rfind(')');
+      if (name_end == std::string::npos)
+      {
+        return -1;
+      }
+      const char *field = stat.c_str() + name_end + 1;
+      for (int i = 3; i <= 39 && *field != '\0'; i++)
+      {
+        while (*field == ' ')
+        {
+          field++;
+        }
+        if (i == 39)
+        {
+          return atoi(field);
+        }
+        while (*field != ' ' && *field != '\0')
+        {
+          field++;
+        }
+      }
+      return -1;
+    }
+  } // namespace
+
+  std::vector<int> background_cpus()
+  {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+      return std::vector<int>();
+    }
+
+    std::set<int> busy;
+    const pid_t pid = getpid();
+    DIR *tasks = opendir("/proc/self/task");
+    if (tasks != nullptr)
+    {
+      while (dirent *entry = readdir(tasks))
+      {
+        if (entry->d_name[0] == '.')
+        {
+          continue;
+        }
+        const std::string task_dir =
+            std::string("/proc/self/task/") + entry->d_name;
+        std::string comm = read_small_file(task_dir + "/comm");
+        if (!comm.empty() && comm.back() == '\n')
+        {
+          comm.pop_back();
+        }
+        if (atoi(entry->d_name) == pid || is_frame_thread(comm))
+        {
+          const int cpu = last_cpu(task_dir);
+          if (cpu >= 0)
+          {
+            busy.insert(cpu);
+          }
+        }
+      }
+      closedir(tasks);
+    }
+
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+      if (CPU_ISSET(cpu, &allowed) && busy.count(cpu) == 0)
+      {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+
+  bool enter_background(const std::vector<int> &cpus)
+  {
+    // pid 0 means the calling thread for all three calls.
+    sched_param param = {};
+    bool lowered = sched_setscheduler(0, SCHED_IDLE, &param) == 0;
+    if (!lowered)
+    {
+      lowered = setpriority(PRIO_PROCESS, 0, 19) == 0;
+    }
+    syscall(SYS_ioprio_set, kIoprioWhoProcess, 0,
+            kIoprioClassIdle << kIoprioClassShift);
+    if (!cpus.empty())
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (int cpu : cpus)
+      {
+        CPU_SET(cpu, &set);
+      }
+      sched_setaffinity(0, sizeof(set), &set);
+    }
+    return lowered;
+  }
+
+  bool in_background()
+  {
+    return sched_getscheduler(0) == SCHED_IDLE;
+  }
+
+} // namespace desktop_updater
@@ -0,0 +1,31 @@
+#ifndef DESKTOP_UPDATER_WORKER_PRIORITY_H_
+#define DESKTOP_UPDATER_WORKER_PRIORITY_H_
+
+#include <vector>
+
+namespace desktop_updater
+{
+
+  // CPUs the process may run on, minus the ones the GTK main thread and
+  // Flutter's UI and raster threads were last scheduled on. Those threads
+  // are not pinned, but the scheduler keeps them where their caches are
+  // warm, so workers kept off these CPUs rarely preempt a frame. Empty when
+  // nothing would be left.
+  std::vector<int> background_cpus();
+
+  // Moves the calling thread to the background: SCHED_IDLE (nice 19 where
+  // that is refused), the idle I/O class so its reads only get disk time no
+  // one else wants, and the given CPUs unless cpus is empty. Returns false
+  // if the CPU priority could not be lowered at all.
+  //
+  // Without CAP_SYS_NICE a thread cannot leave SCHED_IDLE or lower its nice
+  // value again; use ThreadPool::respawn to get normal-priority workers
+  // back.
+  bool enter_background(const std::vector<int> &cpus);
+
+  // True if the calling thread runs under SCHED_IDLE.
+  bool in_background();
+
+} // namespace desktop_updater
+
+#endif // DESKTOP_UPDATER_WORKER_PRIORITY_H_
@@ -1,12 +1,24 @@
+import "dart:convert";
+import "dart:io";
+import "dart:typed_data";
+
 import "package:desktop_updater/desktop_updater.dart";
 import "package:desktop_updater/desktop_updater_method_channel.dart";
 import "package:desktop_updater/desktop_updater_platform_interface.dart";
+import "package:desktop_updater/src/binary_manifest.dart";
+import "package:desktop_updater/src/merkle.dart";
+import "package:desktop_updater/src/update.dart";
 import "package:flutter_test/flutter_test.dart";
 import "package:plugin_platform_interface/plugin_platform_interface.dart";
 
+import "../bin/archive.dart" as archive;
+
 class MockDesktopUpdaterPlatform
     with MockPlatformInterfaceMixin
     implements DesktopUpdaterPlatform {
+  /// Sizes passed to the last [planWork] call.
+  List<int>? plannedSizes;
+
   @override
   Future<String?> getPlatformVersion() => Future.value("42");
 
@@ -30,6 +42,108 @@ class MockDesktopUpdaterPlatform
     return Future.value();
   }
 
+  @override
+  Future<String?> hashDirectory({
+    required String directory,
+    required String outputPath,
+    required String algorithm,
+    String? treeOutputPath,
+  }) {
+    return Future.value(outputPath);
+  }
+
+  @override
+  Future<Uint8List?> diffManifest({
+    required String oldHashFilePath,
+    required String newHashFilePath,
+    Set<String>? onlyDirectories,
+    bool returnAllOnAnyChange = false,
+  }) {
+    return Future.value();
+  }
+
+  @override
+  Future<void> setMemoryBudget(int bytes) {
+    return Future.value();
+  }
+
+  @override
+  Future<void> setRateLimits({
+    int? diskBytesPerSecond,
+    int? diskOpsPerSecond,
+    int? networkBytesPerSecond,
+  }) {
+    return Future.value();
+  }
+
+  @override
+  Future<void> setDirtyTracking({required bool enabled}) {
+    return Future.value();
+  }
+
+  @override
+  Future<void> setBackgroundPriority({required bool enabled}) {
+    return Future.value();
+  }
+
+  @override
+  Future<void> setForegroundBoost({required bool enabled}) {
+    return Future.value();
+  }
+
+  @override
+  Future<bool?> applyUpdate() {
+    return Future.value();
+  }
+
+  @override
+  Future<List<RestartMetrics>?> getRestartMetrics() {
+    return Future.value();
+  }
+
+  @override
+  Future<MemoryStats?> getMemoryStats() {
+    return Future.value();
+  }
+
+  @override
+  Future<void> downloadFile({
+    required String url,
+    required String path,
+    required int length,
+    required String id,
+    String? dictionaryUrl,
+    String? hash,
+    String? algorithm,
+  }) {
+    return Future.value();
+  }
+
+  @override
+  Future<Map<String, int>?> getDownloadProgress() {
+    return Future.value();
+  }
+
+  @override
+  Future<bool?> cancelDownload(String id) {
+    return Future.value();
+  }
+
+  @override
+  Future<Map<String, dynamic>?> cancelUpdate() {
+    return Future.value();
+  }
+
+  @override
+  Future<List<int>?> planWork({
+    required List<int> sizes,
+    required int workers,
+    String kind = "download",
+  }) {
+    plannedSizes = sizes;
+    return Future.value();
+  }
+
   @override
   Future<List<FileHashModel?>> verifyFileHash(
     String oldHashFilePath,
@@ -69,4 +183,153 @@ void main() {
 
     expect(await desktopUpdaterPlugin.getPlatformVersion(), "42");
   });
+
+  test("BinaryManifest reads what encodeBinaryManifest writes", () {
+    final entries = [
+      FileHashModel(
+        filePath: "lib/libapp.so",
+        calculatedHash: base64.encode(List.filled(32, 1)),
+        length: 1 << 33,
+        algorithm: blake3HashAlgorithm,
+      ),
+      FileHashModel(
+        filePath: "data/\u00e9.txt",
+        calculatedHash: base64.encode(List.filled(32, 2)),
+        length: 3,
+        algorithm: blake3HashAlgorithm,
+      ),
+    ];
+    final manifest = BinaryManifest.parse(
+      encodeBinaryManifest(entries, blake3HashAlgorithm),
+    );
+
+    expect(manifest.length, 2);
+    expect(manifest.algorithm, blake3HashAlgorithm);
+    expect(manifest.path(0), "data/\u00e9.txt");
+    expect(manifest.fileLength(1), 1 << 33);
+    expect(manifest.digest(1), List.filled(32, 1));
+    expect(
+      manifest.toModels().map((e) => jsonEncode(e)),
+      [jsonEncode(entries[1]), jsonEncode(entries[0])],
+    );
+    expect(
+      () => BinaryManifest.parse(Uint8List(8)),
+      throwsFormatException,
+    );
+  });
+
+  test("A native diff entry carries compressedLength into the download queue",
+      () async {
+    final fakePlatform = MockDesktopUpdaterPlatform();
+    DesktopUpdaterPlatform.instance = fakePlatform;
+    final diff = encodeBinaryManifest(
+      [
+        FileHashModel(
+          filePath: "data/flutter_assets/assets/strings.json",
+          calculatedHash: base64.encode(List.filled(64, 1)),
+          length: 40000,
+          algorithm: treeHashAlgorithm,
+          compressedLength: 900,
+        ),
+        FileHashModel(
+          filePath: "lib/libapp.so",
+          calculatedHash: base64.encode(List.filled(64, 2)),
+          length: 1 << 20,
+          algorithm: treeHashAlgorithm,
+        ),
+      ],
+      treeHashAlgorithm,
+    );
+
+    final queue = BinaryManifest.parse(diff).toModels();
+    await scheduleDownloads(queue, 8);
+
+    expect(queue.map((f) => f.filePath), [
+      "lib/libapp.so",
+      "data/flutter_assets/assets/strings.json",
+    ]);
+    expect(queue.map((f) => f.compressedLength), [null, 900]);
+    if (Platform.isLinux) {
+      // Planned by the bytes actually transferred.
+      expect(fakePlatform.plannedSizes, [900, 1 << 20]);
+    }
+  });
+
+  test("archive hashes blake2b-tree releases with the native tool", () async {
+    final dir = await Directory.systemTemp.createTemp("desktop_updater");
+    addTearDown(() => dir.delete(recursive: true));
+    final bundle = await Directory("${dir.path}/bundle").create();
+    // desktop_updater_manifest's output for a bundle of "app" containing
+    // "runner" and "lib/libapp.so" containing "library"
+    await File("${dir.path}/hashes.json").writeAsString(
+      jsonEncode([
+        {
+          "path": "app",
+          "calculatedHash": "am09Iw3a3a6/J2gLFEu+hhTWeWPf3liQ+MIzBnISU5mdIRA9/"
+              "PPxRJ2u9Nw+GfQL/ww0pNukbGPfaEmL26KWRA==",
+          "length": 6,
+          "algorithm": "blake2b-tree",
+        },
+        {
+          "path": "lib/libapp.so",
+          "calculatedHash": "jBW8K7tn2Dqb1hvBfq6DIsqYzEkSf5/8yJQe8c0mFfElWOUk"
+              "qXTu+QahlHWSpMC6Q+apcThfrDz7HRnfNcomiw==",
+          "length": 7,
+          "algorithm": "blake2b-tree",
+        },
+      ]),
+    );
+    const root = "CXdkjeBLOB4/XRNuaKynm1lF3I/whRO9rkNFiByrQzimK610eiyBxW2eMvFv"
+        "Hp6AHmzQfv2ILX0o2I27Egnxjg==";
+    await File("${dir.path}/tree.json").writeAsString(
+      jsonEncode({
+        "algorithm": "blake2b-tree",
+        "root": root,
+        "directories": {
+          "": root,
+          "lib": "upk7f8WoqtCRGpJYl6icpymkpwwgPB3lI8W9W0Wsdtecc3XEr3OxF2HeCvBv"
+              "0DEUxJI5Ccpbbq0tMfhmuH3DCw==",
+        },
+      }),
+    );
+    final tool = File("${dir.path}/desktop_updater_manifest");
+    await tool.writeAsString(
+      "#!/bin/sh\n"
+      '[ "\$3" = $treeHashAlgorithm ] || exit 2\n'
+      'cp "${dir.path}/hashes.json" "${dir.path}/tree.json" "\$1"\n',
+    );
+    await Process.run("chmod", ["+x", tool.path]);
+
+    await archive.genFileHashes(
+      path: bundle.path,
+      algorithm: treeHashAlgorithm,
+      manifestTool: tool.path,
+      manifestIndex: "${dir.path}/index.bin",
+    );
+
+    final entries = [
+      for (final entry in jsonDecode(
+        await File("${bundle.path}/hashes.json").readAsString(),
+      ) as List)
+        FileHashModel.fromJson(entry),
+    ];
+    expect(entries.map((e) => e.filePath), ["app", "lib/libapp.so"]);
+    expect(entries.map((e) => e.algorithm), everyElement(treeHashAlgorithm));
+    expect(base64.decode(entries[1].calculatedHash).length, 64);
+    final tree = MerkleTree.fromJson(
+      jsonDecode(await File("${bundle.path}/tree.json").readAsString()),
+    );
+    expect(tree.algorithm, treeHashAlgorithm);
+    expect(tree.directories[""], tree.root);
+    expect(tree.directories.keys, ["", "lib"]);
+    // Dart has no tree hasher to fall back on.
+    await expectLater(
+      archive.hashFiles(
+        bundle,
+        algorithm: treeHashAlgorithm,
+        include: (_) => true,
+      ),
+      throwsArgumentError,
+    );
+  }, skip: Platform.isWindows);
 }